@@ -32,6 +32,7 @@
 #include <glib.h>
 
 #include "graphengine.h"
+#include "osdoverlay.h"
 
 // For gstreamer < 1.18
 GstClockTime gst_element_get_current_running_time (GstElement * element);
@@ -88,20 +89,98 @@ on_message (GstBus * bus, GstMessage * message, gpointer user_data)
     return TRUE;
 }
 
-static void cb_need_data (GstElement *appsrc, guint unused_size, gpointer user_data)
+// Frames kept for reuse, downstream may ask for more
+#define OSD_POOL_BUFFERS 3
+
+static GstBufferPool *osd_pool = NULL;
+
+/**
+ * osd_buffer_pool_new: create active pool for OSD frames.
+ * Frames are rendered into system memory buffers from the pool, so steady
+ * state rendering neither allocates nor clears whole frames. The pool isn't
+ * limited: if downstream holds more frames than expected, new buffers are
+ * allocated instead of blocking the renderer.
+ *
+ * @param       pad     pad the frames are pushed from, NULL = frames stay in the process
+ * @return      pool of GRAPHICS_WIDTH x GRAPHICS_HEIGHT RGBA buffers
+ */
+GstBufferPool *osd_buffer_pool_new(GstPad *pad)
 {
-    GMainLoop *loop = (GMainLoop *) user_data;
+    GstVideoInfo info;
+    GstCaps *caps;
+    GstQuery *query;
+    GstBufferPool *pool;
+    GstStructure *config;
+    guint min_buffers = OSD_POOL_BUFFERS;
+
+    gst_video_info_set_format(&info, GST_VIDEO_FORMAT_RGBA, GRAPHICS_WIDTH, GRAPHICS_HEIGHT);
+    caps = gst_video_info_to_caps(&info);
+
+    // Ask downstream how many frames it keeps, its own pool (GL memory) isn't used for CPU drawing
+    query = gst_query_new_allocation(caps, TRUE);
+    if (pad != NULL && gst_pad_peer_query(pad, query) && gst_query_get_n_allocation_pools(query) > 0)
+    {
+        GstBufferPool *proposed = NULL;
+        guint size, min, max;
+
+        gst_query_parse_nth_allocation_pool(query, 0, &proposed, &size, &min, &max);
+        min_buffers = MAX(min_buffers, min);
+        if (proposed != NULL)
+            gst_object_unref(proposed);
+    }
+    gst_query_unref(query);
+
+    pool = gst_video_buffer_pool_new();
+    config = gst_buffer_pool_get_config(pool);
+    gst_buffer_pool_config_set_params(config, caps, GST_VIDEO_INFO_SIZE(&info), min_buffers, 0);
+    gst_caps_unref(caps);
+
+    if (!gst_buffer_pool_set_config(pool, config) || !gst_buffer_pool_set_active(pool, TRUE))
+    {
+        fprintf(stderr, "Unable to setup OSD buffer pool\n");
+        exit(1);
+    }
+
+    if (osd_debug)
+        fprintf(stderr, "OSD buffer pool: %u buffers\n", min_buffers);
+
+    return pool;
+}
+
+/*
+ * A frame is pushed only when the OSD changed. The mixer keeps showing the
+ * last OSD buffer until a new one arrives (buffers have no duration), so
+ * unchanged frames cost neither a copy nor a GL upload. appsrc waits for
+ * data after need-data, so while it's pending frames are polled from the
+ * main loop until one differs.
+ */
+#define OSD_POLL_MS 16
 
+typedef struct {
+    GstElement *appsrc;
+    GMainLoop *loop;
+} osd_source_t;
+
+static gint osd_need_data = 0;
+static unsigned int frames_pushed, frames_unchanged;
+static gint64 stats_start_us;
+
+static void push_frame (GstElement *appsrc, GMainLoop *loop)
+{
     pthread_mutex_lock(&video_mutex);
     GstBuffer *buffer = render();
+    // Cleared before the push, the next need-data may come right after it
+    if (buffer != NULL)
+        g_atomic_int_set(&osd_need_data, 0);
     pthread_mutex_unlock(&video_mutex);
 
-    GST_BUFFER_PTS (buffer) = gst_element_get_current_running_time(appsrc);
+    if (buffer == NULL) {
+        frames_unchanged++;
+        return;
+    }
 
-    // set to min supported fps,
-    // but low value will increase latency.
-    // If fps lower than selected then cpu usage will increase a lot
-    GST_BUFFER_DURATION (buffer) = gst_util_uint64_scale_int (1, GST_SECOND, 30);
+    GST_BUFFER_PTS (buffer) = gst_element_get_current_running_time(appsrc);
+    GST_BUFFER_DURATION (buffer) = GST_CLOCK_TIME_NONE;
     GST_BUFFER_FLAG_SET(buffer, GST_BUFFER_FLAG_LIVE);
     GST_BUFFER_FLAG_SET(buffer, GST_BUFFER_FLAG_DROPPABLE);
 
@@ -109,7 +188,7 @@ static void cb_need_data (GstElement *appsrc, guint unused_size, gpointer user_d
     GstFlowReturn ret;
     g_signal_emit_by_name (appsrc, "push-buffer", buffer, &ret);
     gst_buffer_unref (buffer);
-
+    frames_pushed++;
 
     if (ret != GST_FLOW_OK) {
         /* something wrong, stop pushing */
@@ -117,6 +196,72 @@ static void cb_need_data (GstElement *appsrc, guint unused_size, gpointer user_d
     }
 }
 
+static void cb_need_data (GstElement *appsrc, guint unused_size, gpointer user_data)
+{
+    GMainLoop *loop = (GMainLoop *) user_data;
+
+    // Downstream answers the allocation query once the pipeline is running
+    if (osd_pool == NULL)
+    {
+        GstPad *pad = gst_element_get_static_pad(appsrc, "src");
+
+        osd_pool = osd_buffer_pool_new(pad);
+        render_set_buffer_pool(osd_pool);
+        gst_object_unref(pad);
+    }
+
+    g_atomic_int_set(&osd_need_data, 1);
+    push_frame(appsrc, loop);
+}
+
+static void print_push_stats (void)
+{
+    gint64 now = g_get_monotonic_time();
+    double seconds = (now - stats_start_us) / 1e6;
+
+    if (seconds < 10)
+        return;
+
+    fprintf(stderr, "OSD frames: %.1f pushed/s, %.1f unchanged/s, upload %.2f MB/s\n",
+            frames_pushed / seconds, frames_unchanged / seconds,
+            frames_pushed * (double)(GRAPHICS_WIDTH * GRAPHICS_HEIGHT * 4) / seconds / 1e6);
+    frames_pushed = 0;
+    frames_unchanged = 0;
+    stats_start_us = now;
+}
+
+static gboolean cb_poll_frame (gpointer user_data)
+{
+    osd_source_t *src = (osd_source_t *) user_data;
+
+    if (g_atomic_int_get(&osd_need_data))
+        push_frame(src->appsrc, src->loop);
+
+    if (osd_debug)
+        print_push_stats();
+
+    return G_SOURCE_CONTINUE;
+}
+
+static const char* select_overlay_sink(osd_render_t osd_render)
+{
+    switch(osd_render)
+    {
+    case OSD_RENDER_XV:
+        return "xvimagesink";
+
+    case OSD_RENDER_GL:
+        return "glimagesink";
+
+    case OSD_RENDER_KMS:
+        return "kmssink";
+
+    case OSD_RENDER_AUTO:
+    default:
+        return "autovideosink";
+    }
+}
+
 static const char* select_osd_render(osd_render_t osd_render)
 {
     switch(osd_render)
@@ -145,87 +290,121 @@ static const char* select_osd_render(osd_render_t osd_render)
 }
 
 
-int gst_main(int rtp_port, char *codec, int rtp_jitter, osd_render_t osd_render, int screen_width, char *rtsp_src)
+static char* build_pipeline(int rtp_port, char *codec, int rtp_jitter, osd_render_t osd_render, int screen_width, char *rtsp_src, osd_overlay_t cpu_overlay)
 {
     int screen_height = screen_width * 9 / 16;
+    char *pipeline_str = NULL;
+    char *src_str = NULL;
 
-    // Fix for intel hd graphics
-    setenv("GST_GL_PLATFORM", "egl", 0);
+    if(rtsp_src != NULL)
+    {
+        asprintf(&src_str,
+                 "rtspsrc latency=%d location=\"%s\"", rtp_jitter, rtsp_src);
+    } else {
+        asprintf(&src_str,
+                 "udpsrc port=%d caps=\"application/x-rtp,media=(string)video,  clock-rate=(int)90000, encoding-name=(string)H%s\"",
+                 rtp_port, codec + 1);
+    }
 
-    /* init GStreamer */
-    gst_init (NULL, NULL);
+    char *codecs[] = {"nv%sdec", "v4l2%sdec", "avdec_%s"};
+    char *decoder = NULL;
 
-    GMainLoop *loop = g_main_loop_new (NULL, FALSE);
-    GstElement *pipeline = NULL;
-
-    /* setup pipeline */
+    for(int i = 0; i < sizeof(codecs) / sizeof(codecs[0]); i++)
     {
-        char *pipeline_str = NULL;
-        char *src_str = NULL;
-        GError *error = NULL;
+        char *buf = NULL;
+        asprintf(&buf, codecs[i], codec);
+        GstElement *tmp = gst_element_factory_make(buf, "decoder");
 
-        if(rtsp_src != NULL)
+        if(tmp != NULL)
         {
-            asprintf(&src_str,
-                     "rtspsrc latency=%d location=\"%s\"", rtp_jitter, rtsp_src);
-        } else {
-            asprintf(&src_str,
-                     "udpsrc port=%d caps=\"application/x-rtp,media=(string)video,  clock-rate=(int)90000, encoding-name=(string)H%s\"",
-                     rtp_port, codec + 1);
+            gst_object_unref(tmp);
+            decoder = buf;
+            break;
         }
 
-        char *codecs[] = {"nv%sdec", "v4l2%sdec", "avdec_%s"};
-        char *decoder = NULL;
-
-        for(int i = 0; i < sizeof(codecs) / sizeof(codecs[0]); i++)
-        {
-            char *buf = NULL;
-            asprintf(&buf, codecs[i], codec);
-            GstElement *tmp = gst_element_factory_make(buf, "decoder");
-
-            if(tmp != NULL)
-            {
-                gst_object_unref(tmp);
-                decoder = buf;
-                break;
-            }
-
-            free(buf);
-        }
+        free(buf);
+    }
 
-        if(decoder == NULL)
-        {
-            fprintf(stderr, "No decoder for %s was found\n", codec);
-            exit(1);
-        }
+    if(decoder == NULL)
+    {
+        fprintf(stderr, "No decoder for %s was found\n", codec);
+        exit(1);
+    }
 
+    if (cpu_overlay != OSD_OVERLAY_NONE)
+    {
+        // OSD is composited into decoded frames, no GL needed
         asprintf(&pipeline_str,
                  "%s ! "
                  "rtp%sdepay ! "
                  "%sparse config-interval=1 disable-passthrough=true ! "
                  "%s qos=false ! "
                  "queue leaky=downstream max-size-buffers=1 max-size-bytes=0 ! "
-                 "glupload ! glcolorconvert ! "
-                 "glvideomixerelement emit-signals=true start-time-selection=1 name=osd_mixer "
-                 "sink_0::emit-signals=true sink_0::width=%d sink_0::height=%d sink_0::zorder=-2 "
-                 "sink_1::emit-signals=true sink_1::width=%d sink_1::height=%d sink_1::zorder=0 "
+                 "wfbosdoverlay sparse=%s ! videoconvert ! %s sync=true",
+                 src_str, codec, codec, decoder,
+                 cpu_overlay == OSD_OVERLAY_SPARSE ? "true" : "false",
+                 select_overlay_sink(osd_render));
+
+        free(src_str);
+        free(decoder);
+        return pipeline_str;
+    }
+
+    asprintf(&pipeline_str,
+             "%s ! "
+             "rtp%sdepay ! "
+             "%sparse config-interval=1 disable-passthrough=true ! "
+             "%s qos=false ! "
+             "queue leaky=downstream max-size-buffers=1 max-size-bytes=0 ! "
+             "glupload ! glcolorconvert ! "
+             "glvideomixerelement emit-signals=true start-time-selection=1 name=osd_mixer "
+             "sink_0::emit-signals=true sink_0::width=%d sink_0::height=%d sink_0::zorder=-2 "
+             "sink_1::emit-signals=true sink_1::width=%d sink_1::height=%d sink_1::zorder=0 "
 #if LOCAL_CAMERA_SUPPORT
-                 "sink_2::emit-signals=true sink_2::width=640 sink_2::height=360 sink_2::zorder=-1 "
+             "sink_2::emit-signals=true sink_2::width=640 sink_2::height=360 sink_2::zorder=-1 "
 #endif
-                 "! %s sync=true "
-                 "appsrc name=osd_src stream-type=0 format=time min-latency=0 ! "
-                 "video/x-raw,format=RGBA,width=%d,height=%d,framerate=0/1 ! glupload ! glcolorconvert ! osd_mixer. "
+             "! %s sync=true "
+             "appsrc name=osd_src stream-type=0 format=time min-latency=0 ! "
+             "video/x-raw,format=RGBA,width=%d,height=%d,framerate=0/1 ! glupload ! glcolorconvert ! osd_mixer. "
 #if LOCAL_CAMERA_SUPPORT
-                 "v4l2src device=/dev/video2 ! video/x-raw,width=640,height=360,framerate=30/1 ! queue ! glupload ! glcolorconvert ! osd_mixer."
+             "v4l2src device=/dev/video2 ! video/x-raw,width=640,height=360,framerate=30/1 ! queue ! glupload ! glcolorconvert ! osd_mixer."
 #endif
-                 ,
-                 src_str, codec, codec, decoder,
-                 screen_width, screen_height, screen_width, screen_height,
-                 select_osd_render(osd_render),
-                 GRAPHICS_WIDTH, GRAPHICS_HEIGHT);
+             ,
+             src_str, codec, codec, decoder,
+             screen_width, screen_height, screen_width, screen_height,
+             select_osd_render(osd_render),
+             GRAPHICS_WIDTH, GRAPHICS_HEIGHT);
 
-        free(src_str);
-        free(decoder);
+    free(src_str);
+    free(decoder);
+
+    return pipeline_str;
+}
+
+int gst_main(int rtp_port, char *codec, int rtp_jitter, osd_render_t osd_render, int screen_width, char *rtsp_src,
+             osd_overlay_t cpu_overlay, char *custom_pipeline)
+{
+    // Fix for intel hd graphics
+    setenv("GST_GL_PLATFORM", "egl", 0);
+
+    /* init GStreamer */
+    gst_init (NULL, NULL);
+    osd_overlay_register ();
+
+    GMainLoop *loop = g_main_loop_new (NULL, FALSE);
+    GstElement *pipeline = NULL;
+
+    /* setup pipeline */
+    {
+        char *pipeline_str = NULL;
+        GError *error = NULL;
+
+        if (custom_pipeline != NULL)
+        {
+            pipeline_str = strdup(custom_pipeline);
+        } else {
+            pipeline_str = build_pipeline(rtp_port, codec, rtp_jitter, osd_render, screen_width, rtsp_src, cpu_overlay);
+        }
 
         printf("GST pipeline: %s\n", pipeline_str);
 
@@ -243,8 +422,16 @@ int gst_main(int rtp_port, char *codec, int rtp_jitter, osd_render_t osd_render,
     g_assert(pipeline);
 
     /* setup */
+    // OSD comes either from the appsrc branch or from wfbosdoverlay elements
     GstElement *appsrc = gst_bin_get_by_name(GST_BIN(pipeline), "osd_src");
-    g_signal_connect (appsrc, "need-data", G_CALLBACK (cb_need_data), loop);
+    osd_source_t osd_source = { appsrc, loop };
+
+    if (appsrc != NULL)
+    {
+        g_signal_connect (appsrc, "need-data", G_CALLBACK (cb_need_data), loop);
+        stats_start_us = g_get_monotonic_time();
+        g_timeout_add (OSD_POLL_MS, cb_poll_frame, &osd_source);
+    }
 
     // Set message handler
     {
@@ -261,5 +448,12 @@ int gst_main(int rtp_port, char *codec, int rtp_jitter, osd_render_t osd_render,
 
     gst_object_unref (pipeline);
 
+    if (osd_pool != NULL)
+    {
+        gst_buffer_pool_set_active(osd_pool, FALSE);
+        gst_object_unref(osd_pool);
+        osd_pool = NULL;
+    }
+
     return 0;
 }
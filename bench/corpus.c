@@ -0,0 +1,244 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+
+/*
+ * Synthetic MAVLink stream as wfb-ng delivers it: a PX4-like message mix
+ * at typical rates, including messages the OSD ignores and a few signed
+ * frames, aggregated into datagrams of up to 1445 bytes. Payloads are
+ * random, so checksums are the only thing that tells frames apart from
+ * noise, the way it is on a lossy link.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "corpus.h"
+#include "mavlink/common/mavlink.h"
+
+#define CORPUS_DATAGRAM     1445    // wfb-ng MAVLink packet limit
+#define CORPUS_TICKS        100     // per second
+
+typedef struct {
+    uint32_t msgid;
+    int rate;       // Hz
+    uint8_t sysid;
+    uint8_t compid;
+} corpus_stream_t;
+
+static const corpus_stream_t corpus_mix[] = {
+    { MAVLINK_MSG_ID_HEARTBEAT, 1, 1, 1 },
+    { MAVLINK_MSG_ID_SYS_STATUS, 2, 1, 1 },
+    { MAVLINK_MSG_ID_GPS_RAW_INT, 5, 1, 1 },
+    { MAVLINK_MSG_ID_ATTITUDE, 50, 1, 1 },
+    { MAVLINK_MSG_ID_ATTITUDE_QUATERNION, 50, 1, 1 },
+    { MAVLINK_MSG_ID_LOCAL_POSITION_NED, 30, 1, 1 },
+    { MAVLINK_MSG_ID_GLOBAL_POSITION_INT, 10, 1, 1 },
+    { MAVLINK_MSG_ID_VFR_HUD, 10, 1, 1 },
+    { MAVLINK_MSG_ID_HIGHRES_IMU, 50, 1, 1 },
+    { MAVLINK_MSG_ID_SERVO_OUTPUT_RAW, 10, 1, 1 },
+    { MAVLINK_MSG_ID_RC_CHANNELS, 5, 1, 1 },
+    { MAVLINK_MSG_ID_RC_CHANNELS_RAW, 5, 1, 1 },
+    { MAVLINK_MSG_ID_ODOMETRY, 30, 1, 1 },
+    { MAVLINK_MSG_ID_ESTIMATOR_STATUS, 5, 1, 1 },
+    { MAVLINK_MSG_ID_TIMESYNC, 10, 1, 1 },
+    { MAVLINK_MSG_ID_ALTITUDE, 10, 1, 1 },
+    { MAVLINK_MSG_ID_BATTERY_STATUS, 1, 1, 1 },
+    { MAVLINK_MSG_ID_EXTENDED_SYS_STATE, 2, 1, 1 },
+    { MAVLINK_MSG_ID_NAV_CONTROLLER_OUTPUT, 5, 1, 1 },
+    { MAVLINK_MSG_ID_RADIO_STATUS, 1, 3, 68 },
+    { MAVLINK_MSG_ID_UTM_GLOBAL_POSITION, 1, 1, 1 },
+    { MAVLINK_MSG_ID_STATUSTEXT, 1, 1, 1 },
+    { MAVLINK_MSG_ID_HOME_POSITION, 1, 1, 1 },
+    { MAVLINK_MSG_ID_MISSION_CURRENT, 1, 1, 1 },
+    { MAVLINK_MSG_ID_GPS2_RAW, 1, 1, 1 },
+};
+
+// Frame of a message with random payload, returns its length
+static int corpus_frame(uint8_t *out, const corpus_stream_t *s, int v1, int sign)
+{
+    static uint8_t seq = 0;
+    const mavlink_msg_entry_t *e = mavlink_get_msg_entry(s->msgid);
+    uint8_t payload[MAVLINK_MAX_PAYLOAD_LEN];
+    int len = e->max_msg_len;
+    int n = 0;
+
+    for (int i = 0; i < len; i++)
+    {
+        payload[i] = rand() % 4 == 0 ? 0 : rand();
+    }
+    if (s->msgid == MAVLINK_MSG_ID_HEARTBEAT)
+    {
+        // Mostly the vehicle, sometimes a GCS, which the OSD ignores
+        payload[4] = rand() % 3 ? MAV_TYPE_QUADROTOR : MAV_TYPE_GCS;
+    }
+
+    if (v1)
+    {
+        len = e->min_msg_len;
+    }
+    else
+    {
+        // MAVLink 2 trims trailing zeros
+        while (len > 1 && payload[len - 1] == 0)
+        {
+            len--;
+        }
+    }
+
+    out[n++] = v1 ? MAVLINK_STX_MAVLINK1 : MAVLINK_STX;
+    out[n++] = len;
+    if (!v1)
+    {
+        out[n++] = sign ? MAVLINK_IFLAG_SIGNED : 0;
+        out[n++] = 0;
+    }
+    out[n++] = seq++;
+    out[n++] = s->sysid;
+    out[n++] = s->compid;
+    out[n++] = s->msgid;
+    if (!v1)
+    {
+        out[n++] = s->msgid >> 8;
+        out[n++] = s->msgid >> 16;
+    }
+    memcpy(out + n, payload, len);
+    n += len;
+
+    uint16_t crc = crc_calculate(out + 1, n - 1);
+    crc_accumulate(e->crc_extra, &crc);
+    out[n++] = crc & 0xff;
+    out[n++] = crc >> 8;
+
+    if (sign)
+    {
+        // Nobody checks signatures, any bytes do
+        for (int i = 0; i < MAVLINK_SIGNATURE_BLOCK_LEN; i++)
+        {
+            out[n++] = rand();
+        }
+    }
+    return n;
+}
+
+static size_t corpus_frame_len(const uint8_t *frame)
+{
+    if (frame[0] == MAVLINK_STX)
+    {
+        return 1 + MAVLINK_CORE_HEADER_LEN + frame[1] + MAVLINK_NUM_CHECKSUM_BYTES +
+               (frame[2] & MAVLINK_IFLAG_SIGNED ? MAVLINK_SIGNATURE_BLOCK_LEN : 0);
+    }
+    return 1 + MAVLINK_CORE_HEADER_MAVLINK1_LEN + frame[1] + MAVLINK_NUM_CHECKSUM_BYTES;
+}
+
+/**
+ * corpus_build: generate a MAVLink datagram stream.
+ *
+ * "whole" - whole frames in each datagram, "split" - the stream cut at
+ * random points, "corrupt" - whole frames with random bit flips,
+ * "v1" - MAVLink 1 only.
+ *
+ * @param       mode    corpus mode
+ * @param       seconds flight time to generate
+ * @param       size    corpus size
+ * @return      malloc'ed datagrams, each prefixed with uint16_t length; NULL for unknown mode
+ */
+uint8_t *corpus_build(const char *mode, int seconds, size_t *size)
+{
+    int split = strcmp(mode, "split") == 0;
+    int corrupt = strcmp(mode, "corrupt") == 0;
+    int v1 = strcmp(mode, "v1") == 0;
+
+    if (!split && !corrupt && !v1 && strcmp(mode, "whole") != 0)
+    {
+        return NULL;
+    }
+
+    size_t capacity = (size_t)seconds * 64 * 1024 + 4096;
+    uint8_t *stream = malloc(capacity);
+    uint8_t *corpus = malloc(capacity * 2);
+    size_t stream_len = 0;
+
+    if (stream == NULL || corpus == NULL)
+    {
+        fprintf(stderr, "Unable to allocate %zu bytes for the corpus\n", capacity * 3);
+        exit(1);
+    }
+
+    srand(1);
+    for (int t = 0; t < seconds * CORPUS_TICKS; t++)
+    {
+        for (int i = 0; i < sizeof(corpus_mix) / sizeof(corpus_mix[0]); i++)
+        {
+            const corpus_stream_t *s = corpus_mix + i;
+
+            if (t * s->rate / CORPUS_TICKS == (t + 1) * s->rate / CORPUS_TICKS || (v1 && s->msgid > 255))
+            {
+                continue;
+            }
+            stream_len += corpus_frame(stream + stream_len, s, v1, !v1 && rand() % 50 == 0);
+        }
+    }
+
+    *size = 0;
+    for (size_t p = 0; p < stream_len;)
+    {
+        size_t n = 0;
+
+        if (split)
+        {
+            n = 1 + rand() % CORPUS_DATAGRAM;
+        }
+        else
+        {
+            while (p + n < stream_len)
+            {
+                size_t len = corpus_frame_len(stream + p + n);
+                if (n > 0 && n + len > CORPUS_DATAGRAM)
+                {
+                    break;
+                }
+                n += len;
+            }
+        }
+        if (p + n > stream_len)
+        {
+            n = stream_len - p;
+        }
+
+        uint16_t len = n;
+        uint8_t *datagram = corpus + *size + sizeof(len);
+
+        memcpy(corpus + *size, &len, sizeof(len));
+        memcpy(datagram, stream + p, n);
+        if (corrupt)
+        {
+            for (size_t i = 0; i < n; i++)
+            {
+                if (rand() % 2000 == 0)
+                {
+                    datagram[i] ^= 1 << (rand() % 8);
+                }
+            }
+        }
+        *size += sizeof(len) + n;
+        p += n;
+    }
+
+    free(stream);
+    return corpus;
+}
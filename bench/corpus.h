@@ -0,0 +1,10 @@
+#ifndef __CORPUS_H
+#define __CORPUS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Synthetic MAVLink datagram streams for the parser benchmarks
+uint8_t *corpus_build(const char *mode, int seconds, size_t *size);
+
+#endif //__CORPUS_H
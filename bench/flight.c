@@ -0,0 +1,212 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+
+/*
+ * Synthetic flight for the benchmarks. Every frame the vehicle sends one
+ * datagram with the messages the OSD shows, encoded with the mavlink
+ * library, so telemetry goes through the same parser and lazy decoding
+ * as in the air. The cruise flight keeps everything but attitude steady,
+ * like a long straight leg.
+ */
+
+#include <string.h>
+#include <math.h>
+
+#include "flight.h"
+#include "osdmavlink.h"
+#include "osdrender.h"
+#include "osdconfig.h"
+
+#define VEHICLE_SYSID   1
+#define VEHICLE_COMPID  1
+#define WFB_SYSID       3
+#define WFB_COMPID      68
+
+#define ADD_MESSAGE(name, sysid, compid, value) {                       \
+        mavlink_message_t msg;                                          \
+        mavlink_msg_##name##_encode(sysid, compid, &msg, value);        \
+        len += mavlink_msg_to_send_buffer(buf + len, &msg);             \
+    }
+
+/**
+ * flight_datagram: encode the telemetry of one frame.
+ *
+ * @param       buf     output, at least 1024 bytes
+ * @param       frame   frame number
+ * @param       cruise  steady flight if set
+ * @return      datagram length
+ */
+int flight_datagram(uint8_t *buf, int frame, int cruise)
+{
+    int f = cruise ? 7 : frame;
+    int len = 0;
+
+    mavlink_heartbeat_t heartbeat = {
+        .type = 2,              // quadrotor
+        .autopilot = MAV_AUTOPILOT_ARDUPILOTMEGA,
+        .base_mode = cruise || (f / 20) % 2 ? MAV_MODE_FLAG_SAFETY_ARMED : 0,
+        .custom_mode = (f / 50) % 2 ? COPTER_MODE_LOITER : COPTER_MODE_ALT_HOLD,
+    };
+    mavlink_attitude_t attitude = {
+        .time_boot_ms = frame * 33,
+        .pitch = (((frame % 60) - 30) * M_PI) / 180,
+        .roll = (((frame * 7 % 200) - 100) * M_PI) / 180,
+        .yaw = ((frame * 3 % 360) * M_PI) / 180,
+    };
+    mavlink_vfr_hud_t vfr_hud = {
+        .airspeed = cruise ? 10.0f : f * 0.2f,
+        .groundspeed = cruise ? 10.0f : (f % 40) * 0.5f,
+        .alt = f * 0.7f,
+        .climb = cruise ? 0 : ((f % 30) - 15) * 0.4f,
+        .heading = (f * 3) % 360,
+        .throttle = cruise ? 50 : f % 101,
+    };
+    mavlink_global_position_int_t global_position_int = {
+        .time_boot_ms = frame * 33,
+        .lat = (55.0 + f * 1e-5) * 1e7,
+        .lon = (37.0 - f * 1e-5) * 1e7,
+        .alt = f * 700,
+        .relative_alt = f * 300,
+        .hdg = (f * 3) % 360 * 100,
+    };
+    mavlink_gps_raw_int_t gps_raw_int = {
+        .lat = (55.0 + f * 1e-5) * 1e7,
+        .lon = (37.0 - f * 1e-5) * 1e7,
+        .eph = 90 + f % 50,
+        .fix_type = cruise ? 3 : f % 5,
+        .satellites_visible = cruise ? 12 : f % 20,
+    };
+    mavlink_gps2_raw_t gps2_raw = {
+        .lat = (55.0 + f * 1e-5) * 1e7,
+        .lon = (37.0 - f * 2e-5) * 1e7,
+        .eph = 110 + f % 30,
+        .fix_type = cruise ? 3 : (f + 2) % 5,
+        .satellites_visible = cruise ? 10 : (f + 5) % 20,
+    };
+    mavlink_sys_status_t sys_status = {
+        .voltage_battery = cruise ? 12000 : 12000 + (f % 10) * 100,
+        .current_battery = cruise ? 300 : f * 3,
+        .battery_remaining = cruise ? 80 : 100 - f % 100,
+    };
+    mavlink_battery_status_t battery_status = {
+        .current_consumed = f * 2,
+        .battery_remaining = cruise ? 80 : 100 - f % 100,
+    };
+    mavlink_nav_controller_output_t nav_controller_output = {
+        .nav_bearing = (f * 3) % 360,
+        .target_bearing = (f * 5) % 360,
+        .wp_dist = cruise ? 0 : f * 2,
+    };
+    mavlink_mission_current_t mission_current = {
+        .seq = cruise ? 0 : f % 3,
+    };
+    mavlink_rc_channels_t rc_channels = {
+        .chan1_raw = 1500, .chan2_raw = 1500, .chan3_raw = 1000 + f % 1000, .chan4_raw = 1500,
+        .chancount = 8,
+        .rssi = 200 - f % 50,
+    };
+    mavlink_home_position_t home_position = {
+        .latitude = 55.0 * 1e7,
+        .longitude = 37.001 * 1e7,
+    };
+    mavlink_radio_status_t radio_status = {
+        .rssi = (uint8_t)(cruise ? -55 : -60 + f % 20),
+        .rxerrors = cruise ? 0 : f % 7 == 0,
+        .remnoise = cruise ? 0 : (f / 50) % 3,
+    };
+
+    ADD_MESSAGE(heartbeat, VEHICLE_SYSID, VEHICLE_COMPID, &heartbeat);
+    ADD_MESSAGE(attitude, VEHICLE_SYSID, VEHICLE_COMPID, &attitude);
+    ADD_MESSAGE(vfr_hud, VEHICLE_SYSID, VEHICLE_COMPID, &vfr_hud);
+    ADD_MESSAGE(global_position_int, VEHICLE_SYSID, VEHICLE_COMPID, &global_position_int);
+    ADD_MESSAGE(gps_raw_int, VEHICLE_SYSID, VEHICLE_COMPID, &gps_raw_int);
+    ADD_MESSAGE(gps2_raw, VEHICLE_SYSID, VEHICLE_COMPID, &gps2_raw);
+    ADD_MESSAGE(sys_status, VEHICLE_SYSID, VEHICLE_COMPID, &sys_status);
+    ADD_MESSAGE(battery_status, VEHICLE_SYSID, VEHICLE_COMPID, &battery_status);
+    ADD_MESSAGE(nav_controller_output, VEHICLE_SYSID, VEHICLE_COMPID, &nav_controller_output);
+    ADD_MESSAGE(mission_current, VEHICLE_SYSID, VEHICLE_COMPID, &mission_current);
+    ADD_MESSAGE(rc_channels, VEHICLE_SYSID, VEHICLE_COMPID, &rc_channels);
+    if (f > 10)
+    {
+        ADD_MESSAGE(home_position, VEHICLE_SYSID, VEHICLE_COMPID, &home_position);
+    }
+    ADD_MESSAGE(radio_status, WFB_SYSID, WFB_COMPID, &radio_status);
+
+    return len;
+}
+
+/**
+ * flight_feed: parse the telemetry of one frame and publish it to the renderer.
+ *
+ * @param       frame   frame number
+ * @param       cruise  steady flight if set
+ */
+void flight_feed(int frame, int cruise)
+{
+    uint8_t buf[1024];
+
+    parse_mavlink_packet(buf, flight_datagram(buf, frame, cruise));
+    osd_telemetry_publish();
+}
+
+/**
+ * flight_layout: select widgets on the screen.
+ *
+ * "default" - osdconfig defaults, "dense" - most widgets on the first panel,
+ * "overlap" - compass and speed/altitude scales moved over the horizon.
+ *
+ * @param       name    layout name
+ * @return      0 on success, -1 for unknown layout
+ */
+int flight_layout(const char *name)
+{
+    // Wall clock would make frames differ between runs
+    osd_params.Time_en = 0;
+
+    if (strcmp(name, "default") == 0)
+    {
+        return 0;
+    }
+
+    if (strcmp(name, "dense") == 0)
+    {
+        osd_params.RSSI_en = 1;
+        osd_params.LinkQuality_en = 1;
+        osd_params.Efficiency_en = 1;
+        osd_params.HomeDirection_enabled = 1;
+        osd_params.HomeLatitude_enabled = 1;
+        osd_params.HomeLongitude_enabled = 1;
+        osd_params.GpsHDOP_en = 1;
+        osd_params.CWH_wp_dist_en = 1;
+        osd_params.Atti_mp_type = 1;
+        osd_params.Gps2Status_panel = 1;
+        osd_params.Gps2Lat_panel = 1;
+        osd_params.Gps2Lon_panel = 1;
+        osd_params.Gps2HDOP_panel = 1;
+        return 0;
+    }
+
+    if (strcmp(name, "overlap") == 0)
+    {
+        osd_params.CWH_Tmode_posY = GRAPHICS_REF_Y_MIDDLE - 10;
+        osd_params.Alt_Scale_posX = GRAPHICS_REF_X_MIDDLE + 30;
+        osd_params.Speed_scale_posX = GRAPHICS_REF_X_MIDDLE - 30;
+        return 0;
+    }
+
+    return -1;
+}
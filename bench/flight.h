@@ -0,0 +1,11 @@
+#ifndef __FLIGHT_H
+#define __FLIGHT_H
+
+#include <stdint.h>
+
+// Synthetic flight fed to the OSD as MAVLink datagrams
+int flight_datagram(uint8_t *buf, int frame, int cruise);
+void flight_feed(int frame, int cruise);
+int flight_layout(const char *name);
+
+#endif //__FLIGHT_H
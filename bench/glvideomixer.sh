@@ -0,0 +1,85 @@
+#!/bin/bash
+# Per frame cost of compositing the OSD with glvideomixer on llvmpipe, the
+# GL path of the gst backend, for comparison with yuvblend_bench. The OSD
+# frame comes from "yuvblend_bench -o osd.rgba". The OSD is uploaded with
+# every video frame here, the osd binary uploads it only when it changes,
+# so the result is an upper bound for a steady OSD.
+#
+#   ./glvideomixer.sh osd.rgba 640x360
+#   ./glvideomixer.sh -n osd.rgba         # print the pipelines, don't run them
+
+set -e
+
+DRY_RUN=0
+if [ "$1" = "-n" ]
+then
+    DRY_RUN=1
+    shift
+fi
+
+OSD=${1:-osd.rgba}
+OSD_SIZE=${2:-640x360}
+FRAMES=${FRAMES:-600}
+ELEMENTS="videotestsrc glupload glcolorconvert glvideomixerelement filesrc rawvideoparse imagefreeze fakesink"
+
+export LIBGL_ALWAYS_SOFTWARE=1 GALLIUM_DRIVER=llvmpipe
+
+osd_w=${OSD_SIZE%x*}
+osd_h=${OSD_SIZE#*x}
+
+run_ms()
+{
+    if [ $DRY_RUN = 1 ]
+    then
+        echo "gst-launch-1.0 -q $*" >&2
+        echo 0
+        return
+    fi
+    local t0=$(date +%s%N)
+    gst-launch-1.0 -q "$@" > /dev/null
+    echo $(( ($(date +%s%N) - t0) / 1000000 ))
+}
+
+if [ $DRY_RUN = 0 ]
+then
+    if ! command -v gst-launch-1.0 > /dev/null || ! command -v gst-inspect-1.0 > /dev/null
+    then
+        echo "gst-launch-1.0 and gst-inspect-1.0 are required" >&2
+        exit 1
+    fi
+    for e in $ELEMENTS
+    do
+        if ! gst-inspect-1.0 --exists $e
+        then
+            echo "GStreamer element $e is missing" >&2
+            exit 1
+        fi
+    done
+    if [ ! -f "$OSD" ]
+    then
+        echo "$OSD not found, make it with: ./yuvblend_bench -l dense -o $OSD" >&2
+        exit 1
+    fi
+fi
+
+for size in 1280x720 1920x1080
+do
+    w=${size%x*}
+    h=${size#*x}
+    video="videotestsrc num-buffers=$FRAMES pattern=smpte ! video/x-raw,format=NV12,width=$w,height=$h,framerate=60/1"
+
+    # Same video upload and conversion without the OSD branch
+    base=$(run_ms $video ! glupload ! glcolorconvert ! fakesink sync=false)
+
+    # Mixer set up like gst_main() does it
+    mix=$(run_ms glvideomixerelement name=mix \
+                 sink_0::width=$w sink_0::height=$h sink_0::zorder=-2 \
+                 sink_1::width=$w sink_1::height=$h sink_1::zorder=0 ! fakesink sync=false \
+                 $video ! glupload ! glcolorconvert ! mix.sink_0 \
+                 filesrc location="$OSD" ! rawvideoparse format=rgba width=$osd_w height=$osd_h framerate=60/1 ! \
+                 imagefreeze num-buffers=$FRAMES ! glupload ! glcolorconvert ! mix.sink_1)
+
+    [ $DRY_RUN = 1 ] && continue
+    echo "glvideomixer osd $OSD_SIZE -> $size NV12: $(( (mix - base) * 1000 / FRAMES )) us per video frame" \
+         "($base ms without OSD, $mix ms with, $FRAMES frames)"
+done
@@ -0,0 +1,240 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+
+
+/*
+ * Text drawing cost per glyph for each font. write_color_string draws
+ * from the glyph atlas through blit_sprite (text cache disabled, so every
+ * character is a blit), and from the text cache, where the whole string
+ * is a single blit. The bit-decoding write_char path the atlas replaced
+ * is kept here for comparison: a bit test and write_pixel_lm for every
+ * pixel of the glyph. Both paths must draw the same pixels.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "headless.h"
+#include "osdrender.h"
+#include "textcache.h"
+#include "../font8x10.h"
+#include "../font12x18.h"
+
+int osd_debug = 0;
+
+static uint64_t monotonic_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/**
+ * bitmap_char: draw character by decoding the font bits, as write_char and
+ * write_char16 did before the glyph atlas.
+ *
+ * @param       ch      character to write
+ * @param       x       x coordinate (left)
+ * @param       y       y coordinate (top)
+ * @param       flags   flags to write with
+ * @param       font    font to use
+ * @param       color   0 = black, 1 = main, 2 = warn
+ */
+static void bitmap_char(char ch, int x, int y, int flags, int font, int color)
+{
+    struct FontEntry font_info;
+    char lookup = 0;
+
+    // Only the outlined fonts have a lookup table
+    if (!fetch_font_info(ch, font, &font_info, fonts[font].id < 2 ? &lookup : NULL))
+    {
+        return;
+    }
+
+    if (font_info.id < 2)
+    {
+        damage_add(&frame_damage, x, y, x + font_info.width - 1, y + font_info.height - 1);
+        for (int dy = 0; dy < font_info.height; dy++)
+        {
+            uint16_t levels, mask;
+            int row = lookup * font_info.height * 2 + dy;
+            for (int dx = 0; dx < font_info.width; dx++)
+            {
+                uint16_t xshift = font_info.width - 1;
+                levels = font_info.data[row + font_info.height];
+                if (flags & FONT_INVERT)
+                {
+                    levels = ~levels;
+                }
+                mask = font_info.data[row];
+                if (mask & (1 << (xshift - dx)))
+                    write_pixel_lm(x + dx, y + dy, 1, (levels & (1 << (xshift - dx))) ? color : 0);
+            }
+        }
+    }
+    else
+    {
+        damage_add(&frame_damage, x + 1, y + 1, x + font_info.width, y + font_info.height);
+        for (int dy = 0; dy < font_info.height; dy++)
+        {
+            uint16_t levels, mask;
+            int row = (uint8_t)ch * font_info.height + dy;
+            if (font == 3)
+            {
+                levels = font_frame12x18[row];
+                mask = font_mask12x18[row];
+            }
+            else
+            {
+                levels = font_frame8x10[row];
+                mask = font_mask8x10[row];
+            }
+            for (int dx = 0; dx < font_info.width; dx++)
+            {
+                uint16_t xshift = font_info.width - 1;
+                if (mask & (1 << (xshift - dx)))
+                    write_pixel_lm(x + dx + 1, y + dy + 1, 1, (levels & (1 << (xshift - dx))) ? color : 0);
+            }
+        }
+    }
+}
+
+static void bitmap_string(const char *str, int x, int y, int font)
+{
+    for (; *str != 0; str++, x += fonts[font].width)
+    {
+        bitmap_char(*str, x, y, 0, font, 1);
+    }
+}
+
+// Both paths have to draw the same pixels
+static int same_pixels(const char *str, int font)
+{
+    osd_layer_t bitmap = { 0 }, atlas = { 0 };
+    int x = 8;
+
+    layer_begin();
+    bitmap_string(str, 8, 100, font);
+    layer_end(&bitmap);
+
+    layer_begin();
+    for (const char *c = str; *c != 0; c++, x += fonts[font].width)
+    {
+        if (fonts[font].id < 2)
+            write_char(*c, x, 100, 0, font, 1);
+        else
+            write_char16(*c, x, 100, font, 1);
+    }
+    layer_end(&atlas);
+
+    int same = bitmap.x == atlas.x && bitmap.y == atlas.y &&
+               bitmap.sprite.width == atlas.sprite.width && bitmap.sprite.height == atlas.sprite.height &&
+               memcmp(bitmap.pixels, atlas.pixels, bitmap.sprite.width * bitmap.sprite.height * sizeof(osd_pixel_t)) == 0;
+    free(bitmap.pixels);
+    free(atlas.pixels);
+    return same;
+}
+
+// ns per drawn glyph of str, drawn n times
+static double time_string(const char *str, int font, int n, int glyphs, int bitmap)
+{
+    uint64_t t0 = monotonic_ns();
+
+    for (int i = 0; i < n; i++)
+    {
+        // Keep the damage list from collapsing into one rectangle
+        clearGraphics(0);
+        if (bitmap)
+        {
+            bitmap_string(str, 8, 100, font);
+        }
+        else
+        {
+            write_color_string((char *)str, 8, 100, 0, 0, TEXT_VA_TOP, TEXT_HA_LEFT, 0, font, 1);
+        }
+    }
+    return (double)(monotonic_ns() - t0) / n / glyphs;
+}
+
+int main(int argc, char **argv)
+{
+    const char *str = "ALT 123.4M SPD 56 HDG 270 BAT";
+    int n = 20000;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:s:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'n':
+            n = atoi(optarg);
+            break;
+        case 's':
+            str = optarg;
+            break;
+        default:
+            fprintf(stderr, "%s [-n strings] [-s string]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if (n <= 0)
+    {
+        fprintf(stderr, "Invalid string count\n");
+        return 1;
+    }
+
+    osd_init(0, 0, 1, 1);
+    clearGraphics(0);
+
+    for (int font = 0; font < NUM_FONTS; font++)
+    {
+        osd_sprite_t glyph;
+        int offset, glyphs = 0;
+
+        for (const char *c = str; *c != 0; c++)
+        {
+            glyphs += glyph_sprite(*c, 0, font, 1, &glyph, &offset);
+        }
+        if (glyphs == 0)
+        {
+            printf("glyph %-12s: no characters of the string in the font\n", fonts[font].name);
+            continue;
+        }
+
+        if (!same_pixels(str, font))
+        {
+            fprintf(stderr, "glyph_bench: %s glyphs differ between bit decoding and the atlas\n", fonts[font].name);
+            return 1;
+        }
+
+        double bitmap = time_string(str, font, n, glyphs, 1);
+
+        size_t budget = text_cache_budget;
+        text_cache_budget = 0;
+        double atlas = time_string(str, font, n, glyphs, 0);
+        text_cache_budget = budget;
+        double cached = time_string(str, font, n, glyphs, 0);
+
+        printf("glyph %-12s %2dx%-2d: bit decoding %6.1f ns/glyph, atlas %6.1f ns/glyph (%.1fx), text cache %6.1f ns/glyph\n",
+               fonts[font].name, fonts[font].width, fonts[font].height, bitmap, atlas, bitmap / atlas, cached);
+    }
+    return 0;
+}
@@ -0,0 +1,142 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+
+/*
+ * Headless display backend. It replaces drm_output.c, so the renderer
+ * runs without libdrm and a display: every displayed layer is mirrored
+ * into memory and the composed frame can be hashed by the benchmarks.
+ * The renderer's clock is wrapped at link time (-Wl,--wrap=gettimeofday),
+ * so blinking and timed widgets give the same frames on every run.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "headless.h"
+#include "drm_output.h"
+
+int headless_layers = 1;
+unsigned int headless_commits = 0;
+uint64_t headless_time_ms = 0;
+
+const char *drm_card = "headless";
+const char *drm_format = NULL;
+const char *drm_static_plane = NULL;
+drm_render_mode_t drm_render_mode = DRM_RENDER_SHADOW;
+
+static osd_pixel_t *mirror[OSD_SCREEN_LAYERS];
+static osd_damage_t mirror_damage[OSD_SCREEN_LAYERS];
+
+int drm_init(void)
+{
+    for (int l = 0; l < headless_layers; l++)
+    {
+        mirror[l] = calloc(GRAPHICS_WIDTH * GRAPHICS_HEIGHT, sizeof(osd_pixel_t));
+        if (mirror[l] == NULL)
+        {
+            fprintf(stderr, "Unable to allocate headless frame\n");
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void drm_cleanup(void)
+{
+}
+
+int drm_layer_count(void)
+{
+    return headless_layers;
+}
+
+void *drm_back_buffer(int layer, osd_damage_t *stale)
+{
+    return NULL;
+}
+
+int drm_display_buffer(int layer, void *src_buf, const osd_damage_t *damage)
+{
+    const osd_pixel_t *src = src_buf;
+    osd_damage_t copy = mirror_damage[layer];
+
+    // Pixels cleared since the previous frame are outside of the new damage
+    damage_merge(&copy, damage);
+    for (int i = 0; i < copy.count; i++)
+    {
+        const osd_rect_t *r = copy.rects + i;
+
+        for (int y = r->y0; y <= r->y1; y++)
+        {
+            size_t offset = y * GRAPHICS_WIDTH + r->x0;
+            memcpy(mirror[layer] + offset, src + offset, (r->x1 - r->x0 + 1) * sizeof(osd_pixel_t));
+        }
+    }
+    mirror_damage[layer] = *damage;
+    return 0;
+}
+
+void drm_commit(void)
+{
+    headless_commits++;
+}
+
+int __wrap_gettimeofday(struct timeval *tv, void *tz)
+{
+    tv->tv_sec = headless_time_ms / 1000;
+    tv->tv_usec = headless_time_ms % 1000 * 1000;
+    return 0;
+}
+
+/**
+ * headless_frame: pixels of a layer as the display shows them.
+ *
+ * @param       layer   screen layer
+ * @return      GRAPHICS_WIDTH x GRAPHICS_HEIGHT draw buffer pixels
+ */
+const osd_pixel_t *headless_frame(int layer)
+{
+    return mirror[layer];
+}
+
+/**
+ * headless_hash: hash the frame on the display, static layer under the dynamic one.
+ *
+ * @return      FNV-1a hash of the composed pixels
+ */
+uint64_t headless_hash(void)
+{
+    uint64_t h = 14695981039346656037ULL;
+
+    for (int i = 0; i < GRAPHICS_WIDTH * GRAPHICS_HEIGHT; i++)
+    {
+        osd_pixel_t p = mirror[0][i];
+
+        if (p == 0 && headless_layers > 1)
+        {
+            p = mirror[1][i];
+        }
+        for (int b = 0; b < sizeof(p); b++)
+        {
+            h ^= (p >> (8 * b)) & 0xff;
+            h *= 1099511628211ULL;
+        }
+    }
+    return h;
+}
@@ -0,0 +1,16 @@
+#ifndef __HEADLESS_H
+#define __HEADLESS_H
+
+#include <stdint.h>
+
+#include "graphengine.h"
+
+// Display backend for benchmarks: the rockchip renderer with frames kept in memory
+extern int headless_layers;             // display planes offered to the renderer, 1 or 2
+extern unsigned int headless_commits;   // frames sent to the display
+extern uint64_t headless_time_ms;       // renderer's clock, the benchmark advances it
+
+const osd_pixel_t *headless_frame(int layer);
+uint64_t headless_hash(void);
+
+#endif //__HEADLESS_H
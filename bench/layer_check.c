@@ -0,0 +1,138 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+
+/*
+ * Retained widget layers must not change the picture. The same flight is
+ * rendered with every widget drawn directly (in a child process, so both
+ * runs start from the same state) and with layers, and the composed
+ * frames are compared. The "overlap" layout puts the compass and
+ * the speed/altitude scales over the horizon, their background erases
+ * have to cut it out the same way in both runs. Cruise legs keep them
+ * steady, so they are replayed from layers while the horizon moves.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "headless.h"
+#include "flight.h"
+#include "osdrender.h"
+#include "tiler.h"
+
+int osd_debug = 0;
+
+static void render_flight(uint64_t *hashes, int frames)
+{
+    osd_init(0, 0, 1, 1);
+
+    for (int f = 0; f < frames; f++)
+    {
+        headless_time_ms = f * 33;
+        flight_feed(f, (f / 40) % 2);
+        render();
+        hashes[f] = headless_hash();
+    }
+}
+
+int main(int argc, char **argv)
+{
+    const char *layout = "overlap";
+    int frames = 300;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "l:n:t:s")) != -1)
+    {
+        switch (opt)
+        {
+        case 'l':
+            layout = optarg;
+            break;
+        case 'n':
+            frames = atoi(optarg);
+            break;
+        case 't':
+            raster_threads = atoi(optarg);
+            break;
+        case 's':
+            headless_layers = 2;
+            break;
+        default:
+            fprintf(stderr, "%s [-l default|dense|overlap] [-n frames] [-t raster_threads] [-s]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if (flight_layout(layout) != 0)
+    {
+        fprintf(stderr, "Unknown layout %s\n", layout);
+        return 1;
+    }
+
+    uint64_t *direct = calloc(frames, sizeof(uint64_t));
+    uint64_t *layered = calloc(frames, sizeof(uint64_t));
+    int fds[2];
+
+    if (direct == NULL || layered == NULL || pipe(fds) != 0)
+    {
+        perror("layer_check");
+        return 1;
+    }
+
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        widget_layers = 0;
+        render_flight(direct, frames);
+        if (write(fds[1], direct, frames * sizeof(uint64_t)) != frames * sizeof(uint64_t))
+        {
+            _exit(1);
+        }
+        _exit(0);
+    }
+
+    widget_layers = 1;
+    render_flight(layered, frames);
+
+    size_t got = 0;
+    ssize_t rc;
+    while (got < frames * sizeof(uint64_t) && (rc = read(fds[0], (uint8_t*)direct + got, frames * sizeof(uint64_t) - got)) > 0)
+    {
+        got += rc;
+    }
+
+    int status;
+    if (pid < 0 || waitpid(pid, &status, 0) != pid || status != 0 || got != frames * sizeof(uint64_t))
+    {
+        fprintf(stderr, "layer_check %s: direct rendering failed\n", layout);
+        return 1;
+    }
+
+    for (int f = 0; f < frames; f++)
+    {
+        if (direct[f] != layered[f])
+        {
+            fprintf(stderr, "layer_check %s: frame %d differs with widget layers\n", layout, f);
+            return 1;
+        }
+    }
+
+    printf("layer_check %s: %d frames identical\n", layout, frames);
+    return 0;
+}
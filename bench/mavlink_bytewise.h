@@ -0,0 +1,26 @@
+#ifndef __MAVLINK_BYTEWISE_H
+#define __MAVLINK_BYTEWISE_H
+
+/*
+ * Byte-wise parsing with mavlink_parse_char(), as parse_mavlink_packet()
+ * did before the whole-frame path. Include after osdmavlink.c, it goes
+ * through the same static dispatch. Uses its own channel, so it can run
+ * next to parse_mavlink_packet() in one process.
+ */
+static void parse_mavlink_bytewise(uint8_t *buf, int buflen)
+{
+    mavlink_status_t status;
+    mavlink_message_t msg;
+
+    datagram_arrived();
+
+    for (int i = 0; i < buflen; i++)
+    {
+        if (mavlink_parse_char(MAVLINK_COMM_1, buf[i], &msg, &status))
+        {
+            dispatch_message(&msg, osd_telemetry_w);
+        }
+    }
+}
+
+#endif //__MAVLINK_BYTEWISE_H
@@ -0,0 +1,118 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+
+/*
+ * MAVLink ingest throughput. The corpus is parsed with
+ * parse_mavlink_packet() and with the byte-wise mavlink_parse_char()
+ * loop it replaced, and MB/s of datagrams are printed for both.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../osdmavlink.c"
+#include "mavlink_bytewise.h"
+#include "corpus.h"
+
+int osd_debug = 0;
+
+static uint64_t monotonic_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// Returns MB/s
+static double parse_corpus(uint8_t *corpus, size_t size, int rounds, void (*parse)(uint8_t *, int))
+{
+    size_t bytes = 0;
+    uint64_t t0 = monotonic_ns();
+
+    for (int r = 0; r < rounds; r++)
+    {
+        for (size_t p = 0; p < size;)
+        {
+            uint16_t len;
+
+            memcpy(&len, corpus + p, sizeof(len));
+            p += sizeof(len);
+            parse(corpus + p, len);
+            p += len;
+            bytes += len;
+        }
+    }
+    return bytes * 1e3 / (monotonic_ns() - t0);
+}
+
+int main(int argc, char **argv)
+{
+    const char *mode = "whole";
+    int seconds = 60, rounds = 10;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "m:s:r:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'm':
+            mode = optarg;
+            break;
+        case 's':
+            seconds = atoi(optarg);
+            break;
+        case 'r':
+            rounds = atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "%s [-m whole|split|corrupt|v1] [-s seconds] [-r rounds]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    size_t size;
+    uint8_t *corpus = corpus_build(mode, seconds, &size);
+
+    if (corpus == NULL)
+    {
+        fprintf(stderr, "Unknown corpus mode: %s\n", mode);
+        return 1;
+    }
+
+    // STATUSTEXT handler prints every message
+    fflush(stdout);
+    FILE *report = fdopen(dup(STDOUT_FILENO), "w");
+    if (report == NULL || freopen("/dev/null", "w", stdout) == NULL)
+    {
+        perror("stdout");
+        return 1;
+    }
+
+    // Warm up both, then time them
+    parse_corpus(corpus, size, 1, parse_mavlink_packet);
+    parse_corpus(corpus, size, 1, parse_mavlink_bytewise);
+
+    double frames = parse_corpus(corpus, size, rounds, parse_mavlink_packet);
+    double bytewise = parse_corpus(corpus, size, rounds, parse_mavlink_bytewise);
+
+    fprintf(report, "mavparse %-7s %zu bytes x %d: whole-frame %7.1f MB/s, byte-wise %7.1f MB/s, %.2fx\n",
+            mode, size, rounds, frames, bytewise, frames / bytewise);
+    return 0;
+}
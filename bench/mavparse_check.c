@@ -0,0 +1,188 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+
+/*
+ * Whole-frame parsing must give the OSD exactly what byte-wise
+ * mavlink_parse_char() gives it. The same corpus is fed datagram by
+ * datagram through parse_mavlink_packet() and through the byte-wise
+ * reference (in a child process, so both start from the same state), and
+ * the parser's telemetry is compared after every datagram: all slots
+ * decoded, arrival times left out.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "../osdmavlink.c"
+#include "mavlink_bytewise.h"
+#include "corpus.h"
+#include "headless.h"
+
+int osd_debug = 0;
+
+#define ALL_GROUPS ((1u << TLM_GROUP_COUNT) - 1)
+
+static uint64_t telemetry_digest(const osd_telemetry_t *t)
+{
+    osd_telemetry_t d = *t;
+    uint64_t hash = 14695981039346656037ULL;
+
+    memset(d.decoded_time_us, 0, sizeof(d.decoded_time_us));
+    decode_mavlink_slots(&d, ALL_GROUPS);
+
+    // Wall clock differs between the runs, decode order above depends on it already
+    for (int i = 0; i < SIZEOF_ARRAY(mavlink_slots); i++)
+    {
+        *(uint64_t*)((uint8_t*)&d + mavlink_slots[i].time_offset) = 0;
+    }
+
+    for (size_t i = 0; i < offsetof(osd_telemetry_t, version); i++)
+    {
+        hash = (hash ^ ((const uint8_t*)&d)[i]) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+// Calls parse for each datagram, returns the number of datagrams
+static int feed_corpus(uint8_t *corpus, size_t size, void (*parse)(uint8_t *, int), int fd)
+{
+    int datagrams = 0;
+
+    for (size_t p = 0; p < size; datagrams++)
+    {
+        uint16_t len;
+
+        memcpy(&len, corpus + p, sizeof(len));
+        p += sizeof(len);
+        parse(corpus + p, len);
+        p += len;
+
+        uint64_t digest = telemetry_digest(osd_telemetry_w);
+        if (fd >= 0 && write(fd, &digest, sizeof(digest)) != sizeof(digest))
+        {
+            perror("write");
+            exit(1);
+        }
+    }
+    return datagrams;
+}
+
+int main(int argc, char **argv)
+{
+    const char *mode = "whole";
+    int seconds = 60;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "m:s:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'm':
+            mode = optarg;
+            break;
+        case 's':
+            seconds = atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "%s [-m whole|split|corrupt|v1] [-s seconds]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    size_t size;
+    uint8_t *corpus = corpus_build(mode, seconds, &size);
+
+    if (corpus == NULL)
+    {
+        fprintf(stderr, "Unknown corpus mode: %s\n", mode);
+        return 1;
+    }
+
+    // STATUSTEXT handler prints every message
+    fflush(stdout);
+    FILE *report = fdopen(dup(STDOUT_FILENO), "w");
+    if (report == NULL || freopen("/dev/null", "w", stdout) == NULL)
+    {
+        perror("stdout");
+        return 1;
+    }
+
+    int fds[2];
+    if (pipe(fds) != 0)
+    {
+        perror("pipe");
+        return 1;
+    }
+
+    pid_t pid = fork();
+    if (pid < 0)
+    {
+        perror("fork");
+        return 1;
+    }
+    if (pid == 0)
+    {
+        close(fds[0]);
+        feed_corpus(corpus, size, parse_mavlink_bytewise, fds[1]);
+        _exit(0);
+    }
+    close(fds[1]);
+
+    int datagrams = 0, mismatch = -1;
+    for (size_t p = 0; p < size; datagrams++)
+    {
+        uint16_t len;
+        uint64_t expected;
+
+        memcpy(&len, corpus + p, sizeof(len));
+        p += sizeof(len);
+        parse_mavlink_packet(corpus + p, len);
+        p += len;
+
+        if (read(fds[0], &expected, sizeof(expected)) != sizeof(expected))
+        {
+            fprintf(stderr, "Byte-wise run ended early\n");
+            return 1;
+        }
+        if (mismatch < 0 && telemetry_digest(osd_telemetry_w) != expected)
+        {
+            mismatch = datagrams;
+        }
+    }
+
+    int status;
+    waitpid(pid, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+    {
+        fprintf(stderr, "Byte-wise run failed\n");
+        return 1;
+    }
+
+    if (mismatch >= 0)
+    {
+        fprintf(report, "mavparse_check %s: telemetry differs from byte-wise parsing after datagram %d of %d\n",
+                mode, mismatch, datagrams);
+        return 1;
+    }
+
+    fprintf(report, "mavparse_check %s: %d datagrams (%zu bytes), telemetry identical to byte-wise parsing\n",
+            mode, datagrams, size);
+    return 0;
+}
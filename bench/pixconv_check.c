@@ -0,0 +1,157 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+
+/*
+ * Scanout format conversions against a plain per-channel reference.
+ * Random pixels (or palette indexes in indexed builds) of every length
+ * up to a few SIMD blocks, at unaligned source and destination offsets,
+ * must convert to the same bytes as the reference and leave the bytes
+ * past the end untouched. Build with CROSS= and RUN= to check the NEON
+ * kernels on ARM or under qemu.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pixconv.h"
+
+int osd_debug = 0;
+
+#define MAX_PIXELS 80
+#define GUARD 0xa5
+
+typedef struct {
+    const char *name;
+    pixconv_func_t convert;
+    int bpp;
+} pixconv_format_t;
+
+static const pixconv_format_t formats[] = {
+    { "abgr8888", pixconv_abgr8888, 4 },
+    { "argb8888", pixconv_argb8888, 4 },
+    { "argb1555", pixconv_argb1555, 2 },
+    { "argb4444", pixconv_argb4444, 2 },
+};
+
+// Bytes of one pixel in the scanout format from R, G, B, A of the draw buffer
+static void reference_pixel(const char *format, const uint8_t *rgba, uint8_t *out)
+{
+    uint8_t r = rgba[0], g = rgba[1], b = rgba[2], a = rgba[3];
+    uint16_t v;
+
+    if (strcmp(format, "abgr8888") == 0)
+    {
+        memcpy(out, rgba, 4);
+        return;
+    }
+
+    if (strcmp(format, "argb8888") == 0)
+    {
+        out[0] = b;
+        out[1] = g;
+        out[2] = r;
+        out[3] = a;
+        return;
+    }
+
+    if (strcmp(format, "argb1555") == 0)
+    {
+        v = (a >> 7) << 15 | (r >> 3) << 10 | (g >> 3) << 5 | (b >> 3);
+    }
+    else
+    {
+        v = (a >> 4) << 12 | (r >> 4) << 8 | (g >> 4) << 4 | (b >> 4);
+    }
+    // Little endian, like the 16-bit DRM formats
+    out[0] = v & 0xff;
+    out[1] = v >> 8;
+}
+
+static uint32_t random32(void)
+{
+    return (uint32_t)rand() << 16 ^ (uint32_t)rand();
+}
+
+int main(int argc, char **argv)
+{
+    int rounds = argc > 1 ? atoi(argv[1]) : 200;
+    osd_pixel_t src_buf[MAX_PIXELS + 4];
+    uint8_t dst_buf[(MAX_PIXELS + 4) * 4 + 16], expected[MAX_PIXELS * 4];
+    int failed = 0;
+
+    srand(1);
+
+    for (int round = 0; round < rounds; round++)
+    {
+#ifdef GRAPHICS_INDEXED
+        for (int i = 1; i < OSD_PALETTE_SIZE; i++) osd_palette[i] = random32();
+        for (int i = 0; i < MAX_PIXELS + 4; i++) src_buf[i] = rand() % OSD_PALETTE_SIZE;
+#else
+        for (int i = 0; i < MAX_PIXELS + 4; i++) src_buf[i] = random32();
+#endif
+
+        for (int f = 0; f < sizeof(formats) / sizeof(formats[0]); f++)
+        {
+            const pixconv_format_t *fmt = formats + f;
+
+            for (int count = 0; count <= MAX_PIXELS; count++)
+            {
+                int src_offset = round % 4, dst_offset = (round / 4) % 4 * fmt->bpp / 2;
+                const osd_pixel_t *src = src_buf + src_offset;
+                uint8_t *dst = dst_buf + dst_offset;
+
+                for (int i = 0; i < count; i++)
+                {
+                    uint32_t rgba;
+#ifdef GRAPHICS_INDEXED
+                    rgba = osd_palette[src[i]];
+#else
+                    rgba = src[i];
+#endif
+                    uint8_t bytes[4] = { rgba, rgba >> 8, rgba >> 16, rgba >> 24 };
+                    reference_pixel(fmt->name, bytes, expected + i * fmt->bpp);
+                }
+
+                memset(dst_buf, GUARD, sizeof(dst_buf));
+                fmt->convert(dst, src, count);
+
+                int bytes = count * fmt->bpp;
+                int bad = memcmp(dst, expected, bytes) != 0;
+                for (int i = bytes; i < bytes + 16 && !bad; i++)
+                {
+                    bad = dst[i] != GUARD;
+                }
+
+                if (bad && failed++ < 10)
+                {
+                    fprintf(stderr, "pixconv_check: %s differs from reference, %d pixels at src+%d dst+%d\n",
+                            fmt->name, count, src_offset, dst_offset);
+                }
+            }
+        }
+    }
+
+    if (failed)
+    {
+        fprintf(stderr, "pixconv_check: %d conversions failed\n", failed);
+        return 1;
+    }
+
+    printf("pixconv_check: %d rounds of %d formats match the reference\n", rounds, (int)(sizeof(formats) / sizeof(formats[0])));
+    return 0;
+}
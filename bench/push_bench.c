@@ -0,0 +1,127 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+
+/*
+ * GStreamer push decision on a synthetic flight. appsrc pushes a frame only
+ * when render() returns one, otherwise glvideomixer keeps the last OSD
+ * buffer. The headless renderer decides the same way and commits where
+ * the gst one returns a buffer. Telemetry arrives at its own rate and frames are polled at the
+ * video rate, as cb_poll_frame() does, assuming downstream always asks
+ * for data. Prints pushed and skipped frames/s, the RGBA upload bandwidth
+ * against pushing every frame, and the CPU time of render().
+ *
+ * idle - vehicle waiting on the ground, the same telemetry every time
+ * cruise - straight leg, only attitude changes
+ * flight - manoeuvring, everything changes
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "headless.h"
+#include "flight.h"
+#include "osdrender.h"
+
+int osd_debug = 0;
+
+static uint64_t monotonic_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+int main(int argc, char **argv)
+{
+    const char *layout = "default";
+    const char *mode = "cruise";
+    int seconds = 60, fps = 60, rate = 10;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "l:m:s:f:r:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'l':
+            layout = optarg;
+            break;
+        case 'm':
+            mode = optarg;
+            break;
+        case 's':
+            seconds = atoi(optarg);
+            break;
+        case 'f':
+            fps = atoi(optarg);
+            break;
+        case 'r':
+            rate = atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "%s [-l default|dense|overlap] [-m idle|cruise|flight] [-s seconds] [-f fps] [-r telemetry_hz]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    int idle = strcmp(mode, "idle") == 0;
+    int cruise = idle || strcmp(mode, "cruise") == 0;
+
+    if (flight_layout(layout) != 0 || (!cruise && strcmp(mode, "flight") != 0) ||
+        seconds <= 0 || fps <= 0 || rate <= 0)
+    {
+        fprintf(stderr, "Invalid layout, mode, duration or rate\n");
+        return 1;
+    }
+
+    osd_init(0, 0, 1, 1);
+
+    int frames = seconds * fps, datagrams = 0, pushed = 0;
+    uint64_t render_ns = 0;
+
+    for (int f = 0; f < frames; f++)
+    {
+        headless_time_ms = (uint64_t)f * 1000 / fps;
+
+        // Datagrams which arrived since the previous frame
+        while ((uint64_t)datagrams * fps < (uint64_t)(f + 1) * rate)
+        {
+            flight_feed(idle ? 0 : datagrams, cruise);
+            datagrams++;
+        }
+
+        // gst render() returns a buffer exactly when the DRM one commits
+        unsigned int commits = headless_commits;
+        uint64_t t0 = monotonic_ns();
+
+        render();
+        render_ns += monotonic_ns() - t0;
+        pushed += headless_commits != commits;
+    }
+
+    double frame_mb = GRAPHICS_WIDTH * GRAPHICS_HEIGHT * 4 / 1e6;
+
+    printf("push %s %-6s %dx%d @ %d fps, telemetry %d Hz: %5.1f pushed/s, %5.1f skipped/s, "
+           "upload %6.2f MB/s (%.2f every frame), render %5.1f us/frame, %4.1f%% of a core\n",
+           layout, mode, GRAPHICS_WIDTH, GRAPHICS_HEIGHT, fps, rate,
+           (double)pushed / seconds, (double)(frames - pushed) / seconds,
+           pushed * frame_mb / seconds, fps * frame_mb,
+           render_ns / 1000.0 / frames, render_ns / 1e7 / seconds);
+    return 0;
+}
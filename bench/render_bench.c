@@ -0,0 +1,168 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+
+/*
+ * Renderer thread scaling. The synthetic flight is rendered with 1..N
+ * raster threads (each count in its own process, the worker pool can't
+ * shrink or grow once started), and the time spent in render() per frame
+ * is printed with the speedup against a single thread. Frames must come
+ * out the same for every thread count.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "headless.h"
+#include "flight.h"
+#include "osdrender.h"
+#include "tiler.h"
+
+int osd_debug = 0;
+
+typedef struct {
+    double us_per_frame;
+    uint64_t hash;
+} bench_result_t;
+
+static uint64_t monotonic_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static bench_result_t render_flight(int frames, int cruise)
+{
+    bench_result_t result = { 0, 14695981039346656037ULL };
+    uint64_t render_ns = 0;
+
+    osd_init(0, 0, 1, 1);
+
+    for (int f = 0; f < frames; f++)
+    {
+        headless_time_ms = f * 33;
+        flight_feed(f, cruise);
+
+        uint64_t t0 = monotonic_ns();
+        render();
+        render_ns += monotonic_ns() - t0;
+
+        result.hash = (result.hash ^ headless_hash()) * 1099511628211ULL;
+    }
+
+    result.us_per_frame = render_ns / 1000.0 / frames;
+    return result;
+}
+
+static int run_threads(int threads, int frames, int cruise, bench_result_t *result)
+{
+    int fds[2];
+
+    if (pipe(fds) != 0)
+    {
+        return -1;
+    }
+
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        raster_threads = threads;
+        bench_result_t r = render_flight(frames, cruise);
+        _exit(write(fds[1], &r, sizeof(r)) == sizeof(r) ? 0 : 1);
+    }
+
+    int status = -1;
+    ssize_t got = pid > 0 ? read(fds[0], result, sizeof(*result)) : -1;
+    close(fds[0]);
+    close(fds[1]);
+    if (pid < 0 || waitpid(pid, &status, 0) != pid || status != 0 || got != sizeof(*result))
+    {
+        return -1;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    const char *layout = "default";
+    int frames = 1000;
+    int max_threads = 4;
+    int cruise = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "l:n:t:cs")) != -1)
+    {
+        switch (opt)
+        {
+        case 'l':
+            layout = optarg;
+            break;
+        case 'n':
+            frames = atoi(optarg);
+            break;
+        case 't':
+            max_threads = atoi(optarg);
+            break;
+        case 'c':
+            cruise = 1;
+            break;
+        case 's':
+            headless_layers = 2;
+            break;
+        default:
+            fprintf(stderr, "%s [-l default|dense|overlap] [-n frames] [-t max_raster_threads] [-c] [-s]\n", argv[0]);
+            fprintf(stderr, "  -c  cruise flight, only attitude changes\n  -s  separate static screen layer\n");
+            return 1;
+        }
+    }
+
+    if (flight_layout(layout) != 0 || frames <= 0 || max_threads < 1 || max_threads > RASTER_MAX_THREADS)
+    {
+        fprintf(stderr, "Invalid layout, frame or thread count\n");
+        return 1;
+    }
+
+    bench_result_t single = { 0, 0 };
+
+    for (int t = 1; t <= max_threads; t++)
+    {
+        bench_result_t r;
+
+        if (run_threads(t, frames, cruise, &r) != 0)
+        {
+            fprintf(stderr, "render_bench: run with %d threads failed\n", t);
+            return 1;
+        }
+        if (t == 1)
+        {
+            single = r;
+        }
+        else if (r.hash != single.hash)
+        {
+            fprintf(stderr, "render_bench: frames with %d threads differ from a single thread\n", t);
+            return 1;
+        }
+
+        printf("render %s%s -t %d: %8.1f us/frame  speedup %.2fx\n", layout, cruise ? " cruise" : "", t,
+               r.us_per_frame, single.us_per_frame / r.us_per_frame);
+    }
+    return 0;
+}
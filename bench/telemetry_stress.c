@@ -0,0 +1,249 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+
+/*
+ * Telemetry handoff under load. A parser thread feeds the synthetic flight
+ * datagram by datagram and publishes after each one, while a renderer
+ * thread fetches, decodes every group and spends the given render time.
+ * Every datagram carries the same frame number in all groups, so whatever
+ * the renderer gets must be one frame throughout, and frames must never go
+ * back. Every other fetch the flight group isn't decoded, like a hidden
+ * widget's, and its fields must keep the frame they were decoded from. Ingest rate and per-datagram parse+publish time are printed; they
+ * shouldn't depend on the render time, the parser never waits for the
+ * renderer. Build with -fsanitize=thread to check the handoff for races.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "headless.h"
+#include "flight.h"
+#include "osdmavlink.h"
+#include "osdvar.h"
+
+int osd_debug = 0;
+
+#define FRAME_MS 33     // attitude and global_position_int time_boot_ms step in flight.c
+#define ALL_GROUPS ((1u << TLM_GROUP_COUNT) - 1)
+
+static int frames = 20000;
+static int ingest_interval_us = 0;
+static int render_us = 0;
+
+static int parser_done = 0;
+
+typedef struct {
+    uint64_t busy_ns;
+    uint64_t max_ns;
+    uint64_t wall_ns;
+} ingest_stats_t;
+
+typedef struct {
+    long fetches;
+    long distinct;
+    long errors;
+} render_stats_t;
+
+static uint64_t monotonic_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void *parser_thread(void *arg)
+{
+    ingest_stats_t *stats = arg;
+    uint8_t buf[1024];
+    uint64_t start = monotonic_ns();
+
+    for (int f = 0; f < frames; f++)
+    {
+        int len = flight_datagram(buf, f, 0);
+        uint64_t t0 = monotonic_ns();
+
+        parse_mavlink_packet(buf, len);
+        osd_telemetry_publish();
+
+        uint64_t t = monotonic_ns() - t0;
+        stats->busy_ns += t;
+        if (t > stats->max_ns)
+            stats->max_ns = t;
+
+        if (ingest_interval_us > 0)
+            usleep(ingest_interval_us);
+    }
+
+    stats->wall_ns = monotonic_ns() - start;
+    __atomic_store_n(&parser_done, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+// Frame number of a slot from its time_boot_ms, -1 before the first message
+static int slot_frame(uint32_t msgid, uint8_t len, uint64_t time_us, const uint8_t *payload)
+{
+    mavlink_message_t msg = { .msgid = msgid, .len = len };
+
+    if (time_us == 0)
+        return -1;
+
+    memcpy(_MAV_PAYLOAD_NON_CONST(&msg), payload, len);
+    return (msgid == MAVLINK_MSG_ID_ATTITUDE ? mavlink_msg_attitude_get_time_boot_ms(&msg) :
+            mavlink_msg_global_position_int_get_time_boot_ms(&msg)) / FRAME_MS;
+}
+
+// Flight fields are checked against flight_f, the frame of their last decode
+static int check_frame(const osd_telemetry_t *t, int f, int flight_f, long fetch)
+{
+    const char *group = NULL;
+    int expected = f;
+
+    if (slot_frame(MAVLINK_MSG_ID_GLOBAL_POSITION_INT, MAVLINK_MSG_ID_GLOBAL_POSITION_INT_LEN,
+                   t->global_position_int_msg.time_us, t->global_position_int_msg.payload) != f)
+        group = "flight slot";
+    else if (flight_f >= 0 && (t->osd_throttle != flight_f % 101 || fabsf(t->osd_alt - flight_f * 0.7f) > 0.01f))
+    {
+        group = "flight";
+        expected = flight_f;
+    }
+    else if (fabsf(t->osd_pitch - ((f % 60) - 30)) > 0.001f)
+        group = "attitude";
+    else if (lround((t->osd_lat - 55.0) * 1e5) != f || t->osd_hdop != 90 + f % 50)
+        group = "gps";
+    else if (t->osd_chan_raw[2] != 1000 + f % 1000)
+        group = "rc";
+    else if (t->wp_dist != (uint16_t)(f * 2))
+        group = "nav";
+    else if (t->osd_curr_consumed_mah != f * 2 || t->osd_curr_A != (int16_t)(f * 3))
+        group = "battery";
+
+    if (group != NULL)
+    {
+        fprintf(stderr, "Fetch %ld: %s group isn't from frame %d\n", fetch, group, expected);
+        return 1;
+    }
+    return 0;
+}
+
+static void *renderer_thread(void *arg)
+{
+    render_stats_t *stats = arg;
+    uint32_t version = 0;
+    int last = -1, flight_f = -1;
+
+    for (;;)
+    {
+        // Last fetch after the parser is done gets the final frame
+        int done = __atomic_load_n(&parser_done, __ATOMIC_ACQUIRE);
+
+        int flight_shown = stats->fetches % 2 == 0;
+
+        osd_telemetry_fetch();
+        decode_mavlink_slots(&osd_telemetry, flight_shown ? ALL_GROUPS : ALL_GROUPS & ~TLM_GROUP_BIT(TLM_FLIGHT));
+        stats->fetches++;
+
+        if (flight_shown)
+        {
+            flight_f = slot_frame(MAVLINK_MSG_ID_GLOBAL_POSITION_INT, MAVLINK_MSG_ID_GLOBAL_POSITION_INT_LEN,
+                                  osd_telemetry.global_position_int_msg.time_us,
+                                  osd_telemetry.global_position_int_msg.payload);
+        }
+
+        int f = slot_frame(MAVLINK_MSG_ID_ATTITUDE, MAVLINK_MSG_ID_ATTITUDE_LEN,
+                           osd_telemetry.attitude_msg.time_us, osd_telemetry.attitude_msg.payload);
+        if (f >= 0 && osd_telemetry.version != version)
+        {
+            if (f < last)
+            {
+                fprintf(stderr, "Fetch %ld: frame %d after %d\n", stats->fetches, f, last);
+                stats->errors++;
+            }
+            else if (f != last)
+            {
+                stats->distinct++;
+            }
+            stats->errors += check_frame(&osd_telemetry, f, flight_f, stats->fetches);
+            last = f;
+            version = osd_telemetry.version;
+        }
+
+        if (done)
+        {
+            if (last != frames - 1)
+            {
+                fprintf(stderr, "Renderer ended at frame %d of %d\n", last, frames);
+                stats->errors++;
+            }
+            break;
+        }
+
+        if (render_us > 0)
+            usleep(render_us);
+    }
+    return NULL;
+}
+
+int main(int argc, char **argv)
+{
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:i:r:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'n':
+            frames = atoi(optarg);
+            break;
+        case 'i':
+            ingest_interval_us = atoi(optarg);
+            break;
+        case 'r':
+            render_us = atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "%s [-n datagrams] [-i ingest_interval_us] [-r render_us]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    // Frame numbers have to fit the flight.c fields they are checked with
+    if (frames < 1 || frames > 30000)
+    {
+        fprintf(stderr, "Datagrams must be 1..30000\n");
+        return 1;
+    }
+
+    ingest_stats_t ingest = { 0, 0, 0 };
+    render_stats_t render = { 0, 0, 0 };
+    pthread_t parser, renderer;
+
+    pthread_create(&renderer, NULL, renderer_thread, &render);
+    pthread_create(&parser, NULL, parser_thread, &ingest);
+    pthread_join(parser, NULL);
+    pthread_join(renderer, NULL);
+
+    printf("telemetry render %6d us: %8.0f datagrams/s, parse+publish %5.2f us avg %7.1f us max, %ld fetches, %ld frames seen, %s\n",
+           render_us, frames * 1e9 / ingest.wall_ns, ingest.busy_ns / 1000.0 / frames, ingest.max_ns / 1000.0,
+           render.fetches, render.distinct, render.errors ? "FAILED" : "ok");
+    return render.errors ? 1 : 0;
+}
@@ -0,0 +1,222 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+
+/*
+ * MAVLink ingest over loopback. A child process sends bursts of datagrams
+ * with sendmmsg(), like wfb-ng forwarding aggregated telemetry, and the
+ * parent drains them the way the DRM main loop does: poll(), then
+ * udp_rx_receive() until the batch isn't full. -1 receives with one recv()
+ * per datagram instead, as before the batched ingest. Prints packets/s,
+ * receive syscalls and receiver CPU time per packet, and datagrams lost.
+ * Unpaced (-i 0) the sender outruns the receiver on purpose; pace it to
+ * compare the per-packet cost at a given rate.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "udprx.h"
+
+int osd_debug = 0;
+
+static uint64_t monotonic_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static uint64_t cpu_ns(void)
+{
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000000000ull +
+           (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) * 1000ull;
+}
+
+static void send_bursts(int port, long packets, int burst, int size, int interval_us)
+{
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = htons(port) };
+    struct mmsghdr msgs[UDP_RX_BATCH];
+    struct iovec iov;
+    uint8_t buf[UDP_RX_SLOT_SIZE];
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+    {
+        perror("sender");
+        _exit(1);
+    }
+
+    memset(buf, 0x55, size);
+    iov.iov_base = buf;
+    iov.iov_len = size;
+    memset(msgs, 0, sizeof(msgs));
+    for (int i = 0; i < burst; i++)
+    {
+        msgs[i].msg_hdr.msg_iov = &iov;
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    while (packets > 0)
+    {
+        int n = packets < burst ? packets : burst;
+        int sent = sendmmsg(fd, msgs, n, 0);
+
+        if (sent < 0)
+        {
+            if (errno == ENOBUFS || errno == EAGAIN) continue;
+            perror("sendmmsg");
+            _exit(1);
+        }
+        packets -= sent;
+        if (interval_us > 0) usleep(interval_us);
+    }
+    _exit(0);
+}
+
+int main(int argc, char **argv)
+{
+    long packets = 1000000;
+    int burst = 8, size = 64, interval_us = 0, port = 14590, single = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:b:s:i:p:r:1")) != -1)
+    {
+        switch (opt)
+        {
+        case 'n':
+            packets = atol(optarg);
+            break;
+        case 'b':
+            burst = atoi(optarg);
+            break;
+        case 's':
+            size = atoi(optarg);
+            break;
+        case 'i':
+            interval_us = atoi(optarg);
+            break;
+        case 'p':
+            port = atoi(optarg);
+            break;
+        case 'r':
+            udp_rx_rcvbuf = atoi(optarg) * 1024;
+            break;
+        case '1':
+            single = 1;
+            break;
+        default:
+            fprintf(stderr, "%s [-n packets] [-b burst] [-s size] [-i burst_interval_us] [-p port] [-r rcvbuf_kb] [-1]\n", argv[0]);
+            fprintf(stderr, "  -1  one recv() per datagram instead of recvmmsg() batches\n");
+            return 1;
+        }
+    }
+
+    if (burst < 1 || burst > UDP_RX_BATCH || size < 1 || size > UDP_RX_SLOT_SIZE)
+    {
+        fprintf(stderr, "Burst must be 1..%d, size 1..%d\n", UDP_RX_BATCH, UDP_RX_SLOT_SIZE);
+        return 1;
+    }
+
+    int fd = udp_rx_open(port);
+    pid_t pid = fork();
+
+    if (pid < 0)
+    {
+        perror("fork");
+        return 1;
+    }
+    if (pid == 0)
+    {
+        close(fd);
+        send_bursts(port, packets, burst, size, interval_us);
+    }
+
+    uint64_t received = 0, syscalls = 0, polls = 0, t0 = 0, t1 = 0;
+    uint64_t cpu0 = cpu_ns();
+    int sender_done = 0;
+    uint8_t buf[UDP_RX_SLOT_SIZE];
+
+    while (received < packets)
+    {
+        struct pollfd pfd = { .fd = fd, .events = POLLIN };
+
+        polls++;
+        if (poll(&pfd, 1, 200) == 0)
+        {
+            // Whatever is still missing was dropped
+            if (sender_done) break;
+            sender_done = waitpid(pid, NULL, WNOHANG) == pid;
+            continue;
+        }
+
+        if (single)
+        {
+            for (;;)
+            {
+                syscalls++;
+                if (recv(fd, buf, sizeof(buf), MSG_DONTWAIT) < 0) break;
+                received++;
+            }
+        }
+        else
+        {
+            int count;
+
+            do
+            {
+                count = udp_rx_receive(fd, MSG_DONTWAIT);
+                if (count > 0) received += count;
+            } while (count == UDP_RX_BATCH);
+            syscalls = udp_rx_stats.syscalls;
+        }
+
+        if (t0 == 0) t0 = monotonic_ns();
+        t1 = monotonic_ns();
+    }
+
+    if (!sender_done) waitpid(pid, NULL, 0);
+
+    uint64_t cpu = cpu_ns() - cpu0;
+    double seconds = (t1 - t0) / 1e9;
+
+    if (received == 0)
+    {
+        fprintf(stderr, "Nothing received\n");
+        return 1;
+    }
+
+    printf("udprx %-8s burst %2d size %4d: %8.0f pkt/s, %.3f recv syscalls/pkt, %.3f polls/pkt, %5.0f ns cpu/pkt, %.1f%% lost\n",
+           single ? "recv" : "recvmmsg", burst, size, seconds > 0 ? received / seconds : 0.0,
+           (double)syscalls / received, (double)polls / received, (double)cpu / received,
+           100.0 * (packets - received) / packets);
+    return 0;
+}
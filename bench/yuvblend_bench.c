@@ -0,0 +1,156 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+
+/*
+ * Cost of blending the OSD into 720p and 1080p NV12 video. OSD frames of
+ * the synthetic flight are converted with yuvblend_update() and blended
+ * into a video frame with yuvblend_apply(), which is the per video frame
+ * cost. -o saves the last OSD frame as raw RGBA for glvideomixer.sh, which
+ * measures the same OSD composited by glvideomixer on llvmpipe.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "headless.h"
+#include "flight.h"
+#include "osdrender.h"
+#include "yuvblend.h"
+
+int osd_debug = 0;
+
+static uint64_t monotonic_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+int main(int argc, char **argv)
+{
+    static const int sizes[][2] = { { 1280, 720 }, { 1920, 1080 } };
+    const char *layout = "dense", *output = NULL;
+    int frames = 200, cruise = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "l:n:g:o:c")) != -1)
+    {
+        switch (opt)
+        {
+        case 'l':
+            layout = optarg;
+            break;
+        case 'n':
+            frames = atoi(optarg);
+            break;
+        case 'g':
+            {
+                int width, height;
+                if (sscanf(optarg, "%dx%d", &width, &height) != 2 || set_graphics_size(width, height) != 0)
+                {
+                    fprintf(stderr, "Unsupported OSD size: %s\n", optarg);
+                    return 1;
+                }
+            }
+            break;
+        case 'o':
+            output = optarg;
+            break;
+        case 'c':
+            cruise = 1;
+            break;
+        default:
+            fprintf(stderr, "%s [-l default|dense|overlap] [-n frames] [-g osd_width x osd_height] [-o osd.rgba] [-c]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if (flight_layout(layout) != 0 || frames <= 0)
+    {
+        fprintf(stderr, "Invalid layout or frame count\n");
+        return 1;
+    }
+
+    osd_init(0, 0, 1, 1);
+
+    int osd_size = GRAPHICS_WIDTH * GRAPHICS_HEIGHT;
+    uint32_t *osd = malloc(osd_size * sizeof(uint32_t));
+    yuvblend_t blend[2];
+    uint8_t *video[2];
+    uint64_t update_ns[2] = { 0 }, apply_ns[2] = { 0 }, occupied[2] = { 0 };
+
+    for (int s = 0; s < 2; s++)
+    {
+        int width = sizes[s][0], height = sizes[s][1];
+
+        video[s] = malloc((size_t)width * height * 3 / 2);
+        if (osd == NULL || video[s] == NULL || yuvblend_init(blend + s, YUVBLEND_NV12, width, height, 0, 0) != 0)
+        {
+            fprintf(stderr, "Out of memory\n");
+            return 1;
+        }
+        memset(video[s], 128, (size_t)width * height * 3 / 2);
+    }
+
+    for (int f = 0; f < frames; f++)
+    {
+        headless_time_ms = f * 33;
+        flight_feed(f, cruise);
+        render();
+        expand_pixels(osd, headless_frame(0), osd_size);
+
+        for (int s = 0; s < 2; s++)
+        {
+            int width = sizes[s][0], height = sizes[s][1];
+            uint8_t *data[3] = { video[s], video[s] + (size_t)width * height, NULL };
+            int stride[3] = { width, width, 0 };
+
+            uint64_t t0 = monotonic_ns();
+            occupied[s] += yuvblend_update(blend + s, (const uint8_t *)osd, GRAPHICS_WIDTH, GRAPHICS_HEIGHT, GRAPHICS_WIDTH * 4);
+            uint64_t t1 = monotonic_ns();
+            yuvblend_apply(blend + s, data, stride);
+            uint64_t t2 = monotonic_ns();
+
+            update_ns[s] += t1 - t0;
+            apply_ns[s] += t2 - t1;
+        }
+    }
+
+    for (int s = 0; s < 2; s++)
+    {
+        printf("yuvblend %s%s osd %dx%d -> %dx%d NV12: update %7.1f us per OSD change, apply %6.1f us per video frame, %4.1f%% tiles\n",
+               layout, cruise ? " cruise" : "", GRAPHICS_WIDTH, GRAPHICS_HEIGHT, sizes[s][0], sizes[s][1],
+               update_ns[s] / 1000.0 / frames, apply_ns[s] / 1000.0 / frames,
+               100.0 * occupied[s] / frames / (blend[s].tiles_x * blend[s].tiles_y));
+    }
+
+    if (output != NULL)
+    {
+        FILE *fp = fopen(output, "wb");
+
+        if (fp == NULL || fwrite(osd, sizeof(uint32_t), osd_size, fp) != osd_size || fclose(fp) != 0)
+        {
+            perror(output);
+            return 1;
+        }
+        printf("OSD frame saved to %s (%dx%d RGBA)\n", output, GRAPHICS_WIDTH, GRAPHICS_HEIGHT);
+    }
+    return 0;
+}
@@ -0,0 +1,210 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+
+/*
+ * SIMD yuvblend against its scalar build (yuvblend_scalar.c). blend_row()
+ * is checked on random runs with transparent, opaque and partial alpha
+ * vectors, and against the exact formula. Whole frames go through
+ * yuvblend_update() and yuvblend_apply() for both video formats, both
+ * matrices and ranges, 720p, 1080p and an odd size, and must come out
+ * byte for byte the same. Build with CROSS= and RUN= to check the NEON
+ * kernel on ARM or under qemu.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "yuvblend.c"
+
+int scalar_yuvblend_init(yuvblend_t *b, yuvblend_format_t format, int width, int height, int bt709, int full_range);
+void scalar_yuvblend_free(yuvblend_t *b);
+int scalar_yuvblend_update(yuvblend_t *b, const uint8_t *osd, int osd_width, int osd_height, int osd_stride);
+void scalar_yuvblend_apply(const yuvblend_t *b, uint8_t *const data[], const int stride[]);
+void scalar_blend_row(uint8_t *dst, const uint8_t *val, const uint8_t *alpha, int count);
+
+#define OSD_WIDTH  1280
+#define OSD_HEIGHT 720
+#define MAX_RUN    200
+
+static int failed = 0;
+
+static void fail(const char *fmt, const char *what, int a, int b)
+{
+    if (failed++ < 10)
+    {
+        fprintf(stderr, "yuvblend_check: ");
+        fprintf(stderr, fmt, what, a, b);
+        fprintf(stderr, "\n");
+    }
+}
+
+// Alpha vectors are all transparent, all opaque or mixed, like OSD edges
+static uint8_t random_alpha(int run_kind)
+{
+    switch (run_kind)
+    {
+    case 0:
+        return 0;
+    case 1:
+        return 255;
+    default:
+        return rand() % 4 == 0 ? 0 : rand() % 4 == 0 ? 255 : rand();
+    }
+}
+
+static void check_blend_row(int rounds)
+{
+    uint8_t dst[MAX_RUN + 32], ref[MAX_RUN + 32], val[MAX_RUN + 32], alpha[MAX_RUN + 32];
+
+    for (int round = 0; round < rounds; round++)
+    {
+        int offset = round % 16;
+
+        for (int i = 0; i < sizeof(dst); i++)
+        {
+            dst[i] = ref[i] = rand();
+            val[i] = rand();
+            alpha[i] = random_alpha((i / 16 + round) % 3);
+        }
+
+        for (int count = 0; count <= MAX_RUN; count++)
+        {
+            uint8_t expect[MAX_RUN + 32];
+
+            memcpy(dst, ref, sizeof(dst));
+            memcpy(expect, ref, sizeof(expect));
+            blend_row(dst + offset, val + offset, alpha + offset, count);
+            scalar_blend_row(expect + offset, val + offset, alpha + offset, count);
+
+            if (memcmp(dst, expect, sizeof(dst)) != 0)
+            {
+                fail("%s differs from scalar, %d samples at +%d", "blend_row", count, offset);
+            }
+
+            for (int i = 0; i < count; i++)
+            {
+                uint8_t d = ref[offset + i], v = val[offset + i], a = alpha[offset + i];
+                int exact = (d * (255 - a) + v * a + 127) / 255;
+
+                if (expect[offset + i] != exact)
+                {
+                    fail("%s rounding differs from exact at %d, count %d", "blend_pixel", i, count);
+                    break;
+                }
+            }
+        }
+    }
+}
+
+// Sparse OSD: transparent frame with a few opaque and translucent boxes
+static void random_osd(uint8_t *osd)
+{
+    memset(osd, 0, OSD_WIDTH * OSD_HEIGHT * 4);
+
+    for (int n = 0; n < 30; n++)
+    {
+        int w = 1 + rand() % 200, h = 1 + rand() % 60;
+        int x0 = rand() % (OSD_WIDTH - w), y0 = rand() % (OSD_HEIGHT - h);
+        uint8_t color[4] = { rand(), rand(), rand(), n % 3 ? 255 : rand() };
+
+        for (int y = y0; y < y0 + h; y++)
+        {
+            for (int x = x0; x < x0 + w; x++)
+            {
+                memcpy(osd + (y * OSD_WIDTH + x) * 4, color, 4);
+            }
+        }
+    }
+}
+
+static void check_frames(int rounds)
+{
+    static const int sizes[][2] = { { 1280, 720 }, { 1920, 1080 }, { 321, 243 } };
+    uint8_t *osd = malloc(OSD_WIDTH * OSD_HEIGHT * 4);
+
+    for (int round = 0; round < rounds; round++)
+    {
+        random_osd(osd);
+
+        for (int s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+        {
+            for (int mode = 0; mode < 8; mode++)
+            {
+                yuvblend_format_t format = mode & 1 ? YUVBLEND_I420 : YUVBLEND_NV12;
+                int width = sizes[s][0], height = sizes[s][1], cw = (width + 1) / 2, ch = (height + 1) / 2;
+                yuvblend_t simd, scalar;
+
+                if (yuvblend_init(&simd, format, width, height, mode & 2, mode & 4) != 0 ||
+                    scalar_yuvblend_init(&scalar, format, width, height, mode & 2, mode & 4) != 0)
+                {
+                    fprintf(stderr, "yuvblend_check: out of memory\n");
+                    exit(1);
+                }
+
+                // Strides with padding, like decoder buffers
+                int stride[3] = { width + 64, format == YUVBLEND_NV12 ? cw * 2 + 64 : cw + 32, cw + 32 };
+                size_t size = (size_t)stride[0] * height + (size_t)stride[1] * ch + (size_t)stride[2] * ch;
+                uint8_t *frame = malloc(size), *expect = malloc(size);
+
+                for (size_t i = 0; i < size; i++) frame[i] = rand();
+                memcpy(expect, frame, size);
+
+                uint8_t *data[3] = { frame, frame + (size_t)stride[0] * height, frame + (size_t)stride[0] * height + (size_t)stride[1] * ch };
+                uint8_t *ref[3] = { expect, expect + (size_t)stride[0] * height, expect + (size_t)stride[0] * height + (size_t)stride[1] * ch };
+
+                int occupied = yuvblend_update(&simd, osd, OSD_WIDTH, OSD_HEIGHT, OSD_WIDTH * 4);
+                if (occupied != scalar_yuvblend_update(&scalar, osd, OSD_WIDTH, OSD_HEIGHT, OSD_WIDTH * 4))
+                {
+                    fail("%s occupied tiles differ at %dx%d", "yuvblend_update", width, height);
+                }
+                yuvblend_apply(&simd, data, stride);
+                scalar_yuvblend_apply(&scalar, ref, stride);
+
+                if (memcmp(frame, expect, size) != 0)
+                {
+                    fail(format == YUVBLEND_NV12 ? "%s NV12 frame differs from scalar at %dx%d" : "%s I420 frame differs from scalar at %dx%d",
+                         "yuvblend_apply", width, height);
+                }
+
+                free(frame);
+                free(expect);
+                yuvblend_free(&simd);
+                scalar_yuvblend_free(&scalar);
+            }
+        }
+    }
+    free(osd);
+}
+
+int main(int argc, char **argv)
+{
+    int rounds = argc > 1 ? atoi(argv[1]) : 4;
+
+    srand(1);
+    check_blend_row(rounds * 10);
+    check_frames(rounds);
+
+    if (failed)
+    {
+        fprintf(stderr, "yuvblend_check: %d checks failed\n", failed);
+        return 1;
+    }
+
+    printf("yuvblend_check: %d rounds match the scalar build\n", rounds);
+    return 0;
+}
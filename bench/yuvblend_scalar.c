@@ -0,0 +1,21 @@
+/*
+ * yuvblend.c built without its SIMD kernels, the reference of
+ * yuvblend_check. Public functions get a scalar_ prefix so both builds
+ * link into one program.
+ */
+
+#undef __AVX2__
+#undef __SSE2__
+#undef __ARM_NEON
+
+#define yuvblend_init scalar_yuvblend_init
+#define yuvblend_free scalar_yuvblend_free
+#define yuvblend_update scalar_yuvblend_update
+#define yuvblend_apply scalar_yuvblend_apply
+
+#include "yuvblend.c"
+
+void scalar_blend_row(uint8_t *dst, const uint8_t *val, const uint8_t *alpha, int count)
+{
+    blend_row(dst, val, alpha, count);
+}
@@ -0,0 +1,305 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/*
+ * Display list: graphengine primitives called while recording are stored
+ * in a compact command buffer together with their bounding boxes and
+ * rasterized later by dl_execute(). This splits deciding what to draw
+ * from drawing it, so identical frames can be detected and commands
+ * culled or replayed into other targets.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "displaylist.h"
+#include "math3d.h"
+
+// Command header, followed by int32 args and extra bytes padded to 4
+typedef struct {
+    uint8_t op;
+    uint8_t nargs;
+    uint16_t extra_len;
+    int16_t x0, y0, x1, y1;             // bounding box, inclusive
+} dl_cmd_t;
+
+osd_dl_t *dl_current = NULL;
+
+static inline int16_t clamp16(int v)
+{
+    return v < INT16_MIN ? INT16_MIN : v > INT16_MAX ? INT16_MAX : v;
+}
+
+static inline size_t pad4(size_t len)
+{
+    return (len + 3) & ~(size_t)3;
+}
+
+void dl_record_begin(osd_dl_t *dl)
+{
+    dl->size = 0;
+    dl->count = 0;
+    dl_current = dl;
+}
+
+void dl_record_end(void)
+{
+    dl_current = NULL;
+}
+
+/**
+ * dl_append: add command to the recording display list.
+ *
+ * @param       op              command
+ * @param       x0, y0, x1, y1  bounding box corners (inclusive, any order)
+ * @param       args            integer arguments
+ * @param       nargs           number of arguments
+ * @param       extra           extra payload (string, pointer)
+ * @param       extra_len       payload length
+ */
+void dl_append(dl_op_t op, int x0, int y0, int x1, int y1, const int32_t *args, int nargs, const void *extra, size_t extra_len)
+{
+    osd_dl_t *dl = dl_current;
+    size_t len = sizeof(dl_cmd_t) + nargs * sizeof(int32_t) + pad4(extra_len);
+
+    if (dl->size + len > dl->capacity)
+    {
+        size_t capacity = dl->capacity ? dl->capacity : 4096;
+        while (capacity < dl->size + len) capacity *= 2;
+
+        uint8_t *data = realloc(dl->data, capacity);
+        if (data == NULL)
+        {
+            fprintf(stderr, "Unable to grow display list\n");
+            exit(1);
+        }
+        dl->data = data;
+        dl->capacity = capacity;
+    }
+
+    dl_cmd_t *cmd = (dl_cmd_t *)(dl->data + dl->size);
+    cmd->op = op;
+    cmd->nargs = nargs;
+    cmd->extra_len = extra_len;
+    cmd->x0 = clamp16(MIN(x0, x1));
+    cmd->y0 = clamp16(MIN(y0, y1));
+    cmd->x1 = clamp16(MAX(x0, x1));
+    cmd->y1 = clamp16(MAX(y0, y1));
+
+    uint8_t *p = (uint8_t *)(cmd + 1);
+    memcpy(p, args, nargs * sizeof(int32_t));
+    p += nargs * sizeof(int32_t);
+
+    if (extra_len > 0)
+    {
+        memcpy(p, extra, extra_len);
+        // Keep padding deterministic for dl_equal
+        memset(p + extra_len, 0, pad4(extra_len) - extra_len);
+    }
+
+    dl->size += len;
+    dl->count++;
+}
+
+static inline size_t cmd_size(const dl_cmd_t *cmd)
+{
+    return sizeof(dl_cmd_t) + cmd->nargs * sizeof(int32_t) + pad4(cmd->extra_len);
+}
+
+static void execute_cmd(const dl_cmd_t *cmd)
+{
+    const int32_t *a = (const int32_t *)(cmd + 1);
+    const void *extra = a + cmd->nargs;
+
+    switch ((dl_op_t)cmd->op)
+    {
+    case DL_PIXEL:
+        write_pixel_lm(a[0], a[1], a[2], a[3]);
+        break;
+
+    case DL_HLINE:
+        write_hline_lm(a[0], a[1], a[2], a[3], a[4]);
+        break;
+
+    case DL_HLINE_OUTLINED:
+        write_hline_outlined(a[0], a[1], a[2], a[3], a[4], a[5], a[6], a[7]);
+        break;
+
+    case DL_VLINE:
+        write_vline_lm(a[0], a[1], a[2], a[3], a[4]);
+        break;
+
+    case DL_VLINE_OUTLINED:
+        write_vline_outlined(a[0], a[1], a[2], a[3], a[4], a[5], a[6], a[7]);
+        break;
+
+    case DL_FILLED_RECTANGLE:
+        write_filled_rectangle_lm(a[0], a[1], a[2], a[3], a[4], a[5]);
+        break;
+
+    case DL_RECTANGLE_OUTLINED:
+        write_rectangle_outlined(a[0], a[1], a[2], a[3], a[4], a[5]);
+        break;
+
+    case DL_CIRCLE_OUTLINED:
+        write_circle_outlined(a[0], a[1], a[2], a[3], a[4], a[5], a[6], a[7]);
+        break;
+
+    case DL_LINE:
+        write_line_lm(a[0], a[1], a[2], a[3], a[4], a[5]);
+        break;
+
+    case DL_LINE_OUTLINED:
+        write_line_outlined(a[0], a[1], a[2], a[3], a[4], a[5], a[6], a[7]);
+        break;
+
+    case DL_LINE_OUTLINED_DASHED:
+        write_line_outlined_dashed(a[0], a[1], a[2], a[3], a[4], a[5], a[6], a[7], a[8]);
+        break;
+
+    case DL_CHAR:
+        write_char(a[0], a[1], a[2], a[3], a[4], a[5]);
+        break;
+
+    case DL_CHAR16:
+        write_char16(a[0], a[1], a[2], a[3], a[4]);
+        break;
+
+    case DL_STRING:
+        write_color_string((char *)extra, a[0], a[1], a[2], a[3], a[4], a[5], a[6], a[7], a[8]);
+        break;
+
+    case DL_LAYER:
+        {
+            osd_layer_t layer;
+            memcpy(&layer.sprite.pixels, extra, sizeof(layer.sprite.pixels));
+            layer.x = a[0];
+            layer.y = a[1];
+            layer.sprite.width = a[2];
+            layer.sprite.height = a[3];
+            layer.key = a[5];
+            layer_draw(&layer);
+        }
+        break;
+
+    default:
+        fprintf(stderr, "Invalid display list command %d\n", cmd->op);
+        abort();
+    }
+}
+
+/**
+ * dl_execute: rasterize display list into the current draw buffer.
+ *
+ * @param       dl      display list
+ * @param       clip    skip commands outside of this rect, NULL = screen
+ */
+void dl_execute(const osd_dl_t *dl, const osd_rect_t *clip)
+{
+    const osd_rect_t screen = { GRAPHICS_LEFT, GRAPHICS_TOP, GRAPHICS_RIGHT, GRAPHICS_BOTTOM };
+    const uint8_t *p = dl->data, *end = dl->data + dl->size;
+
+    if (clip == NULL) clip = &screen;
+
+    while (p < end)
+    {
+        const dl_cmd_t *cmd = (const dl_cmd_t *)p;
+        p += cmd_size(cmd);
+
+        if (cmd->x1 < clip->x0 || cmd->x0 > clip->x1 || cmd->y1 < clip->y0 || cmd->y0 > clip->y1)
+            continue;
+
+        execute_cmd(cmd);
+    }
+}
+
+/**
+ * dl_bin: sort commands into tile bins by bounding box. Every bin keeps
+ * the recording order, so tiles can be rasterized independently.
+ *
+ * @param       dl      display list
+ * @param       bins    cols * rows bins, row-major
+ * @param       cols    number of tile columns
+ * @param       rows    number of tile rows
+ * @param       tile_w  tile width
+ * @param       tile_h  tile height
+ */
+void dl_bin(const osd_dl_t *dl, dl_bin_t *bins, int cols, int rows, int tile_w, int tile_h)
+{
+    const uint8_t *p = dl->data, *end = dl->data + dl->size;
+
+    for (int i = 0; i < cols * rows; i++) bins[i].count = 0;
+
+    while (p < end)
+    {
+        const dl_cmd_t *cmd = (const dl_cmd_t *)p;
+        uint32_t offset = p - dl->data;
+        p += cmd_size(cmd);
+
+        if (cmd->x1 < GRAPHICS_LEFT || cmd->x0 > GRAPHICS_RIGHT || cmd->y1 < GRAPHICS_TOP || cmd->y0 > GRAPHICS_BOTTOM)
+            continue;
+
+        int tx0 = MAX(cmd->x0, GRAPHICS_LEFT) / tile_w, tx1 = MIN(cmd->x1, GRAPHICS_RIGHT) / tile_w;
+        int ty0 = MAX(cmd->y0, GRAPHICS_TOP) / tile_h, ty1 = MIN(cmd->y1, GRAPHICS_BOTTOM) / tile_h;
+
+        for (int ty = ty0; ty <= ty1 && ty < rows; ty++)
+        {
+            for (int tx = tx0; tx <= tx1 && tx < cols; tx++)
+            {
+                dl_bin_t *bin = bins + ty * cols + tx;
+
+                if (bin->count == bin->capacity)
+                {
+                    int capacity = bin->capacity ? bin->capacity * 2 : 64;
+                    uint32_t *cmds = realloc(bin->cmds, capacity * sizeof(uint32_t));
+                    if (cmds == NULL)
+                    {
+                        fprintf(stderr, "Unable to grow tile bin\n");
+                        exit(1);
+                    }
+                    bin->cmds = cmds;
+                    bin->capacity = capacity;
+                }
+                bin->cmds[bin->count++] = offset;
+            }
+        }
+    }
+}
+
+/**
+ * dl_execute_bin: rasterize commands of one tile bin.
+ *
+ * @param       dl      display list the bin was built from
+ * @param       bin     tile bin
+ */
+void dl_execute_bin(const osd_dl_t *dl, const dl_bin_t *bin)
+{
+    for (int i = 0; i < bin->count; i++)
+    {
+        execute_cmd((const dl_cmd_t *)(dl->data + bin->cmds[i]));
+    }
+}
+
+/**
+ * dl_equal: compare two recorded frames.
+ *
+ * @return      1 if both lists will produce the same pixels
+ */
+int dl_equal(const osd_dl_t *a, const osd_dl_t *b)
+{
+    return a->size == b->size && a->count == b->count && memcmp(a->data, b->data, a->size) == 0;
+}
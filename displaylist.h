@@ -0,0 +1,60 @@
+#ifndef __DISPLAYLIST_H
+#define __DISPLAYLIST_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "graphengine.h"
+
+// Recorded drawing commands. Buffer memory is kept between frames,
+// so recording doesn't allocate once the buffer has grown to frame size.
+typedef struct {
+    uint8_t *data;
+    size_t size;                        // used bytes
+    size_t capacity;                    // allocated bytes
+    int count;                          // number of commands
+} osd_dl_t;
+
+// Offsets of the commands touching one tile
+typedef struct {
+    uint32_t *cmds;
+    int count;
+    int capacity;
+} dl_bin_t;
+
+typedef enum {
+    DL_PIXEL = 1,
+    DL_HLINE,
+    DL_HLINE_OUTLINED,
+    DL_VLINE,
+    DL_VLINE_OUTLINED,
+    DL_FILLED_RECTANGLE,
+    DL_RECTANGLE_OUTLINED,
+    DL_CIRCLE_OUTLINED,
+    DL_LINE,
+    DL_LINE_OUTLINED,
+    DL_LINE_OUTLINED_DASHED,
+    DL_CHAR,
+    DL_CHAR16,
+    DL_STRING,
+    DL_LAYER,
+} dl_op_t;
+
+extern osd_dl_t *dl_current;            // recording target, NULL = draw immediately
+
+void dl_record_begin(osd_dl_t *dl);
+void dl_record_end(void);
+void dl_append(dl_op_t op, int x0, int y0, int x1, int y1, const int32_t *args, int nargs, const void *extra, size_t extra_len);
+void dl_execute(const osd_dl_t *dl, const osd_rect_t *clip);
+int dl_equal(const osd_dl_t *a, const osd_dl_t *b);
+void dl_bin(const osd_dl_t *dl, dl_bin_t *bins, int cols, int rows, int tile_w, int tile_h);
+void dl_execute_bin(const osd_dl_t *dl, const dl_bin_t *bin);
+
+// Record primitive with its bounding box instead of drawing it when the display list is active
+#define DL_RECORD(op, x0, y0, x1, y1, ...)                              \
+    if (dl_current != NULL) {                                           \
+        const int32_t _dl_args[] = { __VA_ARGS__ };                     \
+        dl_append(op, x0, y0, x1, y1, _dl_args, SIZEOF_ARRAY(_dl_args), NULL, 0); \
+        return;                                                         \
+    }
+
+#endif //__DISPLAYLIST_H
@@ -60,6 +60,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <sys/mman.h>
 #include <time.h>
 #include <unistd.h>
@@ -68,6 +69,8 @@
 #include <drm_fourcc.h>
 
 #include "graphengine.h"
+#include "drm_output.h"
+#include "pixconv.h"
 
 #define FB_WIDTH  GRAPHICS_WIDTH
 #define FB_HEIGHT GRAPHICS_HEIGHT
@@ -85,7 +88,28 @@ struct drm_object {
     uint32_t id;
 };
 
+/*
+ * Scanout formats keeping per-pixel transparency, cheapest first. OSD pixels
+ * are either transparent or opaque, so 1 bit of alpha is enough. Formats
+ * without alpha (C8, RGB565, NV12) would hide the video plane underneath,
+ * and a C8 palette would go to the CRTC gamma LUT shared with the video.
+ */
+struct plane_format {
+    uint32_t fourcc;
+    uint32_t bpp;
+    const char *name;
+    pixconv_func_t convert;
+};
+
+static const struct plane_format plane_formats[] = {
+    { DRM_FORMAT_ARGB1555, 16, "argb1555", pixconv_argb1555 },
+    { DRM_FORMAT_ARGB4444, 16, "argb4444", pixconv_argb4444 },
+    { DRM_FORMAT_ABGR8888, 32, "abgr8888", pixconv_abgr8888 },
+    { DRM_FORMAT_ARGB8888, 32, "argb8888", pixconv_argb8888 },
+};
+
 struct modeset_buf {
+    const struct plane_format *format;
     uint32_t width;
     uint32_t height;
     uint32_t stride;
@@ -93,24 +117,83 @@ struct modeset_buf {
     uint32_t handle;
     uint8_t *map;
     uint32_t fb;
+    osd_damage_t damage;  // regions drawn into this buffer last time it was used
 };
 
-struct modeset_output {
-    struct modeset_output *next;
+/*
+ * Front and back framebuffers. Outputs with the same scanout format and
+ * refresh rate share one set: a frame is converted once and all of them
+ * flip to it in the same atomic commit.
+ */
+
+struct modeset_fbset {
+    struct modeset_fbset *next;
 
     unsigned int front_buf;
     struct modeset_buf bufs[2];
 
+    unsigned int users;
+    unsigned int layer;         // screen layer shown by the planes
+    uint64_t frame_ns;          // refresh period of the outputs
+    bool queued;                // back buffer goes to the next commit
+    uint32_t damage_blob;       // FB_DAMAGE_CLIPS of the queued frame, 0 = whole plane
+};
+
+/*
+ * Plane showing one screen layer. The dynamic layer is on the primary plane,
+ * the static one (if enabled) on an overlay plane right below it.
+ */
+
+struct modeset_plane {
+    struct drm_object obj;
+    struct modeset_fbset *fbs;
+
+    /* plane properties changed by page flips, resolved once at setup */
+    struct {
+        uint32_t fb_id;
+        uint32_t fb_damage_clips;   // 0 if the driver doesn't support it
+    } prop;
+};
+
+struct modeset_output {
+    struct modeset_output *next;
+
     struct drm_object connector;
     struct drm_object crtc;
-    struct drm_object plane;
+    struct modeset_plane planes[OSD_SCREEN_LAYERS];
+    unsigned int plane_count;
 
     drmModeModeInfo mode;
     uint32_t mode_blob_id;
     uint32_t crtc_index;
+
+    bool flip_pending;          // committed buffer isn't on screen yet
+    uint64_t vblank_ns;         // time of the last completed flip
+    uint64_t frame_ns;          // refresh period of the mode
+    uint64_t target_ns;         // vblank the pending flip was rendered for
 };
 
 static struct modeset_output *output_list = NULL;
+static struct modeset_fbset *fbset_list = NULL;
+
+/* page flip request, reused for every frame */
+static drmModeAtomicReq *flip_req = NULL;
+static uint64_t commit_prep_ns;         // building of flip requests since the last report
+static unsigned int commits;
+static uint64_t damage_pixels;          // changed pixels of flipped frames since the last report
+static unsigned int damage_frames;
+
+const char *drm_card = "/dev/dri/card0";
+const char *drm_format = NULL;
+const char *drm_static_plane = NULL;
+drm_render_mode_t drm_render_mode = DRM_RENDER_AUTO;
+
+static uint64_t get_time_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
 
 /*
  * modeset_open() changes just a little bit. We now have to set that we're going
@@ -240,18 +323,21 @@ static void modeset_get_object_properties(int fd, struct drm_object *obj,
  * CRTC, plane or connector object.
  */
 
-static int set_drm_object_property(drmModeAtomicReq *req, struct drm_object *obj,
-				   const char *name, uint64_t value)
+static uint32_t get_drm_object_property_id(struct drm_object *obj, const char *name)
 {
     int i;
-    uint32_t prop_id = 0;
 
     for (i = 0; i < obj->props->count_props; i++) {
-        if (!strcmp(obj->props_info[i]->name, name)) {
-            prop_id = obj->props_info[i]->prop_id;
-            break;
-        }
+        if (!strcmp(obj->props_info[i]->name, name))
+            return obj->props_info[i]->prop_id;
     }
+    return 0;
+}
+
+static int set_drm_object_property(drmModeAtomicReq *req, struct drm_object *obj,
+				   const char *name, uint64_t value)
+{
+    uint32_t prop_id = get_drm_object_property_id(obj, name);
 
     if (prop_id == 0) {
         fprintf(stderr, "no object property: %s\n", name);
@@ -409,7 +495,7 @@ static int modeset_find_plane(int fd, struct modeset_output *out)
              */
             if (get_property_value(fd, props, "type") == DRM_PLANE_TYPE_PRIMARY) {
                 found_primary = true;
-                out->plane.id = plane_id;
+                out->planes[0].obj.id = plane_id;
                 ret = 0;
             }
 
@@ -422,7 +508,7 @@ static int modeset_find_plane(int fd, struct modeset_output *out)
     drmModeFreePlaneResources(plane_res);
 
     if (found_primary)
-        fprintf(stdout, "found primary plane, id: %d\n", out->plane.id);
+        fprintf(stdout, "found primary plane, id: %d\n", out->planes[0].obj.id);
     else
         fprintf(stdout, "couldn't find a primary plane\n");
     return ret;
@@ -441,6 +527,30 @@ static void modeset_drm_object_fini(struct drm_object *obj)
     drmModeFreeObjectProperties(obj->props);
 }
 
+/*
+ * modeset_setup_plane() retrieves the properties of a plane and resolves
+ * the ids of the ones changed by page flips.
+ */
+
+static int modeset_setup_plane(int fd, struct modeset_plane *plane)
+{
+    modeset_get_object_properties(fd, &plane->obj, DRM_MODE_OBJECT_PLANE);
+    if (!plane->obj.props)
+        return -ENOMEM;
+
+    /* page flips only change these, don't look them up by name every frame */
+    plane->prop.fb_id = get_drm_object_property_id(&plane->obj, "FB_ID");
+    plane->prop.fb_damage_clips = get_drm_object_property_id(&plane->obj, "FB_DAMAGE_CLIPS");
+    if (plane->prop.fb_id == 0) {
+        fprintf(stderr, "plane %u has no FB_ID property\n", plane->obj.id);
+        modeset_drm_object_fini(&plane->obj);
+        plane->obj.props = NULL;
+        return -ENOMEM;
+    }
+
+    return 0;
+}
+
 /*
  * modeset_setup_objects() is a new function. It helps us to retrieve
  * connector, CRTC and plane objects properties from the device. These
@@ -452,7 +562,6 @@ static int modeset_setup_objects(int fd, struct modeset_output *out)
 {
     struct drm_object *connector = &out->connector;
     struct drm_object *crtc = &out->crtc;
-    struct drm_object *plane = &out->plane;
 
     /* retrieve connector properties from the device */
     modeset_get_object_properties(fd, connector, DRM_MODE_OBJECT_CONNECTOR);
@@ -465,9 +574,9 @@ static int modeset_setup_objects(int fd, struct modeset_output *out)
         goto out_crtc;
 
     /* retrieve plane properties from the device */
-    modeset_get_object_properties(fd, plane, DRM_MODE_OBJECT_PLANE);
-    if (!plane->props)
+    if (modeset_setup_plane(fd, &out->planes[0]) < 0)
         goto out_plane;
+    out->plane_count = 1;
 
     return 0;
 
@@ -488,14 +597,16 @@ static void modeset_destroy_objects(int fd, struct modeset_output *out)
 {
     modeset_drm_object_fini(&out->connector);
     modeset_drm_object_fini(&out->crtc);
-    modeset_drm_object_fini(&out->plane);
+    for (unsigned int i = 0; i < out->plane_count; i++)
+        modeset_drm_object_fini(&out->planes[i].obj);
 }
 
 /*
  * modeset_create_fb() stays the same.
  */
 
-static int modeset_create_fb(int fd, struct modeset_buf *buf)
+static int modeset_create_fb(int fd, struct modeset_buf *buf,
+                             const struct plane_format *format)
 {
     struct drm_mode_create_dumb creq;
     struct drm_mode_destroy_dumb dreq;
@@ -507,13 +618,14 @@ static int modeset_create_fb(int fd, struct modeset_buf *buf)
     memset(&creq, 0, sizeof(creq));
     creq.width = buf->width;
     creq.height = buf->height;
-    creq.bpp = 32;
+    creq.bpp = format->bpp;
     ret = drmIoctl(fd, DRM_IOCTL_MODE_CREATE_DUMB, &creq);
     if (ret < 0) {
         fprintf(stderr, "cannot create dumb buffer (%d): %m\n",
                 errno);
         return -errno;
     }
+    buf->format = format;
     buf->stride = creq.pitch;
     buf->size = creq.size;
     buf->handle = creq.handle;
@@ -521,7 +633,7 @@ static int modeset_create_fb(int fd, struct modeset_buf *buf)
     /* create framebuffer object for the dumb-buffer */
     handles[0] = buf->handle;
     pitches[0] = buf->stride;
-    ret = drmModeAddFB2(fd, buf->width, buf->height, DRM_FORMAT_ABGR8888,
+    ret = drmModeAddFB2(fd, buf->width, buf->height, format->fourcc,
                         handles, pitches, offsets, &buf->fb, 0);
     if (ret) {
         fprintf(stderr, "cannot create framebuffer (%d): %m\n",
@@ -586,37 +698,80 @@ static void modeset_destroy_fb(int fd, struct modeset_buf *buf)
 }
 
 /*
- * modeset_setup_framebuffers() creates framebuffers for the back and front
- * buffers of a certain output. Also, it copies the connector mode to these
- * buffers.
+ * modeset_setup_framebuffers() attaches front and back framebuffers to the
+ * plane of a screen layer. A set already used by another output for the same
+ * layer is shared if the format matches and both refresh at the same rate
+ * (within 0.1%), otherwise they couldn't flip in lockstep.
  */
 
 static int modeset_setup_framebuffers(int fd,
-				      struct modeset_output *out)
+				      struct modeset_output *out,
+				      unsigned int layer,
+				      const struct plane_format *format)
 {
+    struct modeset_fbset *fbs;
     int i, ret;
 
+    for (fbs = fbset_list; fbs; fbs = fbs->next) {
+        uint64_t diff = fbs->frame_ns > out->frame_ns ? fbs->frame_ns - out->frame_ns : out->frame_ns - fbs->frame_ns;
+
+        if (fbs->layer == layer && fbs->bufs[0].format == format && diff * 1000 <= out->frame_ns) {
+            fbs->users++;
+            out->planes[layer].fbs = fbs;
+            fprintf(stderr, "connector %u shares framebuffers with another output\n", out->connector.id);
+            return 0;
+        }
+    }
+
+    fbs = calloc(1, sizeof(*fbs));
+    if (!fbs)
+        return -ENOMEM;
+
     /* setup the front and back framebuffers */
     for (i = 0; i < 2; i++) {
 
         /* copy mode info to buffer */
-        out->bufs[i].width = FB_WIDTH;
-        out->bufs[i].height = FB_HEIGHT;
+        fbs->bufs[i].width = FB_WIDTH;
+        fbs->bufs[i].height = FB_HEIGHT;
 
         /* create a framebuffer for the buffer */
-        ret = modeset_create_fb(fd, &out->bufs[i]);
+        ret = modeset_create_fb(fd, &fbs->bufs[i], format);
         if (ret) {
             /* the second framebuffer creation failed, so
              * we have to destroy the first before returning */
             if (i == 1)
-                modeset_destroy_fb(fd, &out->bufs[0]);
+                modeset_destroy_fb(fd, &fbs->bufs[0]);
+            free(fbs);
             return ret;
         }
     }
 
+    fbs->users = 1;
+    fbs->layer = layer;
+    fbs->frame_ns = out->frame_ns;
+    fbs->next = fbset_list;
+    fbset_list = fbs;
+    out->planes[layer].fbs = fbs;
     return 0;
 }
 
+static void modeset_release_framebuffers(int fd, struct modeset_plane *plane)
+{
+    struct modeset_fbset *fbs = plane->fbs, **p;
+
+    plane->fbs = NULL;
+    if (--fbs->users > 0)
+        return;
+
+    for (p = &fbset_list; *p != fbs; p = &(*p)->next)
+        ;
+    *p = fbs->next;
+
+    modeset_destroy_fb(fd, &fbs->bufs[0]);
+    modeset_destroy_fb(fd, &fbs->bufs[1]);
+    free(fbs);
+}
+
 /*
  * modeset_output_destroy() is new. It destroys the objects (connector, crtc and
  * plane), front and back buffers, the mode blob property and then destroys the
@@ -625,19 +780,86 @@ static int modeset_setup_framebuffers(int fd,
 
 static void modeset_output_destroy(int fd, struct modeset_output *out)
 {
+    /* destroy front/back framebuffers unless another output still uses them */
+    for (unsigned int i = 0; i < out->plane_count; i++) {
+        if (out->planes[i].fbs)
+            modeset_release_framebuffers(fd, &out->planes[i]);
+    }
+
     /* destroy connector, crtc and plane objects */
     modeset_destroy_objects(fd, out);
 
-    /* destroy front/back framebuffers */
-    modeset_destroy_fb(fd, &out->bufs[0]);
-    modeset_destroy_fb(fd, &out->bufs[1]);
-
     /* destroy mode blob property */
     drmModeDestroyPropertyBlob(fd, out->mode_blob_id);
 
     free(out);
 }
 
+/*
+ * plane_supports_format() checks whether the plane can scan out a linear
+ * buffer in the given format. IN_FORMATS lists format+modifier pairs, older
+ * kernels only report plain formats, which are linear then.
+ */
+
+static bool plane_supports_format(int fd, struct drm_object *obj, uint32_t fourcc)
+{
+    int64_t blob_id = get_property_value(fd, obj->props, "IN_FORMATS");
+    bool found = false;
+
+    if (blob_id > 0) {
+        drmModePropertyBlobPtr blob = drmModeGetPropertyBlob(fd, blob_id);
+
+        if (blob) {
+            const struct drm_format_modifier_blob *hdr = blob->data;
+            const uint32_t *formats = (const uint32_t *)((const uint8_t *)hdr + hdr->formats_offset);
+            const struct drm_format_modifier *mods =
+                (const struct drm_format_modifier *)((const uint8_t *)hdr + hdr->modifiers_offset);
+
+            for (uint32_t i = 0; i < hdr->count_formats && !found; i++) {
+                if (formats[i] != fourcc)
+                    continue;
+
+                for (uint32_t j = 0; j < hdr->count_modifiers && !found; j++) {
+                    found = mods[j].modifier == DRM_FORMAT_MOD_LINEAR &&
+                            i >= mods[j].offset && i < mods[j].offset + 64 &&
+                            (mods[j].formats >> (i - mods[j].offset)) & 1;
+                }
+            }
+            drmModeFreePropertyBlob(blob);
+            return found;
+        }
+    }
+
+    drmModePlanePtr plane = drmModeGetPlane(fd, obj->id);
+    if (!plane)
+        return false;
+
+    for (uint32_t i = 0; i < plane->count_formats && !found; i++)
+        found = plane->formats[i] == fourcc;
+
+    drmModeFreePlane(plane);
+    return found;
+}
+
+static const struct plane_format *modeset_choose_format(int fd, struct drm_object *obj)
+{
+    for (unsigned int i = 0; i < sizeof(plane_formats) / sizeof(plane_formats[0]); i++) {
+        const struct plane_format *format = &plane_formats[i];
+
+        if (drm_format != NULL && strcasecmp(drm_format, format->name) != 0)
+            continue;
+
+        if (plane_supports_format(fd, obj, format->fourcc)) {
+            fprintf(stderr, "plane %u scanout format: %s\n", obj->id, format->name);
+            return format;
+        }
+    }
+
+    fprintf(stderr, "plane %u doesn't support %s scanout format\n", obj->id,
+            drm_format != NULL ? drm_format : "any OSD");
+    return NULL;
+}
+
 /*
  * With a certain combination of connector+CRTC, we look for a suitable primary
  * plane for it. After that, we retrieve connector, CRTC and plane objects
@@ -658,6 +880,7 @@ static struct modeset_output *modeset_output_create(int fd, drmModeRes *res,
 {
     int ret;
     struct modeset_output *out;
+    const struct plane_format *format;
 
     /* creates an output structure */
     out = malloc(sizeof(*out));
@@ -680,6 +903,7 @@ static struct modeset_output *modeset_output_create(int fd, drmModeRes *res,
 
     /* copy the mode information into our output structure */
     memcpy(&out->mode, &conn->modes[0], sizeof(out->mode));
+    out->frame_ns = out->mode.clock ? (uint64_t)out->mode.htotal * out->mode.vtotal * 1000000 / out->mode.clock : 1000000000 / 60;
     /* create the blob property using out->mode and save its id in the output*/
     if (drmModeCreatePropertyBlob(fd, &out->mode, sizeof(out->mode),
                                   &out->mode_blob_id) != 0) {
@@ -687,7 +911,7 @@ static struct modeset_output *modeset_output_create(int fd, drmModeRes *res,
         goto out_error;
     }
     fprintf(stderr, "mode for connector %u is %ux%u\n",
-            conn->connector_id, out->bufs[0].width, out->bufs[0].height);
+            conn->connector_id, out->mode.hdisplay, out->mode.vdisplay);
 
     /* find a crtc for this connector */
     ret = modeset_find_crtc(fd, res, conn, out);
@@ -711,8 +935,15 @@ static struct modeset_output *modeset_output_create(int fd, drmModeRes *res,
         goto out_blob;
     }
 
+    /* pick the cheapest scanout format of the plane */
+    format = modeset_choose_format(fd, &out->planes[0].obj);
+    if (!format) {
+        ret = -EINVAL;
+        goto out_obj;
+    }
+
     /* setup front/back framebuffers for this CRTC */
-    ret = modeset_setup_framebuffers(fd, out);
+    ret = modeset_setup_framebuffers(fd, out, OSD_LAYER_DYNAMIC, format);
     if (ret) {
         fprintf(stderr, "cannot create framebuffers for connector %u\n",
                 conn->connector_id);
@@ -780,6 +1011,123 @@ static int modeset_prepare(int fd)
     return 0;
 }
 
+/*
+ * The static screen layer needs an overlay plane of each CRTC. Video players
+ * usually put their frames on an overlay plane too, so it's only used when
+ * asked for: "auto" takes any overlay plane nobody shows anything on, a
+ * plane id takes that plane regardless.
+ */
+
+static bool plane_taken(uint32_t plane_id)
+{
+    for (const struct modeset_output *iter = output_list; iter; iter = iter->next) {
+        for (unsigned int i = 0; i < iter->plane_count; i++) {
+            if (iter->planes[i].obj.id == plane_id)
+                return true;
+        }
+    }
+    return false;
+}
+
+static uint32_t modeset_find_static_plane(int fd, struct modeset_output *out)
+{
+    bool any = strcmp(drm_static_plane, "auto") == 0;
+    uint32_t wanted = any ? 0 : strtoul(drm_static_plane, NULL, 0);
+    drmModePlaneResPtr plane_res;
+    uint32_t found = 0;
+
+    plane_res = drmModeGetPlaneResources(fd);
+    if (!plane_res) {
+        fprintf(stderr, "drmModeGetPlaneResources failed: %s\n",
+                strerror(errno));
+        return 0;
+    }
+
+    for (uint32_t i = 0; i < plane_res->count_planes && !found; i++) {
+        uint32_t plane_id = plane_res->planes[i];
+
+        if ((!any && plane_id != wanted) || plane_taken(plane_id))
+            continue;
+
+        drmModePlanePtr plane = drmModeGetPlane(fd, plane_id);
+        if (!plane)
+            continue;
+
+        if ((plane->possible_crtcs & (1 << out->crtc_index)) &&
+            (!any || (plane->crtc_id == 0 && plane->fb_id == 0))) {
+            drmModeObjectPropertiesPtr props =
+                drmModeObjectGetProperties(fd, plane_id, DRM_MODE_OBJECT_PLANE);
+
+            /* stacking below the primary plane needs a zpos */
+            if (props && get_property_value(fd, props, "type") == DRM_PLANE_TYPE_OVERLAY &&
+                get_property_value(fd, props, "zpos") >= 0)
+                found = plane_id;
+
+            drmModeFreeObjectProperties(props);
+        }
+
+        drmModeFreePlane(plane);
+    }
+
+    drmModeFreePlaneResources(plane_res);
+    return found;
+}
+
+static void modeset_drop_static_layer(int fd, struct modeset_output *out)
+{
+    struct modeset_plane *plane = &out->planes[OSD_LAYER_STATIC];
+
+    if (out->plane_count <= OSD_LAYER_STATIC)
+        return;
+
+    if (plane->fbs)
+        modeset_release_framebuffers(fd, plane);
+    modeset_drm_object_fini(&plane->obj);
+    out->plane_count = OSD_LAYER_STATIC;
+}
+
+/*
+ * modeset_setup_static_layer() gives every output an overlay plane for the
+ * static layer. It's all or nothing: if any output can't get one, all of
+ * them show both layers on the primary plane.
+ */
+
+static unsigned int layer_count = 1;
+
+static void modeset_setup_static_layer(int fd)
+{
+    struct modeset_output *iter;
+
+    for (iter = output_list; iter; iter = iter->next) {
+        struct modeset_plane *plane = &iter->planes[OSD_LAYER_STATIC];
+        const struct plane_format *format;
+
+        plane->obj.id = modeset_find_static_plane(fd, iter);
+        if (plane->obj.id == 0) {
+            fprintf(stderr, "no overlay plane '%s' for crtc %u\n", drm_static_plane, iter->crtc.id);
+            goto out_drop;
+        }
+
+        if (modeset_setup_plane(fd, plane) < 0)
+            goto out_drop;
+        iter->plane_count = OSD_LAYER_STATIC + 1;
+
+        format = modeset_choose_format(fd, &plane->obj);
+        if (!format || modeset_setup_framebuffers(fd, iter, OSD_LAYER_STATIC, format) < 0)
+            goto out_drop;
+
+        fprintf(stderr, "static OSD layer on plane %u\n", plane->obj.id);
+    }
+
+    layer_count = OSD_SCREEN_LAYERS;
+    return;
+
+out_drop:
+    for (iter = output_list; iter; iter = iter->next)
+        modeset_drop_static_layer(fd, iter);
+    fprintf(stderr, "static OSD layer disabled\n");
+}
+
 /*
  * modeset_atomic_prepare_commit() is new. Here we set the values of properties
  * (of our connector, CRTC and plane objects) that we want to change in the
@@ -790,9 +1138,6 @@ static int modeset_prepare(int fd)
 static int modeset_atomic_prepare_commit(int fd, struct modeset_output *out,
 					 drmModeAtomicReq *req)
 {
-    struct drm_object *plane = &out->plane;
-    struct modeset_buf *buf = &out->bufs[out->front_buf ^ 1];
-
     /* set id of the CRTC id that the connector is using */
     if (set_drm_object_property(req, &out->connector, "CRTC_ID", out->crtc.id) < 0)
         return -1;
@@ -806,27 +1151,33 @@ static int modeset_atomic_prepare_commit(int fd, struct modeset_output *out,
     if (set_drm_object_property(req, &out->crtc, "ACTIVE", 1) < 0)
         return -1;
 
-    /* set properties of the plane related to the CRTC and the framebuffer */
-    if (set_drm_object_property(req, plane, "FB_ID", buf->fb) < 0)
-        return -1;
-    if (set_drm_object_property(req, plane, "CRTC_ID", out->crtc.id) < 0)
-        return -1;
-    if (set_drm_object_property(req, plane, "SRC_X", 0) < 0)
-        return -1;
-    if (set_drm_object_property(req, plane, "SRC_Y", 0) < 0)
-        return -1;
-    if (set_drm_object_property(req, plane, "SRC_W", buf->width << 16) < 0)
-        return -1;
-    if (set_drm_object_property(req, plane, "SRC_H", buf->height << 16) < 0)
-        return -1;
-    if (set_drm_object_property(req, plane, "CRTC_X", 0) < 0)
-        return -1;
-    if (set_drm_object_property(req, plane, "CRTC_Y", 0) < 0)
-        return -1;
-    if (set_drm_object_property(req, plane, "CRTC_W", out->mode.hdisplay) < 0)
-        return -1;
-    if (set_drm_object_property(req, plane, "CRTC_H", out->mode.vdisplay) < 0)
-        return -1;
+    /* set properties of the planes related to the CRTC and the framebuffer */
+    for (unsigned int i = 0; i < out->plane_count; i++) {
+        struct drm_object *plane = &out->planes[i].obj;
+        struct modeset_fbset *fbs = out->planes[i].fbs;
+        struct modeset_buf *buf = &fbs->bufs[fbs->front_buf ^ 1];
+
+        if (set_drm_object_property(req, plane, "FB_ID", buf->fb) < 0)
+            return -1;
+        if (set_drm_object_property(req, plane, "CRTC_ID", out->crtc.id) < 0)
+            return -1;
+        if (set_drm_object_property(req, plane, "SRC_X", 0) < 0)
+            return -1;
+        if (set_drm_object_property(req, plane, "SRC_Y", 0) < 0)
+            return -1;
+        if (set_drm_object_property(req, plane, "SRC_W", buf->width << 16) < 0)
+            return -1;
+        if (set_drm_object_property(req, plane, "SRC_H", buf->height << 16) < 0)
+            return -1;
+        if (set_drm_object_property(req, plane, "CRTC_X", 0) < 0)
+            return -1;
+        if (set_drm_object_property(req, plane, "CRTC_Y", 0) < 0)
+            return -1;
+        if (set_drm_object_property(req, plane, "CRTC_W", out->mode.hdisplay) < 0)
+            return -1;
+        if (set_drm_object_property(req, plane, "CRTC_H", out->mode.vdisplay) < 0)
+            return -1;
+    }
 
     return 0;
 }
@@ -835,39 +1186,30 @@ static int modeset_atomic_prepare_commit(int fd, struct modeset_output *out,
  * Draw on back framebuffer before the page-flip is requested.
  */
 
-static void modeset_paint_framebuffer(struct modeset_output *out, uint32_t color)
+static void modeset_paint_framebuffer(struct modeset_fbset *fbs, uint32_t color)
 {
     struct modeset_buf *buf;
 
-    buf = &out->bufs[out->front_buf ^ 1];
+    buf = &fbs->bufs[fbs->front_buf ^ 1];
     for (int j = 0; j < buf->height; ++j) {
         for (int k = 0; k < buf->width; ++k) {
-            int off = buf->stride * j + k * 4;
-            *(uint32_t*)(buf->map + off) = color;
+            int off = buf->stride * j + k * buf->format->bpp / 8;
+            memcpy(buf->map + off, &color, buf->format->bpp / 8);
         }
     }
 }
 
 /*
- * modeset_draw_commit() prepares the framebuffer with the drawing and then it asks
- * for the driver to perform an atomic commit. This will lead to a page-flip and
- * the content of the framebuffer will be displayed. In this simple example
- * we're only using the primary plane, but we could also be updating other
- * planes in the same atomic commit.
+ * modeset_draw_commit() asks the driver to flip every output whose framebuffer
+ * set has a new frame queued, all in one atomic commit. This will lead to a
+ * page-flip on each of their CRTCs and the new frame will be displayed.
  *
- * Just like in modeset_perform_modeset(), we first setup everything with
- * modeset_atomic_prepare_commit() and then actually perform the atomic commit.
- * But there are some important differences:
+ * Just like in modeset_perform_modeset(), we first setup the request and then
+ * actually perform the atomic commit. But there are some important differences:
  *
- * 1. Here we just want to perform a commit that changes the state of a specific
- *    output, and in modeset_perform_modeset() we did an atomic commit that was
- *    supposed to setup all the outputs at once. So there's no need to prepare
- *    every output before performing the atomic commit. But let's suppose you
- *    prepare every output and then perform the commit. It should schedule a
- *    page-flip for all of them, but modeset_draw_commit() was called because the
- *    page-flip for a specific output has finished. The others may not be
- *    prepared for a page-flip yet (e.g. in the middle of a scanout), so these
- *    page-flips will fail.
+ * 1. Outputs whose previous page-flip hasn't finished yet (e.g. a display
+ *    with another refresh rate) are left out. The kernel would reject the
+ *    whole commit with EBUSY otherwise.
  *
  * 2. Here we have already painted the framebuffer and also we don't use the
  *    flag DRM_MODE_ALLOW_MODESET anymore, since the modeset already happened.
@@ -878,21 +1220,67 @@ static void modeset_paint_framebuffer(struct modeset_output *out, uint32_t color
  *    just want page-flips to occur. If we still need to perform modesets it
  *    means that we have a bug somewhere, and it may be better to fail than to
  *    glitch (a modeset can cause unecessary latency and also blank the screen).
+ *
+ * 3. Atomic state persists between commits, so the request carries only the
+ *    properties a page-flip changes, with ids resolved at setup. The request
+ *    itself is allocated once and rewound with drmModeAtomicSetCursor().
  */
 
-static void modeset_draw_commit(int fd, struct modeset_output *out)
+static int modeset_atomic_prepare_flip(struct modeset_plane *plane,
+				       drmModeAtomicReq *req)
 {
-    drmModeAtomicReq *req;
-    int ret, flags;
+    struct modeset_buf *buf = &plane->fbs->bufs[plane->fbs->front_buf ^ 1];
+    int ret;
 
-    /* prepare output for atomic commit */
-    req = drmModeAtomicAlloc();
-    ret = modeset_atomic_prepare_commit(fd, out, req);
-    if (ret < 0) {
-        fprintf(stderr, "prepare atomic commit failed, %d\n", errno);
-        return;
+    ret = drmModeAtomicAddProperty(req, plane->obj.id, plane->prop.fb_id, buf->fb);
+    if (ret < 0 || plane->fbs->damage_blob == 0)
+        return ret;
+
+    /* damage clips aren't kept in the plane state, so they go with every flip */
+    return drmModeAtomicAddProperty(req, plane->obj.id, plane->prop.fb_damage_clips,
+                                    plane->fbs->damage_blob);
+}
+
+/* output has a new frame queued on any of its planes */
+static bool output_queued(const struct modeset_output *out)
+{
+    for (unsigned int i = 0; i < out->plane_count; i++) {
+        if (out->planes[i].fbs->queued)
+            return true;
+    }
+    return false;
+}
+
+static void modeset_draw_commit(int fd)
+{
+    struct modeset_output *iter;
+    struct modeset_fbset *fbs;
+    drmModeAtomicReq *req = flip_req;
+    uint64_t start = get_time_ns();
+    int ret, flags, count = 0;
+
+    /* prepare outputs for atomic commit */
+    drmModeAtomicSetCursor(req, 0);
+    for (iter = output_list; iter; iter = iter->next) {
+        for (unsigned int i = 0; i < iter->plane_count; i++) {
+            if (!iter->planes[i].fbs->queued)
+                continue;
+
+            ret = modeset_atomic_prepare_flip(&iter->planes[i], req);
+            if (ret < 0) {
+                fprintf(stderr, "prepare atomic commit failed, %d\n", errno);
+                goto out;
+            }
+            count++;
+        }
     }
 
+    if (count == 0)
+        goto out;
+
+    commit_prep_ns += get_time_ns() - start;
+    commits++;
+
     /* We've just draw on the framebuffer, prepared the commit and now it's
      * time to perform a page-flip to display its content.
      *
@@ -900,18 +1288,92 @@ static void modeset_draw_commit(int fd, struct modeset_output *out)
      * want to be blocked waiting for the commit to happen, since we can use
      * this time to prepare a new framebuffer, for instance. We can only do
      * this because there are mechanisms to know when the commit is complete
-     * (like page flip event, explained above).
+     * (like page flip event, explained above). Every CRTC in the commit
+     * sends its own event.
      */
-    flags = DRM_MODE_ATOMIC_NONBLOCK;
+    flags = DRM_MODE_ATOMIC_NONBLOCK | DRM_MODE_PAGE_FLIP_EVENT;
     ret = drmModeAtomicCommit(fd, req, flags, NULL);
-    drmModeAtomicFree(req);
 
     if (ret < 0) {
         fprintf(stderr, "atomic commit failed, %d\n", errno);
+    } else {
+        /* the old front buffers are scanned out until the flip events arrive */
+        for (iter = output_list; iter; iter = iter->next) {
+            if (output_queued(iter))
+                iter->flip_pending = true;
+        }
+        for (fbs = fbset_list; fbs; fbs = fbs->next) {
+            if (fbs->queued)
+                fbs->front_buf ^= 1;
+        }
+    }
+
+out:
+    for (fbs = fbset_list; fbs; fbs = fbs->next) {
+        /* the commit holds its own reference to the blob */
+        if (fbs->damage_blob) {
+            drmModeDestroyPropertyBlob(fd, fbs->damage_blob);
+            fbs->damage_blob = 0;
+        }
+        fbs->queued = false;
+    }
+}
+
+/* plane of the output showing the set, NULL if it isn't shown there */
+static struct modeset_plane *fbset_plane(struct modeset_output *out, const struct modeset_fbset *fbs)
+{
+    if (fbs->layer < out->plane_count && out->planes[fbs->layer].fbs == fbs)
+        return &out->planes[fbs->layer];
+    return NULL;
+}
+
+/* back buffer of the set is free only when all its outputs have flipped */
+static bool fbset_busy(const struct modeset_fbset *fbs)
+{
+    for (struct modeset_output *iter = output_list; iter; iter = iter->next) {
+        if (iter->flip_pending && fbset_plane(iter, fbs))
+            return true;
+    }
+    return false;
+}
+
+/*
+ * Pixels that differ between the frame on screen and the new one lie in
+ * regions drawn into either of them. Drivers that honor FB_DAMAGE_CLIPS
+ * fetch or recompress only these instead of the whole plane.
+ */
+
+static void modeset_set_damage_clips(int fd, struct modeset_fbset *fbs)
+{
+    struct drm_mode_rect clips[OSD_MAX_DAMAGE_RECTS];
+    osd_damage_t damage = fbs->bufs[fbs->front_buf].damage;
+    struct modeset_output *iter;
+
+    damage_merge(&damage, &fbs->bufs[fbs->front_buf ^ 1].damage);
+    damage_pixels += damage_area(&damage);
+    damage_frames++;
+
+    /* without the property the driver updates the whole plane */
+    for (iter = output_list; iter; iter = iter->next) {
+        struct modeset_plane *plane = fbset_plane(iter, fbs);
+
+        if (plane && plane->prop.fb_damage_clips == 0)
+            return;
+    }
+
+    /* an empty blob is rejected, the frame is flipped as a whole then */
+    if (damage.count == 0)
         return;
+
+    for (int i = 0; i < damage.count; i++) {
+        clips[i].x1 = damage.rects[i].x0;
+        clips[i].y1 = damage.rects[i].y0;
+        clips[i].x2 = damage.rects[i].x1 + 1;
+        clips[i].y2 = damage.rects[i].y1 + 1;
     }
 
-    out->front_buf ^= 1;
+    if (drmModeCreatePropertyBlob(fd, clips, sizeof(clips[0]) * damage.count, &fbs->damage_blob) < 0)
+        fbs->damage_blob = 0;
 }
 
 
@@ -956,18 +1418,24 @@ static int modeset_perform_modeset(int fd)
         return ret;
     }
 
-    /* draw on back framebuffer of all outputs */
+    /* static layer goes right below the dynamic one */
     for (iter = output_list; iter; iter = iter->next)
     {
-        if (set_drm_object_property(req, &iter->plane, "zpos", ZPOS) < 0)
+        for (unsigned int i = 0; i < iter->plane_count; i++)
         {
-            fprintf(stderr, "Unable to set zpos %d for primary plane\n", ZPOS);
-            drmModeAtomicFree(req);
-            return -1;
+            if (set_drm_object_property(req, &iter->planes[i].obj, "zpos", ZPOS - i) < 0)
+            {
+                fprintf(stderr, "Unable to set zpos %d for plane %u\n", ZPOS - i, iter->planes[i].obj.id);
+                drmModeAtomicFree(req);
+                return -1;
+            }
         }
-        modeset_paint_framebuffer(iter, 0);
     }
 
+    /* draw on back framebuffer of all outputs */
+    for (struct modeset_fbset *fbs = fbset_list; fbs; fbs = fbs->next)
+        modeset_paint_framebuffer(fbs, 0);
+
     /* initial modeset on all outputs */
     flags = DRM_MODE_ATOMIC_ALLOW_MODESET;
     ret = drmModeAtomicCommit(fd, req, flags, NULL);
@@ -975,6 +1443,14 @@ static int modeset_perform_modeset(int fd)
     {
         fprintf(stderr, "modeset atomic commit failed, %d\n", errno);
     }
+    else
+    {
+        /* the painted buffers are on screen now, so the first frame goes to the other ones */
+        for (struct modeset_fbset *fbs = fbset_list; fbs; fbs = fbs->next)
+            fbs->front_buf ^= 1;
+        for (iter = output_list; iter; iter = iter->next)
+            iter->vblank_ns = get_time_ns();
+    }
 
     drmModeAtomicFree(req);
 
@@ -992,7 +1468,14 @@ static void modeset_cleanup(int fd)
 
     for(iter = output_list; iter; iter = iter->next)
     {
-        set_drm_object_property(req, &iter->plane, "zpos", 0);
+        set_drm_object_property(req, &iter->planes[0].obj, "zpos", 0);
+
+        /* overlay plane is left free for other clients */
+        for (unsigned int i = 1; i < iter->plane_count; i++)
+        {
+            set_drm_object_property(req, &iter->planes[i].obj, "FB_ID", 0);
+            set_drm_object_property(req, &iter->planes[i].obj, "CRTC_ID", 0);
+        }
     }
 
     ret = drmModeAtomicCommit(fd, req, 0, NULL);
@@ -1019,22 +1502,157 @@ static void modeset_cleanup(int fd)
 
 static int drm_fd = -1;
 
+#define FRAME_SLACK_NS 1000000  // margin for the commit to reach the hardware before vblank
+
+static uint64_t render_est_ns = 2000000;    // time from frame start to commit
+static uint64_t frame_start_ns;
+static uint64_t frame_target_ns;            // vblank the next frame is scheduled for
+static uint64_t last_target_ns;             // vblank the last rendered frame was scheduled for
+static unsigned int frames_dropped;
+static unsigned int flips_late;
+static unsigned int flips;
+
 void drm_cleanup(void)
 {
     /* cleanup everything */
+    drmModeAtomicFree(flip_req);
     modeset_cleanup(drm_fd);
     close(drm_fd);
 }
 
+/*
+ * Dumb buffers are usually mapped write-combined: streaming stores are fast,
+ * but every read goes to uncached memory. Rendering straight into the mapping
+ * saves the damage copy only if read-modify-write spans (masked blits) don't
+ * cost more than that copy, which depends on the SoC. So both strategies
+ * render the same synthetic frame a few times and the faster one wins.
+ */
+
+#define PROBE_ROUNDS 8
+
+/* fill half of every fourth row and blend the other half like text does */
+static void probe_draw(uint32_t *dst, int pitch, const uint32_t *src)
+{
+    for (int y = 0; y < FB_HEIGHT; y += 4)
+    {
+        uint32_t *row = dst + pitch * y;
+
+        for (int x = 0; x < FB_WIDTH / 2; x++)
+            row[x] = src[x];
+        for (int x = FB_WIDTH / 2; x < FB_WIDTH; x++)
+            row[x] |= src[x];
+    }
+}
+
+static drm_render_mode_t modeset_probe_render_mode(struct modeset_buf *buf)
+{
+    uint32_t *shadow = calloc(FB_WIDTH * FB_HEIGHT, 4);
+    uint32_t *src = malloc(FB_WIDTH * 4);
+    uint64_t direct_ns = UINT64_MAX, shadow_ns = UINT64_MAX;
+
+    if (shadow == NULL || src == NULL) {
+        free(shadow);
+        free(src);
+        return DRM_RENDER_SHADOW;
+    }
+
+    for (int x = 0; x < FB_WIDTH; x++)
+        src[x] = (x & 2) ? 0xff00ff00 : 0;
+
+    for (int i = 0; i < PROBE_ROUNDS; i++) {
+        uint64_t t0 = get_time_ns();
+        probe_draw((uint32_t *)buf->map, buf->stride / 4, src);
+
+        uint64_t t1 = get_time_ns();
+        probe_draw(shadow, FB_WIDTH, src);
+        for (int y = 0; y < FB_HEIGHT; y += 4)
+            memcpy(buf->map + buf->stride * y, shadow + FB_WIDTH * y, FB_WIDTH * 4);
+
+        uint64_t t2 = get_time_ns();
+        if (t1 - t0 < direct_ns)
+            direct_ns = t1 - t0;
+        if (t2 - t1 < shadow_ns)
+            shadow_ns = t2 - t1;
+    }
+
+    /* the buffer is shown by the next flip */
+    memset(buf->map, 0, buf->size);
+    free(shadow);
+    free(src);
+
+    fprintf(stderr, "DRM render probe: direct %.1f us, shadow %.1f us\n",
+            direct_ns / 1000.0, shadow_ns / 1000.0);
+
+    return direct_ns <= shadow_ns ? DRM_RENDER_DIRECT : DRM_RENDER_SHADOW;
+}
+
+/* the only framebuffer set of the layer, NULL if there are several */
+static struct modeset_fbset *layer_fbset(unsigned int layer)
+{
+    struct modeset_fbset *found = NULL;
+
+    for (struct modeset_fbset *fbs = fbset_list; fbs; fbs = fbs->next) {
+        if (fbs->layer != layer)
+            continue;
+        if (found)
+            return NULL;
+        found = fbs;
+    }
+    return found;
+}
+
+/*
+ * Graphengine draws RGBA with a row pitch of FB_WIDTH, and every output has
+ * its own buffers, so the direct mode only works for a single output with
+ * a tightly packed ABGR8888 dumb buffer per layer.
+ */
+static int modeset_direct_supported(void)
+{
+#ifdef GRAPHICS_INDEXED
+    return 0;
+#else
+    /* outputs scanning out the same buffers can share one render target */
+    for (unsigned int l = 0; l < layer_count; l++) {
+        struct modeset_fbset *fbs = layer_fbset(l);
+
+        if (fbs == NULL)
+            return 0;
+
+        for (int i = 0; i < 2; i++) {
+            if (fbs->bufs[i].format->fourcc != DRM_FORMAT_ABGR8888 ||
+                fbs->bufs[i].stride != FB_WIDTH * 4)
+                return 0;
+        }
+    }
+    return 1;
+#endif
+}
+
+static void modeset_select_render_mode(void)
+{
+    if (drm_render_mode != DRM_RENDER_SHADOW && !modeset_direct_supported()) {
+        if (drm_render_mode == DRM_RENDER_DIRECT)
+            fprintf(stderr, "DRM direct rendering isn't supported by this output, using shadow buffer\n");
+        drm_render_mode = DRM_RENDER_SHADOW;
+    }
+
+    if (drm_render_mode == DRM_RENDER_AUTO) {
+        struct modeset_fbset *fbs = layer_fbset(OSD_LAYER_DYNAMIC);
+
+        drm_render_mode = modeset_probe_render_mode(&fbs->bufs[fbs->front_buf ^ 1]);
+    }
+
+    fprintf(stderr, "DRM render mode: %s\n", drm_render_mode == DRM_RENDER_DIRECT ? "direct" : "shadow");
+}
+
 int drm_init(void)
 {
     int ret;
-    const char *card = "/dev/dri/card0";
 
-    fprintf(stderr, "DRM using card '%s'\n", card);
+    fprintf(stderr, "DRM using card '%s'\n", drm_card);
 
     /* open the DRM device */
-    ret = modeset_open(&drm_fd, card);
+    ret = modeset_open(&drm_fd, drm_card);
     if (ret)
         goto out_return;
 
@@ -1043,7 +1661,18 @@ int drm_init(void)
     if (ret)
         goto out_close;
 
+    if (drm_static_plane != NULL)
+        modeset_setup_static_layer(drm_fd);
+
     modeset_perform_modeset(drm_fd);
+    modeset_select_render_mode();
+
+    flip_req = drmModeAtomicAlloc();
+    if (!flip_req) {
+        ret = -ENOMEM;
+        modeset_cleanup(drm_fd);
+        goto out_close;
+    }
 
     return 0;
 
@@ -1060,12 +1689,233 @@ out_return:
 }
 
 
-void drm_display_buffer(void *src_buf)
+/*
+ * Back buffer still holds the frame before previous one, so
+ * both its old content and the new frame's regions must be refreshed.
+ */
+static void copy_damage(struct modeset_buf *dst_buf, const uint8_t *src_buf, const osd_damage_t *damage)
+{
+    osd_damage_t copy = dst_buf->damage;
+
+    damage_merge(&copy, damage);
+
+    for (int i = 0; i < copy.count; i++)
+    {
+        const osd_rect_t *r = copy.rects + i;
+
+        for (int y = r->y0; y <= r->y1; y++)
+        {
+            dst_buf->format->convert(dst_buf->map + dst_buf->stride * y + r->x0 * dst_buf->format->bpp / 8,
+                                     (const osd_pixel_t *)src_buf + GRAPHICS_WIDTH * y + r->x0, r->x1 - r->x0 + 1);
+        }
+    }
+
+    dst_buf->damage = *damage;
+}
+
+/**
+ * drm_layer_count: get number of screen layers with a plane of their own.
+ *
+ * @return      OSD_SCREEN_LAYERS if the static layer is enabled, 1 otherwise
+ */
+int drm_layer_count(void)
+{
+    return layer_count;
+}
+
+/**
+ * drm_back_buffer: get buffer to render the next frame of a layer into.
+ *
+ * @param       layer   screen layer
+ * @param       stale   set to the regions drawn when the buffer was used last time
+ * @return      mapped back buffer in direct mode, NULL in shadow mode
+ */
+void *drm_back_buffer(int layer, osd_damage_t *stale)
+{
+    if (drm_render_mode != DRM_RENDER_DIRECT)
+        return NULL;
+
+    struct modeset_fbset *fbs = layer_fbset(layer);
+    struct modeset_buf *buf = &fbs->bufs[fbs->front_buf ^ 1];
+    if (stale != NULL)
+        *stale = buf->damage;
+    return buf->map;
+}
+
+/**
+ * drm_display_buffer: queue new frame of a layer for the next drm_commit().
+ *
+ * @param       layer   screen layer
+ * @param       src_buf rendered frame, ignored in direct mode
+ * @param       damage  regions drawn into the frame
+ * @return      0 or -1 if some output still shows the previous frame and misses this one
+ */
+int drm_display_buffer(int layer, void *src_buf, const osd_damage_t *damage)
+{
+    int ret = 0;
+
+    for (struct modeset_fbset *fbs = fbset_list; fbs; fbs = fbs->next)
+    {
+        struct modeset_buf *dst_buf = &fbs->bufs[fbs->front_buf ^ 1];
+
+        if (fbs->layer != layer)
+            continue;
+
+        /* the frame is already in the buffer, a later one must refresh its regions too */
+        if (drm_render_mode == DRM_RENDER_DIRECT)
+            dst_buf->damage = *damage;
+
+        /* secondary output with another refresh rate is still flipping, it gets the next frame */
+        if (fbset_busy(fbs))
+        {
+            frames_dropped++;
+            ret = -1;
+            continue;
+        }
+
+        if (drm_render_mode != DRM_RENDER_DIRECT)
+            copy_damage(dst_buf, src_buf, damage);
+        modeset_set_damage_clips(drm_fd, fbs);
+        fbs->queued = true;
+    }
+
+    return ret;
+}
+
+/**
+ * drm_commit: flip all outputs to the frames queued by drm_display_buffer().
+ */
+void drm_commit(void)
 {
     for (struct modeset_output *iter = output_list; iter; iter = iter->next)
     {
-        struct modeset_buf *dst_buf = &iter->bufs[iter->front_buf ^ 1];
-        memcpy(dst_buf->map, src_buf, dst_buf->size);
-        modeset_draw_commit(drm_fd, iter);
+        if (output_queued(iter))
+            iter->target_ns = frame_target_ns;
     }
+
+    /* one commit flips all outputs with a new frame */
+    modeset_draw_commit(drm_fd);
+
+    /* fast attack, slow decay: a late frame costs more than an early one */
+    uint64_t elapsed = get_time_ns() - frame_start_ns;
+    render_est_ns = elapsed > render_est_ns ? elapsed : render_est_ns - (render_est_ns - elapsed) / 8;
+}
+
+/*
+ * Frames are paced by page flip events of the first output. Rendering
+ * starts right before the next vblank, so the OSD shows the latest
+ * telemetry with the lowest latency, and a frame is never committed while
+ * the previous flip is pending (that commit would fail with EBUSY).
+ * If the loop wakes up too late to make a vblank, that frame is dropped
+ * and the following vblank is targeted instead.
+ */
+
+static void page_flip_handler(int fd, unsigned int sequence, unsigned int tv_sec,
+                              unsigned int tv_usec, unsigned int crtc_id, void *user_data)
+{
+    struct modeset_output *out;
+
+    /* a commit with several CRTCs sends one event per CRTC */
+    for (out = output_list; out; out = out->next) {
+        if (out->crtc.id == crtc_id)
+            break;
+    }
+    if (out == NULL)
+        return;
+
+    out->flip_pending = false;
+    out->vblank_ns = (uint64_t)tv_sec * 1000000000ull + tv_usec * 1000ull;
+
+    if (out != output_list)
+        return;
+
+    /* flip landed on a later vblank than the frame was rendered for */
+    if (out->target_ns != 0 && out->vblank_ns > out->target_ns + out->frame_ns / 2)
+        flips_late++;
+
+    if (osd_debug && ++flips % 300 == 0)
+    {
+        fprintf(stderr, "DRM: %.2f Hz, render estimate %.1f us, commit prep %.2f us, damage %.1f%%, %u frames dropped, %u late flips\n",
+                1e9 / out->frame_ns, render_est_ns / 1000.0, commits ? commit_prep_ns / 1000.0 / commits : 0.0,
+                damage_frames ? 100.0 * damage_pixels / damage_frames / (FB_WIDTH * FB_HEIGHT) : 0.0,
+                frames_dropped, flips_late);
+        commit_prep_ns = 0;
+        commits = 0;
+        damage_pixels = 0;
+        damage_frames = 0;
+    }
+}
+
+/**
+ * drm_event_fd: get file descriptor to poll for page flip events.
+ */
+int drm_event_fd(void)
+{
+    return drm_fd;
+}
+
+/**
+ * drm_handle_events: process pending page flip events.
+ */
+void drm_handle_events(void)
+{
+    drmEventContext ev = {
+        .version = 3,
+        .page_flip_handler2 = page_flip_handler,
+    };
+
+    drmHandleEvent(drm_fd, &ev);
+}
+
+/* first vblank at or after t, extrapolated from the last flip */
+static uint64_t vblank_after(const struct modeset_output *out, uint64_t t)
+{
+    if (t <= out->vblank_ns)
+        return out->vblank_ns;
+    return out->vblank_ns + (t - out->vblank_ns + out->frame_ns - 1) / out->frame_ns * out->frame_ns;
+}
+
+/**
+ * drm_frame_delay_ns: get time until the next frame should be rendered.
+ *
+ * @return      delay in ns, 0 = render now, -1 = wait for page flip event
+ */
+int64_t drm_frame_delay_ns(void)
+{
+    struct modeset_output *out = output_list;
+    uint64_t now = get_time_ns();
+
+    for (unsigned int i = 0; i < out->plane_count; i++) {
+        if (fbset_busy(out->planes[i].fbs))
+            return -1;
+    }
+
+    uint64_t lead = render_est_ns + FRAME_SLACK_NS;
+
+    /* keep the scheduled vblank while the frame still fits, waking up late eats the slack */
+    if (frame_target_ns <= last_target_ns || now + render_est_ns >= frame_target_ns)
+    {
+        uint64_t earliest = now + lead;
+
+        /* one frame per vblank */
+        if (earliest < last_target_ns + out->frame_ns / 2)
+            earliest = last_target_ns + out->frame_ns / 2;
+
+        uint64_t target = vblank_after(out, earliest);
+
+        if (frame_target_ns > last_target_ns)
+            frames_dropped += (target - frame_target_ns + out->frame_ns / 2) / out->frame_ns;
+        frame_target_ns = target;
+    }
+
+    return frame_target_ns - lead > now ? (int64_t)(frame_target_ns - lead - now) : 0;
+}
+
+/**
+ * drm_frame_begin: mark start of the frame scheduled by drm_frame_delay_ns().
+ */
+void drm_frame_begin(void)
+{
+    frame_start_ns = get_time_ns();
+    last_target_ns = frame_target_ns;
 }
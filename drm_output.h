@@ -0,0 +1,29 @@
+#ifndef __DRM_OUTPUT_H
+#define __DRM_OUTPUT_H
+
+#include "graphengine.h"
+
+// Where frames are rasterized
+typedef enum {
+    DRM_RENDER_AUTO = 0,                // pick the faster one with a startup probe
+    DRM_RENDER_SHADOW,                  // malloc'ed buffer, damaged regions copied to the dumb buffer
+    DRM_RENDER_DIRECT,                  // straight into the mapped dumb buffer
+} drm_render_mode_t;
+
+extern const char *drm_card;            // DRM device node
+extern const char *drm_format;          // scanout format name, NULL = cheapest supported by the plane
+extern const char *drm_static_plane;    // overlay plane for the static layer: "auto" or plane id, NULL = off
+extern drm_render_mode_t drm_render_mode;
+
+int drm_init(void);
+void drm_cleanup(void);
+int drm_layer_count(void);
+void *drm_back_buffer(int layer, osd_damage_t *stale);
+int drm_display_buffer(int layer, void *src_buf, const osd_damage_t *damage);
+void drm_commit(void);
+int drm_event_fd(void);
+void drm_handle_events(void);
+int64_t drm_frame_delay_ns(void);
+void drm_frame_begin(void);
+
+#endif //__DRM_OUTPUT_H
@@ -26,11 +26,19 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <assert.h>
 #include <math.h>
 #include <stdint.h>
 #include <pthread.h>
+#include <time.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
 
 #ifdef __BCM_OPENVG__
 #include <bcm_host.h>
@@ -45,20 +53,316 @@
 #include <gst/gst.h>
 #endif
 
+#ifdef __DRM_ROCKCHIP__
+#include "drm_output.h"
+#endif
+
 #include "osdrender.h"
 #include "graphengine.h"
 #include "math3d.h"
 #include "fonts.h"
 #include "font12x18.h"
 #include "font8x10.h"
+#include "textcache.h"
+#include "displaylist.h"
+#include "tiler.h"
 
 
 static uint8_t* video_buf_int = NULL;
+__thread osd_damage_t frame_damage;
+
+// Each screen layer records its own display list, only changed layers are rasterized
+typedef struct {
+    osd_dl_t dl[2];                     // alternating, the previous one is kept for comparison
+    osd_damage_t damage;                // drawn when the layer was rasterized last time
+    int changed;                        // rasterized in this frame
+    int redraw;                         // display didn't take the last frame, rasterize again
+    unsigned int frames;                // rasterized frames since the last debug report
+} screen_layer_t;
+
+static screen_layer_t screen_layers[OSD_SCREEN_LAYERS];
+static int screen_layer_count = 1;      // backend sets more if it can show them
+static int frame_dl_idx;
+
+#ifndef GRAPHICS_FIXED_WIDTH
+int graphics_width = GRAPHICS_DEFAULT_WIDTH, graphics_height = GRAPHICS_DEFAULT_HEIGHT;
+#endif
+
+// Pixel writes are clipped to this rect. Tile workers narrow it to their tile.
+static __thread osd_rect_t draw_clip = { 0, 0, GRAPHICS_DEFAULT_WIDTH - 1, GRAPHICS_DEFAULT_HEIGHT - 1 };
+static __thread int draw_tiled = 0;
+
+// BE: ABGR
+// LE: RGBA
+uint32_t osd_palette[OSD_PALETTE_SIZE] = {
+    0x00000000u,  // transparent
+    0xff000000u,  // black
+    0xff41ff00u,  // monochrome crt green
+    0xff0000ffu,  // amber
+};
+static int palette_changed = 0;
+
+static inline osd_pixel_t resolve_color(int opaq, int color)
+{
+    assert((opaq == 0 || opaq == 1) && (color >= 0 && color <= 2));
+#ifdef GRAPHICS_INDEXED
+    return opaq ? color + 1 : 0;
+#else
+    return opaq ? osd_palette[color + 1] : 0u;
+#endif
+}
+
+static inline osd_pixel_t *pixel_ptr(int x, int y)
+{
+#ifdef __BCM_OPENVG__
+    return ((osd_pixel_t*)video_buf_int) + GRAPHICS_WIDTH * (GRAPHICS_HEIGHT - y - 1) + x;
+#else
+    return ((osd_pixel_t*)video_buf_int) + GRAPHICS_WIDTH * (y) + x;
+#endif
+}
+
+// Distance in pixels between (x, y) and (x, y + 1)
+#ifdef __BCM_OPENVG__
+#define PIXEL_ROW_STEP (-GRAPHICS_WIDTH)
+#else
+#define PIXEL_ROW_STEP GRAPHICS_WIDTH
+#endif
+
+static void damage_add_slow(osd_damage_t *damage, int x0, int y0, int x1, int y1);
+
+static inline int rect_area(const osd_rect_t *r)
+{
+    return (r->x1 - r->x0 + 1) * (r->y1 - r->y0 + 1);
+}
+
+/**
+ * damage_add: add rectangle to damage list
+ * Rectangles which already lie inside the most recently grown rect are
+ * ignored without a scan, so per-pixel calls after a primitive has
+ * registered its bounding box are cheap.
+ *
+ * @param       damage  damage list
+ * @param       x0, y0  first corner (inclusive)
+ * @param       x1, y1  opposite corner (inclusive), may be above or left of the first
+ */
+void damage_add(osd_damage_t *damage, int x0, int y0, int x1, int y1)
+{
+    osd_rect_t *r = damage->rects + damage->last;
+
+    if (x1 < x0) SWAP(x0, x1);
+    if (y1 < y0) SWAP(y0, y1);
+
+    if (damage->count > 0 && x0 >= r->x0 && x1 <= r->x1 && y0 >= r->y0 && y1 <= r->y1)
+        return;
+
+    damage_add_slow(damage, x0, y0, x1, y1);
+}
+
+static void damage_add_slow(osd_damage_t *damage, int x0, int y0, int x1, int y1)
+{
+    osd_rect_t n;
+    int i, best = 0, best_grow = -1;
+
+    // Clip to screen, drop if fully outside
+    if (x1 < GRAPHICS_LEFT || x0 > GRAPHICS_RIGHT || y1 < GRAPHICS_TOP || y0 > GRAPHICS_BOTTOM)
+        return;
+
+    CLIP_COORDS(x0, y0);
+    CLIP_COORDS(x1, y1);
+
+    n.x0 = x0; n.y0 = y0; n.x1 = x1; n.y1 = y1;
+
+    for (i = 0; i < damage->count; i++)
+    {
+        osd_rect_t *r = damage->rects + i;
+        osd_rect_t u = { MIN(r->x0, n.x0), MIN(r->y0, n.y0), MAX(r->x1, n.x1), MAX(r->y1, n.y1) };
+        int grow = rect_area(&u) - rect_area(r);
+
+        // Merge when union doesn't waste more than the new rect itself covers
+        if (grow <= rect_area(&n))
+        {
+            *r = u;
+            damage->last = i;
+            return;
+        }
+
+        if (best_grow < 0 || grow < best_grow)
+        {
+            best_grow = grow;
+            best = i;
+        }
+    }
+
+    if (damage->count < OSD_MAX_DAMAGE_RECTS)
+    {
+        damage->last = damage->count++;
+        damage->rects[damage->last] = n;
+        return;
+    }
+
+    // List is full: grow the rect which needs the least extra area
+    osd_rect_t *r = damage->rects + best;
+    r->x0 = MIN(r->x0, n.x0);
+    r->y0 = MIN(r->y0, n.y0);
+    r->x1 = MAX(r->x1, n.x1);
+    r->y1 = MAX(r->y1, n.y1);
+    damage->last = best;
+}
+
+void damage_merge(osd_damage_t *dst, const osd_damage_t *src)
+{
+    for (int i = 0; i < src->count; i++)
+    {
+        const osd_rect_t *r = src->rects + i;
+        damage_add(dst, r->x0, r->y0, r->x1, r->y1);
+    }
+}
+
+int damage_area(const osd_damage_t *damage)
+{
+    int area = 0;
+    for (int i = 0; i < damage->count; i++)
+    {
+        area += rect_area(damage->rects + i);
+    }
+    return area;
+}
+
+/*
+ * Clear only the regions which were drawn in the previous frame,
+ * everything else is still transparent.
+ */
+static void clear_damage(const osd_damage_t *damage)
+{
+    for (int i = 0; i < damage->count; i++)
+    {
+        const osd_rect_t *r = damage->rects + i;
+        int len = (r->x1 - r->x0 + 1) * sizeof(osd_pixel_t);
+
+        for (int y = r->y0; y <= r->y1; y++)
+        {
+            memset(pixel_ptr(r->x0, y), '\0', len);
+        }
+    }
+}
+
+#ifdef GRAPHICS_INDEXED
+/**
+ * expand_pixels: convert palette indexes to RGBA.
+ *
+ * @param       dst     RGBA pixels
+ * @param       src     palette indexes
+ * @param       count   number of pixels
+ */
+void expand_pixels(uint32_t *dst, const osd_pixel_t *src, int count)
+{
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    __m128i pal[OSD_PALETTE_SIZE], key[OSD_PALETTE_SIZE];
+
+    for (int i = 0; i < OSD_PALETTE_SIZE; i++)
+    {
+        pal[i] = _mm_set1_epi32((int)osd_palette[i]);
+        key[i] = _mm_set1_epi32(i);
+    }
+
+    for (; count >= 16; count -= 16, src += 16, dst += 16)
+    {
+        __m128i idx = _mm_loadu_si128((const __m128i*)src);
+
+        // Most of the OSD is transparent
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(idx, zero)) == 0xffff)
+        {
+            for (int j = 0; j < 4; j++) _mm_storeu_si128((__m128i*)dst + j, pal[0]);
+            continue;
+        }
+
+        __m128i lo = _mm_unpacklo_epi8(idx, zero), hi = _mm_unpackhi_epi8(idx, zero);
+        __m128i q[4] = { _mm_unpacklo_epi16(lo, zero), _mm_unpackhi_epi16(lo, zero),
+                         _mm_unpacklo_epi16(hi, zero), _mm_unpackhi_epi16(hi, zero) };
+
+        for (int j = 0; j < 4; j++)
+        {
+            __m128i out = zero;
+            for (int i = 0; i < OSD_PALETTE_SIZE; i++)
+            {
+                out = _mm_or_si128(out, _mm_and_si128(_mm_cmpeq_epi32(q[j], key[i]), pal[i]));
+            }
+            _mm_storeu_si128((__m128i*)dst + j, out);
+        }
+    }
+#elif defined(__ARM_NEON)
+    // One table per RGBA byte, vtbl returns 0 for indexes past the palette
+    uint8_t tables[4][8] = { { 0 } };
+    uint8x8_t tab[4];
+
+    for (int i = 0; i < OSD_PALETTE_SIZE; i++)
+    {
+        for (int c = 0; c < 4; c++) tables[c][i] = osd_palette[i] >> (8 * c);
+    }
+    for (int c = 0; c < 4; c++) tab[c] = vld1_u8(tables[c]);
+
+    for (; count >= 8; count -= 8, src += 8, dst += 8)
+    {
+        uint8x8_t idx = vld1_u8(src);
+        uint8x8x4_t out;
+
+        out.val[0] = vtbl1_u8(tab[0], idx);
+        out.val[1] = vtbl1_u8(tab[1], idx);
+        out.val[2] = vtbl1_u8(tab[2], idx);
+        out.val[3] = vtbl1_u8(tab[3], idx);
+        vst4_u8((uint8_t *)dst, out);
+    }
+#endif
+    while (count-- > 0) *dst++ = osd_palette[*src++];
+}
+
+#if defined(__BCM_OPENVG__) || defined(__GST_OPENGL__)
+/**
+ * expand_damage: expand damaged regions of the draw buffer into RGBA image
+ * with the same layout.
+ *
+ * @param       dst     RGBA image
+ * @param       damage  regions to expand
+ */
+static void expand_damage(uint32_t *dst, const osd_damage_t *damage)
+{
+    for (int i = 0; i < damage->count; i++)
+    {
+        const osd_rect_t *r = damage->rects + i;
+
+        for (int y = r->y0; y <= r->y1; y++)
+        {
+            const osd_pixel_t *src = pixel_ptr(r->x0, y);
+            expand_pixels(dst + (src - (const osd_pixel_t *)video_buf_int), src, r->x1 - r->x0 + 1);
+        }
+    }
+}
+#endif
+#endif
+
+/**
+ * set_osd_color: change palette entry. Indexed builds recolor the next frame,
+ * RGBA builds bake colors into glyphs and layers, so call it before osd_init().
+ *
+ * @param       color   0 = black, 1 = main, 2 = warn
+ * @param       rgba    new color
+ */
+void set_osd_color(int color, uint32_t rgba)
+{
+    assert(color >= 0 && color < OSD_PALETTE_SIZE - 1);
+    osd_palette[color + 1] = rgba;
+    palette_changed = 1;
+}
 
 #ifdef __BCM_OPENVG__
 STATE_T ogl_state;
 static int corr_x, corr_y;
 static float corr_scale_x, corr_scale_y;
+#ifdef GRAPHICS_INDEXED
+static uint32_t *video_buf_rgba;
+static osd_damage_t shown_damage;       // drawn in the previous frame, cleared now
+#endif
 
 void render_init(int shift_x, int shift_y, float scale_x, float scale_y)
 {
@@ -71,11 +375,17 @@ void render_init(int shift_x, int shift_y, float scale_x, float scale_y)
     corr_scale_y = scale_y;
 
     fprintf(stderr, "Screen HW %dx%d, virtual %dx%d, corr %d, %d, %f, %f \n", ogl_state.screen_width, ogl_state.screen_height, GRAPHICS_WIDTH, GRAPHICS_HEIGHT, corr_x, corr_y, corr_scale_x, corr_scale_y);
-    video_buf_int = malloc(GRAPHICS_WIDTH * GRAPHICS_HEIGHT * 4);
+    video_buf_int = calloc(GRAPHICS_WIDTH * GRAPHICS_HEIGHT, sizeof(osd_pixel_t));
+#ifdef GRAPHICS_INDEXED
+    video_buf_rgba = calloc(GRAPHICS_WIDTH * GRAPHICS_HEIGHT, 4);
+#endif
 }
 
-void clearGraphics(void) {
-    memset(video_buf_int, '\0', GRAPHICS_WIDTH * GRAPHICS_HEIGHT * 4);
+void clearGraphics(int layer) {
+#ifdef GRAPHICS_INDEXED
+    shown_damage = frame_damage;
+#endif
+    clear_damage(&frame_damage);
 }
 
 void* displayGraphics(void) {
@@ -96,7 +406,13 @@ void* displayGraphics(void) {
     float screen_scale_y = (float)ogl_state.screen_height / GRAPHICS_HEIGHT * corr_scale_y;
     float screen_scale = MIN(screen_scale_x, screen_scale_y);
 
+#ifdef GRAPHICS_INDEXED
+    damage_merge(&shown_damage, &frame_damage);
+    expand_damage(video_buf_rgba, &shown_damage);
+    vgImageSubData(img, (void *)video_buf_rgba, dstride, rgbaFormat, 0, 0, GRAPHICS_WIDTH, GRAPHICS_HEIGHT);
+#else
     vgImageSubData(img, (void *)video_buf_int, dstride, rgbaFormat, 0, 0, GRAPHICS_WIDTH, GRAPHICS_HEIGHT);
+#endif
     vgSeti(VG_MATRIX_MODE, VG_MATRIX_IMAGE_USER_TO_SURFACE);
     vgLoadIdentity();
     vgTranslate((1.0 - screen_scale/screen_scale_x) / 2.0 * ogl_state.screen_width  + corr_x,
@@ -119,35 +435,106 @@ void* displayGraphics(void) {
 #ifdef __GST_OPENGL__
 static GstBuffer *gst_buffer;
 static GstMapInfo info_in;
+static GstBufferPool *gst_pool;
+static GQuark damage_quark;
+// Serializes render() callers (appsrc need-data, frame poll, wfbosdoverlay), telemetry is lock-free
 pthread_mutex_t video_mutex = PTHREAD_MUTEX_INITIALIZER;
 
+/**
+ * render_set_buffer_pool: set pool of RGBA buffers the frames are rendered into.
+ *
+ * @param       pool    active pool of GRAPHICS_WIDTH x GRAPHICS_HEIGHT RGBA buffers
+ */
+void render_set_buffer_pool(GstBufferPool *pool)
+{
+    gst_pool = pool;
+}
+
+/*
+ * Pooled buffers come back with the frame they were pushed with, so only
+ * regions drawn into that frame need to be cleared. They are kept on the
+ * buffer itself, a buffer seen first is cleared as a whole.
+ */
+static osd_damage_t *acquire_frame_buffer(void)
+{
+    osd_damage_t *stale;
+
+    if (gst_buffer_pool_acquire_buffer(gst_pool, &gst_buffer, NULL) != GST_FLOW_OK)
+    {
+        fprintf(stderr, "Unable to acquire OSD buffer\n");
+        exit(1);
+    }
+
+    stale = gst_mini_object_get_qdata(GST_MINI_OBJECT(gst_buffer), damage_quark);
+    if (stale == NULL)
+    {
+        stale = g_new0(osd_damage_t, 1);
+        damage_add(stale, GRAPHICS_LEFT, GRAPHICS_TOP, GRAPHICS_RIGHT, GRAPHICS_BOTTOM);
+        gst_mini_object_set_qdata(GST_MINI_OBJECT(gst_buffer), damage_quark, stale, g_free);
+    }
+
+    gst_buffer_map(gst_buffer, &info_in, GST_MAP_WRITE);
+    return stale;
+}
+
+#ifdef GRAPHICS_INDEXED
+// Indexes are drawn into a persistent buffer and expanded into a pooled RGBA buffer per frame
+void render_init(int shift_x, int shift_y, float scale_x, float scale_y)
+{
+    gst_buffer = NULL;
+    damage_quark = g_quark_from_static_string("osd-damage");
+    video_buf_int = calloc(GRAPHICS_WIDTH * GRAPHICS_HEIGHT, sizeof(osd_pixel_t));
+    // First frame negotiates the OSD branch even if nothing is drawn
+    screen_layers[0].redraw = 1;
+}
+
+void clearGraphics(int layer)
+{
+    clear_damage(&frame_damage);
+}
+
+void *displayGraphics(void)
+{
+    osd_damage_t *stale = acquire_frame_buffer();
+
+    // Regions of the old frame are transparent in the draw buffer unless drawn again
+    damage_merge(stale, &frame_damage);
+    expand_damage((uint32_t *)info_in.data, stale);
+    *stale = frame_damage;
+    gst_buffer_unmap(gst_buffer, &info_in);
+    return gst_buffer;
+}
+#else
 void render_init(int shift_x, int shift_y, float scale_x, float scale_y)
 {
     gst_buffer = NULL;
+    damage_quark = g_quark_from_static_string("osd-damage");
     video_buf_int = NULL;
+    // First frame negotiates the OSD branch even if nothing is drawn
+    screen_layers[0].redraw = 1;
 }
 
-void clearGraphics(void)
+void clearGraphics(int layer)
 {
-    gst_buffer = gst_buffer_new_allocate(NULL, GRAPHICS_WIDTH * GRAPHICS_HEIGHT * 4, NULL);
-    gst_buffer_memset(gst_buffer, 0, 0, GRAPHICS_WIDTH * GRAPHICS_HEIGHT * 4);
-    gst_buffer_map(gst_buffer, &info_in, GST_MAP_WRITE);
+    osd_damage_t *stale = acquire_frame_buffer();
+
     video_buf_int = info_in.data;
+    clear_damage(stale);
 }
 
 void *displayGraphics(void)
 {
+    *(osd_damage_t *)gst_mini_object_get_qdata(GST_MINI_OBJECT(gst_buffer), damage_quark) = frame_damage;
     gst_buffer_unmap(gst_buffer, &info_in);
     return gst_buffer;
 }
 #endif
+#endif
 
 
 #ifdef __DRM_ROCKCHIP__
-
-int drm_init(void);
-void drm_cleanup(void);
-void drm_display_buffer(void *src_buf);
+static int drm_direct;                  // drawing goes straight into the dumb buffer
+static uint8_t *layer_buf[OSD_SCREEN_LAYERS];
 
 void render_init(int shift_x, int shift_y, float scale_x, float scale_y)
 {
@@ -156,27 +543,164 @@ void render_init(int shift_x, int shift_y, float scale_x, float scale_y)
         exit(1);
     }
     atexit(drm_cleanup);
-    video_buf_int = malloc(GRAPHICS_WIDTH * GRAPHICS_HEIGHT * 4);
+    screen_layer_count = drm_layer_count();
+    drm_direct = drm_back_buffer(0, NULL) != NULL;
+    for (int l = 0; l < screen_layer_count && !drm_direct; l++)
+    {
+        layer_buf[l] = calloc(GRAPHICS_WIDTH * GRAPHICS_HEIGHT, sizeof(osd_pixel_t));
+    }
 }
 
-void clearGraphics(void)
+void clearGraphics(int layer)
 {
-    memset(video_buf_int, '\0', GRAPHICS_WIDTH * GRAPHICS_HEIGHT * 4);
+    if (drm_direct)
+    {
+        // Back buffer still holds the frame before previous one
+        osd_damage_t stale;
+        video_buf_int = drm_back_buffer(layer, &stale);
+        clear_damage(&stale);
+    }
+    else
+    {
+        video_buf_int = layer_buf[layer];
+        clear_damage(&frame_damage);
+    }
 }
 
 void* displayGraphics(void)
 {
-    drm_display_buffer(video_buf_int);
+    for (int l = 0; l < screen_layer_count; l++)
+    {
+        screen_layer_t *sl = screen_layers + l;
+
+        // A display busy with the previous flip misses the frame, the layer has to come again
+        if (sl->changed && drm_display_buffer(l, layer_buf[l], &sl->damage) < 0)
+        {
+            sl->redraw = 1;
+        }
+    }
+    drm_commit();
     return NULL;
 }
 
 #endif
 
 
+static unsigned int frames_skipped;
+static uint64_t raster_ns;
+static unsigned int raster_frames;
+
+static uint64_t monotonic_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void print_debug_stats(const osd_dl_t *dl)
+{
+    fprintf(stderr, "text cache: %u hits, %u misses, %u evictions, %u runs, %zu/%zu bytes\n",
+            text_cache_stats.hits, text_cache_stats.misses, text_cache_stats.evictions,
+            text_cache_stats.entries, text_cache_stats.bytes, text_cache_budget);
+    fprintf(stderr, "display list: %d commands, %zu/%zu bytes, %u unchanged frames skipped\n",
+            dl->count, dl->size, dl->capacity, frames_skipped);
+    if (raster_frames > 0)
+    {
+        fprintf(stderr, "raster: %.1f us/frame, %d threads\n", raster_ns / 1000.0 / raster_frames, raster_threads);
+        raster_ns = 0;
+        raster_frames = 0;
+    }
+    if (screen_layer_count > 1)
+    {
+        fprintf(stderr, "screen layers: dynamic rasterized %u times, static %u times\n",
+                screen_layers[OSD_LAYER_DYNAMIC].frames, screen_layers[OSD_LAYER_STATIC].frames);
+        for (int l = 0; l < screen_layer_count; l++) screen_layers[l].frames = 0;
+    }
+}
+
+/**
+ * select_screen_layer: record following drawing into a screen layer.
+ * Without a display plane per layer everything goes to the same one.
+ *
+ * @param       layer   OSD_LAYER_DYNAMIC or OSD_LAYER_STATIC
+ */
+void select_screen_layer(int layer)
+{
+    if (dl_current == NULL)
+        return;
+
+    layer = MIN(MAX(layer, 0), screen_layer_count - 1);
+    dl_current = screen_layers[layer].dl + frame_dl_idx;
+}
+
 void* render(void)
 {
-    clearGraphics();
+    static unsigned int frames = 0;
+    int changed = 0;
+
+    // Drawing starts in the dynamic layer, widgets switch it
+    for (int l = screen_layer_count - 1; l >= 0; l--)
+    {
+        dl_record_begin(screen_layers[l].dl + frame_dl_idx);
+    }
     RenderScreen();
+    dl_record_end();
+    frame_dl_idx = !frame_dl_idx;
+
+    if (osd_debug && ++frames % 300 == 0)
+    {
+        print_debug_stats(screen_layers[OSD_LAYER_DYNAMIC].dl + !frame_dl_idx);
+    }
+
+    uint64_t t0 = osd_debug ? monotonic_ns() : 0;
+    for (int l = 0; l < screen_layer_count; l++)
+    {
+        screen_layer_t *sl = screen_layers + l;
+        const osd_dl_t *cur = sl->dl + !frame_dl_idx;
+
+        // Same commands as the previous frame: the displayed image is still valid
+        sl->changed = palette_changed || sl->redraw || !dl_equal(cur, sl->dl + frame_dl_idx);
+        if (!sl->changed)
+            continue;
+
+        sl->redraw = 0;
+        sl->frames++;
+        changed++;
+
+        frame_damage = sl->damage;
+        clearGraphics(l);
+        frame_damage.count = 0;
+        frame_damage.last = 0;
+        if (raster_threads > 1)
+        {
+            tiler_execute(cur);
+        }
+        else
+        {
+            dl_execute(cur, NULL);
+        }
+
+        if (palette_changed)
+        {
+            // Every visible pixel has to be converted with the new colors
+            damage_add(&frame_damage, GRAPHICS_LEFT, GRAPHICS_TOP, GRAPHICS_RIGHT, GRAPHICS_BOTTOM);
+        }
+        sl->damage = frame_damage;
+    }
+    palette_changed = 0;
+
+    if (changed == 0)
+    {
+        frames_skipped++;
+        return NULL;
+    }
+
+    if (osd_debug)
+    {
+        raster_ns += monotonic_ns() - t0;
+        raster_frames++;
+    }
+
     return displayGraphics();
 }
 
@@ -203,46 +727,384 @@ void drawBox(uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2) {
 }
 
 /**
- * write_pixel_lm: write the pixel on both surfaces (level and mask.)
- * Uses current draw buffer.
+ * fill_span: fill run of pixels with one value.
  *
- * @param       x               x coordinate
- * @param       y               y coordinate
- * @param       opaq    0 = transparent, 1 = opaque
- * @param       color   0 = black, 1 = main, 2 = warn
+ * @param       dst     first pixel
+ * @param       value   pixel value
+ * @param       count   number of pixels
  */
-void inline write_pixel_lm(int x, int y, int opaq, int color){
-    CHECK_COORDS(x, y);
-    assert((opaq == 0 || opaq == 1) && (color >= 0 && color <= 2));
+static inline void fill_span(osd_pixel_t *dst, osd_pixel_t value, int count)
+{
+#ifdef GRAPHICS_INDEXED
+    memset(dst, value, count);
+#else
+#if defined(__SSE2__)
+    __m128i v = _mm_set1_epi32((int)value);
 
-#ifdef __BCM_OPENVG__
-    uint32_t *ptr = ((uint32_t*)video_buf_int) + GRAPHICS_WIDTH * (GRAPHICS_HEIGHT - y - 1) + x;
+    // Align destination so the main loop uses aligned stores
+    for (; count > 0 && ((uintptr_t)dst & 15); count--) *dst++ = value;
+    for (; count >= 8; count -= 8, dst += 8)
+    {
+        _mm_store_si128((__m128i*)dst, v);
+        _mm_store_si128((__m128i*)(dst + 4), v);
+    }
+    for (; count >= 4; count -= 4, dst += 4) _mm_store_si128((__m128i*)dst, v);
+#elif defined(__ARM_NEON)
+    uint32x4_t v = vdupq_n_u32(value);
+
+    for (; count >= 8; count -= 8, dst += 8)
+    {
+        vst1q_u32(dst, v);
+        vst1q_u32(dst + 4, v);
+    }
+    for (; count >= 4; count -= 4, dst += 4) vst1q_u32(dst, v);
+#endif
+    while (count-- > 0) *dst++ = value;
+#endif
+}
+
+/**
+ * fill_rect: fill clipped rectangle with one value.
+ * Coordinates are inclusive and must be already clipped to the screen.
+ *
+ * @param       x0, y0  top-left corner
+ * @param       x1, y1  bottom-right corner
+ * @param       value   pixel value
+ */
+static void fill_rect(int x0, int y0, int x1, int y1, osd_pixel_t value)
+{
+    osd_pixel_t *row = pixel_ptr(x0, y0);
+    int width = x1 - x0 + 1;
+
+    damage_add(&frame_damage, x0, y0, x1, y1);
+
+    if (width == 1)
+    {
+        for (int y = y0; y <= y1; y++, row += PIXEL_ROW_STEP) *row = value;
+        return;
+    }
+
+    for (int y = y0; y <= y1; y++, row += PIXEL_ROW_STEP)
+    {
+        fill_span(row, value, width);
+    }
+}
+
+/**
+ * blit_span_keyed: copy run of pixels, skipping the ones equal to the key.
+ *
+ * @param       dst     first destination pixel
+ * @param       src     first source pixel
+ * @param       count   number of pixels
+ * @param       key     transparent source value
+ */
+static inline void blit_span_keyed(osd_pixel_t *dst, const osd_pixel_t *src, int count, osd_pixel_t key)
+{
+#ifdef GRAPHICS_INDEXED
+#if defined(__SSE2__)
+    const __m128i k = _mm_set1_epi8((char)key);
+
+    for (; count >= 16; count -= 16, dst += 16, src += 16)
+    {
+        __m128i s = _mm_loadu_si128((const __m128i*)src);
+        __m128i d = _mm_loadu_si128((const __m128i*)dst);
+        __m128i keep = _mm_cmpeq_epi8(s, k);
+        _mm_storeu_si128((__m128i*)dst, _mm_or_si128(_mm_andnot_si128(keep, s), _mm_and_si128(keep, d)));
+    }
+#elif defined(__ARM_NEON)
+    const uint8x16_t k = vdupq_n_u8(key);
+
+    for (; count >= 16; count -= 16, dst += 16, src += 16)
+    {
+        uint8x16_t s = vld1q_u8(src);
+        uint8x16_t keep = vceqq_u8(s, k);
+        vst1q_u8(dst, vbslq_u8(keep, vld1q_u8(dst), s));
+    }
+#endif
+#elif defined(__SSE2__)
+    const __m128i k = _mm_set1_epi32((int)key);
+
+    for (; count >= 4; count -= 4, dst += 4, src += 4)
+    {
+        __m128i s = _mm_loadu_si128((const __m128i*)src);
+        __m128i d = _mm_loadu_si128((const __m128i*)dst);
+        __m128i keep = _mm_cmpeq_epi32(s, k);
+        _mm_storeu_si128((__m128i*)dst, _mm_or_si128(_mm_andnot_si128(keep, s), _mm_and_si128(keep, d)));
+    }
+#elif defined(__ARM_NEON)
+    const uint32x4_t k = vdupq_n_u32(key);
+
+    for (; count >= 4; count -= 4, dst += 4, src += 4)
+    {
+        uint32x4_t s = vld1q_u32(src);
+        uint32x4_t keep = vceqq_u32(s, k);
+        vst1q_u32(dst, vbslq_u32(keep, vld1q_u32(dst), s));
+    }
+#endif
+    for (; count > 0; count--, dst++, src++)
+    {
+        if (*src != key) *dst = *src;
+    }
+}
+
+/**
+ * blit_keyed: draw pixels with their top-left corner at (x, y),
+ * skipping the ones equal to the key.
+ *
+ * @param       sprite  pixels to draw
+ * @param       x       x coordinate (left)
+ * @param       y       y coordinate (top)
+ * @param       key     transparent value
+ */
+static void blit_keyed(const osd_sprite_t *sprite, int x, int y, osd_pixel_t key)
+{
+    int x0 = x, y0 = y, x1 = x + sprite->width - 1, y1 = y + sprite->height - 1;
+
+    if (x1 < draw_clip.x0 || x0 > draw_clip.x1 || y1 < draw_clip.y0 || y0 > draw_clip.y1) return;
+    x0 = MAX(x0, draw_clip.x0);
+    y0 = MAX(y0, draw_clip.y0);
+    x1 = MIN(x1, draw_clip.x1);
+    y1 = MIN(y1, draw_clip.y1);
+
+    damage_add(&frame_damage, x0, y0, x1, y1);
+
+    const osd_pixel_t *src = sprite->pixels + (y0 - y) * sprite->width + (x0 - x);
+    osd_pixel_t *dst = pixel_ptr(x0, y0);
+
+    for (int j = y0; j <= y1; j++, src += sprite->width, dst += PIXEL_ROW_STEP)
+    {
+        blit_span_keyed(dst, src, x1 - x0 + 1, key);
+    }
+}
+
+/**
+ * blit_sprite: draw sprite with its top-left corner at (x, y).
+ * Zero pixels of the sprite are transparent and leave the buffer untouched.
+ *
+ * @param       sprite  sprite to draw
+ * @param       x       x coordinate (left)
+ * @param       y       y coordinate (top)
+ */
+void blit_sprite(const osd_sprite_t *sprite, int x, int y)
+{
+    blit_keyed(sprite, x, y, 0);
+}
+
+/*
+ * Layers: drawing between layer_begin() and layer_end() goes to a private
+ * scratch buffer, and the touched area is kept as a sprite which can be
+ * drawn again in later frames without re-rasterizing. The scratch buffer
+ * is filled with a key value no drawing produces, so transparent pixels
+ * written by the widget (erases) are told apart from untouched ones and
+ * the layer replays exactly like direct drawing.
+ */
+static uint8_t *layer_scratch = NULL;
+static osd_pixel_t layer_scratch_key;
+static uint8_t *layer_saved_buf;
+static osd_damage_t layer_saved_damage;
+static osd_dl_t *layer_saved_dl;
+static uint32_t layer_generation;
+
+/**
+ * layer_key: pick pixel value which isn't used by the palette.
+ *
+ * @return      key value
+ */
+static osd_pixel_t layer_key(void)
+{
+#ifdef GRAPHICS_INDEXED
+    return OSD_PALETTE_SIZE;
 #else
-    uint32_t *ptr = ((uint32_t*)video_buf_int) + GRAPHICS_WIDTH * (y) + x;
+    osd_pixel_t key = 0x00ff00ffu;
+
+    for (int i = 0; i < OSD_PALETTE_SIZE; i++)
+    {
+        if (osd_palette[i] == key)
+        {
+            key++;
+            i = -1;
+        }
+    }
+    return key;
 #endif
+}
 
-    if (opaq == 0){
-      *ptr = 0u;
-      return;
+/**
+ * layer_begin: redirect drawing into the layer scratch buffer.
+ */
+void layer_begin(void)
+{
+    osd_pixel_t key = layer_key();
+
+    if (layer_scratch == NULL || key != layer_scratch_key)
+    {
+        if (layer_scratch == NULL)
+        {
+            layer_scratch = malloc(GRAPHICS_WIDTH * GRAPHICS_HEIGHT * sizeof(osd_pixel_t));
+        }
+        if (layer_scratch == NULL)
+        {
+            fprintf(stderr, "Unable to allocate layer buffer\n");
+            exit(1);
+        }
+        fill_span((osd_pixel_t*)layer_scratch, key, GRAPHICS_WIDTH * GRAPHICS_HEIGHT);
+        layer_scratch_key = key;
     }
 
-    // BE: ABGR
-    // LE: RGBA
+    layer_saved_buf = video_buf_int;
+    layer_saved_damage = frame_damage;
+    layer_saved_dl = dl_current;
+    dl_current = NULL;
+    video_buf_int = layer_scratch;
+    frame_damage.count = 0;
+    frame_damage.last = 0;
+}
+
+/**
+ * layer_end: store everything drawn since layer_begin() in the layer
+ * and restore drawing to the frame buffer.
+ *
+ * @param       layer   layer to update
+ */
+void layer_end(osd_layer_t *layer)
+{
+    int x0 = GRAPHICS_RIGHT, y0 = GRAPHICS_BOTTOM, x1 = GRAPHICS_LEFT - 1, y1 = GRAPHICS_TOP - 1;
 
-    switch(color)
+    for (int i = 0; i < frame_damage.count; i++)
     {
-    case 0: //black
-        *ptr = 0xff000000u;
-        break;
+        const osd_rect_t *r = frame_damage.rects + i;
+        x0 = MIN(x0, r->x0);
+        y0 = MIN(y0, r->y0);
+        x1 = MAX(x1, r->x1);
+        y1 = MAX(y1, r->y1);
+    }
 
-    case 1: // monochrome crt green
-        *ptr = 0xff41ff00u;
-        break;
+    layer->x = x0;
+    layer->y = y0;
+    layer->generation = ++layer_generation;
+    layer->key = layer_scratch_key;
+    layer->sprite.width = 0;
+    layer->sprite.height = 0;
 
-    case 2: // amber
-      *ptr = 0xff0000ffu;
-      break;
+    if (x1 >= x0 && y1 >= y0)
+    {
+        int width = x1 - x0 + 1, height = y1 - y0 + 1;
+
+        if (width * height > layer->capacity)
+        {
+            free(layer->pixels);
+            layer->pixels = malloc(width * height * sizeof(osd_pixel_t));
+            layer->capacity = layer->pixels != NULL ? width * height : 0;
+        }
+
+        if (layer->pixels != NULL)
+        {
+            for (int y = y0; y <= y1; y++)
+            {
+                memcpy(layer->pixels + (y - y0) * width, pixel_ptr(x0, y), width * sizeof(osd_pixel_t));
+            }
+            layer->sprite.width = width;
+            layer->sprite.height = height;
+            layer->sprite.pixels = layer->pixels;
+        }
+
+        // Back to all key for the next layer
+        for (int i = 0; i < frame_damage.count; i++)
+        {
+            const osd_rect_t *r = frame_damage.rects + i;
+
+            for (int y = r->y0; y <= r->y1; y++)
+            {
+                fill_span(pixel_ptr(r->x0, y), layer_scratch_key, r->x1 - r->x0 + 1);
+            }
+        }
+    }
+
+    video_buf_int = layer_saved_buf;
+    frame_damage = layer_saved_damage;
+    dl_current = layer_saved_dl;
+}
+
+/**
+ * layer_draw: draw layer content into the frame.
+ *
+ * @param       layer   layer to draw
+ */
+void layer_draw(const osd_layer_t *layer)
+{
+    if (dl_current != NULL && layer->sprite.width > 0)
+    {
+        // Pixels are owned by the layer, the generation tells apart new content at the same address
+        const int32_t args[] = { layer->x, layer->y, layer->sprite.width, layer->sprite.height, layer->generation, layer->key };
+        dl_append(DL_LAYER, layer->x, layer->y, layer->x + layer->sprite.width - 1, layer->y + layer->sprite.height - 1,
+                  args, SIZEOF_ARRAY(args), &layer->sprite.pixels, sizeof(layer->sprite.pixels));
+        return;
     }
+
+    if (layer->sprite.width > 0)
+    {
+        blit_keyed(&layer->sprite, layer->x, layer->y, layer->key);
+    }
+}
+
+/**
+ * set_graphics_size: set render surface size. Must be called before osd_init().
+ *
+ * @param       width   surface width
+ * @param       height  surface height
+ * @return      0 on success, -1 if the size isn't supported
+ */
+int set_graphics_size(int width, int height)
+{
+    if (width < GRAPHICS_REF_WIDTH / 4 || height < GRAPHICS_REF_HEIGHT / 4 ||
+        width > GRAPHICS_MAX_WIDTH || height > GRAPHICS_MAX_HEIGHT)
+        return -1;
+
+#ifdef GRAPHICS_FIXED_WIDTH
+    if (width != GRAPHICS_WIDTH || height != GRAPHICS_HEIGHT)
+        return -1;
+#else
+    graphics_width = width;
+    graphics_height = height;
+#endif
+    set_draw_tile(NULL);
+    return 0;
+}
+
+/**
+ * set_draw_tile: restrict drawing of the calling thread to one tile.
+ * Shared caches are only read while a tile is set.
+ *
+ * @param       tile    tile rect, NULL = whole screen
+ */
+void set_draw_tile(const osd_rect_t *tile)
+{
+    if (tile != NULL)
+    {
+        draw_clip = *tile;
+        draw_tiled = 1;
+    }
+    else
+    {
+        draw_clip = (osd_rect_t){ GRAPHICS_LEFT, GRAPHICS_TOP, GRAPHICS_RIGHT, GRAPHICS_BOTTOM };
+        draw_tiled = 0;
+    }
+}
+
+/**
+ * write_pixel_lm: write the pixel on both surfaces (level and mask.)
+ * Uses current draw buffer.
+ *
+ * @param       x               x coordinate
+ * @param       y               y coordinate
+ * @param       opaq    0 = transparent, 1 = opaque
+ * @param       color   0 = black, 1 = main, 2 = warn
+ */
+void inline write_pixel_lm(int x, int y, int opaq, int color){
+    DL_RECORD(DL_PIXEL, x, y, x, y, x, y, opaq, color);
+    if (x < draw_clip.x0 || x > draw_clip.x1 || y < draw_clip.y0 || y > draw_clip.y1) return;
+    damage_add(&frame_damage, x, y, x, y);
+    *pixel_ptr(x, y) = resolve_color(opaq, color);
 }
 
 
@@ -256,9 +1118,13 @@ void inline write_pixel_lm(int x, int y, int opaq, int color){
  * @param       opaq   0 = transparent, 1 = opaque
  */
 void write_hline_lm(int x0, int x1, int y, int color, int opaq) {
-    int x;
+    DL_RECORD(DL_HLINE, x0, y, x1, y, x0, x1, y, color, opaq);
     if (x1 < x0) SWAP(x0, x1);
-    for(x = x0; x <= x1; x++) write_pixel_lm(x, y, opaq, color);
+    if (y < draw_clip.y0 || y > draw_clip.y1) return;
+    if (x1 < draw_clip.x0 || x0 > draw_clip.x1) return;
+    x0 = MAX(x0, draw_clip.x0);
+    x1 = MIN(x1, draw_clip.x1);
+    fill_rect(x0, y, x1, y, resolve_color(opaq, color));
 }
 
 /**
@@ -276,10 +1142,13 @@ void write_hline_lm(int x0, int x1, int y, int color, int opaq) {
 void write_hline_outlined(int x0, int x1, int y, int endcap0, int endcap1, int mode, int opaq, int color) {
   int stroke, fill;
 
+  DL_RECORD(DL_HLINE_OUTLINED, x0, y - 1, x1, y + 1, x0, x1, y, endcap0, endcap1, mode, opaq, color);
+
   SETUP_STROKE_FILL(stroke, fill, mode);
   if (x0 > x1) {
     SWAP(x0, x1);
   }
+  damage_add(&frame_damage, x0, y - 1, x1, y + 1);
   // Draw the main body of the line.
   write_hline_lm(x0 + 1, x1 - 1, y - 1, stroke, opaq);
   write_hline_lm(x0 + 1, x1 - 1, y + 1, stroke, opaq);
@@ -300,11 +1169,13 @@ void write_hline_outlined(int x0, int x1, int y, int endcap0, int endcap1, int m
  * @param       opaq   0 = transparent, 1 = opaque
  */
 void write_vline_lm(int x, int y0, int y1, int color, int opaq) {
-    // TODO: an optimisation would compute the masks and apply to
-    // both buffers simultaneously.
-    int y;
+    DL_RECORD(DL_VLINE, x, y0, x, y1, x, y0, y1, color, opaq);
     if (y1 < y0) SWAP(y0, y1);
-    for(y = y0; y <= y1; y++) write_pixel_lm(x, y, opaq, color);
+    if (x < draw_clip.x0 || x > draw_clip.x1) return;
+    if (y1 < draw_clip.y0 || y0 > draw_clip.y1) return;
+    y0 = MAX(y0, draw_clip.y0);
+    y1 = MIN(y1, draw_clip.y1);
+    fill_rect(x, y0, x, y1, resolve_color(opaq, color));
 }
 
 /**
@@ -322,10 +1193,13 @@ void write_vline_lm(int x, int y0, int y1, int color, int opaq) {
 void write_vline_outlined(int x, int y0, int y1, int endcap0, int endcap1, int mode, int opaq, int color) {
   int stroke, fill;
 
+  DL_RECORD(DL_VLINE_OUTLINED, x - 1, y0, x + 1, y1, x, y0, y1, endcap0, endcap1, mode, opaq, color);
+
   if (y0 > y1) {
     SWAP(y0, y1);
   }
   SETUP_STROKE_FILL(stroke, fill, mode);
+  damage_add(&frame_damage, x - 1, y0, x + 1, y1);
   // Draw the main body of the line.
   write_vline_lm(x - 1, y0 + 1, y1 - 1, stroke, opaq);
   write_vline_lm(x + 1, y0 + 1, y1 - 1, stroke, opaq);
@@ -347,14 +1221,15 @@ void write_vline_outlined(int x, int y0, int y1, int endcap0, int endcap1, int m
  * @param       opaq   0 = transparent, 1 = opaque
  */
 void write_filled_rectangle_lm(int x, int y, int width, int height, int color, int opaq) {
-    int i, j;
-    for(j=y; j <= y + height; j++)
-    {
-        for(i=x; i <= x + width; i++)
-        {
-            write_pixel_lm(i, j, opaq, color);
-        }
-    }
+    DL_RECORD(DL_FILLED_RECTANGLE, x, y, x + width, y + height, x, y, width, height, color, opaq);
+    int x1 = x + width, y1 = y + height;
+    if (width < 0 || height < 0) return;
+    if (x1 < draw_clip.x0 || x > draw_clip.x1 || y1 < draw_clip.y0 || y > draw_clip.y1) return;
+    x = MAX(x, draw_clip.x0);
+    y = MAX(y, draw_clip.y0);
+    x1 = MIN(x1, draw_clip.x1);
+    y1 = MIN(y1, draw_clip.y1);
+    fill_rect(x, y, x1, y1, resolve_color(opaq, color));
 }
 
 /**
@@ -369,6 +1244,8 @@ void write_filled_rectangle_lm(int x, int y, int width, int height, int color, i
  * @param       opaq   0 = transparent, 1 = opaque
  */
 void write_rectangle_outlined(int x, int y, int width, int height, int mode, int opaq) {
+  DL_RECORD(DL_RECTANGLE_OUTLINED, x - 1, y - 1, x + width + 1, y + height + 1, x, y, width, height, mode, opaq);
+  damage_add(&frame_damage, x - 1, y - 1, x + width + 1, y + height + 1);
   write_hline_outlined(x, x + width, y, ENDCAP_ROUND, ENDCAP_ROUND, mode, opaq, 1);
   write_hline_outlined(x, x + width, y + height, ENDCAP_ROUND, ENDCAP_ROUND, mode, opaq, 1);
   write_vline_outlined(x, y, y + height, ENDCAP_ROUND, ENDCAP_ROUND, mode, opaq, 1);
@@ -390,8 +1267,11 @@ void write_rectangle_outlined(int x, int y, int width, int height, int mode, int
 void write_circle_outlined(int cx, int cy, int r, int dashp, int bmode, int mode, int opaq, int color) {
   int stroke, fill;
 
+  DL_RECORD(DL_CIRCLE_OUTLINED, cx - r - 2, cy - r - 2, cx + r + 2, cy + r + 2, cx, cy, r, dashp, bmode, mode, opaq, color);
+
   CHECK_COORDS(cx, cy);
   SETUP_STROKE_FILL(stroke, fill, mode);
+  damage_add(&frame_damage, cx - r - 2, cy - r - 2, cx + r + 2, cy + r + 2);
   // This is a two step procedure. First, we draw the outline of the
   // circle, then we draw the inner part.
   int error = -r, x = r, y = 0;
@@ -444,6 +1324,8 @@ void write_circle_outlined(int cx, int cy, int r, int dashp, int bmode, int mode
  */
 void write_line_lm(int x0, int y0, int x1, int y1, int opaq, int color) {
   // Based on http://en.wikipedia.org/wiki/Bresenham%27s_line_algorithm
+  DL_RECORD(DL_LINE, x0, y0, x1, y1, x0, y0, x1, y1, opaq, color);
+  damage_add(&frame_damage, x0, y0, x1, y1);
   int steep = abs(y1 - y0) > abs(x1 - x0);
 
   if (steep) {
@@ -500,6 +1382,9 @@ void write_line_outlined(int x0, int y0, int x1, int y1,
   // This could be improved for speed.
   int omode, imode;
 
+  DL_RECORD(DL_LINE_OUTLINED, MIN(x0, x1) - 1, MIN(y0, y1) - 1, MAX(x0, x1) + 1, MAX(y0, y1) + 1,
+            x0, y0, x1, y1, endcap0, endcap1, mode, opaq);
+
   switch(mode)
   {
   case 0:
@@ -518,6 +1403,7 @@ void write_line_outlined(int x0, int y0, int x1, int y1,
       assert(0);
   }
 
+  damage_add(&frame_damage, MIN(x0, x1) - 1, MIN(y0, y1) - 1, MAX(x0, x1) + 1, MAX(y0, y1) + 1);
   int steep = abs(y1 - y0) > abs(x1 - x0);
   if (steep) {
     SWAP(x0, y0);
@@ -595,6 +1481,9 @@ void write_line_outlined_dashed(int x0, int y0, int x1, int y1,
   // This could be improved for speed.
   int omode, imode;
 
+  DL_RECORD(DL_LINE_OUTLINED_DASHED, MIN(x0, x1) - 1, MIN(y0, y1) - 1, MAX(x0, x1) + 1, MAX(y0, y1) + 1,
+            x0, y0, x1, y1, endcap0, endcap1, mode, opaq, dots);
+
   if (mode == 0) {
     omode = 0;
     imode = 1;
@@ -602,6 +1491,7 @@ void write_line_outlined_dashed(int x0, int y0, int x1, int y1,
     omode = 1;
     imode = 0;
   }
+  damage_add(&frame_damage, MIN(x0, x1) - 1, MIN(y0, y1) - 1, MAX(x0, x1) + 1, MAX(y0, y1) + 1);
   int steep = abs(y1 - y0) > abs(x1 - x0);
   if (steep) {
     SWAP(x0, y0);
@@ -697,6 +1587,148 @@ int fetch_font_info(uint8_t ch, int font, struct FontEntry *font_info, char *loo
   return 1;
 }
 
+/*
+ * Glyph atlas: every font is expanded once into glyph images for each
+ * (color, FONT_INVERT) combination, so drawing text is a masked copy of
+ * glyph rows instead of per-pixel bit tests.
+ */
+#define GLYPH_COLORS 3
+
+static struct {
+  int width, height;
+  int offset;                   // font8x10/font12x18 glyphs are drawn at (x + 1, y + 1)
+  int size;                     // pixels per glyph
+  uint8_t index[256];           // character -> glyph, 0xff if not present
+  osd_pixel_t *pixels[GLYPH_COLORS][2];
+} glyph_atlas[NUM_FONTS];
+
+static void glyph_atlas_build_font(int font)
+{
+  struct FontEntry font_info = fonts[font];
+  int count = 0;
+
+  glyph_atlas[font].width = font_info.width;
+  glyph_atlas[font].height = font_info.height;
+  glyph_atlas[font].offset = font_info.id < 2 ? 0 : 1;
+  glyph_atlas[font].size = font_info.width * font_info.height;
+
+  for (int ch = 0; ch < 256; ch++) {
+    if (font_info.id < 2) {
+      glyph_atlas[font].index[ch] = (uint8_t)font_info.lookup[ch];
+      if ((uint8_t)font_info.lookup[ch] != 0xff && (uint8_t)font_info.lookup[ch] >= count) {
+        count = (uint8_t)font_info.lookup[ch] + 1;
+      }
+    } else {
+      glyph_atlas[font].index[ch] = ch;
+      count = 256;
+    }
+  }
+
+  for (int color = 0; color < GLYPH_COLORS; color++) {
+    for (int invert = 0; invert < 2; invert++) {
+      // Invert flag is ignored by font8x10 and font12x18
+      if (invert && font_info.id >= 2) {
+        glyph_atlas[font].pixels[color][1] = glyph_atlas[font].pixels[color][0];
+        continue;
+      }
+
+      osd_pixel_t *pixels = calloc(count * glyph_atlas[font].size, sizeof(osd_pixel_t));
+      if (pixels == NULL) {
+        fprintf(stderr, "Unable to allocate glyph atlas\n");
+        exit(1);
+      }
+      glyph_atlas[font].pixels[color][invert] = pixels;
+
+      for (int glyph = 0; glyph < count; glyph++) {
+        for (int dy = 0; dy < font_info.height; dy++) {
+          uint16_t levels, mask;
+          uint16_t xshift = font_info.width - 1;
+
+          if (font_info.id < 2) {
+            int row = glyph * font_info.height * 2 + dy;
+            levels = font_info.data[row + font_info.height];
+            if (invert) {
+              levels = ~levels;
+            }
+            mask = font_info.data[row];
+          } else if (font_info.id == 3) {
+            levels = font_frame12x18[glyph * font_info.height + dy];
+            mask = font_mask12x18[glyph * font_info.height + dy];
+          } else {
+            levels = font_frame8x10[glyph * font_info.height + dy];
+            mask = font_mask8x10[glyph * font_info.height + dy];
+          }
+
+          for (int dx = 0; dx < font_info.width; dx++) {
+            if (mask & (1 << (xshift - dx))) {
+              *pixels = resolve_color(1, (levels & (1 << (xshift - dx))) ? color : 0);
+            }
+            pixels++;
+          }
+        }
+      }
+    }
+  }
+}
+
+/**
+ * glyph_atlas_init: pre-render all fonts. Must be called once before drawing text.
+ */
+void glyph_atlas_init(void)
+{
+  for (int font = 0; font < NUM_FONTS; font++) {
+    glyph_atlas_build_font(font);
+  }
+}
+
+/**
+ * glyph_sprite: get pre-rendered character from the glyph atlas.
+ *
+ * @param       ch      character
+ * @param       flags   font flags
+ * @param       font    font to use
+ * @param       color   0 = black, 1 = main, 2 = warn
+ * @param       glyph   return result: glyph image
+ * @param       offset  return result: glyph offset from the character position (both axes)
+ * @return      0 if character doesn't exist in the font
+ */
+int glyph_sprite(char ch, int flags, int font, int color, osd_sprite_t *glyph, int *offset)
+{
+  uint8_t index = glyph_atlas[font].index[(uint8_t)ch];
+
+  assert(font >= 0 && font < NUM_FONTS && color >= 0 && color < GLYPH_COLORS);
+  if (index == 0xff) {
+    return 0;
+  }
+
+  glyph->width = glyph_atlas[font].width;
+  glyph->height = glyph_atlas[font].height;
+  glyph->pixels = glyph_atlas[font].pixels[color][(flags & FONT_INVERT) ? 1 : 0] + index * glyph_atlas[font].size;
+  *offset = glyph_atlas[font].offset;
+  return 1;
+}
+
+/**
+ * write_glyph: draw character from the glyph atlas.
+ *
+ * @param       ch      character to write
+ * @param       x       x coordinate (left)
+ * @param       y       y coordinate (top)
+ * @param       flags   flags to write with
+ * @param       font    font to use
+ * @param       color   0 = black, 1 = main, 2 = warn
+ */
+static inline void write_glyph(char ch, int x, int y, int flags, int font, int color)
+{
+  osd_sprite_t glyph;
+  int offset;
+
+  if (!glyph_sprite(ch, flags, font, color, &glyph, &offset)) {
+    return;                   // character doesn't exist, don't bother writing it.
+  }
+  blit_sprite(&glyph, x + offset, y + offset);
+}
+
 /**
  * write_char16: Draw a character on the current draw buffer.
  *
@@ -706,40 +1738,12 @@ int fetch_font_info(uint8_t ch, int font, struct FontEntry *font_info, char *loo
  * @param       font    font to use
  */
 void write_char16(char ch, int x, int y, int font, int color) {
-  struct FontEntry font_info;
-  fetch_font_info(0, font, &font_info, NULL);
-
-  // If font only supports lowercase or uppercase, make the letter lowercase or uppercase
-  // if (font_info.flags & FONT_LOWERCASE_ONLY) ch = tolower(ch);
-  // if (font_info.flags & FONT_UPPERCASE_ONLY) ch = toupper(ch);
-
-  // How wide is the character? We handle characters from 8 pixels up in this function
-  if (font_info.width >= 8) {
-    // We can write mask words easily.
-    // Level bits are more complicated. We need to set or clear level bits, but only where the mask bit is set; otherwise, we need to leave them alone.
-    // To do this, for each word, we construct an AND mask and an OR mask, and apply each individually.
-    for (int dy = 0; dy < font_info.height; dy++) {
-        uint16_t levels, mask;
-        int row = ch * font_info.height + dy;
-        if (font == 3) {
-            levels = font_frame12x18[row];
-            mask = font_mask12x18[row];
-        }else{
-            levels = font_frame8x10[row];
-            mask = font_mask8x10[row];
-        }
-        for(int dx = 0; dx < font_info.width; dx++) {
-            uint16_t xshift = font_info.width - 1;
-            if (mask & (1 << (xshift - dx)))
-              write_pixel_lm(x + dx + 1, y + dy + 1, 1, (levels & (1 << (xshift - dx))) ? color : 0);
-        }
-    }
-  }
+  DL_RECORD(DL_CHAR16, x - 1, y - 1, x + fonts[font].width + 1, y + fonts[font].height + 1, ch, x, y, font, color);
+  write_glyph(ch, x, y, 0, font, color);
 }
 
 /**
  * write_char: Draw a character on the current draw buffer.
- * Currently supports outlined characters and characters with a width of up to 8 pixels.
  *
  * @param       ch      character to write
  * @param       x       x coordinate (left)
@@ -748,33 +1752,8 @@ void write_char16(char ch, int x, int y, int font, int color) {
  * @param       font    font to use
  */
 void write_char(char ch, int x, int y, int flags, int font, int color) {
-  struct FontEntry font_info;
-  char lookup = 0;
-
-  fetch_font_info(ch, font, &font_info, &lookup);
-
-  // If font only supports lowercase or uppercase, make the letter lowercase or uppercase
-  // if (font_info.flags & FONT_LOWERCASE_ONLY) ch = tolower(ch);
-  // if (font_info.flags & FONT_UPPERCASE_ONLY) ch = toupper(ch);
-
-  // How wide is the character? We handle characters up to 8 pixels in this function
-  if (font_info.width <= 8) {
-    // Load data pointer.
-    for (int dy = 0; dy < font_info.height; dy++) {
-        uint16_t levels, mask;
-        int row = lookup * font_info.height * 2 + dy;
-        for(int dx = 0; dx < font_info.width; dx++) {
-            uint16_t xshift = font_info.width - 1;
-            levels = font_info.data[row + font_info.height];
-            if (flags & FONT_INVERT) {
-                levels = ~levels;
-            }
-            mask = font_info.data[row];
-            if (mask & (1 << (xshift - dx)))
-              write_pixel_lm(x + dx, y + dy, 1, (levels & (1 << (xshift - dx))) ? color : 0);
-        }
-    }
-  }
+  DL_RECORD(DL_CHAR, x - 1, y - 1, x + fonts[font].width + 1, y + fonts[font].height + 1, ch, x, y, flags, font, color);
+  write_glyph(ch, x, y, flags, font, color);
 }
 
 /**
@@ -829,38 +1808,86 @@ void write_string(char *str, int x, int y, int xs, int ys, int va, int ha, int f
   write_color_string(str, x, y, xs, ys, va, ha, flags, font, 1);
 }
 
-void write_color_string(char *str, int x, int y, int xs, int ys, int va, int ha, int flags, int font, int color) {
-
-  int xx = 0, yy = 0, xx_original = 0;
-  struct FontEntry font_info;
-  struct FontDimensions dim;
-
-  //font = 2;
-  // Determine font info and dimensions/position of the string.
-  fetch_font_info(0, font, &font_info, NULL);
-  calc_text_dimensions(str, font_info, xs, ys, &dim);
+/**
+ * calc_text_origin: Find top left corner of an aligned string.
+ *
+ * @param       str             string
+ * @param       x, y            anchor coordinates
+ * @param       xs, ys          horizontal and vertical spacing
+ * @param       va, ha          vertical and horizontal align
+ * @param       font_info       font info structure
+ * @param       xx, yy          return result: top left corner
+ * @param       dim             return result: string dimensions
+ */
+static void calc_text_origin(char *str, int x, int y, int xs, int ys, int va, int ha, struct FontEntry font_info,
+                             int *xx, int *yy, struct FontDimensions *dim) {
+  *xx = 0;
+  *yy = 0;
+  calc_text_dimensions(str, font_info, xs, ys, dim);
   switch (va) {
   case TEXT_VA_TOP:
-    yy = y;
+    *yy = y;
     break;
   case TEXT_VA_MIDDLE:
-    yy = y - (dim.height / 2);
+    *yy = y - (dim->height / 2);
     break;
   case TEXT_VA_BOTTOM:
-    yy = y - dim.height;
+    *yy = y - dim->height;
     break;
   }
   switch (ha) {
   case TEXT_HA_LEFT:
-    xx = x;
+    *xx = x;
     break;
   case TEXT_HA_CENTER:
-    xx = x - (dim.width / 2);
+    *xx = x - (dim->width / 2);
     break;
   case TEXT_HA_RIGHT:
-    xx = x - dim.width;
+    *xx = x - dim->width;
     break;
   }
+}
+
+void write_color_string(char *str, int x, int y, int xs, int ys, int va, int ha, int flags, int font, int color) {
+
+  int xx = 0, yy = 0, xx_original = 0;
+  struct FontEntry font_info;
+  struct FontDimensions dim;
+
+  //font = 2;
+  // Determine font info and dimensions/position of the string.
+  if (!fetch_font_info(0, font, &font_info, NULL)) {
+    return;
+  }
+  calc_text_origin(str, x, y, xs, ys, va, ha, font_info, &xx, &yy, &dim);
+
+  // Runs which are fully visible are drawn from the text cache.
+  // Characters starting off-screen are skipped, so partially visible runs use the slow path.
+  int cacheable = xs >= 0 && ys >= 0 && xx >= GRAPHICS_LEFT && xx + dim.width - (font_info.width + xs) < GRAPHICS_RIGHT;
+
+  if (dl_current != NULL) {
+    // Tile workers only read the cache, so fill it while recording
+    if (cacheable && raster_threads > 1) {
+      text_cache_lookup(str, font, color, flags, xs, ys);
+    }
+    // Keep a copy of the text, callers reuse their string buffers
+    const int32_t args[] = { x, y, xs, ys, va, ha, flags, font, color };
+    dl_append(DL_STRING, xx - 1, yy - 1, xx + dim.width + 1, yy + dim.height + 1,
+              args, SIZEOF_ARRAY(args), str, strlen(str) + 1);
+    return;
+  }
+
+  damage_add(&frame_damage, xx, yy, xx + dim.width, yy + dim.height);
+
+  if (cacheable) {
+    const osd_sprite_t *run = draw_tiled ? text_cache_peek(str, font, color, flags, xs, ys)
+                                         : text_cache_lookup(str, font, color, flags, xs, ys);
+    if (run != NULL) {
+      blit_sprite(run, xx, yy);
+      return;
+    }
+  }
+
   // Then write each character.
   xx_original = xx;
   while (*str != 0) {
@@ -869,11 +1896,7 @@ void write_color_string(char *str, int x, int y, int xs, int ys, int va, int ha,
       xx  = xx_original;
     } else {
       if (xx >= GRAPHICS_LEFT && xx < GRAPHICS_RIGHT) {
-        if (font_info.id < 2) {
-          write_char(*str, xx, yy, flags, font, color);
-        } else {
-          write_char16(*str, xx, yy, font, color);
-        }
+        write_glyph(*str, xx, yy, flags, font, color);
       }
       xx += font_info.width + xs;
     }
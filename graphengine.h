@@ -2,6 +2,8 @@
 #define GRAPH_ENGINE_H__
 
 #include <pthread.h>
+#include <stdint.h>
+#include <string.h>
 #include "fonts.h"
 
 extern int osd_debug;
@@ -14,6 +16,14 @@ typedef enum
     OSD_RENDER_KMS,
 } osd_render_t;
 
+// How wfbosdoverlay blends OSD into decoded video (GStreamer without GL mixer)
+typedef enum
+{
+    OSD_OVERLAY_NONE = 0,               // glvideomixer pipeline
+    OSD_OVERLAY_SPARSE,                 // yuvblend, only tiles covered by OSD
+    OSD_OVERLAY_GST,                    // gst_video_overlay_composition_blend
+} osd_overlay_t;
+
 // Size of an array (num items.)
 #define SIZEOF_ARRAY(x) (sizeof(x) / sizeof((x)[0]))
 
@@ -105,9 +115,38 @@ typedef struct {
 
 extern int screen_width, screen_height;
 
-// PAL
-#define GRAPHICS_WIDTH         640
-#define GRAPHICS_HEIGHT        360
+// Reference surface. Default layout coordinates are given for this size
+// and scaled to the actual surface at startup.
+#define GRAPHICS_REF_WIDTH     640
+#define GRAPHICS_REF_HEIGHT    360
+#define GRAPHICS_REF_TOP       0
+#define GRAPHICS_REF_RIGHT     (GRAPHICS_REF_WIDTH - 1)
+#define GRAPHICS_REF_BOTTOM    (GRAPHICS_REF_HEIGHT - 1)
+#define GRAPHICS_REF_X_MIDDLE  (GRAPHICS_REF_WIDTH / 2)
+#define GRAPHICS_REF_Y_MIDDLE  (GRAPHICS_REF_HEIGHT / 2)
+
+// Surface size is set at runtime with set_graphics_size().
+// Build with -DGRAPHICS_FIXED_WIDTH=w -DGRAPHICS_FIXED_HEIGHT=h to make it a compile time constant.
+#if defined(GRAPHICS_FIXED_WIDTH) && defined(GRAPHICS_FIXED_HEIGHT)
+#define GRAPHICS_WIDTH         GRAPHICS_FIXED_WIDTH
+#define GRAPHICS_HEIGHT        GRAPHICS_FIXED_HEIGHT
+#define GRAPHICS_DEFAULT_WIDTH  GRAPHICS_FIXED_WIDTH
+#define GRAPHICS_DEFAULT_HEIGHT GRAPHICS_FIXED_HEIGHT
+#else
+extern int graphics_width, graphics_height;
+#define GRAPHICS_WIDTH         graphics_width
+#define GRAPHICS_HEIGHT        graphics_height
+#define GRAPHICS_DEFAULT_WIDTH  GRAPHICS_REF_WIDTH
+#define GRAPHICS_DEFAULT_HEIGHT GRAPHICS_REF_HEIGHT
+#endif
+
+#define GRAPHICS_MAX_WIDTH     4096
+#define GRAPHICS_MAX_HEIGHT    4096
+
+// Scale reference layout coordinates to the surface
+#define GRAPHICS_SCALE_X(x)    ((x) * GRAPHICS_WIDTH / GRAPHICS_REF_WIDTH)
+#define GRAPHICS_SCALE_Y(y)    ((y) * GRAPHICS_HEIGHT / GRAPHICS_REF_HEIGHT)
+
 #define GRAPHICS_LEFT          0
 #define GRAPHICS_TOP           0
 #define GRAPHICS_RIGHT         (GRAPHICS_WIDTH - 1)
@@ -129,11 +168,89 @@ extern int screen_width, screen_height;
 // Macro to swap two variables using XOR swap.
 #define SWAP(a, b)                   { a ^= b; b ^= a; a ^= b; }
 
+// Damage tracking. Every primitive records the bounding box it touched,
+// so clear and copy passes only have to visit the changed parts of the frame.
+#define OSD_MAX_DAMAGE_RECTS 32
+
+typedef struct {
+  int x0, y0, x1, y1;                   // inclusive
+} osd_rect_t;
+
+typedef struct {
+  int count;
+  int last;                             // rect which absorbed the latest add
+  osd_rect_t rects[OSD_MAX_DAMAGE_RECTS];
+} osd_damage_t;
+
+extern __thread osd_damage_t frame_damage;  // per thread, tile workers merge theirs after the frame
+
+void damage_add(osd_damage_t *damage, int x0, int y0, int x1, int y1);
+void damage_merge(osd_damage_t *dst, const osd_damage_t *src);
+int damage_area(const osd_damage_t *damage);
+
+// Draw buffer pixel. GRAPHICS_INDEXED builds store palette indexes,
+// which are expanded to RGBA only when the frame is sent to the display.
+#ifdef GRAPHICS_INDEXED
+typedef uint8_t osd_pixel_t;
+#else
+typedef uint32_t osd_pixel_t;
+#endif
+
+// Palette: 0 = transparent, then black, main and warn colors
+#define OSD_PALETTE_SIZE 4
+
+extern uint32_t osd_palette[OSD_PALETTE_SIZE];
+
+void set_osd_color(int color, uint32_t rgba);
+
+#ifdef GRAPHICS_INDEXED
+void expand_pixels(uint32_t *dst, const osd_pixel_t *src, int count);
+#else
+static inline void expand_pixels(uint32_t *dst, const osd_pixel_t *src, int count)
+{
+  memcpy(dst, src, count * sizeof(uint32_t));
+}
+#endif
+
+// Image in draw buffer format, zero pixels are transparent
+typedef struct {
+  int width, height;
+  const osd_pixel_t *pixels;
+} osd_sprite_t;
+
+void blit_sprite(const osd_sprite_t *sprite, int x, int y);
+
+// Retained drawing: pixels drawn between layer_begin/layer_end
+typedef struct {
+  int x, y;                             // screen position of the sprite
+  osd_sprite_t sprite;                  // pixels equal to key weren't drawn
+  osd_pixel_t key;
+  osd_pixel_t *pixels;                  // owned storage for the sprite
+  int capacity;                         // allocated pixels
+  uint32_t generation;                  // changes on every layer_end()
+} osd_layer_t;
+
+void layer_begin(void);
+void layer_end(osd_layer_t *layer);
+void layer_draw(const osd_layer_t *layer);
+void set_draw_tile(const osd_rect_t *tile);
+void glyph_atlas_init(void);
+int glyph_sprite(char ch, int flags, int font, int color, osd_sprite_t *glyph, int *offset);
+
 uint8_t getCharData(uint16_t charPos);
 
+// Screen layers. Backends with a display plane per layer keep widgets which
+// rarely change on the static one, so it's rasterized only when they do.
+#define OSD_LAYER_DYNAMIC 0
+#define OSD_LAYER_STATIC  1
+#define OSD_SCREEN_LAYERS 2
+
+void select_screen_layer(int layer);
+
+int set_graphics_size(int width, int height);
 void* render(void);
 void render_init(int shift_x, int shift_y, float scale_x, float scale_y);
-void clearGraphics(void);
+void clearGraphics(int layer);
 void* displayGraphics(void);
 
 //void drawArrow(uint16_t x, uint16_t y, uint16_t angle, uint16_t size);
@@ -172,4 +289,10 @@ void calc_text_dimensions(char *str, struct FontEntry font, int xs, int ys, stru
 extern uint8_t* video_buf_ext;
 extern pthread_mutex_t video_mutex;
 
+#ifdef __GST_OPENGL__
+#include <gst/gst.h>
+void render_set_buffer_pool(GstBufferPool *pool);
+GstBufferPool *osd_buffer_pool_new(GstPad *pad);
+#endif
+
 #endif
@@ -20,6 +20,7 @@
  */
 
 
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <string.h>
 #include <strings.h>
@@ -29,14 +30,13 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <sys/time.h>
+#include <time.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <signal.h>
 #include <poll.h>
 #include <sys/socket.h>
-#include <netinet/in.h>
-#include <arpa/inet.h>
 
 #include "osdrender.h"
 #include "osdmavlink.h"
@@ -44,10 +44,17 @@
 #include "osdconfig.h"
 #include "UAVObj.h"
 #include "graphengine.h"
+#include "textcache.h"
+#include "tiler.h"
+#include "udprx.h"
+#ifdef __DRM_ROCKCHIP__
+#include "drm_output.h"
+#endif
 
 
 #ifdef __GST_OPENGL__
-int gst_main(int rtp_port, char *codec, int rtp_jitter, osd_render_t osd_render, int screen_width, char *rtsp_url);
+int gst_main(int rtp_port, char *codec, int rtp_jitter, osd_render_t osd_render, int screen_width, char *rtsp_url,
+             osd_overlay_t cpu_overlay, char *custom_pipeline);
 #endif
 
 static volatile uint8_t finished = 0;
@@ -58,31 +65,6 @@ void sigterm_handler(int signum)
     finished = 1;
 }
 
-int open_udp_socket_for_rx(int port)
-{
-    struct sockaddr_in saddr;
-    int fd = socket(AF_INET, SOCK_DGRAM, 0);
-    if (fd < 0){
-        perror("Error opening socket");
-        exit(1);
-    }
-
-    int optval = 1;
-    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, (const void *)&optval , sizeof(int));
-
-    bzero((char *) &saddr, sizeof(saddr));
-    saddr.sin_family = AF_INET;
-    saddr.sin_addr.s_addr = htonl(INADDR_ANY);
-    saddr.sin_port = htons((unsigned short)port);
-
-    if (bind(fd, (struct sockaddr *) &saddr, sizeof(saddr)) < 0)
-    {
-        perror("Bind error");
-        exit(1);
-    }
-    return fd;
-}
-
 int main(int argc, char **argv)
 {
     int opt;
@@ -93,19 +75,26 @@ int main(int argc, char **argv)
     osd_render_t osd_render = OSD_RENDER_GL;
     int screen_width = 1920;
     char *rtsp_url = NULL;
+    osd_overlay_t cpu_overlay = OSD_OVERLAY_NONE;
+    char *custom_pipeline = NULL;
 
+#ifndef __DRM_ROCKCHIP__
     uint64_t render_ts = 0;
     uint64_t cur_ts = 0;
-    uint8_t buf[65536]; // Max UDP packet size
+#endif
     int fd;
-    struct pollfd fds[1];
+    struct pollfd fds[2];
 
-    while ((opt = getopt(argc, argv, "hdp:P:R:45j:xakw:")) != -1) {
+    while ((opt = getopt(argc, argv, "hdp:b:P:R:45j:xakO:G:w:c:t:g:D:z:F:S:")) != -1) {
         switch (opt) {
         case 'p':
             osd_port = atoi(optarg);
             break;
 
+        case 'b':
+            udp_rx_rcvbuf = atoi(optarg) * 1024;
+            break;
+
         case 'P':
             rtp_port = atoi(optarg);
             break;
@@ -138,10 +127,67 @@ int main(int argc, char **argv)
             osd_render = OSD_RENDER_KMS;
             break;
 
+        case 'O':
+            if (strcmp(optarg, "sparse") == 0)
+                cpu_overlay = OSD_OVERLAY_SPARSE;
+            else if (strcmp(optarg, "gst") == 0)
+                cpu_overlay = OSD_OVERLAY_GST;
+            else
+                goto show_usage;
+            break;
+
+        case 'G':
+            custom_pipeline = strdup(optarg);
+            break;
+
         case 'w':
             screen_width = atoi(optarg);
             break;
 
+        case 'c':
+            text_cache_budget = (size_t)atoi(optarg) * 1024;
+            break;
+
+        case 'g':
+            {
+                int width, height;
+                if (sscanf(optarg, "%dx%d", &width, &height) != 2 || set_graphics_size(width, height) != 0)
+                {
+                    fprintf(stderr, "Unsupported OSD size: %s\n", optarg);
+                    exit(1);
+                }
+            }
+            break;
+
+        case 't':
+            raster_threads = LIMIT(atoi(optarg), 1, RASTER_MAX_THREADS);
+            break;
+
+#ifdef __DRM_ROCKCHIP__
+        case 'D':
+            drm_card = strdup(optarg);
+            break;
+
+        case 'F':
+            drm_format = strdup(optarg);
+            break;
+
+        case 'S':
+            drm_static_plane = strdup(optarg);
+            break;
+
+        case 'z':
+            if (strcmp(optarg, "auto") == 0)
+                drm_render_mode = DRM_RENDER_AUTO;
+            else if (strcmp(optarg, "shadow") == 0)
+                drm_render_mode = DRM_RENDER_SHADOW;
+            else if (strcmp(optarg, "direct") == 0)
+                drm_render_mode = DRM_RENDER_DIRECT;
+            else
+                goto show_usage;
+            break;
+#endif
+
         case 'd':
             osd_debug = 1;
             break;
@@ -151,14 +197,19 @@ int main(int argc, char **argv)
         show_usage:
 
 #ifdef __GST_OPENGL__
-            fprintf(stderr, "%s [-p mavlink_port] [-P rtp_port] [ -R rtsp_url ] [-4] [-5] [-j rtp_jitter] [-x] [-a] [-w screen_width] \n", argv[0]);
-            fprintf(stderr, "Default: mavlink_port=%d, rtp_port=%d, rtsp_url=%s, codec=%s, rtp_jitter=%d, screen_width=%d\n",
+            fprintf(stderr, "%s [-p mavlink_port] [-b rcvbuf_kb] [-P rtp_port] [ -R rtsp_url ] [-4] [-5] [-j rtp_jitter] [-x] [-a] [-k] [-O sparse|gst] [-G gst_pipeline] [-w screen_width] [-c text_cache_kb] [-t raster_threads] [-g osd_width x osd_height] \n", argv[0]);
+            fprintf(stderr, "Default: mavlink_port=%d, rcvbuf=system, rtp_port=%d, rtsp_url=%s, codec=%s, rtp_jitter=%d, screen_width=%d, text_cache_kb=%zu, raster_threads=%d, osd_size=%dx%d\n",
                     osd_port, rtp_port,
                     rtsp_url != NULL ? rtsp_url : "none",
-                    codec, rtp_jitter, screen_width);
+                    codec, rtp_jitter, screen_width, text_cache_budget / 1024, raster_threads, GRAPHICS_WIDTH, GRAPHICS_HEIGHT);
+#elif defined(__DRM_ROCKCHIP__)
+            fprintf(stderr, "%s [-p mavlink_port] [-b rcvbuf_kb] [-c text_cache_kb] [-t raster_threads] [-g osd_width x osd_height] [-D drm_card] [-z auto|shadow|direct] [-F argb1555|argb4444|abgr8888|argb8888] [-S auto|static_plane_id]\n", argv[0]);
+            fprintf(stderr, "Default: mavlink_port=%d, rcvbuf=system, text_cache_kb=%zu, raster_threads=%d, osd_size=%dx%d, drm_card=%s, drm_render=auto, drm_format=auto, static_plane=none\n",
+                    osd_port, text_cache_budget / 1024, raster_threads, GRAPHICS_WIDTH, GRAPHICS_HEIGHT, drm_card);
 #else
-            fprintf(stderr, "%s [-p mavlink_port]\n", argv[0]);
-            fprintf(stderr, "Default: mavlink_port=%d\n", osd_port);
+            fprintf(stderr, "%s [-p mavlink_port] [-b rcvbuf_kb] [-c text_cache_kb] [-t raster_threads] [-g osd_width x osd_height]\n", argv[0]);
+            fprintf(stderr, "Default: mavlink_port=%d, rcvbuf=system, text_cache_kb=%zu, raster_threads=%d, osd_size=%dx%d\n",
+                    osd_port, text_cache_budget / 1024, raster_threads, GRAPHICS_WIDTH, GRAPHICS_HEIGHT);
 #endif
             fprintf(stderr, "WFB-ng OSD version " WFB_OSD_VERSION "\n");
             fprintf(stderr, "WFB-ng home page: <http://wfb-ng.org>\n");
@@ -177,11 +228,11 @@ int main(int argc, char **argv)
            codec, rtp_jitter, osd_render, screen_width);
 
     osd_init(0, 0, 1, 1);
-    fd = open_udp_socket_for_rx(osd_port);
+    fd = udp_rx_open(osd_port);
 
     void* gst_thread_start(void *arg)
     {
-        gst_main(rtp_port, codec, rtp_jitter, osd_render, screen_width, rtsp_url);
+        gst_main(rtp_port, codec, rtp_jitter, osd_render, screen_width, rtsp_url, cpu_overlay, custom_pipeline);
         fprintf(stderr, "gst thread exited\n");
         exit(1);
     }
@@ -191,16 +242,20 @@ int main(int argc, char **argv)
 
     while(1)
     {
-        ssize_t rsize;
-        while((rsize = recv(fd, buf, sizeof(buf), 0)) >= 0)
+        int count;
+        while((count = udp_rx_receive(fd, MSG_WAITFORONE)) >= 0)
         {
-            // Avoid race with rendering in gstreamer
-            pthread_mutex_lock(&video_mutex);
-            parse_mavlink_packet(buf, rsize);
-            pthread_mutex_unlock(&video_mutex);
+            // Parser owns its own telemetry copy, no lock against rendering in gstreamer
+            for (int i = 0; i < count; i++)
+            {
+                size_t size;
+                uint8_t *buf = udp_rx_packet(i, &size);
+                parse_mavlink_packet(buf, size);
+            }
+            osd_telemetry_publish();
         }
 
-        if (rsize < 0 && errno != EINTR)
+        if (count < 0 && errno != EINTR)
         {
             perror("Error receiving packet");
             exit(1);
@@ -211,7 +266,7 @@ int main(int argc, char **argv)
     printf("Use mavlink_port=%d\n", osd_port);
 
     osd_init(0, 0, 1, 1);
-    fd = open_udp_socket_for_rx(osd_port);
+    fd = udp_rx_open(osd_port);
 
     if(fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK) < 0)
     {
@@ -222,6 +277,10 @@ int main(int argc, char **argv)
     memset(fds, '\0', sizeof(fds));
     fds[0].fd = fd;
     fds[0].events = POLLIN;
+#ifdef __DRM_ROCKCHIP__
+    fds[1].fd = drm_event_fd();
+    fds[1].events = POLLIN;
+#endif
 
     signal(SIGTERM, sigterm_handler);
     signal(SIGINT, sigterm_handler);
@@ -229,9 +288,16 @@ int main(int argc, char **argv)
     fprintf(stderr, "Starting event loop\n");
     while(!finished)
     {
+#ifdef __DRM_ROCKCHIP__
+        // Sleep until the render slot before the next vblank, or until the pending flip is done
+        int64_t delay_ns = drm_frame_delay_ns();
+        struct timespec timeout = { delay_ns / 1000000000, delay_ns % 1000000000 };
+        int rc = ppoll(fds, 2, delay_ns >= 0 ? &timeout : NULL, NULL);
+#else
         cur_ts = GetSystimeMS();
         uint64_t sleep_ts = render_ts > cur_ts ? render_ts - cur_ts : 0;
         int rc = poll(fds, 1, sleep_ts);
+#endif
 
         if (rc < 0){
             if (errno == EINTR || errno == EAGAIN) continue;
@@ -246,23 +312,50 @@ int main(int argc, char **argv)
         }
 
         if (fds[0].revents & POLLIN){
-            ssize_t rsize;
-            while((rsize = recv(fd, buf, sizeof(buf), 0)) >= 0)
+            int count;
+            // Partial batch: the queue is drained
+            while((count = udp_rx_receive(fd, 0)) >= 0)
             {
-                parse_mavlink_packet(buf, rsize);
+                for (int i = 0; i < count; i++)
+                {
+                    size_t size;
+                    uint8_t *buf = udp_rx_packet(i, &size);
+                    parse_mavlink_packet(buf, size);
+                }
+                if (count < UDP_RX_BATCH) break;
             }
-            if (rsize < 0 && errno != EWOULDBLOCK){
+            osd_telemetry_publish();
+            if (count < 0 && errno != EWOULDBLOCK && errno != EINTR){
                 perror("Error receiving packet");
                 exit(1);
             }
         }
 
+#ifdef __DRM_ROCKCHIP__
+        if (fds[1].revents & (POLLERR | POLLNVAL))
+        {
+            fprintf(stderr, "DRM device error!");
+            exit(1);
+        }
+
+        if (fds[1].revents & POLLIN)
+        {
+            drm_handle_events();
+        }
+
+        if (drm_frame_delay_ns() == 0)
+        {
+            drm_frame_begin();
+            render();
+        }
+#else
         cur_ts = GetSystimeMS();
         if (render_ts <= cur_ts)
         {
             render_ts = cur_ts + 1000 / 30; // 30Hz osd refresh rate
             render();
         }
+#endif
     }
     fprintf(stderr, "Event loop finished\n");
 #endif
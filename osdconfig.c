@@ -14,91 +14,93 @@
  * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
  */
 
+#include <stddef.h>
+
 #include "osdconfig.h"
 #include "graphengine.h"
 
 osd_params_t osd_params = {
     .Arm_en=1,
     .Arm_panel=1,
-    .Arm_posX=GRAPHICS_RIGHT - 10,
+    .Arm_posX=GRAPHICS_REF_RIGHT - 10,
     .Arm_posY=40,
     .Arm_fontsize=0,
     .Arm_align=2,
     .BattVolt_en=1,
     .BattVolt_panel=1,
     .BattVolt_posX=10,
-    .BattVolt_posY=GRAPHICS_BOTTOM - 60,
+    .BattVolt_posY=GRAPHICS_REF_BOTTOM - 60,
     .BattVolt_fontsize=0,
     .BattVolt_align=0,
     .BattCurrent_en=1,
     .BattCurrent_panel=1,
     .BattCurrent_posX=2,
-    .BattCurrent_posY=GRAPHICS_BOTTOM - 48,
+    .BattCurrent_posY=GRAPHICS_REF_BOTTOM - 48,
     .BattCurrent_fontsize=0,
     .BattCurrent_align=0,
     .BattRemaining_en=1,
     .BattRemaining_panel=1,
     .BattRemaining_posX=18,
-    .BattRemaining_posY=GRAPHICS_BOTTOM - 78,
+    .BattRemaining_posY=GRAPHICS_REF_BOTTOM - 78,
     .BattRemaining_fontsize=0,
     .BattRemaining_align=0,
     .FlightMode_en=1,
     .FlightMode_panel=1,
-    .FlightMode_posX=GRAPHICS_X_MIDDLE,
+    .FlightMode_posX=GRAPHICS_REF_X_MIDDLE,
     .FlightMode_posY=64,
     .FlightMode_fontsize=1,
     .FlightMode_align=1,
     .GpsStatus_en=1,
     .GpsStatus_panel=1,
     .GpsStatus_posX=72,
-    .GpsStatus_posY=GRAPHICS_BOTTOM - 78,
+    .GpsStatus_posY=GRAPHICS_REF_BOTTOM - 78,
     .GpsStatus_fontsize=0,
     .GpsStatus_align=0,
     .GpsHDOP_en=0,
     .GpsHDOP_panel=1,
     .GpsHDOP_posX=72,
-    .GpsHDOP_posY=GRAPHICS_BOTTOM - 68,
+    .GpsHDOP_posY=GRAPHICS_REF_BOTTOM - 68,
     .GpsHDOP_fontsize=0,
     .GpsHDOP_align=0,
     .GpsLat_en=1,
     .GpsLat_panel=1,
     .GpsLat_posX=72,
-    .GpsLat_posY=GRAPHICS_BOTTOM - 60,
+    .GpsLat_posY=GRAPHICS_REF_BOTTOM - 60,
     .GpsLat_fontsize=0,
     .GpsLat_align=0,
     .GpsLon_en=1,
     .GpsLon_panel=1,
     .GpsLon_posX=72,
-    .GpsLon_posY=GRAPHICS_BOTTOM - 48,
+    .GpsLon_posY=GRAPHICS_REF_BOTTOM - 48,
     .GpsLon_fontsize=0,
     .GpsLon_align=0,
     .Gps2Status_en=1,
     .Gps2Status_panel=2,
     .Gps2Status_posX=0,
-    .Gps2Status_posY=GRAPHICS_BOTTOM - 38,
+    .Gps2Status_posY=GRAPHICS_REF_BOTTOM - 38,
     .Gps2Status_fontsize=0,
     .Gps2Status_align=0,
     .Gps2HDOP_en=1,
     .Gps2HDOP_panel=2,
     .Gps2HDOP_posX=70,
-    .Gps2HDOP_posY=GRAPHICS_BOTTOM - 38,
+    .Gps2HDOP_posY=GRAPHICS_REF_BOTTOM - 38,
     .Gps2HDOP_fontsize=0,
     .Gps2HDOP_align=0,
     .Gps2Lat_en=1,
     .Gps2Lat_panel=2,
-    .Gps2Lat_posX=GRAPHICS_RIGHT - 88,
-    .Gps2Lat_posY=GRAPHICS_BOTTOM - 38,
+    .Gps2Lat_posX=GRAPHICS_REF_RIGHT - 88,
+    .Gps2Lat_posY=GRAPHICS_REF_BOTTOM - 38,
     .Gps2Lat_fontsize=0,
     .Gps2Lat_align=0,
     .Gps2Lon_en=1,
     .Gps2Lon_panel=2,
-    .Gps2Lon_posX=GRAPHICS_RIGHT - 8,
-    .Gps2Lon_posY=GRAPHICS_BOTTOM - 38,
+    .Gps2Lon_posX=GRAPHICS_REF_RIGHT - 8,
+    .Gps2Lon_posY=GRAPHICS_REF_BOTTOM - 38,
     .Gps2Lon_fontsize=0,
     .Gps2Lon_align=0,
     .Time_en=0,
     .Time_panel=1,
-    .Time_posX=GRAPHICS_RIGHT - 10,
+    .Time_posX=GRAPHICS_REF_RIGHT - 10,
     .Time_posY=15,
     .Time_fontsize=0,
     .Time_align=2,
@@ -110,14 +112,14 @@ osd_params_t osd_params = {
     .TALT_align=0,
     .Alt_Scale_en=1,
     .Alt_Scale_panel=1,
-    .Alt_Scale_posX=GRAPHICS_RIGHT - 160,
-    .Alt_Scale_posY=GRAPHICS_Y_MIDDLE,
+    .Alt_Scale_posX=GRAPHICS_REF_RIGHT - 160,
+    .Alt_Scale_posY=GRAPHICS_REF_Y_MIDDLE,
     .Alt_Scale_align=1,
     .Alt_Scale_source=1,
     .TSPD_en=1,
     .TSPD_panel=3,
     .TSPD_posX=125,
-    .TSPD_posY=GRAPHICS_BOTTOM - 99,
+    .TSPD_posY=GRAPHICS_REF_BOTTOM - 99,
     .TSPD_fontsize=0,
     .TSPD_align=1,
     .Speed_scale_en=1,
@@ -125,12 +127,12 @@ osd_params_t osd_params = {
     .Speed_scale_posX=160,
     .Speed_scale_align=0,
     .Speed_scale_source=0,
-    .Speed_scale_posY=GRAPHICS_Y_MIDDLE,
+    .Speed_scale_posY=GRAPHICS_REF_Y_MIDDLE,
     .Throt_en=1,
     .Throt_panel=1,
     .Throt_scale_en=1,
-    .Throt_posX=GRAPHICS_X_MIDDLE,
-    .Throt_posY=GRAPHICS_BOTTOM - 105,
+    .Throt_posX=GRAPHICS_REF_X_MIDDLE,
+    .Throt_posY=GRAPHICS_REF_BOTTOM - 105,
     .CWH_home_dist_en=1,
     .CWH_home_dist_panel=1,
     .CWH_home_dist_posX=25,
@@ -166,8 +168,8 @@ osd_params_t osd_params = {
     .PWM_Panel_en=0,
     .PWM_Panel_ch=0,
     .PWM_Panel_value=1200,
-    .Alarm_posX=GRAPHICS_X_MIDDLE,
-    .Alarm_posY=GRAPHICS_TOP + 90,
+    .Alarm_posX=GRAPHICS_REF_X_MIDDLE,
+    .Alarm_posY=GRAPHICS_REF_TOP + 90,
     .Alarm_fontsize=1,
     .Alarm_align=1,
     .Alarm_GPS_status_en=1,
@@ -185,14 +187,14 @@ osd_params_t osd_params = {
     .Alarm_wfb_status_en=1,
     .ClimbRate_en=1,
     .ClimbRate_panel=1,
-    .ClimbRate_posX=GRAPHICS_RIGHT - 150,
-    .ClimbRate_posY=GRAPHICS_Y_MIDDLE,
+    .ClimbRate_posX=GRAPHICS_REF_RIGHT - 150,
+    .ClimbRate_posY=GRAPHICS_REF_Y_MIDDLE,
     .ClimbRate_fontsize=0,
     .RSSI_en=0,
     .RSSI_type=0,
     .RSSI_panel=1,
     .RSSI_posX=72,
-    .RSSI_posY=GRAPHICS_BOTTOM - 38,
+    .RSSI_posY=GRAPHICS_REF_BOTTOM - 38,
     .RSSI_fontsize=0,
     .RSSI_align=0,
     .RSSI_min=0,
@@ -205,12 +207,12 @@ osd_params_t osd_params = {
     .Wind_posY=100,
     .Time_type=0,
     .Throttle_Scale_Type=1,
-    .Atti_mp_posX=GRAPHICS_X_MIDDLE,
-    .Atti_mp_posY=GRAPHICS_Y_MIDDLE,
+    .Atti_mp_posX=GRAPHICS_REF_X_MIDDLE,
+    .Atti_mp_posY=GRAPHICS_REF_Y_MIDDLE,
     .Atti_mp_scale_real=1,
     .Atti_mp_scale_frac=0,
-    .Atti_3D_posX=GRAPHICS_X_MIDDLE,
-    .Atti_3D_posY=GRAPHICS_Y_MIDDLE,
+    .Atti_3D_posX=GRAPHICS_REF_X_MIDDLE,
+    .Atti_3D_posY=GRAPHICS_REF_Y_MIDDLE,
     .Atti_3D_scale_real=1,
     .Atti_3D_scale_frac=0,
     .Atti_3D_map_radius=40,
@@ -220,12 +222,12 @@ osd_params_t osd_params = {
     .video_mode=1,
     .BattConsumed_panel=1,
     .BattConsumed_posX=65,
-    .BattConsumed_posY=GRAPHICS_BOTTOM - 38,
+    .BattConsumed_posY=GRAPHICS_REF_BOTTOM - 38,
     .BattConsumed_fontsize=0,
     .BattConsumed_align=0,
     .TotalTripDist_panel=0,
-    .TotalTripDist_posX=GRAPHICS_RIGHT - 10,
-    .TotalTripDist_posY=GRAPHICS_BOTTOM - 78,
+    .TotalTripDist_posX=GRAPHICS_REF_RIGHT - 10,
+    .TotalTripDist_posY=GRAPHICS_REF_BOTTOM - 78,
     .TotalTripDist_fontsize=0,
     .TotalTripDist_align=2,
     .Map_en=1,
@@ -244,7 +246,7 @@ osd_params_t osd_params = {
     .Air_Speed_en=1,
     .Air_Speed_panel=2,
     .Air_Speed_posX=160,
-    .Air_Speed_posY=GRAPHICS_BOTTOM - 88,
+    .Air_Speed_posY=GRAPHICS_REF_BOTTOM - 88,
     .Air_Speed_fontsize=0,
     .Air_Speed_align=0,
     .Spd_Scale_type=0,
@@ -253,8 +255,8 @@ osd_params_t osd_params = {
     .Atti_mp_type=1,
     .Efficiency_en=0,
     .Efficiency_panel=0,
-    .Efficiency_posX=GRAPHICS_RIGHT - 10,
-    .Efficiency_posY=GRAPHICS_BOTTOM - 88,
+    .Efficiency_posX=GRAPHICS_REF_RIGHT - 10,
+    .Efficiency_posY=GRAPHICS_REF_BOTTOM - 88,
     .Efficiency_fontsize=0,
     .Efficiency_align=2,
     .PWM_Video_mode=1,
@@ -262,7 +264,7 @@ osd_params_t osd_params = {
     .LinkQuality_en=0,
     .LinkQuality_panel=0,
     .LinkQuality_posX=150,
-    .LinkQuality_posY=GRAPHICS_BOTTOM - 53,
+    .LinkQuality_posY=GRAPHICS_REF_BOTTOM - 53,
     .LinkQuality_fontsize=0,
     .LinkQuality_align=0,
     .LinkQuality_chan=5,
@@ -271,8 +273,8 @@ osd_params_t osd_params = {
     .LinkQuality_type=0,
     .Vario_Graph_enabled=0,
     .Vario_Graph_panel=0,
-    .Vario_Graph_posX=GRAPHICS_BOTTOM - 88,
-    .Vario_Graph_posY=GRAPHICS_BOTTOM - 88,
+    .Vario_Graph_posX=GRAPHICS_REF_BOTTOM - 88,
+    .Vario_Graph_posY=GRAPHICS_REF_BOTTOM - 88,
     .HomeDirection_enabled=0,
     .HomeDirection_panel=1,
     .HomeDirection_posX=35,
@@ -280,18 +282,18 @@ osd_params_t osd_params = {
     .HomeLatitude_enabled=0,
     .HomeLatitude_panel=0,
     .HomeLatitude_posX=184,
-    .HomeLatitude_posY=GRAPHICS_BOTTOM - 48,
+    .HomeLatitude_posY=GRAPHICS_REF_BOTTOM - 48,
     .HomeLatitude_fontsize=0,
     .HomeLatitude_align=0,
     .HomeLongitude_enabled=0,
     .HomeLongitude_panel=0,
-    .HomeLongitude_posX=GRAPHICS_BOTTOM - 24,
-    .HomeLongitude_posY=GRAPHICS_BOTTOM - 48,
+    .HomeLongitude_posX=GRAPHICS_REF_BOTTOM - 24,
+    .HomeLongitude_posY=GRAPHICS_REF_BOTTOM - 48,
     .HomeLongitude_fontsize=0,
     .HomeLongitude_align=0,
     .WFBState_en=1,
     .WFBState_panel=1,
-    .WFBState_posX=GRAPHICS_RIGHT - 10,
+    .WFBState_posX=GRAPHICS_REF_RIGHT - 10,
     .WFBState_posY=15,
     .WFBState_fontsize=0,
     .WFBState_align=2,
@@ -299,4 +301,151 @@ osd_params_t osd_params = {
     .OSDMessages_panel=1,
     .OSDMessages_posX=180,
     .OSDMessages_posY=285,
+    .FlightMode_layer=OSD_LAYER_STATIC,
+    .Arm_layer=OSD_LAYER_STATIC,
+    .BattVolt_layer=OSD_LAYER_STATIC,
+    .BattCurrent_layer=OSD_LAYER_DYNAMIC,
+    .BattRemaining_layer=OSD_LAYER_STATIC,
+    .BattConsumed_layer=OSD_LAYER_STATIC,
+    .Alt_Scale_layer=OSD_LAYER_DYNAMIC,
+    .TALT_layer=OSD_LAYER_DYNAMIC,
+    .Relative_ALT_layer=OSD_LAYER_DYNAMIC,
+    .Speed_scale_layer=OSD_LAYER_DYNAMIC,
+    .TSPD_layer=OSD_LAYER_DYNAMIC,
+    .HomeDirection_layer=OSD_LAYER_DYNAMIC,
+    .Atti_mp_layer=OSD_LAYER_DYNAMIC,
+    .Throt_layer=OSD_LAYER_DYNAMIC,
+    .HomeLatitude_layer=OSD_LAYER_STATIC,
+    .HomeLongitude_layer=OSD_LAYER_STATIC,
+    .GpsStatus_layer=OSD_LAYER_STATIC,
+    .GpsHDOP_layer=OSD_LAYER_STATIC,
+    .GpsLat_layer=OSD_LAYER_STATIC,
+    .GpsLon_layer=OSD_LAYER_STATIC,
+    .Gps2Status_layer=OSD_LAYER_STATIC,
+    .Gps2HDOP_layer=OSD_LAYER_STATIC,
+    .Gps2Lat_layer=OSD_LAYER_STATIC,
+    .Gps2Lon_layer=OSD_LAYER_STATIC,
+    .TotalTripDist_layer=OSD_LAYER_STATIC,
+    .Time_layer=OSD_LAYER_STATIC,
+    .CWH_layer=OSD_LAYER_DYNAMIC,
+    .ClimbRate_layer=OSD_LAYER_DYNAMIC,
+    .RSSI_layer=OSD_LAYER_STATIC,
+    .WFBState_layer=OSD_LAYER_STATIC,
+    .LinkQuality_layer=OSD_LAYER_STATIC,
+    .Efficiency_layer=OSD_LAYER_DYNAMIC,
+    .Wind_layer=OSD_LAYER_STATIC,
+    .Alarm_layer=OSD_LAYER_DYNAMIC,
+    .OSDMessages_layer=OSD_LAYER_STATIC,
+};
+
+// Widget anchors, given for the GRAPHICS_REF_WIDTH x GRAPHICS_REF_HEIGHT surface
+static const size_t pos_x_fields[] = {
+    offsetof(osd_params_t, Arm_posX),
+    offsetof(osd_params_t, BattVolt_posX),
+    offsetof(osd_params_t, BattCurrent_posX),
+    offsetof(osd_params_t, BattRemaining_posX),
+    offsetof(osd_params_t, FlightMode_posX),
+    offsetof(osd_params_t, GpsStatus_posX),
+    offsetof(osd_params_t, GpsHDOP_posX),
+    offsetof(osd_params_t, GpsLat_posX),
+    offsetof(osd_params_t, GpsLon_posX),
+    offsetof(osd_params_t, Gps2Status_posX),
+    offsetof(osd_params_t, Gps2HDOP_posX),
+    offsetof(osd_params_t, Gps2Lat_posX),
+    offsetof(osd_params_t, Gps2Lon_posX),
+    offsetof(osd_params_t, Time_posX),
+    offsetof(osd_params_t, TALT_posX),
+    offsetof(osd_params_t, Alt_Scale_posX),
+    offsetof(osd_params_t, TSPD_posX),
+    offsetof(osd_params_t, Speed_scale_posX),
+    offsetof(osd_params_t, Throt_posX),
+    offsetof(osd_params_t, CWH_home_dist_posX),
+    offsetof(osd_params_t, CWH_wp_dist_posX),
+    offsetof(osd_params_t, CWH_Nmode_posX),
+    offsetof(osd_params_t, Alarm_posX),
+    offsetof(osd_params_t, ClimbRate_posX),
+    offsetof(osd_params_t, RSSI_posX),
+    offsetof(osd_params_t, Wind_posX),
+    offsetof(osd_params_t, Atti_mp_posX),
+    offsetof(osd_params_t, Atti_3D_posX),
+    offsetof(osd_params_t, BattConsumed_posX),
+    offsetof(osd_params_t, TotalTripDist_posX),
+    offsetof(osd_params_t, Relative_ALT_posX),
+    offsetof(osd_params_t, Air_Speed_posX),
+    offsetof(osd_params_t, Efficiency_posX),
+    offsetof(osd_params_t, LinkQuality_posX),
+    offsetof(osd_params_t, Vario_Graph_posX),
+    offsetof(osd_params_t, HomeDirection_posX),
+    offsetof(osd_params_t, HomeLatitude_posX),
+    offsetof(osd_params_t, HomeLongitude_posX),
+    offsetof(osd_params_t, WFBState_posX),
+    offsetof(osd_params_t, OSDMessages_posX),
+};
+
+static const size_t pos_y_fields[] = {
+    offsetof(osd_params_t, Arm_posY),
+    offsetof(osd_params_t, BattVolt_posY),
+    offsetof(osd_params_t, BattCurrent_posY),
+    offsetof(osd_params_t, BattRemaining_posY),
+    offsetof(osd_params_t, FlightMode_posY),
+    offsetof(osd_params_t, GpsStatus_posY),
+    offsetof(osd_params_t, GpsHDOP_posY),
+    offsetof(osd_params_t, GpsLat_posY),
+    offsetof(osd_params_t, GpsLon_posY),
+    offsetof(osd_params_t, Gps2Status_posY),
+    offsetof(osd_params_t, Gps2HDOP_posY),
+    offsetof(osd_params_t, Gps2Lat_posY),
+    offsetof(osd_params_t, Gps2Lon_posY),
+    offsetof(osd_params_t, Time_posY),
+    offsetof(osd_params_t, TALT_posY),
+    offsetof(osd_params_t, TSPD_posY),
+    offsetof(osd_params_t, Throt_posY),
+    offsetof(osd_params_t, CWH_home_dist_posY),
+    offsetof(osd_params_t, CWH_wp_dist_posY),
+    offsetof(osd_params_t, CWH_Tmode_posY),
+    offsetof(osd_params_t, CWH_Nmode_posY),
+    offsetof(osd_params_t, Alarm_posY),
+    offsetof(osd_params_t, ClimbRate_posY),
+    offsetof(osd_params_t, RSSI_posY),
+    offsetof(osd_params_t, Wind_posY),
+    offsetof(osd_params_t, Atti_mp_posY),
+    offsetof(osd_params_t, Atti_3D_posY),
+    offsetof(osd_params_t, Speed_scale_posY),
+    offsetof(osd_params_t, Alt_Scale_posY),
+    offsetof(osd_params_t, BattConsumed_posY),
+    offsetof(osd_params_t, TotalTripDist_posY),
+    offsetof(osd_params_t, Relative_ALT_posY),
+    offsetof(osd_params_t, Air_Speed_posY),
+    offsetof(osd_params_t, Efficiency_posY),
+    offsetof(osd_params_t, LinkQuality_posY),
+    offsetof(osd_params_t, Vario_Graph_posY),
+    offsetof(osd_params_t, HomeDirection_posY),
+    offsetof(osd_params_t, HomeLatitude_posY),
+    offsetof(osd_params_t, HomeLongitude_posY),
+    offsetof(osd_params_t, WFBState_posY),
+    offsetof(osd_params_t, OSDMessages_posY),
 };
+
+/**
+ * osd_params_scale: move widget anchors from the reference layout to the render surface.
+ *
+ * @param       width   surface width
+ * @param       height  surface height
+ */
+void osd_params_scale(int width, int height)
+{
+    if (width == GRAPHICS_REF_WIDTH && height == GRAPHICS_REF_HEIGHT)
+        return;
+
+    for (size_t i = 0; i < SIZEOF_ARRAY(pos_x_fields); i++)
+    {
+        uint16_t *v = (uint16_t *)((uint8_t *)&osd_params + pos_x_fields[i]);
+        *v = (int)*v * width / GRAPHICS_REF_WIDTH;
+    }
+
+    for (size_t i = 0; i < SIZEOF_ARRAY(pos_y_fields); i++)
+    {
+        uint16_t *v = (uint16_t *)((uint8_t *)&osd_params + pos_y_fields[i]);
+        *v = (int)*v * height / GRAPHICS_REF_HEIGHT;
+    }
+}
@@ -346,9 +346,47 @@ typedef struct
     uint16_t OSDMessages_posX;
     uint16_t OSDMessages_posY;
 
+    //screen layer of each widget: OSD_LAYER_STATIC or OSD_LAYER_DYNAMIC
+    uint16_t FlightMode_layer;
+    uint16_t Arm_layer;
+    uint16_t BattVolt_layer;
+    uint16_t BattCurrent_layer;
+    uint16_t BattRemaining_layer;
+    uint16_t BattConsumed_layer;
+    uint16_t Alt_Scale_layer;
+    uint16_t TALT_layer;
+    uint16_t Relative_ALT_layer;
+    uint16_t Speed_scale_layer;
+    uint16_t TSPD_layer;
+    uint16_t HomeDirection_layer;
+    uint16_t Atti_mp_layer;
+    uint16_t Throt_layer;
+    uint16_t HomeLatitude_layer;
+    uint16_t HomeLongitude_layer;
+    uint16_t GpsStatus_layer;
+    uint16_t GpsHDOP_layer;
+    uint16_t GpsLat_layer;
+    uint16_t GpsLon_layer;
+    uint16_t Gps2Status_layer;
+    uint16_t Gps2HDOP_layer;
+    uint16_t Gps2Lat_layer;
+    uint16_t Gps2Lon_layer;
+    uint16_t TotalTripDist_layer;
+    uint16_t Time_layer;
+    uint16_t CWH_layer;
+    uint16_t ClimbRate_layer;
+    uint16_t RSSI_layer;
+    uint16_t WFBState_layer;
+    uint16_t LinkQuality_layer;
+    uint16_t Efficiency_layer;
+    uint16_t Wind_layer;
+    uint16_t Alarm_layer;
+    uint16_t OSDMessages_layer;
 
 } osd_params_t;
 
 extern osd_params_t osd_params;
 
+void osd_params_scale(int width, int height);
+
 #endif  //__OSD_CONFIG_H
@@ -19,6 +19,10 @@
  * MinimOSD - arducam-osd Controller(https://code.google.com/p/arducam-osd/)
  */
 
+#include <stddef.h>
+#include <string.h>
+#include <time.h>
+
 #include "osdmavlink.h"
 #include "osdvar.h"
 #include "osdconfig.h"
@@ -29,230 +33,591 @@ float Rad2Deg(float x)
   return x * (180.0F / M_PI);
 }
 
-void parse_mavlink_packet(uint8_t *buf, int buflen)
+static void handle_heartbeat(const mavlink_message_t *msg, osd_telemetry_t *tlm)
 {
-    mavlink_status_t status;
-    mavlink_message_t msg;
     uint8_t mavtype;
 
-    for(int i = 0; i < buflen; i++)
+    if ((msg->compid != 1) && (msg->compid != 50)) {
+        // MAVMSG not from ardupilot(component ID:1) or pixhawk(component ID:50)
+        return;
+    }
+
+    mavtype = mavlink_msg_heartbeat_get_type(msg);
+    if (mavtype == MAV_TYPE_GCS) {
+        // MAVMSG from GCS
+        return;
+    }
+
+    tlm->mav_system    = msg->sysid;
+    tlm->mav_component = msg->compid;
+    tlm->mav_type      = mavtype;
+    tlm->autopilot = mavlink_msg_heartbeat_get_autopilot(msg);
+    tlm->base_mode = mavlink_msg_heartbeat_get_base_mode(msg);
+    tlm->custom_mode = mavlink_msg_heartbeat_get_custom_mode(msg);
+
+    tlm->last_motor_armed = tlm->motor_armed;
+    tlm->motor_armed = tlm->base_mode & MAV_MODE_FLAG_SAFETY_ARMED;
+
+    if (!tlm->last_motor_armed && tlm->motor_armed) {
+        tlm->armed_start_time = GetSystimeMS();
+    }
+
+    if (tlm->last_motor_armed && !tlm->motor_armed) {
+        tlm->total_armed_time = GetSystimeMS() - tlm->armed_start_time + tlm->total_armed_time;
+        tlm->armed_start_time = 0;
+    }
+}
+
+static void handle_home_position(const mavlink_message_t *msg, osd_telemetry_t *tlm)
+{
+    tlm->osd_home_lat = mavlink_msg_home_position_get_latitude(msg) / 1e7;
+    tlm->osd_home_lon = mavlink_msg_home_position_get_longitude(msg) / 1e7;
+    tlm->osd_home_alt = mavlink_msg_home_position_get_altitude(msg) / 1000;
+    tlm->osd_got_home = 1;
+}
+
+static void handle_extended_sys_state(const mavlink_message_t *msg, osd_telemetry_t *tlm)
+{
+    tlm->vtol_state = mavlink_msg_extended_sys_state_get_vtol_state(msg);
+}
+
+static void handle_sys_status(const mavlink_message_t *msg, osd_telemetry_t *tlm)
+{
+    tlm->osd_vbat_A = (mavlink_msg_sys_status_get_voltage_battery(msg) / 1000.0f);                 //Battery voltage, in millivolts (1 = 1 millivolt)
+    tlm->osd_curr_A = mavlink_msg_sys_status_get_current_battery(msg);                 //Battery current, in 10*milliamperes (1 = 10 milliampere)
+    tlm->osd_battery_remaining_A = mavlink_msg_sys_status_get_battery_remaining(msg);                 //Remaining battery energy: (0%: 0, 100%: 100)
+    //custom_mode = mav_component;//Debug
+    //osd_nav_mode = mav_system;//Debug
+}
+
+static void handle_battery_status(const mavlink_message_t *msg, osd_telemetry_t *tlm)
+{
+    tlm->osd_curr_consumed_mah = mavlink_msg_battery_status_get_current_consumed(msg);
+}
+
+static void handle_gps_raw_int(const mavlink_message_t *msg, osd_telemetry_t *tlm)
+{
+    tlm->osd_lat = mavlink_msg_gps_raw_int_get_lat(msg) / 10000000.0;
+    tlm->osd_lon = mavlink_msg_gps_raw_int_get_lon(msg) / 10000000.0;
+    tlm->osd_fix_type = mavlink_msg_gps_raw_int_get_fix_type(msg);
+    tlm->osd_hdop = mavlink_msg_gps_raw_int_get_eph(msg);
+    tlm->osd_satellites_visible = mavlink_msg_gps_raw_int_get_satellites_visible(msg);
+}
+
+static void handle_gps2_raw(const mavlink_message_t *msg, osd_telemetry_t *tlm)
+{
+    tlm->osd_lat2 = mavlink_msg_gps2_raw_get_lat(msg) / 10000000.0;
+    tlm->osd_lon2 = mavlink_msg_gps2_raw_get_lon(msg) / 10000000.0;
+    tlm->osd_fix_type2 = mavlink_msg_gps2_raw_get_fix_type(msg);
+    tlm->osd_hdop2 = mavlink_msg_gps2_raw_get_eph(msg);
+    tlm->osd_satellites_visible2 = mavlink_msg_gps2_raw_get_satellites_visible(msg);
+}
+
+static void handle_vfr_hud(const mavlink_message_t *msg, osd_telemetry_t *tlm)
+{
+    tlm->osd_airspeed = mavlink_msg_vfr_hud_get_airspeed(msg);
+    tlm->osd_groundspeed = mavlink_msg_vfr_hud_get_groundspeed(msg);
+    tlm->osd_heading = mavlink_msg_vfr_hud_get_heading(msg);                 // 0..360 deg, 0=north
+    tlm->osd_throttle = mavlink_msg_vfr_hud_get_throttle(msg);
+    tlm->osd_alt = mavlink_msg_vfr_hud_get_alt(msg);
+    tlm->osd_climb = mavlink_msg_vfr_hud_get_climb(msg);
+}
+
+// Workaround for ardupilot
+static void handle_global_position_int(const mavlink_message_t *msg, osd_telemetry_t *tlm)
+{
+    mavlink_global_position_int_t global_position;
+    mavlink_msg_global_position_int_decode(msg, &global_position);
+    tlm->osd_alt = global_position.alt / 1000.0;
+    tlm->osd_rel_alt = global_position.relative_alt / 1000.0;
+}
+
+static void handle_altitude(const mavlink_message_t *msg, osd_telemetry_t *tlm)
+{
+    tlm->osd_bottom_clearance = mavlink_msg_altitude_get_bottom_clearance(msg);
+    tlm->osd_rel_alt = mavlink_msg_altitude_get_altitude_relative(msg);
+}
+
+static void handle_attitude(const mavlink_message_t *msg, osd_telemetry_t *tlm)
+{
+    tlm->osd_pitch = Rad2Deg(mavlink_msg_attitude_get_pitch(msg));
+    tlm->osd_roll = Rad2Deg(mavlink_msg_attitude_get_roll(msg));
+    tlm->osd_yaw = Rad2Deg(mavlink_msg_attitude_get_yaw(msg));
+}
+
+static void handle_nav_controller_output(const mavlink_message_t *msg, osd_telemetry_t *tlm)
+{
+    tlm->nav_roll = mavlink_msg_nav_controller_output_get_nav_roll(msg);
+    tlm->nav_pitch = mavlink_msg_nav_controller_output_get_nav_pitch(msg);
+    tlm->nav_bearing = mavlink_msg_nav_controller_output_get_nav_bearing(msg);
+    tlm->wp_target_bearing = mavlink_msg_nav_controller_output_get_target_bearing(msg);
+    tlm->wp_dist = mavlink_msg_nav_controller_output_get_wp_dist(msg);
+    tlm->alt_error = mavlink_msg_nav_controller_output_get_alt_error(msg);
+    tlm->aspd_error = mavlink_msg_nav_controller_output_get_aspd_error(msg);
+    tlm->xtrack_error = mavlink_msg_nav_controller_output_get_xtrack_error(msg);
+}
+
+static void handle_mission_current(const mavlink_message_t *msg, osd_telemetry_t *tlm)
+{
+    tlm->wp_number = (uint8_t)mavlink_msg_mission_current_get_seq(msg);
+}
+
+static void handle_rc_channels_raw(const mavlink_message_t *msg, osd_telemetry_t *tlm)
+{
+    if (!tlm->osd_chan_cnt_above_eight)
+    {
+        tlm->osd_chan_raw[0] = mavlink_msg_rc_channels_raw_get_chan1_raw(msg);
+        tlm->osd_chan_raw[1] = mavlink_msg_rc_channels_raw_get_chan2_raw(msg);
+        tlm->osd_chan_raw[2] = mavlink_msg_rc_channels_raw_get_chan3_raw(msg);
+        tlm->osd_chan_raw[3] = mavlink_msg_rc_channels_raw_get_chan4_raw(msg);
+        tlm->osd_chan_raw[4] = mavlink_msg_rc_channels_raw_get_chan5_raw(msg);
+        tlm->osd_chan_raw[5] = mavlink_msg_rc_channels_raw_get_chan6_raw(msg);
+        tlm->osd_chan_raw[6] = mavlink_msg_rc_channels_raw_get_chan7_raw(msg);
+        tlm->osd_chan_raw[7] = mavlink_msg_rc_channels_raw_get_chan8_raw(msg);
+        tlm->osd_rssi = mavlink_msg_rc_channels_raw_get_rssi(msg);
+    }
+}
+
+static void handle_rc_channels(const mavlink_message_t *msg, osd_telemetry_t *tlm)
+{
+    tlm->osd_chan_cnt_above_eight = true;
+    tlm->osd_chan_raw[0] = mavlink_msg_rc_channels_get_chan1_raw(msg);
+    tlm->osd_chan_raw[1] = mavlink_msg_rc_channels_get_chan2_raw(msg);
+    tlm->osd_chan_raw[2] = mavlink_msg_rc_channels_get_chan3_raw(msg);
+    tlm->osd_chan_raw[3] = mavlink_msg_rc_channels_get_chan4_raw(msg);
+    tlm->osd_chan_raw[4] = mavlink_msg_rc_channels_get_chan5_raw(msg);
+    tlm->osd_chan_raw[5] = mavlink_msg_rc_channels_get_chan6_raw(msg);
+    tlm->osd_chan_raw[6] = mavlink_msg_rc_channels_get_chan7_raw(msg);
+    tlm->osd_chan_raw[7] = mavlink_msg_rc_channels_get_chan8_raw(msg);
+    tlm->osd_chan_raw[8] = mavlink_msg_rc_channels_get_chan9_raw(msg);
+    tlm->osd_chan_raw[9] = mavlink_msg_rc_channels_get_chan10_raw(msg);
+    tlm->osd_chan_raw[10] = mavlink_msg_rc_channels_get_chan11_raw(msg);
+    tlm->osd_chan_raw[11] = mavlink_msg_rc_channels_get_chan12_raw(msg);
+    tlm->osd_chan_raw[12] = mavlink_msg_rc_channels_get_chan13_raw(msg);
+    tlm->osd_chan_raw[13] = mavlink_msg_rc_channels_get_chan14_raw(msg);
+    tlm->osd_chan_raw[14] = mavlink_msg_rc_channels_get_chan15_raw(msg);
+    tlm->osd_chan_raw[15] = mavlink_msg_rc_channels_get_chan16_raw(msg);
+    tlm->osd_rssi = mavlink_msg_rc_channels_get_rssi(msg);
+}
+
+static void handle_radio_status(const mavlink_message_t *msg, osd_telemetry_t *tlm)
+{
+    if ((msg->sysid != 3) || (msg->compid != 68)) {
+        return;
+    }
+
+    tlm->wfb_rssi = (int8_t)mavlink_msg_radio_status_get_rssi(msg);
+    tlm->wfb_errors = mavlink_msg_radio_status_get_rxerrors(msg);
+    tlm->wfb_fec_fixed = mavlink_msg_radio_status_get_fixed(msg);
+    tlm->wfb_flags = mavlink_msg_radio_status_get_remnoise(msg);
+}
+
+static void handle_statustext(const mavlink_message_t *msg, osd_telemetry_t *tlm)
+{
+    tlm->osd_message_queue_tail = (tlm->osd_message_queue_tail + 1) % OSD_MAX_MESSAGES;
+    osd_message_t *item = tlm->osd_message_queue + tlm->osd_message_queue_tail;
+    item->severity = mavlink_msg_statustext_get_severity(msg);
+    mavlink_msg_statustext_get_text(msg, item->message);
+    item->message[sizeof(item->message) - 1] = '\0';
+    printf("Message: %s\n", item->message);
+}
+
+typedef void (*mavlink_handler_t)(const mavlink_message_t *msg, osd_telemetry_t *tlm);
+
+/*
+ * High-rate messages are decoded lazily. The parser only keeps the latest
+ * payload of each in its osd_telemetry slot, the renderer applies the
+ * handlers to the slots of the groups it shows with decode_mavlink_slots().
+ */
+typedef struct {
+    uint32_t msgid;
+    osd_telemetry_group_t group;
+    size_t time_offset;         // slot's time_us in osd_telemetry_t
+    size_t payload_offset;      // slot's payload in osd_telemetry_t
+    uint8_t len;
+    mavlink_handler_t decode;
+} mavlink_slot_t;
+
+#define MAVLINK_SLOT_ENTRY(msg, group, slot, handler) {                 \
+    MAVLINK_MSG_ID_##msg, group,                                        \
+    offsetof(osd_telemetry_t, slot.time_us),                            \
+    offsetof(osd_telemetry_t, slot.payload),                            \
+    MAVLINK_MSG_ID_##msg##_LEN, handler                                 \
+}
+
+static const mavlink_slot_t mavlink_slots[] = {
+    MAVLINK_SLOT_ENTRY(ATTITUDE, TLM_ATTITUDE, attitude_msg, handle_attitude),
+    MAVLINK_SLOT_ENTRY(VFR_HUD, TLM_FLIGHT, vfr_hud_msg, handle_vfr_hud),
+    MAVLINK_SLOT_ENTRY(GLOBAL_POSITION_INT, TLM_FLIGHT, global_position_int_msg, handle_global_position_int),
+    MAVLINK_SLOT_ENTRY(ALTITUDE, TLM_FLIGHT, altitude_msg, handle_altitude),
+    MAVLINK_SLOT_ENTRY(GPS_RAW_INT, TLM_GPS, gps_raw_int_msg, handle_gps_raw_int),
+    MAVLINK_SLOT_ENTRY(GPS2_RAW, TLM_GPS2, gps2_raw_msg, handle_gps2_raw),
+    MAVLINK_SLOT_ENTRY(RC_CHANNELS, TLM_RC, rc_channels_msg, handle_rc_channels),
+    MAVLINK_SLOT_ENTRY(RC_CHANNELS_RAW, TLM_RC, rc_channels_raw_msg, handle_rc_channels_raw),
+    MAVLINK_SLOT_ENTRY(NAV_CONTROLLER_OUTPUT, TLM_NAV, nav_controller_output_msg, handle_nav_controller_output),
+    MAVLINK_SLOT_ENTRY(MISSION_CURRENT, TLM_NAV, mission_current_msg, handle_mission_current),
+    MAVLINK_SLOT_ENTRY(SYS_STATUS, TLM_BATTERY, sys_status_msg, handle_sys_status),
+    MAVLINK_SLOT_ENTRY(BATTERY_STATUS, TLM_BATTERY, battery_status_msg, handle_battery_status),
+};
+
+// Most recently stored slot of each group, parser thread only
+static const mavlink_slot_t *latest_slot[TLM_GROUP_COUNT];
+
+// Arrival time of the current datagram and of the last stored message
+static uint64_t datagram_time_us = 0;
+static uint64_t stored_time_us = 0;
+
+static void datagram_arrived(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    datagram_time_us = ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+// Only for ids handled by store_payload()
+static const mavlink_slot_t *mavlink_slot(uint32_t msgid)
+{
+    const mavlink_slot_t *s = mavlink_slots;
+
+    while (s->msgid != msgid)
+    {
+        s++;
+    }
+    return s;
+}
+
+/**
+ * store_slot: keep the payload of a lazily decoded message.
+ *
+ * @param s         slot of the message
+ * @param payload   received payload, MAVLink 2 may trim its trailing zeros
+ * @param len       received payload length
+ * @param tlm       parser's telemetry copy
+ */
+static void store_slot(const mavlink_slot_t *s, const uint8_t *payload, uint8_t len, osd_telemetry_t *tlm)
+{
+    uint8_t *slot = (uint8_t*)tlm + s->payload_offset;
+
+    if (len > s->len)
+    {
+        len = s->len;
+    }
+
+    // Repeated latest message changes nothing, so the group isn't republished
+    if (latest_slot[s->group] == s && memcmp(slot, payload, len) == 0)
     {
-        uint8_t c = buf[i];
-        if (mavlink_parse_char(0, c, &msg, &status))
+        int i = len;
+        while (i < s->len && slot[i] == 0)
         {
-            //handle msg
-            switch (msg.msgid)
-            {
-            case MAVLINK_MSG_ID_HEARTBEAT:
-            {
-                if ((msg.compid != 1) && (msg.compid != 50)) {
-                    // MAVMSG not from ardupilot(component ID:1) or pixhawk(component ID:50)
-                    break;
-                }
+            i++;
+        }
+        if (i == s->len)
+        {
+            return;
+        }
+    }
 
-                mavtype = mavlink_msg_heartbeat_get_type(&msg);
-                if (mavtype == MAV_TYPE_GCS) {
-                    // MAVMSG from GCS
-                    break;
-                }
+    memcpy(slot, payload, len);
+    memset(slot + len, 0, s->len - len);
 
-                mav_system    = msg.sysid;
-                mav_component = msg.compid;
-                mav_type      = mavtype;
-                autopilot = mavlink_msg_heartbeat_get_autopilot(&msg);
-                base_mode = mavlink_msg_heartbeat_get_base_mode(&msg);
-                custom_mode = mavlink_msg_heartbeat_get_custom_mode(&msg);
+    // Strictly increasing, so messages of one datagram keep their order too
+    stored_time_us = datagram_time_us > stored_time_us ? datagram_time_us : stored_time_us + 1;
+    *(uint64_t*)((uint8_t*)tlm + s->time_offset) = stored_time_us;
+    latest_slot[s->group] = s;
+}
 
-                last_motor_armed = motor_armed;
-                motor_armed = base_mode & MAV_MODE_FLAG_SAFETY_ARMED;
+static void store_payload(const mavlink_message_t *msg, osd_telemetry_t *tlm)
+{
+    store_slot(mavlink_slot(msg->msgid), (const uint8_t*)_MAV_PAYLOAD(msg), msg->len, tlm);
+}
 
-                if (!last_motor_armed && motor_armed) {
-                    armed_start_time = GetSystimeMS();
-                }
+/**
+ * decode_mavlink_slots: decode stored payloads into telemetry fields.
+ *
+ * Slots which came after the last decode of the group are applied over
+ * the fields in the arrival order, so fields set by several messages end
+ * up with the value from the latest one, as if every message was decoded
+ * when it came. Fields of groups not asked for stay as they are.
+ *
+ * @param tlm       renderer's telemetry copy
+ * @param groups    bitmap of osd_telemetry_group_t to bring up to date
+ * @return          bitmap of groups whose fields were decoded
+ */
+uint32_t decode_mavlink_slots(osd_telemetry_t *tlm, uint32_t groups)
+{
+    uint32_t decoded = 0;
 
-                if (last_motor_armed && !motor_armed) {
-                    total_armed_time = GetSystimeMS() - armed_start_time + total_armed_time;
-                    armed_start_time = 0;
-                }
-            }
-            break;
+    for (int g = 0; g < TLM_GROUP_COUNT; g++)
+    {
+        if (!(groups & TLM_GROUP_BIT(g)))
+        {
+            continue;
+        }
 
-            case MAVLINK_MSG_ID_HOME_POSITION:
+        uint64_t after = tlm->decoded_time_us[g];
+        for (;;)
+        {
+            const mavlink_slot_t *next = NULL;
+            uint64_t next_time = UINT64_MAX;
+
+            for (int i = 0; i < SIZEOF_ARRAY(mavlink_slots); i++)
             {
-                osd_home_lat = mavlink_msg_home_position_get_latitude(&msg) / 1e7;
-                osd_home_lon = mavlink_msg_home_position_get_longitude(&msg) / 1e7;
-                osd_home_alt = mavlink_msg_home_position_get_altitude(&msg) / 1000;
-                osd_got_home = 1;
-                break;
+                const mavlink_slot_t *s = mavlink_slots + i;
+                uint64_t time_us = *(const uint64_t*)((const uint8_t*)tlm + s->time_offset);
+                if (s->group == g && time_us > after && time_us < next_time)
+                {
+                    next = s;
+                    next_time = time_us;
+                }
             }
-
-            case MAVLINK_MSG_ID_EXTENDED_SYS_STATE:
+            if (next == NULL)
             {
-                vtol_state = mavlink_msg_extended_sys_state_get_vtol_state(&msg);
                 break;
             }
 
-            case MAVLINK_MSG_ID_SYS_STATUS:
-            {
-                osd_vbat_A = (mavlink_msg_sys_status_get_voltage_battery(&msg) / 1000.0f);                 //Battery voltage, in millivolts (1 = 1 millivolt)
-                osd_curr_A = mavlink_msg_sys_status_get_current_battery(&msg);                 //Battery current, in 10*milliamperes (1 = 10 milliampere)
-                osd_battery_remaining_A = mavlink_msg_sys_status_get_battery_remaining(&msg);                 //Remaining battery energy: (0%: 0, 100%: 100)
-                //custom_mode = mav_component;//Debug
-                //osd_nav_mode = mav_system;//Debug
-            }
-            break;
+            mavlink_message_t msg = { .msgid = next->msgid, .len = next->len };
+            memcpy(_MAV_PAYLOAD_NON_CONST(&msg), (const uint8_t*)tlm + next->payload_offset, next->len);
+            next->decode(&msg, tlm);
+            decoded |= TLM_GROUP_BIT(g);
+            after = next_time;
+        }
+        tlm->decoded_time_us[g] = after;
+    }
+    return decoded;
+}
 
-            case MAVLINK_MSG_ID_BATTERY_STATUS:
-            {
-                osd_curr_consumed_mah = mavlink_msg_battery_status_get_current_consumed(&msg);
-            }
-            break;
+// All consumed messages have ids below 256, anything else is dropped unparsed
+#define MAVLINK_HANDLERS 256
 
-            case MAVLINK_MSG_ID_GPS_RAW_INT:
-            {
-                osd_lat = mavlink_msg_gps_raw_int_get_lat(&msg) / 10000000.0;
-                osd_lon = mavlink_msg_gps_raw_int_get_lon(&msg) / 10000000.0;
-                osd_fix_type = mavlink_msg_gps_raw_int_get_fix_type(&msg);
-                osd_hdop = mavlink_msg_gps_raw_int_get_eph(&msg);
-                osd_satellites_visible = mavlink_msg_gps_raw_int_get_satellites_visible(&msg);
-            }
-            break;
+static const mavlink_handler_t mavlink_handlers[MAVLINK_HANDLERS] = {
+    [MAVLINK_MSG_ID_HEARTBEAT] = handle_heartbeat,
+    [MAVLINK_MSG_ID_HOME_POSITION] = handle_home_position,
+    [MAVLINK_MSG_ID_EXTENDED_SYS_STATE] = handle_extended_sys_state,
+    [MAVLINK_MSG_ID_SYS_STATUS] = store_payload,
+    [MAVLINK_MSG_ID_BATTERY_STATUS] = store_payload,
+    [MAVLINK_MSG_ID_GPS_RAW_INT] = store_payload,
+    [MAVLINK_MSG_ID_GPS2_RAW] = store_payload,
+    [MAVLINK_MSG_ID_VFR_HUD] = store_payload,
+    [MAVLINK_MSG_ID_GLOBAL_POSITION_INT] = store_payload,
+    [MAVLINK_MSG_ID_ALTITUDE] = store_payload,
+    [MAVLINK_MSG_ID_ATTITUDE] = store_payload,
+    [MAVLINK_MSG_ID_NAV_CONTROLLER_OUTPUT] = store_payload,
+    [MAVLINK_MSG_ID_MISSION_CURRENT] = store_payload,
+    [MAVLINK_MSG_ID_RC_CHANNELS_RAW] = store_payload,
+    [MAVLINK_MSG_ID_RC_CHANNELS] = store_payload,
+    [MAVLINK_MSG_ID_RADIO_STATUS] = handle_radio_status,
+    [MAVLINK_MSG_ID_STATUSTEXT] = handle_statustext,
+};
 
-            case MAVLINK_MSG_ID_GPS2_RAW:
-            {
-                osd_lat2 = mavlink_msg_gps2_raw_get_lat(&msg) / 10000000.0;
-                osd_lon2 = mavlink_msg_gps2_raw_get_lon(&msg) / 10000000.0;
-                osd_fix_type2 = mavlink_msg_gps2_raw_get_fix_type(&msg);
-                osd_hdop2 = mavlink_msg_gps2_raw_get_eph(&msg);
-                osd_satellites_visible2 = mavlink_msg_gps2_raw_get_satellites_visible(&msg);
-            }
-            break;
+// mavlink_get_msg_entry() results for handled ids, looked up on first use
+static const mavlink_msg_entry_t *mavlink_entries[MAVLINK_HANDLERS];
 
-            case MAVLINK_MSG_ID_VFR_HUD:
-            {
-                osd_airspeed = mavlink_msg_vfr_hud_get_airspeed(&msg);
-                osd_groundspeed = mavlink_msg_vfr_hud_get_groundspeed(&msg);
-                osd_heading = mavlink_msg_vfr_hud_get_heading(&msg);                 // 0..360 deg, 0=north
-                osd_throttle = mavlink_msg_vfr_hud_get_throttle(&msg);
-                osd_alt = mavlink_msg_vfr_hud_get_alt(&msg);
-                osd_climb = mavlink_msg_vfr_hud_get_climb(&msg);
-            }
-            break;
+static inline mavlink_handler_t mavlink_handler(uint32_t msgid)
+{
+    return msgid < MAVLINK_HANDLERS ? mavlink_handlers[msgid] : NULL;
+}
 
-            // Workaround for ardupilot
-            case MAVLINK_MSG_ID_GLOBAL_POSITION_INT:
-            {
-                mavlink_global_position_int_t global_position;
-                mavlink_msg_global_position_int_decode(&msg, &global_position);
-                osd_alt = global_position.alt / 1000.0;
-                osd_rel_alt = global_position.relative_alt / 1000.0;
-            }
-            break;
+static void dispatch_message(const mavlink_message_t *msg, osd_telemetry_t *tlm)
+{
+    mavlink_handler_t handler = mavlink_handler(msg->msgid);
+    if (handler != NULL)
+    {
+        handler(msg, tlm);
+    }
+}
 
-            case MAVLINK_MSG_ID_ALTITUDE:
-            {
-                osd_bottom_clearance = mavlink_msg_altitude_get_bottom_clearance(&msg);
-                osd_rel_alt = mavlink_msg_altitude_get_altitude_relative(&msg);
-            }
-            break;
+/**
+ * frame_valid: check the checksum of a whole frame.
+ *
+ * @param frame     frame starting at STX, header and payload are complete
+ * @param v2        MAVLink 2 frame
+ * @param msgid     message id from the header, must have a handler
+ * @return          true if the checksum is valid
+ */
+static bool frame_valid(const uint8_t *frame, bool v2, uint32_t msgid)
+{
+    const mavlink_msg_entry_t *e = mavlink_entries[msgid];
+    int header_len = v2 ? MAVLINK_CORE_HEADER_LEN : MAVLINK_CORE_HEADER_MAVLINK1_LEN;
+    uint8_t len = frame[1];
+    const uint8_t *payload = frame + 1 + header_len;
 
-            case MAVLINK_MSG_ID_ATTITUDE:
-            {
-                osd_pitch = Rad2Deg(mavlink_msg_attitude_get_pitch(&msg));
-                osd_roll = Rad2Deg(mavlink_msg_attitude_get_roll(&msg));
-                osd_yaw = Rad2Deg(mavlink_msg_attitude_get_yaw(&msg));
-            }
-            break;
+    if (e == NULL)
+    {
+        e = mavlink_entries[msgid] = mavlink_get_msg_entry(msgid);
+    }
 
-            case MAVLINK_MSG_ID_NAV_CONTROLLER_OUTPUT:
-            {
-                nav_roll = mavlink_msg_nav_controller_output_get_nav_roll(&msg);
-                nav_pitch = mavlink_msg_nav_controller_output_get_nav_pitch(&msg);
-                nav_bearing = mavlink_msg_nav_controller_output_get_nav_bearing(&msg);
-                wp_target_bearing = mavlink_msg_nav_controller_output_get_target_bearing(&msg);
-                wp_dist = mavlink_msg_nav_controller_output_get_wp_dist(&msg);
-                alt_error = mavlink_msg_nav_controller_output_get_alt_error(&msg);
-                aspd_error = mavlink_msg_nav_controller_output_get_aspd_error(&msg);
-                xtrack_error = mavlink_msg_nav_controller_output_get_xtrack_error(&msg);
-            }
-            break;
+    uint16_t crc = crc_calculate(frame + 1, header_len + len);
+    crc_accumulate(e != NULL ? e->crc_extra : 0, &crc);
+    return (payload[len] | (payload[len + 1] << 8)) == crc;
+}
+
+/**
+ * frame_message: unpack a valid frame like mavlink_parse_char() does.
+ *
+ * @param frame     frame checked by frame_valid()
+ * @param v2        MAVLink 2 frame
+ * @param msgid     message id from the header
+ * @param msg       unpacked message
+ */
+static void frame_message(const uint8_t *frame, bool v2, uint32_t msgid, mavlink_message_t *msg)
+{
+    const mavlink_msg_entry_t *e = mavlink_entries[msgid];
+    int header_len = v2 ? MAVLINK_CORE_HEADER_LEN : MAVLINK_CORE_HEADER_MAVLINK1_LEN;
+    uint8_t len = frame[1];
+    const uint8_t *payload = frame + 1 + header_len;
+
+    msg->magic = frame[0];
+    msg->len = len;
+    msg->msgid = msgid;
+    if (v2)
+    {
+        msg->incompat_flags = frame[2];
+        msg->compat_flags = frame[3];
+        msg->seq = frame[4];
+        msg->sysid = frame[5];
+        msg->compid = frame[6];
+    }
+    else
+    {
+        msg->incompat_flags = 0;
+        msg->compat_flags = 0;
+        msg->seq = frame[2];
+        msg->sysid = frame[3];
+        msg->compid = frame[4];
+    }
+    msg->checksum = payload[len] | (payload[len + 1] << 8);
+    memcpy(_MAV_PAYLOAD_NON_CONST(msg), payload, len);
+
+    // MAVLink 2 trims trailing zeros of the payload
+    if (e != NULL && len < e->max_msg_len)
+    {
+        memset(_MAV_PAYLOAD_NON_CONST(msg) + len, 0, e->max_msg_len - len);
+    }
+}
+
+static bool mavlink_stream_idle(void)
+{
+    uint8_t state = mavlink_get_channel_status(MAVLINK_COMM_0)->parse_state;
+    return state == MAVLINK_PARSE_STATE_UNINIT || state == MAVLINK_PARSE_STATE_IDLE;
+}
+
+/**
+ * parse_mavlink_packet: parse MAVLink frames from a datagram.
+ *
+ * Frames are normally whole inside a datagram, so they are located with
+ * memchr(), checked and dispatched at once. Messages without a handler are
+ * skipped before the checksum. A frame which continues in the next datagram
+ * goes through the byte-wise mavlink_parse_char(), and so does a broken
+ * one, so the stream resyncs after it exactly as with byte-wise parsing.
+ */
+void parse_mavlink_packet(uint8_t *buf, int buflen)
+{
+    osd_telemetry_t *tlm = osd_telemetry_w;
+    const uint8_t *p = buf;
+    const uint8_t *end = buf + buflen;
+    const uint8_t *stx2 = buf;
+    mavlink_status_t status;
+    mavlink_message_t msg;
 
-            case MAVLINK_MSG_ID_MISSION_CURRENT:
+    datagram_arrived();
+
+    while (p < end)
+    {
+        // Finish the frame started in the previous datagram
+        if (!mavlink_stream_idle())
+        {
+            if (mavlink_parse_char(MAVLINK_COMM_0, *p++, &msg, &status))
             {
-                wp_number = (uint8_t)mavlink_msg_mission_current_get_seq(&msg);
+                dispatch_message(&msg, tlm);
             }
-            break;
+            continue;
+        }
 
-            case MAVLINK_MSG_ID_RC_CHANNELS_RAW:
+        // MAVLink 1 start byte is looked for only up to the next MAVLink 2 one
+        if (stx2 < p)
+        {
+            stx2 = memchr(p, MAVLINK_STX, end - p);
+            if (stx2 == NULL)
             {
-                if (!osd_chan_cnt_above_eight)
-                {
-                    osd_chan1_raw = mavlink_msg_rc_channels_raw_get_chan1_raw(&msg);
-                    osd_chan2_raw = mavlink_msg_rc_channels_raw_get_chan2_raw(&msg);
-                    osd_chan3_raw = mavlink_msg_rc_channels_raw_get_chan3_raw(&msg);
-                    osd_chan4_raw = mavlink_msg_rc_channels_raw_get_chan4_raw(&msg);
-                    osd_chan5_raw = mavlink_msg_rc_channels_raw_get_chan5_raw(&msg);
-                    osd_chan6_raw = mavlink_msg_rc_channels_raw_get_chan6_raw(&msg);
-                    osd_chan7_raw = mavlink_msg_rc_channels_raw_get_chan7_raw(&msg);
-                    osd_chan8_raw = mavlink_msg_rc_channels_raw_get_chan8_raw(&msg);
-                    osd_rssi = mavlink_msg_rc_channels_raw_get_rssi(&msg);
-                }
+                stx2 = end;
             }
+        }
+        const uint8_t *stx1 = memchr(p, MAVLINK_STX_MAVLINK1, stx2 - p);
+        p = stx1 != NULL ? stx1 : stx2;
+        if (p == end)
+        {
             break;
+        }
+
+        bool v2 = *p == MAVLINK_STX;
+        int header_len = v2 ? MAVLINK_CORE_HEADER_LEN : MAVLINK_CORE_HEADER_MAVLINK1_LEN;
+        if (end - p < 1 + header_len)
+        {
+            goto bytewise;
+        }
 
-            case MAVLINK_MSG_ID_RC_CHANNELS:
+        uint8_t len = p[1];
+        uint32_t msgid;
+        int frame_len = 1 + header_len + len + MAVLINK_NUM_CHECKSUM_BYTES;
+        if (v2)
+        {
+            if (p[2] & ~MAVLINK_IFLAG_MASK)
             {
-                osd_chan_cnt_above_eight = true;
-                osd_chan1_raw = mavlink_msg_rc_channels_get_chan1_raw(&msg);
-                osd_chan2_raw = mavlink_msg_rc_channels_get_chan2_raw(&msg);
-                osd_chan3_raw = mavlink_msg_rc_channels_get_chan3_raw(&msg);
-                osd_chan4_raw = mavlink_msg_rc_channels_get_chan4_raw(&msg);
-                osd_chan5_raw = mavlink_msg_rc_channels_get_chan5_raw(&msg);
-                osd_chan6_raw = mavlink_msg_rc_channels_get_chan6_raw(&msg);
-                osd_chan7_raw = mavlink_msg_rc_channels_get_chan7_raw(&msg);
-                osd_chan8_raw = mavlink_msg_rc_channels_get_chan8_raw(&msg);
-                osd_chan9_raw = mavlink_msg_rc_channels_get_chan9_raw(&msg);
-                osd_chan10_raw = mavlink_msg_rc_channels_get_chan10_raw(&msg);
-                osd_chan11_raw = mavlink_msg_rc_channels_get_chan11_raw(&msg);
-                osd_chan12_raw = mavlink_msg_rc_channels_get_chan12_raw(&msg);
-                osd_chan13_raw = mavlink_msg_rc_channels_get_chan13_raw(&msg);
-                osd_chan14_raw = mavlink_msg_rc_channels_get_chan14_raw(&msg);
-                osd_chan15_raw = mavlink_msg_rc_channels_get_chan15_raw(&msg);
-                osd_chan16_raw = mavlink_msg_rc_channels_get_chan16_raw(&msg);
-                osd_rssi = mavlink_msg_rc_channels_get_rssi(&msg);
+                // Unknown incompatible flags, mavlink_parse_char() drops the header
+                goto bytewise;
             }
-            break;
-
-            case MAVLINK_MSG_ID_RADIO_STATUS:
+            if (p[2] & MAVLINK_IFLAG_SIGNED)
             {
-                if ((msg.sysid != 3) || (msg.compid != 68)) {
-                    break;
-                }
-
-                wfb_rssi = (int8_t)mavlink_msg_radio_status_get_rssi(&msg);
-                wfb_errors = mavlink_msg_radio_status_get_rxerrors(&msg);
-                wfb_fec_fixed = mavlink_msg_radio_status_get_fixed(&msg);
-                wfb_flags = mavlink_msg_radio_status_get_remnoise(&msg);
+                frame_len += MAVLINK_SIGNATURE_BLOCK_LEN;
             }
-            break;
+            msgid = p[7] | (p[8] << 8) | ((uint32_t)p[9] << 16);
+        }
+        else
+        {
+            msgid = p[5];
+        }
+
+        if (end - p < frame_len)
+        {
+            goto bytewise;
+        }
 
-            case MAVLINK_MSG_ID_STATUSTEXT:
+        mavlink_handler_t handler = mavlink_handler(msgid);
+        if (handler == NULL)
+        {
+            // Not used by OSD: skip unchecked, valid or not mavlink_parse_char() drops it whole.
+            // Unless a broken one ends with STX, it starts over there
+            if (p[frame_len - 1] == MAVLINK_STX)
             {
-                osd_message_queue_tail = (osd_message_queue_tail + 1) % OSD_MAX_MESSAGES;
-                osd_message_t *item = osd_message_queue + osd_message_queue_tail;
-                item->severity = mavlink_msg_statustext_get_severity(&msg);
-                mavlink_msg_statustext_get_text(&msg, item->message);
-                item->message[sizeof(item->message) - 1] = '\0';
-                printf("Message: %s\n", item->message);
+                goto bytewise;
             }
-            break;
+            p += frame_len;
+            continue;
+        }
 
+        if (!frame_valid(p, v2, msgid))
+        {
+            goto bytewise;
+        }
+        if (handler == store_payload)
+        {
+            // Straight from the frame, without unpacking
+            store_slot(mavlink_slot(msgid), p + 1 + header_len, len, tlm);
+        }
+        else
+        {
+            frame_message(p, v2, msgid, &msg);
+            handler(&msg, tlm);
+        }
+        p += frame_len;
+        continue;
 
-            default:
-                //Do nothing
-                break;
-            }   //end switch(msg.msgid)
+bytewise:
+        // Start byte-wise parsing, it goes on until mavlink_parse_char() is idle again
+        if (mavlink_parse_char(MAVLINK_COMM_0, *p++, &msg, &status))
+        {
+            dispatch_message(&msg, tlm);
         }
     }
 }
-
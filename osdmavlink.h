@@ -2,7 +2,9 @@
 #define __OSD_MAVLINK_H
 
 #include "mavlink/common/mavlink.h"
+#include "osdvar.h"
 
 void parse_mavlink_packet(uint8_t *buf, int buflen);
+uint32_t decode_mavlink_slots(osd_telemetry_t *tlm, uint32_t groups);
 
 #endif  //__OSD_MAVLINK_H
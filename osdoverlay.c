@@ -0,0 +1,353 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * wfbosdoverlay: video filter compositing the OSD into decoded frames.
+ * If downstream handles GstVideoOverlayCompositionMeta (hardware overlay
+ * planes, some sinks) the OSD is attached as meta, otherwise it's blended
+ * in place on the CPU. Unlike the glvideomixer pipeline it needs no GL and
+ * can be put after any decoder, e.g. in front of an encoder for recording.
+ * NV12 and I420 frames are blended by yuvblend (sparse=true, default), which
+ * touches only tiles covered by the OSD, other formats by the overlay
+ * composition blender.
+ */
+
+#include <gst/gst.h>
+#include <gst/video/video.h>
+#include <gst/video/gstvideofilter.h>
+
+#include <stdint.h>
+#include <pthread.h>
+#include <stdio.h>
+
+#include "graphengine.h"
+#include "osdoverlay.h"
+#include "yuvblend.h"
+
+#define OSD_OVERLAY_CAPS GST_VIDEO_CAPS_MAKE (GST_VIDEO_OVERLAY_COMPOSITION_BLEND_FORMATS)
+
+enum {
+    PROP_0,
+    PROP_SPARSE,
+};
+
+typedef struct {
+    GstVideoFilter parent;
+
+    GstBufferPool *pool;                        // OSD frames
+    GstBuffer *osd;                             // last OSD frame, NULL until first one
+    GstVideoOverlayComposition *composition;    // osd as composition, NULL = not built yet
+    gboolean attach_meta;                       // downstream composites the meta itself
+
+    gboolean sparse;                            // property: blend NV12 / I420 with yuvblend
+    yuvblend_t blend;
+    gboolean blend_ready;                       // blend is setup for negotiated caps
+    gboolean blend_stale;                       // osd isn't converted into blend yet
+} WfbOsdOverlay;
+
+typedef struct {
+    GstVideoFilterClass parent_class;
+} WfbOsdOverlayClass;
+
+G_DEFINE_TYPE (WfbOsdOverlay, wfb_osd_overlay, GST_TYPE_VIDEO_FILTER);
+
+#define WFB_OSD_OVERLAY(obj) ((WfbOsdOverlay *) (obj))
+
+static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE ("sink",
+    GST_PAD_SINK, GST_PAD_ALWAYS, GST_STATIC_CAPS (OSD_OVERLAY_CAPS));
+
+static GstStaticPadTemplate src_template = GST_STATIC_PAD_TEMPLATE ("src",
+    GST_PAD_SRC, GST_PAD_ALWAYS, GST_STATIC_CAPS (OSD_OVERLAY_CAPS));
+
+/*
+ * Overlay rectangles take native endian ARGB, i.e. B, G, R, A bytes on
+ * little endian hosts, while the OSD is R, G, B, A.
+ */
+static GstBuffer *
+osd_to_overlay_buffer (GstBuffer *osd)
+{
+    GstBuffer *buffer = gst_buffer_new_allocate (NULL, GRAPHICS_WIDTH * GRAPHICS_HEIGHT * 4, NULL);
+    GstMapInfo src, dst;
+
+    gst_buffer_map (osd, &src, GST_MAP_READ);
+    gst_buffer_map (buffer, &dst, GST_MAP_WRITE);
+
+    const uint32_t *in = (const uint32_t *) src.data;
+    uint32_t *out = (uint32_t *) dst.data;
+
+    for (int i = 0; i < GRAPHICS_WIDTH * GRAPHICS_HEIGHT; i++) {
+        uint32_t v = in[i];
+        out[i] = (v & 0xff00ff00) | ((v & 0xff) << 16) | ((v >> 16) & 0xff);
+    }
+
+    gst_buffer_unmap (buffer, &dst);
+    gst_buffer_unmap (osd, &src);
+
+    gst_buffer_add_video_meta (buffer, GST_VIDEO_FRAME_FLAG_NONE,
+                               GST_VIDEO_OVERLAY_COMPOSITION_FORMAT_RGB,
+                               GRAPHICS_WIDTH, GRAPHICS_HEIGHT);
+    return buffer;
+}
+
+static void
+update_composition (WfbOsdOverlay *self, const GstVideoInfo *info)
+{
+    GstBuffer *buffer = osd_to_overlay_buffer (self->osd);
+
+    // OSD is stretched over the whole frame, like in the mixer pipeline
+    GstVideoOverlayRectangle *rect =
+        gst_video_overlay_rectangle_new_raw (buffer, 0, 0,
+                                             GST_VIDEO_INFO_WIDTH (info), GST_VIDEO_INFO_HEIGHT (info),
+                                             GST_VIDEO_OVERLAY_FORMAT_FLAG_NONE);
+
+    self->composition = gst_video_overlay_composition_new (rect);
+
+    gst_video_overlay_rectangle_unref (rect);
+    gst_buffer_unref (buffer);
+}
+
+static void
+drop_composition (WfbOsdOverlay *self)
+{
+    if (self->composition != NULL) {
+        gst_video_overlay_composition_unref (self->composition);
+        self->composition = NULL;
+    }
+}
+
+static void
+update_blend (WfbOsdOverlay *self)
+{
+    GstMapInfo map;
+
+    gst_buffer_map (self->osd, &map, GST_MAP_READ);
+    int occupied = yuvblend_update (&self->blend, map.data, GRAPHICS_WIDTH, GRAPHICS_HEIGHT, GRAPHICS_WIDTH * 4);
+    gst_buffer_unmap (self->osd, &map);
+
+    if (occupied < 0) {
+        fprintf (stderr, "wfbosdoverlay: out of memory\n");
+        exit (1);
+    }
+
+    self->blend_stale = FALSE;
+}
+
+static GstFlowReturn
+wfb_osd_overlay_transform_frame_ip (GstVideoFilter *filter, GstVideoFrame *frame)
+{
+    WfbOsdOverlay *self = WFB_OSD_OVERLAY (filter);
+
+    if (self->pool == NULL) {
+        self->pool = osd_buffer_pool_new (NULL);
+        render_set_buffer_pool (self->pool);
+    }
+
+    // Unchanged OSD: the last converted frame is used again
+    pthread_mutex_lock (&video_mutex);
+    GstBuffer *osd = render ();
+    pthread_mutex_unlock (&video_mutex);
+
+    if (osd != NULL) {
+        if (self->osd != NULL)
+            gst_buffer_unref (self->osd);
+        self->osd = osd;
+        self->blend_stale = TRUE;
+        drop_composition (self);
+    }
+
+    if (self->osd == NULL)
+        return GST_FLOW_OK;
+
+    if (self->blend_ready && !self->attach_meta) {
+        uint8_t *data[GST_VIDEO_MAX_PLANES];
+        int stride[GST_VIDEO_MAX_PLANES];
+
+        if (self->blend_stale)
+            update_blend (self);
+
+        for (guint i = 0; i < GST_VIDEO_FRAME_N_PLANES (frame); i++) {
+            data[i] = GST_VIDEO_FRAME_PLANE_DATA (frame, i);
+            stride[i] = GST_VIDEO_FRAME_PLANE_STRIDE (frame, i);
+        }
+        yuvblend_apply (&self->blend, data, stride);
+        return GST_FLOW_OK;
+    }
+
+    if (self->composition == NULL)
+        update_composition (self, &frame->info);
+
+    if (self->attach_meta)
+        gst_buffer_add_video_overlay_composition_meta (frame->buffer, self->composition);
+    else
+        gst_video_overlay_composition_blend (self->composition, frame);
+
+    return GST_FLOW_OK;
+}
+
+static void
+drop_blend (WfbOsdOverlay *self)
+{
+    if (self->blend_ready) {
+        yuvblend_free (&self->blend);
+        self->blend_ready = FALSE;
+    }
+}
+
+static gboolean
+wfb_osd_overlay_set_info (GstVideoFilter *filter, GstCaps *incaps, GstVideoInfo *in_info,
+                          GstCaps *outcaps, GstVideoInfo *out_info)
+{
+    WfbOsdOverlay *self = WFB_OSD_OVERLAY (filter);
+    GstVideoFormat format = GST_VIDEO_INFO_FORMAT (in_info);
+
+    // Composition is sized to the frame
+    drop_composition (self);
+    drop_blend (self);
+
+    if (!self->sparse || (format != GST_VIDEO_FORMAT_NV12 && format != GST_VIDEO_FORMAT_I420))
+        return TRUE;
+
+    if (yuvblend_init (&self->blend, format == GST_VIDEO_FORMAT_NV12 ? YUVBLEND_NV12 : YUVBLEND_I420,
+                       GST_VIDEO_INFO_WIDTH (in_info), GST_VIDEO_INFO_HEIGHT (in_info),
+                       in_info->colorimetry.matrix == GST_VIDEO_COLOR_MATRIX_BT709,
+                       in_info->colorimetry.range == GST_VIDEO_COLOR_RANGE_0_255) != 0) {
+        fprintf (stderr, "wfbosdoverlay: out of memory\n");
+        exit (1);
+    }
+
+    self->blend_ready = TRUE;
+    self->blend_stale = TRUE;
+    return TRUE;
+}
+
+static gboolean
+wfb_osd_overlay_decide_allocation (GstBaseTransform *trans, GstQuery *query)
+{
+    WfbOsdOverlay *self = WFB_OSD_OVERLAY (trans);
+
+    self->attach_meta = gst_query_find_allocation_meta (query, GST_VIDEO_OVERLAY_COMPOSITION_META_API_TYPE, NULL);
+    if (osd_debug)
+        fprintf (stderr, "wfbosdoverlay: %s\n", self->attach_meta ? "attaching overlay meta" :
+                 self->blend_ready ? "sparse blending into frames" : "blending into frames");
+
+    return GST_BASE_TRANSFORM_CLASS (wfb_osd_overlay_parent_class)->decide_allocation (trans, query);
+}
+
+static gboolean
+wfb_osd_overlay_stop (GstBaseTransform *trans)
+{
+    WfbOsdOverlay *self = WFB_OSD_OVERLAY (trans);
+
+    drop_composition (self);
+    drop_blend (self);
+
+    if (self->osd != NULL) {
+        gst_buffer_unref (self->osd);
+        self->osd = NULL;
+    }
+
+    // Render state outlives the element, frames are taken from the new pool next time
+    if (self->pool != NULL) {
+        render_set_buffer_pool (NULL);
+        gst_buffer_pool_set_active (self->pool, FALSE);
+        gst_object_unref (self->pool);
+        self->pool = NULL;
+    }
+
+    return TRUE;
+}
+
+static void
+wfb_osd_overlay_set_property (GObject *object, guint prop_id, const GValue *value, GParamSpec *pspec)
+{
+    WfbOsdOverlay *self = WFB_OSD_OVERLAY (object);
+
+    switch (prop_id) {
+    case PROP_SPARSE:
+        // Applied on next caps negotiation
+        self->sparse = g_value_get_boolean (value);
+        break;
+    default:
+        G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+        break;
+    }
+}
+
+static void
+wfb_osd_overlay_get_property (GObject *object, guint prop_id, GValue *value, GParamSpec *pspec)
+{
+    WfbOsdOverlay *self = WFB_OSD_OVERLAY (object);
+
+    switch (prop_id) {
+    case PROP_SPARSE:
+        g_value_set_boolean (value, self->sparse);
+        break;
+    default:
+        G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+        break;
+    }
+}
+
+static void
+wfb_osd_overlay_class_init (WfbOsdOverlayClass *klass)
+{
+    GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+    GstElementClass *element_class = GST_ELEMENT_CLASS (klass);
+    GstBaseTransformClass *trans_class = GST_BASE_TRANSFORM_CLASS (klass);
+    GstVideoFilterClass *filter_class = GST_VIDEO_FILTER_CLASS (klass);
+
+    gst_element_class_set_static_metadata (element_class,
+        "WFB-ng OSD overlay", "Filter/Editor/Video",
+        "Composites WFB-ng OSD into video frames", "WFB-ng <http://wfb-ng.org>");
+
+    gobject_class->set_property = wfb_osd_overlay_set_property;
+    gobject_class->get_property = wfb_osd_overlay_get_property;
+
+    g_object_class_install_property (gobject_class, PROP_SPARSE,
+        g_param_spec_boolean ("sparse", "Sparse blending",
+                              "Blend NV12 / I420 frames only where the OSD isn't transparent",
+                              TRUE, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+    gst_element_class_add_static_pad_template (element_class, &sink_template);
+    gst_element_class_add_static_pad_template (element_class, &src_template);
+
+    trans_class->decide_allocation = wfb_osd_overlay_decide_allocation;
+    trans_class->stop = wfb_osd_overlay_stop;
+    filter_class->set_info = wfb_osd_overlay_set_info;
+    filter_class->transform_frame_ip = wfb_osd_overlay_transform_frame_ip;
+}
+
+static void
+wfb_osd_overlay_init (WfbOsdOverlay *self)
+{
+    self->pool = NULL;
+    self->osd = NULL;
+    self->composition = NULL;
+    self->attach_meta = FALSE;
+    self->sparse = TRUE;
+    self->blend_ready = FALSE;
+    self->blend_stale = FALSE;
+}
+
+/**
+ * osd_overlay_register: make wfbosdoverlay available to gst_parse_launch().
+ */
+gboolean
+osd_overlay_register (void)
+{
+    return gst_element_register (NULL, "wfbosdoverlay", GST_RANK_NONE, wfb_osd_overlay_get_type ());
+}
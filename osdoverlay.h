@@ -0,0 +1,8 @@
+#ifndef __OSDOVERLAY_H
+#define __OSDOVERLAY_H
+
+#include <gst/gst.h>
+
+gboolean osd_overlay_register(void);
+
+#endif //__OSDOVERLAY_H
@@ -26,6 +26,7 @@
 #include "osdrender.h"
 #include "graphengine.h"
 #include "osdvar.h"
+#include "osdmavlink.h"
 #include "fonts.h"
 #include "UAVObj.h"
 #include "osdconfig.h"
@@ -66,6 +67,8 @@ const char * dist_unit_short = METRIC_DIST_SHORT;
 const char * dist_unit_long = METRIC_DIST_LONG;
 const char * spd_unit = METRIC_SPEED;
 
+static void widgets_init(void);
+
 
 uint64_t GetSystimeMS(void) {
     struct timeval te;
@@ -78,7 +81,9 @@ uint64_t GetSystimeMS(void) {
 void osd_init(int shift_x, int shift_y, float scale_x, float scale_y)
 {
     sys_start_time = GetSystimeMS();
+    osd_params_scale(GRAPHICS_WIDTH, GRAPHICS_HEIGHT);
     render_init(shift_x, shift_y, scale_x, scale_y);
+    glyph_atlas_init();
     atti_mp_scale = (float)osd_params.Atti_mp_scale_real + (float)osd_params.Atti_mp_scale_frac * 0.01;
     atti_3d_scale = (float)osd_params.Atti_3D_scale_real + (float)osd_params.Atti_3D_scale_frac * 0.01;
     atti_3d_min_clipX = osd_params.Atti_mp_posX - (uint32_t)(22 * atti_mp_scale);
@@ -90,6 +95,7 @@ void osd_init(int shift_x, int shift_y, float scale_x, float scale_y)
     uav2D_init();
     simple_attitude_init();
     home_direction_init();
+    widgets_init();
 }
 
 
@@ -126,57 +132,301 @@ bool enabledAndShownOnPanel(uint16_t enabled, uint16_t panel) {
 // TODO: try if this is performance critical or not
 char tmp_str[51] = { 0 };
 
+/*
+ * Retained widgets. Each widget lists the osdvar fields it reads; its
+ * pixels are kept in a layer and re-used until one of the inputs (or the
+ * current panel) changes. Position and size come from osd_params, the
+ * layer bounds are whatever the widget actually draws.
+ * Widgets without inputs depend on time and are drawn every frame.
+ * Telemetry inputs are compared only if their osd_telemetry group got a
+ * new version since the previous frame. Widgets which are disabled or not
+ * on the current panel are skipped, and messages read only by them are
+ * never decoded.
+ */
+typedef struct {
+  const volatile void *ptr;
+  size_t size;
+} widget_input_t;
+
+#define WIDGET_INPUT(var) { &(var), sizeof(var) }
+#define TELEMETRY_INPUT(field) WIDGET_INPUT(osd_telemetry.field)
+#define WIDGET_INPUTS_END { NULL, 0 }
+
+// Widgets which keep changing for this many frames are drawn directly
+#define WIDGET_DIRECT_FRAMES 2
+
+int widget_layers = 1;
+
+typedef struct {
+  void (*draw)(void);
+  const widget_input_t *inputs;           // NULL - redraw every frame
+  const uint16_t *screen_layer;           // osd_params field, NULL - dynamic
+  const uint16_t *enabled, *panel;        // osd_params fields, NULL - always drawn
+  uint8_t *state;                         // input values used for the layer
+  size_t state_size;
+  int valid;                              // layer matches state
+  int changed_frames;                     // number of consecutive frames with changed inputs
+  uint32_t groups;                        // osd_telemetry groups of the inputs
+  osd_layer_t layer;
+} osd_widget_t;
+
+static const widget_input_t common_inputs[] = {
+  WIDGET_INPUT(current_panel),
+  WIDGET_INPUT(osd_params.Units_mode),
+  WIDGET_INPUTS_END
+};
+
+static const widget_input_t flight_mode_inputs[] = {
+  TELEMETRY_INPUT(autopilot), TELEMETRY_INPUT(mav_type), TELEMETRY_INPUT(custom_mode),
+  TELEMETRY_INPUT(motor_armed), TELEMETRY_INPUT(wfb_errors), TELEMETRY_INPUT(wfb_flags),
+  WIDGET_INPUTS_END
+};
+static const widget_input_t arm_state_inputs[] = { TELEMETRY_INPUT(motor_armed), WIDGET_INPUTS_END };
+static const widget_input_t battery_voltage_inputs[] = { TELEMETRY_INPUT(osd_vbat_A), WIDGET_INPUTS_END };
+static const widget_input_t battery_current_inputs[] = { TELEMETRY_INPUT(osd_curr_A), WIDGET_INPUTS_END };
+static const widget_input_t battery_remaining_inputs[] = { TELEMETRY_INPUT(osd_battery_remaining_A), WIDGET_INPUTS_END };
+static const widget_input_t battery_consumed_inputs[] = { TELEMETRY_INPUT(osd_curr_consumed_mah), WIDGET_INPUTS_END };
+static const widget_input_t altitude_scale_inputs[] = {
+  TELEMETRY_INPUT(osd_bottom_clearance), TELEMETRY_INPUT(osd_alt), TELEMETRY_INPUT(osd_rel_alt), WIDGET_INPUTS_END
+};
+static const widget_input_t absolute_altitude_inputs[] = { TELEMETRY_INPUT(osd_alt), WIDGET_INPUTS_END };
+static const widget_input_t relative_altitude_inputs[] = { TELEMETRY_INPUT(osd_rel_alt), WIDGET_INPUTS_END };
+static const widget_input_t speed_scale_inputs[] = {
+  TELEMETRY_INPUT(vtol_state), TELEMETRY_INPUT(mav_type), TELEMETRY_INPUT(osd_airspeed), TELEMETRY_INPUT(osd_groundspeed),
+  WIDGET_INPUTS_END
+};
+static const widget_input_t ground_speed_inputs[] = {
+  TELEMETRY_INPUT(vtol_state), TELEMETRY_INPUT(mav_type), TELEMETRY_INPUT(osd_groundspeed), WIDGET_INPUTS_END
+};
+static const widget_input_t home_direction_inputs[] = {
+  TELEMETRY_INPUT(osd_got_home), WIDGET_INPUT(osd_home_bearing), TELEMETRY_INPUT(osd_heading), WIDGET_INPUTS_END
+};
+static const widget_input_t uav2d_inputs[] = { TELEMETRY_INPUT(osd_roll), TELEMETRY_INPUT(osd_pitch), WIDGET_INPUTS_END };
+static const widget_input_t throttle_inputs[] = { TELEMETRY_INPUT(osd_throttle), WIDGET_INPUTS_END };
+static const widget_input_t home_latitude_inputs[] = { TELEMETRY_INPUT(osd_home_lat), WIDGET_INPUTS_END };
+static const widget_input_t home_longitude_inputs[] = { TELEMETRY_INPUT(osd_home_lon), WIDGET_INPUTS_END };
+static const widget_input_t gps_status_inputs[] = {
+  TELEMETRY_INPUT(osd_fix_type), TELEMETRY_INPUT(osd_satellites_visible), WIDGET_INPUTS_END
+};
+static const widget_input_t gps_hdop_inputs[] = { TELEMETRY_INPUT(osd_hdop), WIDGET_INPUTS_END };
+static const widget_input_t gps_latitude_inputs[] = { TELEMETRY_INPUT(osd_lat), WIDGET_INPUTS_END };
+static const widget_input_t gps_longitude_inputs[] = { TELEMETRY_INPUT(osd_lon), WIDGET_INPUTS_END };
+static const widget_input_t gps2_status_inputs[] = {
+  TELEMETRY_INPUT(osd_fix_type2), TELEMETRY_INPUT(osd_satellites_visible2), WIDGET_INPUTS_END
+};
+static const widget_input_t gps2_hdop_inputs[] = { TELEMETRY_INPUT(osd_hdop2), WIDGET_INPUTS_END };
+static const widget_input_t gps2_latitude_inputs[] = { TELEMETRY_INPUT(osd_lat2), WIDGET_INPUTS_END };
+static const widget_input_t gps2_longitude_inputs[] = { TELEMETRY_INPUT(osd_lon2), WIDGET_INPUTS_END };
+static const widget_input_t total_trip_inputs[] = { WIDGET_INPUT(osd_total_trip_dist), WIDGET_INPUTS_END };
+static const widget_input_t CWH_inputs[] = {
+  TELEMETRY_INPUT(osd_got_home), TELEMETRY_INPUT(osd_lat), TELEMETRY_INPUT(osd_lon),
+  TELEMETRY_INPUT(osd_home_lat), TELEMETRY_INPUT(osd_home_lon),
+  WIDGET_INPUT(osd_home_distance), WIDGET_INPUT(osd_home_bearing), TELEMETRY_INPUT(osd_heading),
+  TELEMETRY_INPUT(wp_number), TELEMETRY_INPUT(wp_dist), TELEMETRY_INPUT(wp_target_bearing),
+  WIDGET_INPUTS_END
+};
+static const widget_input_t climb_rate_inputs[] = { TELEMETRY_INPUT(osd_climb), WIDGET_INPUTS_END };
+
+static const widget_input_t rssi_inputs[] = { TELEMETRY_INPUT(osd_rssi), TELEMETRY_INPUT(osd_chan_raw), WIDGET_INPUTS_END };
+static const widget_input_t wfb_state_inputs[] = {
+  TELEMETRY_INPUT(wfb_flags), TELEMETRY_INPUT(wfb_rssi), TELEMETRY_INPUT(wfb_fec_fixed), TELEMETRY_INPUT(wfb_errors),
+  WIDGET_INPUTS_END
+};
+static const widget_input_t link_quality_inputs[] = { TELEMETRY_INPUT(osd_chan_raw), WIDGET_INPUTS_END };
+static const widget_input_t efficiency_inputs[] = {
+  TELEMETRY_INPUT(osd_vbat_A), TELEMETRY_INPUT(osd_curr_A), TELEMETRY_INPUT(osd_groundspeed), WIDGET_INPUTS_END
+};
+static const widget_input_t wind_inputs[] = { WIDGET_INPUT(osd_windSpeed), WIDGET_INPUT(osd_windDir), WIDGET_INPUTS_END };
+static const widget_input_t osd_messages_inputs[] = {
+  TELEMETRY_INPUT(osd_message_queue), TELEMETRY_INPUT(osd_message_queue_tail), WIDGET_INPUTS_END
+};
+
+static void draw_fw_ground_speed(void) {
+  if (osd_telemetry.vtol_state == MAV_VTOL_STATE_TRANSITION_TO_FW || osd_telemetry.vtol_state == MAV_VTOL_STATE_FW || osd_telemetry.mav_type == MAV_TYPE_FIXED_WING)
+  {
+    draw_ground_speed();
+  }
+}
+
+// Drawing order
+static osd_widget_t widgets[] = {
+  { draw_flight_mode, flight_mode_inputs, &osd_params.FlightMode_layer, &osd_params.FlightMode_en, &osd_params.FlightMode_panel },
+  { draw_arm_state, arm_state_inputs, &osd_params.Arm_layer, &osd_params.Arm_en, &osd_params.Arm_panel },
+  { draw_battery_voltage, battery_voltage_inputs, &osd_params.BattVolt_layer, &osd_params.BattVolt_en, &osd_params.BattVolt_panel },
+  { draw_battery_current, battery_current_inputs, &osd_params.BattCurrent_layer, &osd_params.BattCurrent_en, &osd_params.BattCurrent_panel },
+  { draw_battery_remaining, battery_remaining_inputs, &osd_params.BattRemaining_layer, &osd_params.BattRemaining_en, &osd_params.BattRemaining_panel },
+  { draw_battery_consumed, battery_consumed_inputs, &osd_params.BattConsumed_layer, &osd_params.BattConsumed_en, &osd_params.BattConsumed_panel },
+  { draw_altitude_scale, altitude_scale_inputs, &osd_params.Alt_Scale_layer, &osd_params.Alt_Scale_en, &osd_params.Alt_Scale_panel },
+  { draw_absolute_altitude, absolute_altitude_inputs, &osd_params.TALT_layer, &osd_params.TALT_en, &osd_params.TALT_panel },
+  { draw_relative_altitude, relative_altitude_inputs, &osd_params.Relative_ALT_layer, &osd_params.Relative_ALT_en, &osd_params.Relative_ALT_panel },
+  { draw_speed_scale, speed_scale_inputs, &osd_params.Speed_scale_layer, &osd_params.Speed_scale_en, &osd_params.Speed_scale_panel },
+  //{ draw_vtol_speed, NULL },
+  { draw_fw_ground_speed, ground_speed_inputs, &osd_params.TSPD_layer, &osd_params.TSPD_en, &osd_params.TSPD_panel },
+  //{ draw_air_speed, NULL },
+  { draw_home_direction, home_direction_inputs, &osd_params.HomeDirection_layer, &osd_params.HomeDirection_enabled, &osd_params.HomeDirection_panel },
+  { draw_uav2d, uav2d_inputs, &osd_params.Atti_mp_layer, &osd_params.Atti_mp_en, &osd_params.Atti_mp_panel },
+  { draw_throttle, throttle_inputs, &osd_params.Throt_layer, &osd_params.Throt_en, &osd_params.Throt_panel },
+  { draw_home_latitude, home_latitude_inputs, &osd_params.HomeLatitude_layer, &osd_params.HomeLatitude_enabled, &osd_params.HomeLatitude_panel },
+  { draw_home_longitude, home_longitude_inputs, &osd_params.HomeLongitude_layer, &osd_params.HomeLongitude_enabled, &osd_params.HomeLongitude_panel },
+  { draw_gps_status, gps_status_inputs, &osd_params.GpsStatus_layer, &osd_params.GpsStatus_en, &osd_params.GpsStatus_panel },
+  { draw_gps_hdop, gps_hdop_inputs, &osd_params.GpsHDOP_layer, &osd_params.GpsHDOP_en, &osd_params.GpsHDOP_panel },
+  { draw_gps_latitude, gps_latitude_inputs, &osd_params.GpsLat_layer, &osd_params.GpsLat_en, &osd_params.GpsLat_panel },
+  { draw_gps_longitude, gps_longitude_inputs, &osd_params.GpsLon_layer, &osd_params.GpsLon_en, &osd_params.GpsLon_panel },
+  { draw_gps2_status, gps2_status_inputs, &osd_params.Gps2Status_layer, &osd_params.Gps2Status_en, &osd_params.Gps2Status_panel },
+  { draw_gps2_hdop, gps2_hdop_inputs, &osd_params.Gps2HDOP_layer, &osd_params.Gps2HDOP_en, &osd_params.Gps2HDOP_panel },
+  { draw_gps2_latitude, gps2_latitude_inputs, &osd_params.Gps2Lat_layer, &osd_params.Gps2Lat_en, &osd_params.Gps2Lat_panel },
+  { draw_gps2_longitude, gps2_longitude_inputs, &osd_params.Gps2Lon_layer, &osd_params.Gps2Lon_en, &osd_params.Gps2Lon_panel },
+  { draw_total_trip, total_trip_inputs, &osd_params.TotalTripDist_layer, &osd_params.TotalTripDist_en, &osd_params.TotalTripDist_panel },
+  { draw_time, NULL, &osd_params.Time_layer, &osd_params.Time_en, &osd_params.Time_panel },
+  { draw_CWH, CWH_inputs, &osd_params.CWH_layer },
+  { draw_climb_rate, climb_rate_inputs, &osd_params.ClimbRate_layer, &osd_params.ClimbRate_en, &osd_params.ClimbRate_panel },
+  { draw_rssi, rssi_inputs, &osd_params.RSSI_layer, &osd_params.RSSI_en, &osd_params.RSSI_panel },
+  { draw_wfb_state, wfb_state_inputs, &osd_params.WFBState_layer, &osd_params.WFBState_en, &osd_params.WFBState_panel },
+  { draw_link_quality, link_quality_inputs, &osd_params.LinkQuality_layer, &osd_params.LinkQuality_en, &osd_params.LinkQuality_panel },
+  { draw_efficiency, efficiency_inputs, &osd_params.Efficiency_layer, &osd_params.Efficiency_en, &osd_params.Efficiency_panel },
+  { draw_wind, wind_inputs, &osd_params.Wind_layer, &osd_params.Wind_en, &osd_params.Wind_panel },
+
+  { draw_panel_changed, NULL },
+  { draw_warning, NULL, &osd_params.Alarm_layer,
+    .groups = TLM_GROUP_BIT(TLM_FLIGHT) | TLM_GROUP_BIT(TLM_GPS) | TLM_GROUP_BIT(TLM_BATTERY) | TLM_GROUP_BIT(TLM_HOME) },
+  { draw_osd_messages, osd_messages_inputs, &osd_params.OSDMessages_layer, &osd_params.OSDMessages_en, &osd_params.OSDMessages_panel },
+};
+
+static size_t widget_inputs_size(const widget_input_t *inputs)
+{
+  size_t size = 0;
+  for (; inputs->ptr != NULL; inputs++) {
+    size += inputs->size;
+  }
+  return size;
+}
+
+static void widgets_init(void)
+{
+  for (int i = 0; i < SIZEOF_ARRAY(widgets); i++) {
+    osd_widget_t *w = widgets + i;
+    if (w->inputs == NULL) {
+      continue;
+    }
+    w->state_size = widget_inputs_size(common_inputs) + widget_inputs_size(w->inputs);
+    for (const widget_input_t *in = w->inputs; in->ptr != NULL; in++) {
+      int g = osd_telemetry_group_of(in->ptr);
+      if (g >= 0) {
+        w->groups |= TLM_GROUP_BIT(g);
+      }
+    }
+    w->state = calloc(1, w->state_size);
+    if (w->state == NULL) {
+      fprintf(stderr, "Unable to allocate widget state\n");
+      exit(1);
+    }
+  }
+}
+
+static inline bool is_telemetry_input(const widget_input_t *in)
+{
+  const volatile uint8_t *p = in->ptr;
+  return p >= (const uint8_t *)&osd_telemetry && p < (const uint8_t *)(&osd_telemetry + 1);
+}
+
+/**
+ * widget_update_state: compare widget inputs with stored values and store the new ones.
+ *
+ * @param telemetry     osd_telemetry groups changed since the previous frame
+ * @return              true if any input has changed
+ */
+static bool widget_update_state(osd_widget_t *w, uint32_t telemetry)
+{
+  const widget_input_t *lists[2] = { common_inputs, w->inputs };
+  bool skip_telemetry = w->valid && (w->groups & telemetry) == 0;
+  uint8_t *state = w->state;
+  bool changed = false;
+
+  for (int l = 0; l < 2; l++) {
+    for (const widget_input_t *in = lists[l]; in->ptr != NULL; in++) {
+      // Stored value is still the current one
+      if (skip_telemetry && is_telemetry_input(in)) {
+        state += in->size;
+        continue;
+      }
+      if (memcmp(state, (const void *)in->ptr, in->size) != 0) {
+        memcpy(state, (const void *)in->ptr, in->size);
+        changed = true;
+      }
+      state += in->size;
+    }
+  }
+  return changed;
+}
+
+static inline bool widget_shown(const osd_widget_t *w)
+{
+  return w->enabled == NULL || enabledAndShownOnPanel(*w->enabled, *w->panel);
+}
+
+static void render_widget(osd_widget_t *w, uint32_t telemetry)
+{
+  if (w->inputs == NULL || !widget_layers) {
+    w->draw();
+    return;
+  }
+
+  if (widget_update_state(w, telemetry)) {
+    w->changed_frames++;
+  } else {
+    w->changed_frames = 0;
+    if (w->valid) {
+      layer_draw(&w->layer);
+      return;
+    }
+  }
+
+  // Animated widget: don't waste time on the layer copy
+  if (w->changed_frames > WIDGET_DIRECT_FRAMES) {
+    w->valid = 0;
+    w->draw();
+    return;
+  }
+
+  layer_begin();
+  w->draw();
+  layer_end(&w->layer);
+  w->valid = 1;
+  layer_draw(&w->layer);
+}
+
 void RenderScreen(void) {
+  static uint32_t telemetry_version = 0;
+
+  osd_telemetry_fetch();
+  uint32_t telemetry = osd_telemetry_changed(&osd_telemetry, telemetry_version);
+  telemetry_version = osd_telemetry.version;
   do_converts();
 
   if (current_panel > osd_params.Max_panels) {
     current_panel = 1;
   }
 
-  draw_flight_mode();
-  draw_arm_state();
-  draw_battery_voltage();
-  draw_battery_current();
-  draw_battery_remaining();
-  draw_battery_consumed();
-  draw_altitude_scale();
-  draw_absolute_altitude();
-  draw_relative_altitude();
-  draw_speed_scale();
-  //draw_vtol_speed();
-  if (vtol_state == MAV_VTOL_STATE_TRANSITION_TO_FW || vtol_state == MAV_VTOL_STATE_FW || mav_type == MAV_TYPE_FIXED_WING)
-  {
-    draw_ground_speed();
+  // Decode high-rate messages only for the widgets on screen
+  uint32_t shown = 0;
+  for (int i = 0; i < SIZEOF_ARRAY(widgets); i++) {
+    if (widget_shown(widgets + i)) {
+      shown |= widgets[i].groups;
+    }
   }
-  //draw_air_speed();
-  draw_home_direction();
-  draw_uav2d();
-  draw_throttle();
-  draw_home_latitude();
-  draw_home_longitude();
-  draw_gps_status();
-  draw_gps_hdop();
-  draw_gps_latitude();
-  draw_gps_longitude();
-  draw_gps2_status();
-  draw_gps2_hdop();
-  draw_gps2_latitude();
-  draw_gps2_longitude();
-  draw_total_trip();
-  draw_time();
-  draw_CWH();
-  draw_climb_rate();
-  draw_rssi();
-  draw_wfb_state();
-  draw_link_quality();
-  draw_efficiency();
-  draw_wind();
-
-  draw_panel_changed();
-  draw_warning();
-  draw_osd_messages();
-}
+  telemetry |= decode_mavlink_slots(&osd_telemetry, shown);
 
+  for (int i = 0; i < SIZEOF_ARRAY(widgets); i++) {
+    osd_widget_t *w = widgets + i;
+    if (!widget_shown(w)) {
+      // Inputs aren't tracked while hidden
+      w->valid = 0;
+      continue;
+    }
+    select_screen_layer(w->screen_layer != NULL ? *w->screen_layer : OSD_LAYER_DYNAMIC);
+    render_widget(w, telemetry);
+  }
+}
 
 void draw_osd_messages()
 {
@@ -187,12 +437,12 @@ void draw_osd_messages()
 
     int x = osd_params.OSDMessages_posX, y = osd_params.OSDMessages_posY;
     int i = 0;
-    int p = (osd_message_queue_tail + 1) % OSD_MAX_MESSAGES;
+    int p = (osd_telemetry.osd_message_queue_tail + 1) % OSD_MAX_MESSAGES;
     int p_start = p;
 
     do
     {
-        osd_message_t *item = osd_message_queue + p;
+        osd_message_t *item = osd_telemetry.osd_message_queue + p;
         if(item->message[0])
         {
             snprintf(tmp_str, sizeof(tmp_str), "%s", item->message);
@@ -211,15 +461,15 @@ void draw_simple_attitude() {
   int x = simple_attitude.x0;
   int y = simple_attitude.y0;
 
-  int line_mode = fabsf(osd_roll) < 90 ? 0 : 2;
-  int roll_color = fabsf(osd_roll) < 90 ? 1 : 2;
+  int line_mode = fabsf(osd_telemetry.osd_roll) < 90 ? 0 : 2;
+  int roll_color = fabsf(osd_telemetry.osd_roll) < 90 ? 1 : 2;
 
   write_line_outlined(x - radius - 1, y, x - 3 * radius - 1, y, 0, 0, 0, 1);
   write_line_outlined(x + radius - 1, y, x + 3 * radius + 1, y, 0, 0, 0, 1);
   write_line_outlined(x, y - radius - 1, x, y - 3 * radius, 0, 0, 0, 1);
   write_circle_outlined(x, y, radius, 0, 1, 0, 1, 1);
 
-  Transform_Polygon2D(&simple_attitude, -osd_roll, 0, osd_pitch);
+  Transform_Polygon2D(&simple_attitude, -osd_telemetry.osd_roll, 0, osd_telemetry.osd_pitch);
 
   for (int i = 0; i < simple_attitude.num_verts; i += 2) {
     write_line_outlined(simple_attitude.vlist_trans[i].x + x, simple_attitude.vlist_trans[i].y + y,
@@ -229,13 +479,13 @@ void draw_simple_attitude() {
 
   //draw pitch value
   y = simple_attitude.y0 - 20;
-  snprintf(tmp_str, sizeof(tmp_str), "PT %d", (int)osd_pitch);
+  snprintf(tmp_str, sizeof(tmp_str), "PT %d", (int)osd_telemetry.osd_pitch);
   write_string(tmp_str, x, y - 3, 0, 0, TEXT_VA_BOTTOM, TEXT_HA_CENTER, 0, SIZE_TO_FONT[1]);
 
   //draw roll value
   y = simple_attitude.y0 + 15;
 
-  snprintf(tmp_str, sizeof(tmp_str), "RL %d", (int)osd_roll);
+  snprintf(tmp_str, sizeof(tmp_str), "RL %d", (int)osd_telemetry.osd_roll);
   write_color_string(tmp_str, x, y + 5, 0, 0, TEXT_VA_TOP, TEXT_HA_CENTER, 0, SIZE_TO_FONT[1], roll_color);
 
 }
@@ -245,7 +495,7 @@ void draw_radar() {
   int index = 0;
 
   Reset_Polygon2D(&uav2D);
-  Transform_Polygon2D(&uav2D, -osd_roll, 0, osd_pitch);
+  Transform_Polygon2D(&uav2D, -osd_telemetry.osd_roll, 0, osd_telemetry.osd_pitch);
 
   // loop thru and draw a line from vertices 1 to n
   VECTOR4D v;
@@ -263,7 +513,7 @@ void draw_radar() {
 
   //rotate roll scale and display, we only cal x
   Reset_Polygon2D(&rollscale2D);
-  Rotate_Polygon2D(&rollscale2D, -osd_roll);
+  Rotate_Polygon2D(&rollscale2D, -osd_telemetry.osd_roll);
   for (index = 0; index < rollscale2D.num_verts - 1; index++)
   {
     // draw line from ith to ith+1 vertex
@@ -284,7 +534,7 @@ void draw_radar() {
   write_line_outlined(x + wingEnd, y, x + wingStart, y, 2, 2, 0, 1);
 
   write_filled_rectangle_lm(x - 9, y + 6, 15, 9, 0, 1);
-  snprintf(tmp_str, sizeof(tmp_str), "%d", (int)osd_pitch);
+  snprintf(tmp_str, sizeof(tmp_str), "%d", (int)osd_telemetry.osd_pitch);
   write_string(tmp_str, x, y + 5, 0, 0, TEXT_VA_TOP, TEXT_HA_CENTER, 0, SIZE_TO_FONT[1]);
 
   y = osd_params.Atti_mp_posY - (int)(38.0f * atti_mp_scale);
@@ -292,16 +542,16 @@ void draw_radar() {
   write_line_outlined(x, y, x - 4, y + 8, 2, 2, 0, 1);
   write_line_outlined(x, y, x + 4, y + 8, 2, 2, 0, 1);
   write_line_outlined(x - 4, y + 8, x + 4, y + 8, 2, 2, 0, 1);
-  snprintf(tmp_str, sizeof(tmp_str), "%d", (int)osd_roll);
+  snprintf(tmp_str, sizeof(tmp_str), "%d", (int)osd_telemetry.osd_roll);
   write_string(tmp_str, x, y - 3, 0, 0, TEXT_VA_BOTTOM, TEXT_HA_CENTER, 0, SIZE_TO_FONT[1]);
 }
 
 void draw_home_direction() {
   if (!enabledAndShownOnPanel(osd_params.HomeDirection_enabled,
-                              osd_params.HomeDirection_panel) || !osd_got_home) {
+                              osd_params.HomeDirection_panel) || !osd_telemetry.osd_got_home) {
     return;
   }
-  float bearing = osd_home_bearing - osd_heading;
+  float bearing = osd_home_bearing - osd_telemetry.osd_heading;
   Reset_Polygon2D(&home_direction);
   Reset_Polygon2D(&home_direction_outline);
   Rotate_Polygon2D(&home_direction, bearing);
@@ -353,9 +603,9 @@ void draw_throttle(void) {
   posY = osd_params.Throt_posY;
 
   if (osd_params.Throt_scale_en) {
-    pos_th_y = (int16_t)(0.5 * osd_throttle);
+    pos_th_y = (int16_t)(0.5 * osd_telemetry.osd_throttle);
     pos_th_x = posX - 25 + pos_th_y;
-    snprintf(tmp_str, sizeof(tmp_str), "THR%3d%%", (int32_t)osd_throttle);
+    snprintf(tmp_str, sizeof(tmp_str), "THR%3d%%", (int32_t)osd_telemetry.osd_throttle);
     write_string(tmp_str, posX, posY - 3, 0, 0, TEXT_VA_TOP, TEXT_HA_CENTER, 0, SIZE_TO_FONT[0]);
     if (osd_params.Throttle_Scale_Type == 0) {
       write_filled_rectangle_lm(posX + 3, posY + 25 - pos_th_y, 5, pos_th_y, 1, 1);
@@ -373,8 +623,8 @@ void draw_throttle(void) {
       /* write_vline_lm(posX - 25, posY + 10, posY + 15, 1, 1); */
     }
   } else {
-    pos_th_y = (int16_t)(0.5 * osd_throttle);
-    snprintf(tmp_str, sizeof(tmp_str), "THR %3d%%", (int32_t)osd_throttle);
+    pos_th_y = (int16_t)(0.5 * osd_telemetry.osd_throttle);
+    snprintf(tmp_str, sizeof(tmp_str), "THR %3d%%", (int32_t)osd_telemetry.osd_throttle);
     write_string(tmp_str, posX, posY, 0, 0, TEXT_VA_TOP, TEXT_HA_RIGHT, 0, SIZE_TO_FONT[0]);
   }
 }
@@ -385,7 +635,7 @@ void draw_home_latitude() {
     return;
   }
 
-  snprintf(tmp_str, sizeof(tmp_str), "H %0.6f", (double) osd_home_lat);
+  snprintf(tmp_str, sizeof(tmp_str), "H %0.6f", (double) osd_telemetry.osd_home_lat);
   write_string(tmp_str, osd_params.HomeLatitude_posX,
                osd_params.HomeLatitude_posY, 0, 0, TEXT_VA_TOP,
                osd_params.HomeLatitude_align, 0,
@@ -398,7 +648,7 @@ void draw_home_longitude() {
     return;
   }
 
-  snprintf(tmp_str, sizeof(tmp_str), "H %0.6f", (double) osd_home_lon);
+  snprintf(tmp_str, sizeof(tmp_str), "H %0.6f", (double) osd_telemetry.osd_home_lon);
   write_string(tmp_str, osd_params.HomeLongitude_posX,
                osd_params.HomeLongitude_posY, 0, 0, TEXT_VA_TOP,
                osd_params.HomeLongitude_align, 0,
@@ -413,20 +663,20 @@ void draw_gps_status() {
 
   int color = 1;
 
-  switch (osd_fix_type) {
+  switch (osd_telemetry.osd_fix_type) {
   case NO_GPS:
   case NO_FIX:
     color = 2;
     snprintf(tmp_str, sizeof(tmp_str), "NOFIX");
     break;
   case GPS_OK_FIX_2D:
-    snprintf(tmp_str, sizeof(tmp_str), "2D-%d", (int) osd_satellites_visible);
+    snprintf(tmp_str, sizeof(tmp_str), "2D-%d", (int) osd_telemetry.osd_satellites_visible);
     break;
   case GPS_OK_FIX_3D:
-    snprintf(tmp_str, sizeof(tmp_str), "3D-%d", (int) osd_satellites_visible);
+    snprintf(tmp_str, sizeof(tmp_str), "3D-%d", (int) osd_telemetry.osd_satellites_visible);
     break;
   case GPS_OK_FIX_3D_DGPS:
-    snprintf(tmp_str, sizeof(tmp_str), "D3D-%d", (int) osd_satellites_visible);
+    snprintf(tmp_str, sizeof(tmp_str), "D3D-%d", (int) osd_telemetry.osd_satellites_visible);
     break;
   default:
     color = 2;
@@ -446,7 +696,7 @@ void draw_gps_hdop() {
     return;
   }
 
-  snprintf(tmp_str, sizeof(tmp_str), "HDOP %0.1f", (double) osd_hdop / 100.0f);
+  snprintf(tmp_str, sizeof(tmp_str), "HDOP %0.1f", (double) osd_telemetry.osd_hdop / 100.0f);
   write_string(tmp_str, osd_params.GpsHDOP_posX,
                osd_params.GpsHDOP_posY, 0, 0, TEXT_VA_TOP,
                osd_params.GpsHDOP_align, 0,
@@ -459,7 +709,7 @@ void draw_gps_latitude() {
     return;
   }
 
-  snprintf(tmp_str, sizeof(tmp_str), "%0.6f", (double) osd_lat);
+  snprintf(tmp_str, sizeof(tmp_str), "%0.6f", (double) osd_telemetry.osd_lat);
   write_string(tmp_str, osd_params.GpsLat_posX,
                osd_params.GpsLat_posY, 0, 0, TEXT_VA_TOP,
                osd_params.GpsLat_align, 0,
@@ -472,7 +722,7 @@ void draw_gps_longitude() {
     return;
   }
 
-  snprintf(tmp_str, sizeof(tmp_str), "%0.6f", (double) osd_lon);
+  snprintf(tmp_str, sizeof(tmp_str), "%0.6f", (double) osd_telemetry.osd_lon);
   write_string(tmp_str, osd_params.GpsLon_posX,
                osd_params.GpsLon_posY, 0, 0, TEXT_VA_TOP,
                osd_params.GpsLon_align, 0,
@@ -487,20 +737,20 @@ void draw_gps2_status() {
 
   int color = 1;
 
-  switch (osd_fix_type2) {
+  switch (osd_telemetry.osd_fix_type2) {
   case NO_GPS:
   case NO_FIX:
     color = 2;
     snprintf(tmp_str, sizeof(tmp_str), "NOFIX");
     break;
   case GPS_OK_FIX_2D:
-    snprintf(tmp_str, sizeof(tmp_str), "2D-%d", (int) osd_satellites_visible2);
+    snprintf(tmp_str, sizeof(tmp_str), "2D-%d", (int) osd_telemetry.osd_satellites_visible2);
     break;
   case GPS_OK_FIX_3D:
-    snprintf(tmp_str, sizeof(tmp_str), "3D-%d", (int) osd_satellites_visible2);
+    snprintf(tmp_str, sizeof(tmp_str), "3D-%d", (int) osd_telemetry.osd_satellites_visible2);
     break;
   case GPS_OK_FIX_3D_DGPS:
-    snprintf(tmp_str, sizeof(tmp_str), "D3D-%d", (int) osd_satellites_visible2);
+    snprintf(tmp_str, sizeof(tmp_str), "D3D-%d", (int) osd_telemetry.osd_satellites_visible2);
     break;
   default:
     color = 2;
@@ -520,7 +770,7 @@ void draw_gps2_hdop() {
     return;
   }
 
-  snprintf(tmp_str, sizeof(tmp_str), "HDOP %0.1f", (double) osd_hdop2 / 100.0f);
+  snprintf(tmp_str, sizeof(tmp_str), "HDOP %0.1f", (double) osd_telemetry.osd_hdop2 / 100.0f);
   write_string(tmp_str, osd_params.Gps2HDOP_posX,
                osd_params.Gps2HDOP_posY, 0, 0, TEXT_VA_TOP,
                osd_params.Gps2HDOP_align, 0,
@@ -533,7 +783,7 @@ void draw_gps2_latitude() {
     return;
   }
 
-  snprintf(tmp_str, sizeof(tmp_str), "%0.6f", (double) osd_lat2);
+  snprintf(tmp_str, sizeof(tmp_str), "%0.6f", (double) osd_telemetry.osd_lat2);
   write_string(tmp_str, osd_params.Gps2Lat_posX,
                osd_params.Gps2Lat_posY, 0, 0, TEXT_VA_TOP,
                osd_params.Gps2Lat_align, 0,
@@ -546,7 +796,7 @@ void draw_gps2_longitude() {
     return;
   }
 
-  snprintf(tmp_str, sizeof(tmp_str), "%0.6f", (double) osd_lon2);
+  snprintf(tmp_str, sizeof(tmp_str), "%0.6f", (double) osd_telemetry.osd_lon2);
   write_string(tmp_str, osd_params.Gps2Lon_posX,
                osd_params.Gps2Lon_posY, 0, 0, TEXT_VA_TOP,
                osd_params.Gps2Lon_align, 0,
@@ -603,13 +853,13 @@ void draw_time() {
 void draw_CWH(void) {
   char tmp_str[100] = { 0 };
 
-  if(osd_got_home)
+  if(osd_telemetry.osd_got_home)
   {
       const double R = 6371e3; // metres
-      double f1 = osd_lat * D2R;  // convert to radians
-      double f2 = osd_home_lat * D2R;
+      double f1 = osd_telemetry.osd_lat * D2R;  // convert to radians
+      double f2 = osd_telemetry.osd_home_lat * D2R;
       double df = f2 - f1;
-      double dl = (osd_home_lon - osd_lon) * D2R;
+      double dl = (osd_telemetry.osd_home_lon - osd_telemetry.osd_lon) * D2R;
 
       // Haversine method
       // https://www.movable-type.co.uk/scripts/latlong.html
@@ -623,7 +873,7 @@ void draw_CWH(void) {
   }
 
   //distance
-  if (osd_params.CWH_home_dist_en == 1 && shownAtPanel(osd_params.CWH_home_dist_panel) && osd_got_home) {
+  if (osd_params.CWH_home_dist_en == 1 && shownAtPanel(osd_params.CWH_home_dist_panel) && osd_telemetry.osd_got_home) {
     float tmp = osd_home_distance * convert_distance;
     if (tmp < convert_distance_divider)
       snprintf(tmp_str, sizeof(tmp_str), "H: %d%s", (int)tmp, dist_unit_short);
@@ -632,8 +882,8 @@ void draw_CWH(void) {
 
     write_string(tmp_str, osd_params.CWH_home_dist_posX, osd_params.CWH_home_dist_posY, 0, 0, TEXT_VA_TOP, osd_params.CWH_home_dist_align, 0, SIZE_TO_FONT[osd_params.CWH_home_dist_fontsize]);
   }
-  if ((wp_number != 0) && (osd_params.CWH_wp_dist_en) && shownAtPanel(osd_params.CWH_wp_dist_panel)) {
-    float tmp = wp_dist * convert_distance;
+  if ((osd_telemetry.wp_number != 0) && (osd_params.CWH_wp_dist_en) && shownAtPanel(osd_params.CWH_wp_dist_panel)) {
+    float tmp = osd_telemetry.wp_dist * convert_distance;
     if (tmp < convert_distance_divider)
       snprintf(tmp_str, sizeof(tmp_str), "WP %d%s", (int)tmp, dist_unit_short);
     else
@@ -649,7 +899,7 @@ void draw_CWH(void) {
 
   //direction - scale mode
   if (osd_params.CWH_Tmode_en == 1 && shownAtPanel(osd_params.CWH_Tmode_panel)) {
-      draw_linear_compass(osd_heading, osd_home_bearing, 120, 180, GRAPHICS_X_MIDDLE, osd_params.CWH_Tmode_posY, 15, 30, 5, 8, 0);
+      draw_linear_compass(osd_telemetry.osd_heading, osd_home_bearing, 120, 180, GRAPHICS_X_MIDDLE, osd_params.CWH_Tmode_posY, 15, 30, 5, 8, 0);
   }
 }
 
@@ -659,7 +909,7 @@ void draw_climb_rate() {
     return;
   }
 
-  float average_climb = roundf(10.0f * osd_climb) / 10.0f;
+  float average_climb = roundf(10.0f * osd_telemetry.osd_climb) / 10.0f;
   /* osd_climb_ma[osd_climb_ma_index] = osd_climb; */
   /* osd_climb_ma_index = (osd_climb_ma_index + 1) % 10; */
 
@@ -710,23 +960,12 @@ void draw_rssi() {
     return;
   }
 
-  int rssi = (int)osd_rssi;
+  int rssi = (int)osd_telemetry.osd_rssi;
 
   //Not from the MAVLINK, should take the RC channel PWM value.
-  if (osd_params.RSSI_type != 0)
+  if (osd_params.RSSI_type >= 5 && osd_params.RSSI_type <= TLM_RC_CHANNELS)
   {
-    if (osd_params.RSSI_type == 5) rssi = (int)osd_chan5_raw;
-    else if (osd_params.RSSI_type == 6) rssi = (int)osd_chan6_raw;
-    else if (osd_params.RSSI_type == 7) rssi = (int)osd_chan7_raw;
-    else if (osd_params.RSSI_type == 8) rssi = (int)osd_chan8_raw;
-    else if (osd_params.RSSI_type == 9) rssi = (int)osd_chan9_raw;
-    else if (osd_params.RSSI_type == 10) rssi = (int)osd_chan10_raw;
-    else if (osd_params.RSSI_type == 11) rssi = (int)osd_chan11_raw;
-    else if (osd_params.RSSI_type == 12) rssi = (int)osd_chan12_raw;
-    else if (osd_params.RSSI_type == 13) rssi = (int)osd_chan13_raw;
-    else if (osd_params.RSSI_type == 14) rssi = (int)osd_chan14_raw;
-    else if (osd_params.RSSI_type == 15) rssi = (int)osd_chan15_raw;
-    else if (osd_params.RSSI_type == 16) rssi = (int)osd_chan16_raw;
+    rssi = (int)osd_telemetry.osd_chan_raw[osd_params.RSSI_type - 1];
   }
 
   //0:percentage 1:raw
@@ -767,22 +1006,12 @@ void draw_link_quality() {
     return;
   }
 
-  int linkquality = (int)linkquality;
+  int linkquality = 0;
   int min = osd_params.LinkQuality_min;
   int max = osd_params.LinkQuality_max;
 
-  if (osd_params.LinkQuality_chan == 5) linkquality = (int)osd_chan5_raw;
-  else if (osd_params.LinkQuality_chan == 6) linkquality = (int)osd_chan6_raw;
-  else if (osd_params.LinkQuality_chan == 7) linkquality = (int)osd_chan7_raw;
-  else if (osd_params.LinkQuality_chan == 8) linkquality = (int)osd_chan8_raw;
-  else if (osd_params.LinkQuality_chan == 9) linkquality = (int)osd_chan9_raw;
-  else if (osd_params.LinkQuality_chan == 10) linkquality = (int)osd_chan10_raw;
-  else if (osd_params.LinkQuality_chan == 11) linkquality = (int)osd_chan11_raw;
-  else if (osd_params.LinkQuality_chan == 12) linkquality = (int)osd_chan12_raw;
-  else if (osd_params.LinkQuality_chan == 13) linkquality = (int)osd_chan13_raw;
-  else if (osd_params.LinkQuality_chan == 14) linkquality = (int)osd_chan14_raw;
-  else if (osd_params.LinkQuality_chan == 15) linkquality = (int)osd_chan15_raw;
-  else if (osd_params.LinkQuality_chan == 16) linkquality = (int)osd_chan16_raw;
+  if (osd_params.LinkQuality_chan >= 5 && osd_params.LinkQuality_chan <= TLM_RC_CHANNELS)
+    linkquality = (int)osd_telemetry.osd_chan_raw[osd_params.LinkQuality_chan - 1];
 
   // 0: percent, 1: raw
   if (osd_params.LinkQuality_type == 0) {
@@ -817,8 +1046,8 @@ void draw_efficiency() {
     return;
   }
 
-  float wattage = osd_vbat_A * osd_curr_A * 0.01;
-  float speed = osd_groundspeed * convert_speed;
+  float wattage = osd_telemetry.osd_vbat_A * osd_telemetry.osd_curr_A * 0.01;
+  float speed = osd_telemetry.osd_groundspeed * convert_speed;
   float efficiency = 0;
   if (speed != 0) {
     efficiency = wattage / speed;
@@ -838,7 +1067,7 @@ void draw_panel_changed() {
 
   if ((GetSystimeMS() - new_panel_start_time) < 3000) {
     snprintf(tmp_str, sizeof(tmp_str), "P %d", (int) current_panel);
-    write_string(tmp_str, GRAPHICS_X_MIDDLE, 210, 0, 0, TEXT_VA_TOP,
+    write_string(tmp_str, GRAPHICS_X_MIDDLE, GRAPHICS_SCALE_Y(210), 0, 0, TEXT_VA_TOP,
                  TEXT_HA_CENTER, 0, SIZE_TO_FONT[1]);
   }
 }
@@ -926,7 +1155,7 @@ void draw_linear_compass(int v, int home_dir, int range, int width, int x, int y
     }
 
      // Put home direction
-     if (osd_got_home && rr == home_dir) {
+     if (osd_telemetry.osd_got_home && rr == home_dir) {
          xs = ((long int)(r * width) / (long int)range) + x;
          write_filled_rectangle_lm(xs - 5, majtick_start + textoffset + 7, 10, 10, 0, 1);
          write_string("H", xs + 1, majtick_start + textoffset + 12, 1, 0, TEXT_VA_MIDDLE, TEXT_HA_CENTER, 0, 2);
@@ -942,7 +1171,7 @@ void draw_linear_compass(int v, int home_dir, int range, int width, int x, int y
      /* } */
   }
 
-  if (osd_got_home && home_dir > 0 && !home_drawn) {
+  if (osd_telemetry.osd_got_home && home_dir > 0 && !home_drawn) {
      if (((v > home_dir) && (v - home_dir < 180)) || ((v < home_dir) && (home_dir -v > 180)))
      {
          r = x - ((long int)(range_2 * width) / (long int)range);
@@ -1194,7 +1423,7 @@ void draw_head_wp_home() {
   VECTOR2D_INITXYZ(&(suav.vlist_local[2]), 6, 14);
   VECTOR2D_INITXYZ(&(suav.vlist_local[3]), 0, 10);
   Reset_Polygon2D(&suav);
-  Rotate_Polygon2D(&suav, osd_heading);
+  Rotate_Polygon2D(&suav, osd_telemetry.osd_heading);
 
   write_line_outlined(suav.vlist_trans[0].x + suav.x0, suav.vlist_trans[0].y + suav.y0,
                       suav.vlist_trans[1].x + suav.x0, suav.vlist_trans[1].y + suav.y0, 2, 2, 0, 1);
@@ -1215,13 +1444,13 @@ void draw_head_wp_home() {
   }
 
   //draw waypoint
-  if ((wp_number != 0) && (wp_dist > 1))
+  if ((osd_telemetry.wp_number != 0) && (osd_telemetry.wp_dist > 1))
   {
     //format bearing
-    wp_target_bearing = (wp_target_bearing + 360) % 360;
-    float wpCX = posX + (osd_params.CWH_Nmode_wp_radius) * Fast_Sin(wp_target_bearing);
-    float wpCY = posY - (osd_params.CWH_Nmode_wp_radius) * Fast_Cos(wp_target_bearing);
-    snprintf(tmp_str, sizeof(tmp_str), "%d", (int)wp_number + 1);
+    int wp_bearing = (osd_telemetry.wp_target_bearing + 360) % 360;
+    float wpCX = posX + (osd_params.CWH_Nmode_wp_radius) * Fast_Sin(wp_bearing);
+    float wpCY = posY - (osd_params.CWH_Nmode_wp_radius) * Fast_Cos(wp_bearing);
+    snprintf(tmp_str, sizeof(tmp_str), "%d", (int)osd_telemetry.wp_number + 1);
     write_string(tmp_str, wpCX, wpCY, 0, 0, TEXT_VA_MIDDLE, TEXT_HA_CENTER, 0, SIZE_TO_FONT[0]);
   }
 }
@@ -1267,20 +1496,20 @@ void draw_warning(void) {
   uint8_t warning[8] = {};
 
   //no GPS fix!
-  if (osd_params.Alarm_GPS_status_en == 1 && (osd_fix_type < GPS_OK_FIX_3D)) {
+  if (osd_params.Alarm_GPS_status_en == 1 && (osd_telemetry.osd_fix_type < GPS_OK_FIX_3D)) {
     haswarn = true;
     warning[0] = 1;
   }
 
   //low batt
-  if (osd_params.Alarm_low_batt_en == 1 && (osd_battery_remaining_A < osd_params.Alarm_low_batt)) {
+  if (osd_params.Alarm_low_batt_en == 1 && (osd_telemetry.osd_battery_remaining_A < osd_params.Alarm_low_batt)) {
     haswarn = true;
     warning[1] = 1;
   }
 
-  float spd_comparison = osd_groundspeed;
+  float spd_comparison = osd_telemetry.osd_groundspeed;
   if (osd_params.Spd_Scale_type == 1) {
-    spd_comparison = osd_airspeed;
+    spd_comparison = osd_telemetry.osd_airspeed;
   }
   spd_comparison *= convert_speed;
   //under speed
@@ -1296,9 +1525,9 @@ void draw_warning(void) {
     warning[3] = 1;
   }
 
-  float alt_comparison = osd_rel_alt;
+  float alt_comparison = osd_telemetry.osd_rel_alt;
   if (osd_params.Alt_Scale_type == 0) {
-    alt_comparison = osd_alt;
+    alt_comparison = osd_telemetry.osd_alt;
   }
   //under altitude
   if (osd_params.Alarm_low_alt_en == 1 && (alt_comparison < osd_params.Alarm_low_alt)) {
@@ -1313,7 +1542,7 @@ void draw_warning(void) {
   }
 
   // no home yet
-  if (osd_got_home == 0) {
+  if (osd_telemetry.osd_got_home == 0) {
     haswarn = true;
     warning[6] = 1;
   }
@@ -1531,21 +1760,21 @@ void draw_flight_mode() {
 
   char* mode_str = "UNKNOWN";
 
-  switch (autopilot)
+  switch (osd_telemetry.autopilot)
   {
   case MAV_AUTOPILOT_ARDUPILOTMEGA:       //ardupilotmega
       {
-          if (mav_type == MAV_TYPE_FIXED_WING)
-              mode_str = ardupilot_modes_plane(custom_mode);
+          if (osd_telemetry.mav_type == MAV_TYPE_FIXED_WING)
+              mode_str = ardupilot_modes_plane(osd_telemetry.custom_mode);
           else
-              mode_str = ardupilot_modes_copter(custom_mode);
+              mode_str = ardupilot_modes_copter(osd_telemetry.custom_mode);
       }
       break;
 
   case MAV_AUTOPILOT_PX4:
       {
           union px4_custom_mode custom_mode_px4;
-          custom_mode_px4.data = custom_mode;
+          custom_mode_px4.data = osd_telemetry.custom_mode;
 
           switch(custom_mode_px4.main_mode)
           {
@@ -1610,7 +1839,7 @@ void draw_flight_mode() {
       break;
   }
 
-  int color = (!motor_armed || wfb_errors > 0 || wfb_flags & (WFB_LINK_LOST | WFB_LINK_JAMMED)) ? 2 : 1;
+  int color = (!osd_telemetry.motor_armed || osd_telemetry.wfb_errors > 0 || osd_telemetry.wfb_flags & (WFB_LINK_LOST | WFB_LINK_JAMMED)) ? 2 : 1;
 
   write_color_string(mode_str, osd_params.FlightMode_posX, osd_params.FlightMode_posY,
                      0, 0, TEXT_VA_TOP, osd_params.FlightMode_align, 0,
@@ -1624,12 +1853,12 @@ void draw_arm_state() {
     return;
   }
 
-  char* tmp_str1 = motor_armed ? "ARMED" : "DISARMED";
+  char* tmp_str1 = osd_telemetry.motor_armed ? "ARMED" : "DISARMED";
   write_color_string(tmp_str1, osd_params.Arm_posX,
                      osd_params.Arm_posY, 0, 0, TEXT_VA_TOP,
                      osd_params.Arm_align, 0,
                      SIZE_TO_FONT[osd_params.Arm_fontsize],
-                     motor_armed ? 1 : 2);
+                     osd_telemetry.motor_armed ? 1 : 2);
 }
 
 void draw_battery_voltage() {
@@ -1638,7 +1867,7 @@ void draw_battery_voltage() {
     return;
   }
 
-  snprintf(tmp_str, sizeof(tmp_str), "%4.1fV", (double) osd_vbat_A);
+  snprintf(tmp_str, sizeof(tmp_str), "%4.1fV", (double) osd_telemetry.osd_vbat_A);
   write_string(tmp_str, osd_params.BattVolt_posX,
                osd_params.BattVolt_posY, 0, 0, TEXT_VA_TOP,
                osd_params.BattVolt_align, 0,
@@ -1651,7 +1880,7 @@ void draw_battery_current() {
     return;
   }
 
-  snprintf(tmp_str, sizeof(tmp_str), "%5.1fA", (double) (osd_curr_A * 0.01));
+  snprintf(tmp_str, sizeof(tmp_str), "%5.1fA", (double) (osd_telemetry.osd_curr_A * 0.01));
   write_string(tmp_str, osd_params.BattCurrent_posX,
                osd_params.BattCurrent_posY, 0, 0, TEXT_VA_TOP,
                osd_params.BattCurrent_align, 0,
@@ -1664,8 +1893,8 @@ void draw_battery_remaining() {
     return;
   }
 
-  int color = osd_battery_remaining_A < 20 ? 2 : 1;
-  snprintf(tmp_str, sizeof(tmp_str), "%3d%%", osd_battery_remaining_A);
+  int color = osd_telemetry.osd_battery_remaining_A < 20 ? 2 : 1;
+  snprintf(tmp_str, sizeof(tmp_str), "%3d%%", osd_telemetry.osd_battery_remaining_A);
   write_color_string(tmp_str, osd_params.BattRemaining_posX,
                      osd_params.BattRemaining_posY, 0, 0, TEXT_VA_TOP,
                      osd_params.BattRemaining_align, 0,
@@ -1679,7 +1908,7 @@ void draw_battery_consumed() {
     return;
   }
 
-  snprintf(tmp_str, sizeof(tmp_str), "%dmah", (int)osd_curr_consumed_mah);
+  snprintf(tmp_str, sizeof(tmp_str), "%dmah", (int)osd_telemetry.osd_curr_consumed_mah);
   write_string(tmp_str, osd_params.BattConsumed_posX,
                osd_params.BattConsumed_posY, 0, 0, TEXT_VA_TOP,
                osd_params.BattConsumed_align, 0,
@@ -1694,24 +1923,24 @@ void draw_wfb_state() {
 
   int color = 1;
 
-  if (wfb_flags & WFB_LINK_LOST)
+  if (osd_telemetry.wfb_flags & WFB_LINK_LOST)
   {
       color = 2;
       snprintf(tmp_str, sizeof(tmp_str), "WFB LINK LOST");
   }
-  else if (wfb_flags & WFB_LINK_JAMMED)
+  else if (osd_telemetry.wfb_flags & WFB_LINK_JAMMED)
   {
       color = 2;
-      snprintf(tmp_str, sizeof(tmp_str), "WFB %3d JAMMED", wfb_rssi);
+      snprintf(tmp_str, sizeof(tmp_str), "WFB %3d JAMMED", osd_telemetry.wfb_rssi);
   }
   else
   {
-      if(wfb_errors > 0)
+      if(osd_telemetry.wfb_errors > 0)
       {
         color = 2;
       }
 
-      snprintf(tmp_str, sizeof(tmp_str), "WFB %3d F%d L%d", wfb_rssi, wfb_fec_fixed, wfb_errors);
+      snprintf(tmp_str, sizeof(tmp_str), "WFB %3d F%d L%d", osd_telemetry.wfb_rssi, osd_telemetry.wfb_fec_fixed, osd_telemetry.wfb_errors);
   }
 
   write_color_string(tmp_str,
@@ -1733,15 +1962,15 @@ void draw_altitude_scale() {
   float alt_shown;
   float min_alt = 10;
 
-  if (!isnan(osd_bottom_clearance)){
-      alt_shown = osd_bottom_clearance;
+  if (!isnan(osd_telemetry.osd_bottom_clearance)){
+      alt_shown = osd_telemetry.osd_bottom_clearance;
       snprintf(tmp_str, sizeof(tmp_str), "AGL");
   }else{
       if (osd_params.Alt_Scale_type == 0) {
-          alt_shown = osd_alt;
+          alt_shown = osd_telemetry.osd_alt;
           snprintf(tmp_str, sizeof(tmp_str), "MSL");
       }else{
-          alt_shown = osd_rel_alt;
+          alt_shown = osd_telemetry.osd_rel_alt;
           snprintf(tmp_str, sizeof(tmp_str), "REL");
       }
   }
@@ -1779,7 +2008,7 @@ void draw_absolute_altitude() {
     return;
   }
 
-  float tmp = osd_alt * convert_distance;
+  float tmp = osd_telemetry.osd_alt * convert_distance;
   if (tmp < convert_distance_divider) {
     snprintf(tmp_str, sizeof(tmp_str), "AA %d%s", (int) tmp, dist_unit_short);
   }
@@ -1799,7 +2028,7 @@ void draw_relative_altitude() {
     return;
   }
 
-  float tmp = osd_rel_alt * convert_distance;
+  float tmp = osd_telemetry.osd_rel_alt * convert_distance;
   if (tmp < convert_distance_divider) {
     snprintf(tmp_str, sizeof(tmp_str), "A %d%s", (int) tmp, dist_unit_short);
   }
@@ -1823,14 +2052,14 @@ void draw_speed_scale() {
   float vmin = -1;
   int  flags = HUD_VSCALE_FLAG_NO_NEGATIVE;
 
-  if (vtol_state == MAV_VTOL_STATE_TRANSITION_TO_FW || vtol_state == MAV_VTOL_STATE_FW || mav_type == MAV_TYPE_FIXED_WING)
+  if (osd_telemetry.vtol_state == MAV_VTOL_STATE_TRANSITION_TO_FW || osd_telemetry.vtol_state == MAV_VTOL_STATE_FW || osd_telemetry.mav_type == MAV_TYPE_FIXED_WING)
   {
-      spd_shown = osd_airspeed;
+      spd_shown = osd_telemetry.osd_airspeed;
       snprintf(tmp_str, sizeof(tmp_str), "AS");
       // Set min airspeed 15 km/h
       vmin = 15;
   } else {
-      spd_shown = osd_groundspeed;
+      spd_shown = osd_telemetry.osd_groundspeed;
       snprintf(tmp_str, sizeof(tmp_str), "GS");
   }
 
@@ -1859,7 +2088,7 @@ void draw_ground_speed() {
     return;
   }
 
-  float tmp = osd_groundspeed * convert_speed;
+  float tmp = osd_telemetry.osd_groundspeed * convert_speed;
   snprintf(tmp_str, sizeof(tmp_str), "GS: %d", (int) tmp);
   write_string(tmp_str, osd_params.TSPD_posX,
                osd_params.TSPD_posY, 0, 0, TEXT_VA_TOP,
@@ -1873,7 +2102,7 @@ void draw_air_speed() {
     return;
   }
 
-  float tmp = osd_airspeed * convert_speed;
+  float tmp = osd_telemetry.osd_airspeed * convert_speed;
   snprintf(tmp_str, sizeof(tmp_str), "AS %d%s", (int) tmp, spd_unit);
   write_string(tmp_str, osd_params.Air_Speed_posX,
                osd_params.Air_Speed_posY, 0, 0, TEXT_VA_TOP,
@@ -1888,12 +2117,12 @@ void draw_vtol_speed() {
   }
 
   float tmp;
-  if (vtol_state == MAV_VTOL_STATE_TRANSITION_TO_FW || vtol_state == MAV_VTOL_STATE_FW)
+  if (osd_telemetry.vtol_state == MAV_VTOL_STATE_TRANSITION_TO_FW || osd_telemetry.vtol_state == MAV_VTOL_STATE_FW)
   {
-      tmp = osd_airspeed * convert_speed;
+      tmp = osd_telemetry.osd_airspeed * convert_speed;
       snprintf(tmp_str, sizeof(tmp_str), "AS: %d %s", (int) tmp, spd_unit);
   } else {
-      tmp = osd_groundspeed * convert_speed;
+      tmp = osd_telemetry.osd_groundspeed * convert_speed;
       snprintf(tmp_str, sizeof(tmp_str), "GS: %d %s", (int) tmp, spd_unit);
   }
 
@@ -19,6 +19,8 @@
 #include "graphengine.h"
 #include "mavlink/ardupilotmega/mavlink.h"
 
+extern int widget_layers;                // 0 = draw all widgets directly, without retained layers
+
 void osd_init(int shift_x, int shift_y, float scale_x, float scale_y);
 
 /// GPS status codes
@@ -17,101 +17,27 @@
  * With Grateful Acknowledgements to the projects:
  * MinimOSD - arducam-osd Controller(https://code.google.com/p/arducam-osd/)
  */
+#include <stddef.h>
+#include <string.h>
+
 #include "osdvar.h"
 
 /////////////////////////////////////////////////////////////////////////
 uint64_t lastWritePanel = 0;
-uint8_t mav_type;
-uint8_t mav_system;
-uint8_t mav_component;
 uint64_t sys_start_time = 0;
-uint64_t armed_start_time = 0;
-uint64_t total_armed_time = 0;
-uint8_t vtol_state = 0;
 
 /////////////////////////////////////////////////////////////////////////
-float osd_vbat_A = 0.0f;                 // Battery A voltage in milivolt
-int16_t osd_curr_A = 0;                 // Battery A current
-int8_t osd_battery_remaining_A = 0;    // 0 to 100 <=> 0 to 1000
-uint32_t osd_curr_consumed_mah = 0;
-
-float osd_pitch = 0.0f;                  // pitch from DCM
-float osd_roll = 0.0f;                   // roll from DCM
-float osd_yaw = 0.0f;                    // relative heading form DCM
-float osd_heading = 0.0f;                // ground course heading from GPS
-
-double osd_lat = 0.0f;                    // latidude
-double osd_lon = 0.0f;                    // longitude
-uint8_t osd_satellites_visible = 0;     // number of satelites
-uint8_t osd_fix_type = 0;               // GPS lock 0-1=no fix, 2=2D, 3=3D
-double osd_hdop = 0.0f;
-
-double osd_lat2 = 0.0f;                    // latidude
-double osd_lon2 = 0.0f;                    // longitude
-uint8_t osd_satellites_visible2 = 0;     // number of satelites
-uint8_t osd_fix_type2 = 0;               // GPS lock 0-1=no fix, 2=2D, 3=3D
-double osd_hdop2 = 0.0f;
-
-float osd_airspeed = -1.0f;              // airspeed
-float osd_groundspeed = 0.0f;            // ground speed
 float osd_downVelocity = 0.0f;
-uint16_t osd_throttle = 0;               // throtle
-float osd_alt = 0.0f;                    // altitude
-float osd_rel_alt = 0.0f;                                // relative altitude	//  jmmods
-float osd_bottom_clearance = NAN;
-float osd_climb = 0.0f;
 float osd_climb_ma[10];
 int osd_climb_ma_index = 0;
 float osd_total_trip_dist = 0;
 
-float nav_roll = 0.0f; // Current desired roll in degrees
-float nav_pitch = 0.0f; // Current desired pitch in degrees
-int16_t nav_bearing = 0; // Current desired heading in degrees
-int16_t wp_target_bearing = 0; // Bearing to current MISSION/target in degrees
 int8_t wp_target_bearing_rotate_int = 0;
-uint16_t wp_dist = 0; // Distance to active MISSION in meters
-uint8_t wp_number = 0; // Current waypoint number
-float alt_error = 0.0f; // Current altitude error in meters
-float aspd_error = 0.0f; // Current airspeed error in meters/second
-float xtrack_error = 0.0f; // Current crosstrack error on x-y plane in meters
 float eff = 0.0f; //Efficiency
 uint8_t osd_linkquality = 0;
 
-bool motor_armed = false;
-bool last_motor_armed = false;
-uint8_t autopilot = 0;
-uint8_t base_mode = 0;
-uint32_t custom_mode = 0;
-
-bool osd_chan_cnt_above_eight = false;
-uint16_t osd_chan1_raw = 0;
-uint16_t osd_chan2_raw = 0;
-uint16_t osd_chan3_raw = 0;
-uint16_t osd_chan4_raw = 0;
-uint16_t osd_chan5_raw = 0;
-uint16_t osd_chan6_raw = 0;
-uint16_t osd_chan7_raw = 0;
-uint16_t osd_chan8_raw = 0;
-uint16_t osd_chan9_raw = 0;
-uint16_t osd_chan10_raw = 0;
-uint16_t osd_chan11_raw = 0;
-uint16_t osd_chan12_raw = 0;
-uint16_t osd_chan13_raw = 0;
-uint16_t osd_chan14_raw = 0;
-uint16_t osd_chan15_raw = 0;
-uint16_t osd_chan16_raw = 0;
-uint8_t osd_rssi = 0; //raw value from mavlink
-
-int8_t wfb_rssi = -128; //WFB rssi -128dBm
-uint16_t wfb_errors = 0;
-uint16_t wfb_fec_fixed = 0;
-int8_t wfb_flags = WFB_LINK_LOST;
 bool rc_lost = true;
 
-uint8_t osd_got_home = 0;               // tels if got home position or not
-double osd_home_lat = 0.0f;               // home latidude
-double osd_home_lon = 0.0f;               // home longitude
-float osd_home_alt = 0.0f;
 long osd_home_distance = 0;          // distance from home
 uint32_t osd_home_bearing = 0;
 uint8_t osd_alt_cnt = 0;              // counter for stable osd_alt
@@ -142,5 +68,175 @@ WAYPOINT wp_list[MAX_WAYPOINTS];
 int8_t osd_offset_Y = 0;
 int8_t osd_offset_X = 0;
 
-osd_message_t osd_message_queue[OSD_MAX_MESSAGES];
-int osd_message_queue_tail = -1;
+#define TELEMETRY_DEFAULTS {                    \
+    .osd_airspeed = -1.0f,                      \
+    .osd_bottom_clearance = NAN,                \
+    .wfb_rssi = -128,   /* -128dBm */           \
+    .wfb_flags = WFB_LINK_LOST,                 \
+    .osd_message_queue_tail = -1,               \
+    .version = 1,       /* readers start with 0, so everything is new */ \
+    .group_version = { [0 ... TLM_GROUP_COUNT - 1] = 1 }, \
+}
+
+#define GROUP_OFFSET(field) offsetof(osd_telemetry_t, field)
+
+// Group g occupies [telemetry_groups[g], telemetry_groups[g + 1])
+static const size_t telemetry_groups[TLM_GROUP_COUNT + 1] = {
+    [TLM_ATTITUDE] = GROUP_OFFSET(osd_pitch),
+    [TLM_FLIGHT] = GROUP_OFFSET(osd_airspeed),
+    [TLM_GPS] = GROUP_OFFSET(osd_lat),
+    [TLM_GPS2] = GROUP_OFFSET(osd_lat2),
+    [TLM_RC] = GROUP_OFFSET(osd_chan_raw),
+    [TLM_WFB] = GROUP_OFFSET(wfb_rssi),
+    [TLM_NAV] = GROUP_OFFSET(nav_roll),
+    [TLM_BATTERY] = GROUP_OFFSET(osd_vbat_A),
+    [TLM_STATE] = GROUP_OFFSET(mav_type),
+    [TLM_HOME] = GROUP_OFFSET(osd_got_home),
+    [TLM_MESSAGES] = GROUP_OFFSET(osd_message_queue),
+    [TLM_GROUP_COUNT] = GROUP_OFFSET(version),
+};
+
+// Fetch copies [telemetry_fetched[g], telemetry_groups[g + 1]), only the slots of groups which have them
+static const size_t telemetry_fetched[TLM_GROUP_COUNT] = {
+    [TLM_ATTITUDE] = GROUP_OFFSET(attitude_msg),
+    [TLM_FLIGHT] = GROUP_OFFSET(vfr_hud_msg),
+    [TLM_GPS] = GROUP_OFFSET(gps_raw_int_msg),
+    [TLM_GPS2] = GROUP_OFFSET(gps2_raw_msg),
+    [TLM_RC] = GROUP_OFFSET(rc_channels_msg),
+    [TLM_WFB] = GROUP_OFFSET(wfb_rssi),
+    [TLM_NAV] = GROUP_OFFSET(nav_controller_output_msg),
+    [TLM_BATTERY] = GROUP_OFFSET(sys_status_msg),
+    [TLM_STATE] = GROUP_OFFSET(mav_type),
+    [TLM_HOME] = GROUP_OFFSET(osd_got_home),
+    [TLM_MESSAGES] = GROUP_OFFSET(osd_message_queue),
+};
+
+/*
+ * Triple buffer: one copy is owned by the parser, one by the renderer and
+ * one holds the latest published state. Publish and fetch swap their copy
+ * with the latest one in a single atomic exchange.
+ */
+#define TELEMETRY_INDEX 3
+#define TELEMETRY_FRESH 4                       // latest copy wasn't fetched yet
+
+static osd_telemetry_t telemetry_buf[3] = { TELEMETRY_DEFAULTS, TELEMETRY_DEFAULTS, TELEMETRY_DEFAULTS };
+static osd_telemetry_t telemetry_last = TELEMETRY_DEFAULTS;    // parser thread only, last published state
+static int telemetry_latest = 1;
+static int telemetry_write = 0;                 // parser thread only
+static int telemetry_read = 2;                  // renderer thread only
+
+osd_telemetry_t osd_telemetry = TELEMETRY_DEFAULTS;
+osd_telemetry_t *osd_telemetry_w = telemetry_buf;
+
+/**
+ * osd_telemetry_publish: make parser's copy visible to the renderer.
+ * Called by the parser thread after a batch of packets. Groups which
+ * differ from the previous published state get the next version, nothing
+ * is published if there are none.
+ */
+void osd_telemetry_publish(void)
+{
+    osd_telemetry_t *t = osd_telemetry_w;
+    uint32_t changed = 0;
+
+    for (int g = 0; g < TLM_GROUP_COUNT; g++)
+    {
+        size_t start = telemetry_groups[g];
+        size_t size = telemetry_groups[g + 1] - start;
+
+        if (memcmp((uint8_t*)t + start, (uint8_t*)&telemetry_last + start, size) != 0)
+        {
+            memcpy((uint8_t*)&telemetry_last + start, (uint8_t*)t + start, size);
+            changed |= TLM_GROUP_BIT(g);
+        }
+    }
+
+    if (changed == 0)
+        return;
+
+    t->version++;
+    for (int g = 0; g < TLM_GROUP_COUNT; g++)
+    {
+        if (changed & TLM_GROUP_BIT(g))
+            t->group_version[g] = t->version;
+    }
+
+    int published = telemetry_write;
+    int prev = __atomic_exchange_n(&telemetry_latest, published | TELEMETRY_FRESH, __ATOMIC_ACQ_REL);
+
+    // Renderer only reads published copies, so the parser can read it too
+    telemetry_write = prev & TELEMETRY_INDEX;
+    memcpy(telemetry_buf + telemetry_write, telemetry_buf + published, sizeof(osd_telemetry_t));
+    osd_telemetry_w = telemetry_buf + telemetry_write;
+}
+
+/**
+ * osd_telemetry_fetch: update osd_telemetry with the latest published copy.
+ * Called by the renderer thread before drawing a frame. Only changed groups
+ * are copied, and of those with MAVLink slots only the slots: the fields
+ * decoded from them keep their values until decode_mavlink_slots().
+ */
+void osd_telemetry_fetch(void)
+{
+    if (!(__atomic_load_n(&telemetry_latest, __ATOMIC_ACQUIRE) & TELEMETRY_FRESH))
+        return;
+
+    telemetry_read = __atomic_exchange_n(&telemetry_latest, telemetry_read, __ATOMIC_ACQ_REL) & TELEMETRY_INDEX;
+
+    const osd_telemetry_t *t = telemetry_buf + telemetry_read;
+    uint32_t changed = osd_telemetry_changed(t, osd_telemetry.version);
+
+    for (int g = 0; g < TLM_GROUP_COUNT; g++)
+    {
+        if (changed & TLM_GROUP_BIT(g))
+        {
+            size_t start = telemetry_fetched[g];
+            memcpy((uint8_t*)&osd_telemetry + start, (const uint8_t*)t + start, telemetry_groups[g + 1] - start);
+        }
+    }
+    osd_telemetry.version = t->version;
+    memcpy(osd_telemetry.group_version, t->group_version, sizeof(t->group_version));
+}
+
+/**
+ * osd_telemetry_changed: groups modified after a version.
+ *
+ * @param t         telemetry copy owned by the caller
+ * @param since     t->version the caller has seen last, 0 - nothing seen yet
+ * @return          bitmap of osd_telemetry_group_t
+ */
+uint32_t osd_telemetry_changed(const osd_telemetry_t *t, uint32_t since)
+{
+    uint32_t changed = 0;
+
+    if (t->version == since)
+        return 0;
+
+    for (int g = 0; g < TLM_GROUP_COUNT; g++)
+    {
+        if ((int32_t)(t->group_version[g] - since) > 0)
+            changed |= TLM_GROUP_BIT(g);
+    }
+    return changed;
+}
+
+/**
+ * osd_telemetry_group_of: group of a field in osd_telemetry.
+ *
+ * @return      osd_telemetry_group_t or -1 if field isn't a part of osd_telemetry
+ */
+int osd_telemetry_group_of(const volatile void *field)
+{
+    const uint8_t *p = (const uint8_t *)field;
+    const uint8_t *base = (const uint8_t *)&osd_telemetry;
+
+    if (p < base || p >= base + telemetry_groups[TLM_GROUP_COUNT])
+        return -1;
+
+    for (int g = TLM_GROUP_COUNT - 1; g > 0; g--)
+    {
+        if (p >= base + telemetry_groups[g])
+            return g;
+    }
+    return 0;
+}
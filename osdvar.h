@@ -5,101 +5,26 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+#include "mavlink/common/mavlink.h"
+
 #define WFB_LINK_LOST   1
 #define WFB_LINK_JAMMED 2
 
 /////////////////////////////////////////////////////////////////////////
 extern uint64_t lastWritePanel;
-extern uint8_t mav_type;
-extern uint8_t mav_system;
-extern uint8_t mav_component;
 extern uint64_t sys_start_time;
-extern uint64_t armed_start_time;
-extern uint64_t total_armed_time;
-extern uint8_t vtol_state;
 
 /////////////////////////////////////////////////////////////////////////
-extern float osd_vbat_A;                 // Battery A voltage in milivolt
-extern int16_t osd_curr_A;                 // Battery A current
-extern int8_t osd_battery_remaining_A;    // 0 to 100 <=> 0 to 1000
-extern uint32_t osd_curr_consumed_mah; // total current drawn since startup in amp-hours
-
-extern float osd_pitch;                  // pitch from DCM
-extern float osd_roll;                   // roll from DCM
-extern float osd_yaw;                    // relative heading form DCM
-extern float osd_heading;                // ground course heading from GPS
-
-extern double osd_lat;                    // latidude
-extern double osd_lon;                    // longitude
-extern uint8_t osd_satellites_visible;     // number of satelites
-extern uint8_t osd_fix_type;               // GPS lock 0-1=no fix, 2=2D, 3=3D
-extern double osd_hdop;
-
-extern double osd_lat2;                    // latidude
-extern double osd_lon2;                    // longitude
-extern uint8_t osd_satellites_visible2;     // number of satelites
-extern uint8_t osd_fix_type2;               // GPS lock 0-1=no fix, 2=2D, 3=3D
-extern double osd_hdop2;
-
-extern float osd_airspeed;               // airspeed
-extern float osd_groundspeed;            // ground speed
 extern float osd_downVelocity;           // ground speed
-extern uint16_t osd_throttle;            // throtle
-extern float osd_alt;                    // altitude
-extern float osd_rel_alt;                // relative altitude	//  jmmods
-extern float osd_bottom_clearance;       // relative altitude	//  jmmods
-extern float osd_climb;
 extern float osd_climb_ma[10];
 extern int osd_climb_ma_index;
 extern float osd_total_trip_dist; //total trip distance since startup, calculated in meter
 
-extern float nav_roll; // Current desired roll in degrees
-extern float nav_pitch; // Current desired pitch in degrees
-extern int16_t nav_bearing; // Current desired heading in degrees
-extern int16_t wp_target_bearing; // Bearing to current MISSION/target in degrees
 extern int8_t wp_target_bearing_rotate_int;
-extern uint16_t wp_dist; // Distance to active MISSION in meters
-extern uint8_t wp_number; // Current waypoint number
-extern float alt_error; // Current altitude error in meters
-extern float aspd_error; // Current airspeed error in meters/second
-extern float xtrack_error; // Current crosstrack error on x-y plane in meters
 extern float eff; //Efficiency
 
-extern uint32_t custom_mode;
-extern bool motor_armed;
-extern bool last_motor_armed;
-extern uint8_t base_mode;
-extern uint8_t autopilot;
-
-extern bool osd_chan_cnt_above_eight;
-extern uint16_t osd_chan1_raw;
-extern uint16_t osd_chan2_raw;
-extern uint16_t osd_chan3_raw;
-extern uint16_t osd_chan4_raw;
-extern uint16_t osd_chan5_raw;
-extern uint16_t osd_chan6_raw;
-extern uint16_t osd_chan7_raw;
-extern uint16_t osd_chan8_raw;
-extern uint16_t osd_chan9_raw;
-extern uint16_t osd_chan10_raw;
-extern uint16_t osd_chan11_raw;
-extern uint16_t osd_chan12_raw;
-extern uint16_t osd_chan13_raw;
-extern uint16_t osd_chan14_raw;
-extern uint16_t osd_chan15_raw;
-extern uint16_t osd_chan16_raw;
-extern uint8_t osd_rssi; //raw value from mavlink
-
-extern int8_t wfb_rssi; //WFB rssi
-extern uint16_t wfb_errors;
-extern uint16_t wfb_fec_fixed;
-extern int8_t wfb_flags;
 extern bool rc_lost;
 
-extern uint8_t osd_got_home;               // tels if got home position or not
-extern double osd_home_lat;               // home latidude
-extern double osd_home_lon;               // home longitude
-extern float osd_home_alt;
 extern long osd_home_distance;          // distance from home
 extern uint32_t osd_home_bearing;
 extern uint8_t osd_alt_cnt;              // counter for stable osd_alt
@@ -156,9 +81,160 @@ typedef struct
     char message[51];
 } osd_message_t;
 
-extern osd_message_t osd_message_queue[OSD_MAX_MESSAGES];
-extern int osd_message_queue_tail;
-
 extern int8_t osd_offset_Y;
 extern int8_t osd_offset_X;
+
+/*
+ * Telemetry received from MAVLink. The parser fills its private copy
+ * (osd_telemetry_w) and publishes it with osd_telemetry_publish(), the
+ * renderer takes the latest published one into osd_telemetry with
+ * osd_telemetry_fetch(). Neither side waits for the other.
+ *
+ * Fields are grouped by the messages which update them, every group starts
+ * at a cache line. Publish compares each group with the previous published
+ * state and stamps the changed ones with the new version, so a reader can
+ * tell what was modified since the version it has seen last.
+ * Groups must be declared in the osd_telemetry_group_t order.
+ *
+ * High-rate messages aren't decoded by the parser. It keeps the raw payload
+ * of the latest one in the group's slot, and the renderer decodes the slots
+ * of the groups shown on screen with decode_mavlink_slots(). Slots are
+ * declared last in their group: fetch copies only them, the fields before
+ * are the renderer's and stay decoded while the group isn't shown.
+ */
+typedef enum {
+    TLM_ATTITUDE = 0,       // ATTITUDE
+    TLM_FLIGHT,             // VFR_HUD, GLOBAL_POSITION_INT, ALTITUDE
+    TLM_GPS,                // GPS_RAW_INT
+    TLM_GPS2,               // GPS2_RAW
+    TLM_RC,                 // RC_CHANNELS, RC_CHANNELS_RAW
+    TLM_WFB,                // RADIO_STATUS
+    TLM_NAV,                // NAV_CONTROLLER_OUTPUT, MISSION_CURRENT
+    TLM_BATTERY,            // SYS_STATUS, BATTERY_STATUS
+    TLM_STATE,              // HEARTBEAT, EXTENDED_SYS_STATE
+    TLM_HOME,               // HOME_POSITION
+    TLM_MESSAGES,           // STATUSTEXT
+    TLM_GROUP_COUNT
+} osd_telemetry_group_t;
+
+#define TLM_GROUP_BIT(group) (1u << (group))
+#define TELEMETRY_GROUP __attribute__((aligned(64)))
+#define TLM_RC_CHANNELS 16
+
+// Latest payload of a message, zero padded to the full length
+#define MAVLINK_SLOT(msg) struct {                                      \
+    uint64_t time_us;  /* arrival, strictly increasing, 0 - none yet */ \
+    uint8_t payload[MAVLINK_MSG_ID_##msg##_LEN];                        \
+}
+
+typedef struct
+{
+    // TLM_ATTITUDE
+    float osd_pitch TELEMETRY_GROUP;  // pitch from DCM
+    float osd_roll;                   // roll from DCM
+    float osd_yaw;                    // relative heading form DCM
+    MAVLINK_SLOT(ATTITUDE) attitude_msg;
+
+    // TLM_FLIGHT
+    float osd_airspeed TELEMETRY_GROUP; // airspeed
+    float osd_groundspeed;            // ground speed
+    float osd_heading;                // ground course heading from GPS
+    uint16_t osd_throttle;            // throtle
+    float osd_alt;                    // altitude
+    float osd_rel_alt;                // relative altitude	//  jmmods
+    float osd_bottom_clearance;       // relative altitude	//  jmmods
+    float osd_climb;
+    MAVLINK_SLOT(VFR_HUD) vfr_hud_msg;
+    MAVLINK_SLOT(GLOBAL_POSITION_INT) global_position_int_msg;
+    MAVLINK_SLOT(ALTITUDE) altitude_msg;
+
+    // TLM_GPS
+    double osd_lat TELEMETRY_GROUP;     // latidude
+    double osd_lon;                    // longitude
+    uint8_t osd_satellites_visible;     // number of satelites
+    uint8_t osd_fix_type;               // GPS lock 0-1=no fix, 2=2D, 3=3D
+    double osd_hdop;
+    MAVLINK_SLOT(GPS_RAW_INT) gps_raw_int_msg;
+
+    // TLM_GPS2
+    double osd_lat2 TELEMETRY_GROUP;    // latidude
+    double osd_lon2;                    // longitude
+    uint8_t osd_satellites_visible2;     // number of satelites
+    uint8_t osd_fix_type2;               // GPS lock 0-1=no fix, 2=2D, 3=3D
+    double osd_hdop2;
+    MAVLINK_SLOT(GPS2_RAW) gps2_raw_msg;
+
+    // TLM_RC
+    uint16_t osd_chan_raw[TLM_RC_CHANNELS] TELEMETRY_GROUP; // channel 1 is osd_chan_raw[0]
+    uint8_t osd_rssi; //raw value from mavlink
+    bool osd_chan_cnt_above_eight;
+    MAVLINK_SLOT(RC_CHANNELS) rc_channels_msg;
+    MAVLINK_SLOT(RC_CHANNELS_RAW) rc_channels_raw_msg;
+
+    // TLM_WFB
+    int8_t wfb_rssi TELEMETRY_GROUP; //WFB rssi
+    uint16_t wfb_errors;
+    uint16_t wfb_fec_fixed;
+    int8_t wfb_flags;
+
+    // TLM_NAV
+    float nav_roll TELEMETRY_GROUP; // Current desired roll in degrees
+    float nav_pitch; // Current desired pitch in degrees
+    int16_t nav_bearing; // Current desired heading in degrees
+    int16_t wp_target_bearing; // Bearing to current MISSION/target in degrees
+    uint16_t wp_dist; // Distance to active MISSION in meters
+    uint8_t wp_number; // Current waypoint number
+    float alt_error; // Current altitude error in meters
+    float aspd_error; // Current airspeed error in meters/second
+    float xtrack_error; // Current crosstrack error on x-y plane in meters
+    MAVLINK_SLOT(NAV_CONTROLLER_OUTPUT) nav_controller_output_msg;
+    MAVLINK_SLOT(MISSION_CURRENT) mission_current_msg;
+
+    // TLM_BATTERY
+    float osd_vbat_A TELEMETRY_GROUP; // Battery A voltage in milivolt
+    int16_t osd_curr_A;                 // Battery A current
+    int8_t osd_battery_remaining_A;    // 0 to 100 <=> 0 to 1000
+    uint32_t osd_curr_consumed_mah; // total current drawn since startup in amp-hours
+    MAVLINK_SLOT(SYS_STATUS) sys_status_msg;
+    MAVLINK_SLOT(BATTERY_STATUS) battery_status_msg;
+
+    // TLM_STATE
+    uint8_t mav_type TELEMETRY_GROUP;
+    uint8_t mav_system;
+    uint8_t mav_component;
+    uint8_t vtol_state;
+    uint32_t custom_mode;
+    bool motor_armed;
+    bool last_motor_armed;
+    uint8_t base_mode;
+    uint8_t autopilot;
+    uint64_t armed_start_time;
+    uint64_t total_armed_time;
+
+    // TLM_HOME
+    uint8_t osd_got_home TELEMETRY_GROUP; // tels if got home position or not
+    double osd_home_lat;               // home latidude
+    double osd_home_lon;               // home longitude
+    float osd_home_alt;
+
+    // TLM_MESSAGES
+    osd_message_t osd_message_queue[OSD_MAX_MESSAGES] TELEMETRY_GROUP;
+    int osd_message_queue_tail;
+
+    // Set by osd_telemetry_publish()
+    uint32_t version TELEMETRY_GROUP;
+    uint32_t group_version[TLM_GROUP_COUNT]; // version of the last change
+
+    // Renderer's copy only, kept by osd_telemetry_fetch()
+    uint64_t decoded_time_us[TLM_GROUP_COUNT]; // latest slot applied by decode_mavlink_slots()
+} osd_telemetry_t;
+
+extern osd_telemetry_t osd_telemetry;      // renderer's copy, stable address for widget inputs
+extern osd_telemetry_t *osd_telemetry_w;   // parser's copy
+
+void osd_telemetry_publish(void);
+void osd_telemetry_fetch(void);
+uint32_t osd_telemetry_changed(const osd_telemetry_t *t, uint32_t since);
+int osd_telemetry_group_of(const volatile void *field);
+
 #endif
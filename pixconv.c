@@ -0,0 +1,253 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/*
+ * Conversion of the draw buffer into scanout formats of display planes.
+ * OSD pixels are either fully transparent or opaque, so 16-bit formats
+ * with 1 or 4 alpha bits keep the image intact at half the bandwidth.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "pixconv.h"
+
+// Draw buffer RGBA is R in the lowest byte, i.e. DRM ABGR8888
+static inline uint16_t pack_argb1555(uint32_t v)
+{
+    return ((v >> 16) & 0x8000) | ((v & 0xf8) << 7) | ((v >> 6) & 0x3e0) | ((v >> 19) & 0x1f);
+}
+
+static inline uint16_t pack_argb4444(uint32_t v)
+{
+    return ((v >> 16) & 0xf000) | ((v & 0xf0) << 4) | ((v >> 8) & 0xf0) | ((v >> 20) & 0xf);
+}
+
+static inline uint32_t swap_rb(uint32_t v)
+{
+    return (v & 0xff00ff00) | ((v & 0xff) << 16) | ((v >> 16) & 0xff);
+}
+
+#ifdef GRAPHICS_INDEXED
+/**
+ * convert_indexed16: expand palette indexes through a table of 16-bit pixels.
+ *
+ * @param       dst     16-bit pixels
+ * @param       src     palette indexes
+ * @param       count   number of pixels
+ * @param       pack    palette entry conversion
+ */
+static inline void convert_indexed16(uint16_t *dst, const osd_pixel_t *src, int count, uint16_t (*pack)(uint32_t))
+{
+    uint16_t pal[OSD_PALETTE_SIZE];
+
+    for (int i = 0; i < OSD_PALETTE_SIZE; i++) pal[i] = pack(osd_palette[i]);
+
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    __m128i pal16[OSD_PALETTE_SIZE], key[OSD_PALETTE_SIZE];
+
+    for (int i = 0; i < OSD_PALETTE_SIZE; i++)
+    {
+        pal16[i] = _mm_set1_epi16((short)pal[i]);
+        key[i] = _mm_set1_epi16(i);
+    }
+
+    for (; count >= 16; count -= 16, src += 16, dst += 16)
+    {
+        __m128i idx = _mm_loadu_si128((const __m128i*)src);
+        __m128i q[2] = { _mm_unpacklo_epi8(idx, zero), _mm_unpackhi_epi8(idx, zero) };
+
+        for (int j = 0; j < 2; j++)
+        {
+            __m128i out = zero;
+            for (int i = 0; i < OSD_PALETTE_SIZE; i++)
+            {
+                out = _mm_or_si128(out, _mm_and_si128(_mm_cmpeq_epi16(q[j], key[i]), pal16[i]));
+            }
+            _mm_storeu_si128((__m128i*)dst + j, out);
+        }
+    }
+#elif defined(__ARM_NEON)
+    // Low and high byte tables, vtbl returns 0 for indexes past the palette
+    uint8_t tables[2][8] = { { 0 } };
+
+    for (int i = 0; i < OSD_PALETTE_SIZE; i++)
+    {
+        tables[0][i] = pal[i];
+        tables[1][i] = pal[i] >> 8;
+    }
+
+    uint8x8_t lo = vld1_u8(tables[0]), hi = vld1_u8(tables[1]);
+
+    for (; count >= 8; count -= 8, src += 8, dst += 8)
+    {
+        uint8x8_t idx = vld1_u8(src);
+        uint8x8x2_t out;
+
+        out.val[0] = vtbl1_u8(lo, idx);
+        out.val[1] = vtbl1_u8(hi, idx);
+        vst2_u8((uint8_t *)dst, out);
+    }
+#endif
+    while (count-- > 0) *dst++ = pal[*src++];
+}
+#endif
+
+/**
+ * pixconv_abgr8888: convert to DRM ABGR8888 (R, G, B, A bytes in memory).
+ */
+void pixconv_abgr8888(void *dst, const osd_pixel_t *src, int count)
+{
+    expand_pixels(dst, src, count);
+}
+
+/**
+ * pixconv_argb8888: convert to DRM ARGB8888 (B, G, R, A bytes in memory).
+ */
+void pixconv_argb8888(void *dst, const osd_pixel_t *src, int count)
+{
+#ifdef GRAPHICS_INDEXED
+    uint32_t pal[OSD_PALETTE_SIZE], *out = dst;
+
+    for (int i = 0; i < OSD_PALETTE_SIZE; i++) pal[i] = swap_rb(osd_palette[i]);
+    while (count-- > 0) *out++ = pal[*src++];
+#else
+    uint32_t *out = dst;
+
+#if defined(__SSE2__)
+    const __m128i ga = _mm_set1_epi32(0xff00ff00), b = _mm_set1_epi32(0xff);
+
+    for (; count >= 4; count -= 4, src += 4, out += 4)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i*)src);
+        __m128i r = _mm_or_si128(_mm_and_si128(v, ga),
+                                 _mm_or_si128(_mm_slli_epi32(_mm_and_si128(v, b), 16),
+                                              _mm_and_si128(_mm_srli_epi32(v, 16), b)));
+        _mm_storeu_si128((__m128i*)out, r);
+    }
+#elif defined(__ARM_NEON)
+    for (; count >= 8; count -= 8, src += 8, out += 8)
+    {
+        uint8x8x4_t v = vld4_u8((const uint8_t *)src);
+        uint8x8_t t = v.val[0];
+
+        v.val[0] = v.val[2];
+        v.val[2] = t;
+        vst4_u8((uint8_t *)out, v);
+    }
+#endif
+    while (count-- > 0) *out++ = swap_rb(*src++);
+#endif
+}
+
+#if !defined(GRAPHICS_INDEXED) && defined(__SSE2__)
+// Keep low 16 bits of every 32-bit lane in 8 words, packs saturation is avoided by sign extension
+static inline __m128i narrow_epi32(__m128i a, __m128i b)
+{
+    a = _mm_srai_epi32(_mm_slli_epi32(a, 16), 16);
+    b = _mm_srai_epi32(_mm_slli_epi32(b, 16), 16);
+    return _mm_packs_epi32(a, b);
+}
+
+static inline __m128i pack_argb1555_sse2(__m128i v)
+{
+    __m128i a = _mm_and_si128(_mm_srli_epi32(v, 16), _mm_set1_epi32(0x8000));
+    __m128i r = _mm_slli_epi32(_mm_and_si128(v, _mm_set1_epi32(0xf8)), 7);
+    __m128i g = _mm_and_si128(_mm_srli_epi32(v, 6), _mm_set1_epi32(0x3e0));
+    __m128i b = _mm_and_si128(_mm_srli_epi32(v, 19), _mm_set1_epi32(0x1f));
+    return _mm_or_si128(_mm_or_si128(a, r), _mm_or_si128(g, b));
+}
+
+static inline __m128i pack_argb4444_sse2(__m128i v)
+{
+    __m128i a = _mm_and_si128(_mm_srli_epi32(v, 16), _mm_set1_epi32(0xf000));
+    __m128i r = _mm_slli_epi32(_mm_and_si128(v, _mm_set1_epi32(0xf0)), 4);
+    __m128i g = _mm_and_si128(_mm_srli_epi32(v, 8), _mm_set1_epi32(0xf0));
+    __m128i b = _mm_and_si128(_mm_srli_epi32(v, 20), _mm_set1_epi32(0xf));
+    return _mm_or_si128(_mm_or_si128(a, r), _mm_or_si128(g, b));
+}
+#endif
+
+/**
+ * pixconv_argb1555: convert to DRM ARGB1555.
+ */
+void pixconv_argb1555(void *dst, const osd_pixel_t *src, int count)
+{
+#ifdef GRAPHICS_INDEXED
+    convert_indexed16(dst, src, count, pack_argb1555);
+#else
+    uint16_t *out = dst;
+
+#if defined(__SSE2__)
+    for (; count >= 8; count -= 8, src += 8, out += 8)
+    {
+        __m128i lo = pack_argb1555_sse2(_mm_loadu_si128((const __m128i*)src));
+        __m128i hi = pack_argb1555_sse2(_mm_loadu_si128((const __m128i*)(src + 4)));
+        _mm_storeu_si128((__m128i*)out, narrow_epi32(lo, hi));
+    }
+#elif defined(__ARM_NEON)
+    for (; count >= 8; count -= 8, src += 8, out += 8)
+    {
+        uint8x8x4_t v = vld4_u8((const uint8_t *)src);
+        uint16x8_t r = vshlq_n_u16(vmovl_u8(vshr_n_u8(v.val[0], 3)), 10);
+        uint16x8_t g = vshlq_n_u16(vmovl_u8(vshr_n_u8(v.val[1], 3)), 5);
+        uint16x8_t b = vmovl_u8(vshr_n_u8(v.val[2], 3));
+        uint16x8_t a = vshlq_n_u16(vmovl_u8(vshr_n_u8(v.val[3], 7)), 15);
+        vst1q_u16(out, vorrq_u16(vorrq_u16(a, r), vorrq_u16(g, b)));
+    }
+#endif
+    while (count-- > 0) *out++ = pack_argb1555(*src++);
+#endif
+}
+
+/**
+ * pixconv_argb4444: convert to DRM ARGB4444.
+ */
+void pixconv_argb4444(void *dst, const osd_pixel_t *src, int count)
+{
+#ifdef GRAPHICS_INDEXED
+    convert_indexed16(dst, src, count, pack_argb4444);
+#else
+    uint16_t *out = dst;
+
+#if defined(__SSE2__)
+    for (; count >= 8; count -= 8, src += 8, out += 8)
+    {
+        __m128i lo = pack_argb4444_sse2(_mm_loadu_si128((const __m128i*)src));
+        __m128i hi = pack_argb4444_sse2(_mm_loadu_si128((const __m128i*)(src + 4)));
+        _mm_storeu_si128((__m128i*)out, narrow_epi32(lo, hi));
+    }
+#elif defined(__ARM_NEON)
+    for (; count >= 8; count -= 8, src += 8, out += 8)
+    {
+        uint8x8x4_t v = vld4_u8((const uint8_t *)src);
+        uint16x8_t r = vshlq_n_u16(vmovl_u8(vshr_n_u8(v.val[0], 4)), 8);
+        uint16x8_t g = vshlq_n_u16(vmovl_u8(vshr_n_u8(v.val[1], 4)), 4);
+        uint16x8_t b = vmovl_u8(vshr_n_u8(v.val[2], 4));
+        uint16x8_t a = vshlq_n_u16(vmovl_u8(vshr_n_u8(v.val[3], 4)), 12);
+        vst1q_u16(out, vorrq_u16(vorrq_u16(a, r), vorrq_u16(g, b)));
+    }
+#endif
+    while (count-- > 0) *out++ = pack_argb4444(*src++);
+#endif
+}
@@ -0,0 +1,15 @@
+#ifndef __PIXCONV_H
+#define __PIXCONV_H
+
+#include <stdint.h>
+#include "graphengine.h"
+
+// Convert run of draw buffer pixels into scanout format
+typedef void (*pixconv_func_t)(void *dst, const osd_pixel_t *src, int count);
+
+void pixconv_abgr8888(void *dst, const osd_pixel_t *src, int count);
+void pixconv_argb8888(void *dst, const osd_pixel_t *src, int count);
+void pixconv_argb1555(void *dst, const osd_pixel_t *src, int count);
+void pixconv_argb4444(void *dst, const osd_pixel_t *src, int count);
+
+#endif //__PIXCONV_H
@@ -0,0 +1,267 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/*
+ * LRU cache of rendered text runs.
+ * Most strings are the same frame after frame, so the whole run is
+ * rendered once into a sprite and then drawn with a single blit.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "textcache.h"
+#include "math3d.h"
+
+#define TEXT_CACHE_BUCKETS 256
+
+typedef struct text_run {
+    struct text_run *hash_next;
+    struct text_run *lru_prev, *lru_next;
+    uint32_t hash;
+    int16_t font, color, flags, xs, ys;
+    size_t len;
+    size_t bytes;
+    osd_sprite_t sprite;
+    char str[];                         // followed by sprite pixels
+} text_run_t;
+
+size_t text_cache_budget = TEXT_CACHE_DEFAULT_BUDGET;
+text_cache_stats_t text_cache_stats;
+
+static text_run_t *buckets[TEXT_CACHE_BUCKETS];
+static text_run_t *lru_head, *lru_tail;    // head is most recently used
+
+static uint32_t run_hash(const char *str, size_t len, int font, int color, int flags, int xs, int ys)
+{
+    // FNV-1a
+    uint32_t h = 2166136261u;
+    int params[5] = { font, color, flags, xs, ys };
+
+    for (size_t i = 0; i < len; i++)
+    {
+        h = (h ^ (uint8_t)str[i]) * 16777619u;
+    }
+    for (int i = 0; i < 5; i++)
+    {
+        h = (h ^ (uint32_t)params[i]) * 16777619u;
+    }
+    return h;
+}
+
+static void lru_unlink(text_run_t *run)
+{
+    if (run->lru_prev) run->lru_prev->lru_next = run->lru_next; else lru_head = run->lru_next;
+    if (run->lru_next) run->lru_next->lru_prev = run->lru_prev; else lru_tail = run->lru_prev;
+    run->lru_prev = run->lru_next = NULL;
+}
+
+static void lru_push_front(text_run_t *run)
+{
+    run->lru_prev = NULL;
+    run->lru_next = lru_head;
+    if (lru_head) lru_head->lru_prev = run; else lru_tail = run;
+    lru_head = run;
+}
+
+static void evict(text_run_t *run)
+{
+    text_run_t **p = &buckets[run->hash % TEXT_CACHE_BUCKETS];
+
+    while (*p != run) p = &(*p)->hash_next;
+    *p = run->hash_next;
+
+    lru_unlink(run);
+    text_cache_stats.bytes -= run->bytes;
+    text_cache_stats.entries--;
+    free(run);
+}
+
+/**
+ * render_run: render text into new cache entry. Layout matches write_color_string.
+ *
+ * @return      new entry or NULL if run is empty or exceeds the budget
+ */
+static text_run_t *render_run(const char *str, size_t len, uint32_t hash, int font, int color, int flags, int xs, int ys)
+{
+    struct FontEntry font_info;
+    osd_sprite_t glyph;
+    int offset = 0, width = 0, height = 0, cx = 0, cy = 0;
+
+    fetch_font_info(0, font, &font_info, NULL);
+
+    // Find sprite size
+    for (size_t i = 0; i < len; i++)
+    {
+        if (str[i] == '\n' || str[i] == '\r')
+        {
+            cy += ys + font_info.height;
+            cx = 0;
+            continue;
+        }
+        if (glyph_sprite(str[i], flags, font, color, &glyph, &offset))
+        {
+            width = MAX(width, cx + offset + glyph.width);
+            height = MAX(height, cy + offset + glyph.height);
+        }
+        cx += font_info.width + xs;
+    }
+
+    if (width == 0 || height == 0)
+        return NULL;
+
+    size_t bytes = sizeof(text_run_t) + len + 4 + (size_t)width * height * sizeof(osd_pixel_t);
+    if (bytes > text_cache_budget)
+        return NULL;
+
+    while (lru_tail != NULL && text_cache_stats.bytes + bytes > text_cache_budget)
+    {
+        evict(lru_tail);
+        text_cache_stats.evictions++;
+    }
+
+    text_run_t *run = calloc(1, bytes);
+    if (run == NULL)
+        return NULL;
+
+    run->hash = hash;
+    run->font = font;
+    run->color = color;
+    run->flags = flags;
+    run->xs = xs;
+    run->ys = ys;
+    run->len = len;
+    run->bytes = bytes;
+    memcpy(run->str, str, len);
+
+    // Pixels follow the string, aligned to 4 bytes
+    osd_pixel_t *pixels = (osd_pixel_t *)(run->str + ((len + 4) & ~(size_t)3));
+    run->sprite.width = width;
+    run->sprite.height = height;
+    run->sprite.pixels = pixels;
+
+    cx = cy = 0;
+    for (size_t i = 0; i < len; i++)
+    {
+        if (str[i] == '\n' || str[i] == '\r')
+        {
+            cy += ys + font_info.height;
+            cx = 0;
+            continue;
+        }
+        if (glyph_sprite(str[i], flags, font, color, &glyph, &offset))
+        {
+            for (int dy = 0; dy < glyph.height; dy++)
+            {
+                const osd_pixel_t *src = glyph.pixels + dy * glyph.width;
+                osd_pixel_t *dst = pixels + (cy + offset + dy) * width + cx + offset;
+
+                for (int dx = 0; dx < glyph.width; dx++)
+                {
+                    if (src[dx]) dst[dx] = src[dx];
+                }
+            }
+        }
+        cx += font_info.width + xs;
+    }
+
+    run->hash_next = buckets[hash % TEXT_CACHE_BUCKETS];
+    buckets[hash % TEXT_CACHE_BUCKETS] = run;
+    lru_push_front(run);
+    text_cache_stats.bytes += bytes;
+    text_cache_stats.entries++;
+    return run;
+}
+
+static text_run_t *find_run(const char *str, size_t len, uint32_t hash, int font, int color, int flags, int xs, int ys)
+{
+    for (text_run_t *run = buckets[hash % TEXT_CACHE_BUCKETS]; run != NULL; run = run->hash_next)
+    {
+        if (run->hash == hash && run->len == len && run->font == font && run->color == color &&
+            run->flags == flags && run->xs == xs && run->ys == ys && memcmp(run->str, str, len) == 0)
+        {
+            return run;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * text_cache_lookup: get rendered text run, render and cache it on miss.
+ * Top-left corner of the sprite is the string origin, as computed by write_color_string.
+ *
+ * @param       str     string
+ * @param       font    font
+ * @param       color   0 = black, 1 = main, 2 = warn
+ * @param       flags   font flags
+ * @param       xs      horizontal spacing
+ * @param       ys      vertical spacing
+ * @return      sprite or NULL if the run can't be cached (draw it directly)
+ */
+const osd_sprite_t *text_cache_lookup(const char *str, int font, int color, int flags, int xs, int ys)
+{
+    size_t len = strlen(str);
+
+    if (text_cache_budget == 0 || len == 0)
+        return NULL;
+
+    uint32_t hash = run_hash(str, len, font, color, flags, xs, ys);
+    text_run_t *run = find_run(str, len, hash, font, color, flags, xs, ys);
+
+    if (run != NULL)
+    {
+        if (run != lru_head)
+        {
+            lru_unlink(run);
+            lru_push_front(run);
+        }
+        text_cache_stats.hits++;
+        return &run->sprite;
+    }
+
+    text_cache_stats.misses++;
+    run = render_run(str, len, hash, font, color, flags, xs, ys);
+    return run != NULL ? &run->sprite : NULL;
+}
+
+/**
+ * text_cache_peek: get cached text run without touching the cache.
+ * Safe to call from several threads as long as nobody calls text_cache_lookup meanwhile.
+ *
+ * @return      sprite or NULL if the run isn't cached
+ */
+const osd_sprite_t *text_cache_peek(const char *str, int font, int color, int flags, int xs, int ys)
+{
+    size_t len = strlen(str);
+
+    if (text_cache_budget == 0 || len == 0)
+        return NULL;
+
+    text_run_t *run = find_run(str, len, run_hash(str, len, font, color, flags, xs, ys), font, color, flags, xs, ys);
+    return run != NULL ? &run->sprite : NULL;
+}
+
+/**
+ * text_cache_flush: drop all cached runs.
+ */
+void text_cache_flush(void)
+{
+    while (lru_tail != NULL)
+    {
+        evict(lru_tail);
+    }
+}
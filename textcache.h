@@ -0,0 +1,25 @@
+#ifndef __TEXTCACHE_H
+#define __TEXTCACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "graphengine.h"
+
+#define TEXT_CACHE_DEFAULT_BUDGET (256 * 1024)
+
+typedef struct {
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t evictions;
+    uint32_t entries;
+    size_t bytes;
+} text_cache_stats_t;
+
+extern size_t text_cache_budget;        // max memory used by cached runs, 0 = disabled
+extern text_cache_stats_t text_cache_stats;
+
+const osd_sprite_t *text_cache_lookup(const char *str, int font, int color, int flags, int xs, int ys);
+const osd_sprite_t *text_cache_peek(const char *str, int font, int color, int flags, int xs, int ys);
+void text_cache_flush(void);
+
+#endif //__TEXTCACHE_H
@@ -0,0 +1,155 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/*
+ * Tiled rasterizer: display list commands are binned by bounding box and
+ * the tiles are drawn by a small worker pool. Every tile replays its
+ * commands in recording order with pixel writes clipped to the tile, so
+ * the result is the same as drawing the whole list serially.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "tiler.h"
+#include "math3d.h"
+
+int raster_threads = 1;
+
+static dl_bin_t *bins;                  // TILE_COUNT bins
+static const osd_dl_t *pool_dl;
+static int next_tile;
+
+static pthread_t workers[RASTER_MAX_THREADS - 1];
+static osd_damage_t worker_damage[RASTER_MAX_THREADS - 1];
+static int num_workers = 0;
+
+static pthread_mutex_t pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pool_start = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t pool_done = PTHREAD_COND_INITIALIZER;
+static unsigned int pool_frame = 0;
+static int pool_busy = 0;
+
+/**
+ * run_tiles: take tiles from the shared counter until all are drawn.
+ */
+static void run_tiles(void)
+{
+    int t;
+
+    while ((t = __sync_fetch_and_add(&next_tile, 1)) < TILE_COUNT)
+    {
+        if (bins[t].count == 0) continue;
+
+        int x0 = (t % TILE_COLS) * TILE_WIDTH, y0 = (t / TILE_COLS) * TILE_HEIGHT;
+        osd_rect_t tile = { x0, y0, MIN(x0 + TILE_WIDTH - 1, GRAPHICS_RIGHT), MIN(y0 + TILE_HEIGHT - 1, GRAPHICS_BOTTOM) };
+
+        set_draw_tile(&tile);
+        dl_execute_bin(pool_dl, bins + t);
+    }
+    set_draw_tile(NULL);
+}
+
+static void *worker_main(void *arg)
+{
+    int id = (intptr_t)arg;
+    unsigned int frame = 0;
+
+    pthread_mutex_lock(&pool_mutex);
+    while (1)
+    {
+        while (pool_frame == frame)
+        {
+            pthread_cond_wait(&pool_start, &pool_mutex);
+        }
+        frame = pool_frame;
+        pthread_mutex_unlock(&pool_mutex);
+
+        frame_damage.count = 0;
+        frame_damage.last = 0;
+        run_tiles();
+        worker_damage[id] = frame_damage;
+
+        pthread_mutex_lock(&pool_mutex);
+        if (--pool_busy == 0)
+        {
+            pthread_cond_signal(&pool_done);
+        }
+    }
+    return NULL;
+}
+
+static void start_workers(void)
+{
+    int n = MIN(MAX(raster_threads, 1), RASTER_MAX_THREADS) - 1;
+
+    for (; num_workers < n; num_workers++)
+    {
+        if (pthread_create(workers + num_workers, NULL, worker_main, (void *)(intptr_t)num_workers) != 0)
+        {
+            fprintf(stderr, "Unable to start raster thread\n");
+            exit(1);
+        }
+    }
+}
+
+/**
+ * tiler_execute: rasterize display list with raster_threads threads.
+ * The caller thread draws tiles too and returns when all tiles are done,
+ * with damage of all threads merged into its frame_damage.
+ *
+ * @param       dl      display list
+ */
+void tiler_execute(const osd_dl_t *dl)
+{
+    if (bins == NULL)
+    {
+        // Surface size is fixed once rendering starts
+        bins = calloc(TILE_COUNT, sizeof(dl_bin_t));
+        if (bins == NULL)
+        {
+            fprintf(stderr, "Unable to allocate tile bins\n");
+            exit(1);
+        }
+        start_workers();
+    }
+
+    dl_bin(dl, bins, TILE_COLS, TILE_ROWS, TILE_WIDTH, TILE_HEIGHT);
+
+    pthread_mutex_lock(&pool_mutex);
+    pool_dl = dl;
+    next_tile = 0;
+    pool_busy = num_workers;
+    pool_frame++;
+    pthread_cond_broadcast(&pool_start);
+    pthread_mutex_unlock(&pool_mutex);
+
+    run_tiles();
+
+    pthread_mutex_lock(&pool_mutex);
+    while (pool_busy > 0)
+    {
+        pthread_cond_wait(&pool_done, &pool_mutex);
+    }
+    pthread_mutex_unlock(&pool_mutex);
+
+    for (int i = 0; i < num_workers; i++)
+    {
+        damage_merge(&frame_damage, worker_damage + i);
+    }
+}
@@ -0,0 +1,19 @@
+#ifndef __TILER_H
+#define __TILER_H
+
+#include "displaylist.h"
+
+// Screen is split into tiles which are rasterized in parallel
+#define TILE_WIDTH   128
+#define TILE_HEIGHT  64
+#define TILE_COLS    ((GRAPHICS_WIDTH + TILE_WIDTH - 1) / TILE_WIDTH)
+#define TILE_ROWS    ((GRAPHICS_HEIGHT + TILE_HEIGHT - 1) / TILE_HEIGHT)
+#define TILE_COUNT   (TILE_COLS * TILE_ROWS)
+
+#define RASTER_MAX_THREADS 16
+
+extern int raster_threads;              // 1 = rasterize in the caller thread only
+
+void tiler_execute(const osd_dl_t *dl);
+
+#endif //__TILER_H
@@ -0,0 +1,221 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/*
+ * Batched MAVLink datagram ingest.
+ * wfb-ng aggregates several sources into one stream, so datagrams come in
+ * bursts. They are received with recvmmsg() into a preallocated ring of
+ * slots, one syscall per burst instead of one per datagram. Datagrams the
+ * kernel dropped because the socket buffer was full are reported through
+ * SO_RXQ_OVFL.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "graphengine.h"
+#include "udprx.h"
+
+#define UDP_RX_STATS_INTERVAL_NS    10000000000ull
+#define UDP_RX_WARN_INTERVAL_NS     1000000000ull
+
+int udp_rx_rcvbuf = 0;
+udp_rx_stats_t udp_rx_stats;
+
+static struct mmsghdr rx_msgs[UDP_RX_BATCH];
+static struct iovec rx_iov[UDP_RX_BATCH];
+static uint8_t rx_slots[UDP_RX_BATCH][UDP_RX_SLOT_SIZE];
+static union {
+    struct cmsghdr align;
+    uint8_t buf[CMSG_SPACE(sizeof(uint32_t))];
+} rx_control[UDP_RX_BATCH];
+
+static uint64_t monotonic_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/**
+ * udp_rx_open: open UDP socket for MAVLink ingest.
+ *
+ * @param       port    local port
+ * @return      socket fd, exits on error
+ */
+int udp_rx_open(int port)
+{
+    struct sockaddr_in saddr;
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0){
+        perror("Error opening socket");
+        exit(1);
+    }
+
+    int optval = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, (const void *)&optval , sizeof(int));
+
+    // Count datagrams dropped on full receive queue, the counter comes with every datagram
+    if (setsockopt(fd, SOL_SOCKET, SO_RXQ_OVFL, (const void *)&optval, sizeof(int)) < 0)
+    {
+        perror("Unable to enable SO_RXQ_OVFL");
+    }
+
+    if (udp_rx_rcvbuf > 0)
+    {
+        // FORCE variant can exceed net.core.rmem_max, but needs CAP_NET_ADMIN
+        if (setsockopt(fd, SOL_SOCKET, SO_RCVBUFFORCE, (const void *)&udp_rx_rcvbuf, sizeof(int)) < 0 &&
+            setsockopt(fd, SOL_SOCKET, SO_RCVBUF, (const void *)&udp_rx_rcvbuf, sizeof(int)) < 0)
+        {
+            perror("Unable to set SO_RCVBUF");
+        }
+
+        int actual = 0;
+        socklen_t len = sizeof(actual);
+
+        // Kernel doubles the value for bookkeeping and caps it at rmem_max
+        getsockopt(fd, SOL_SOCKET, SO_RCVBUF, (void *)&actual, &len);
+        if (actual / 2 < udp_rx_rcvbuf)
+        {
+            fprintf(stderr, "MAVLink socket buffer is %d bytes, %d requested (see net.core.rmem_max)\n", actual / 2, udp_rx_rcvbuf);
+        }
+    }
+
+    bzero((char *) &saddr, sizeof(saddr));
+    saddr.sin_family = AF_INET;
+    saddr.sin_addr.s_addr = htonl(INADDR_ANY);
+    saddr.sin_port = htons((unsigned short)port);
+
+    if (bind(fd, (struct sockaddr *) &saddr, sizeof(saddr)) < 0)
+    {
+        perror("Bind error");
+        exit(1);
+    }
+
+    for (int i = 0; i < UDP_RX_BATCH; i++)
+    {
+        rx_iov[i].iov_base = rx_slots[i];
+        rx_iov[i].iov_len = UDP_RX_SLOT_SIZE;
+        rx_msgs[i].msg_hdr.msg_iov = &rx_iov[i];
+        rx_msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    return fd;
+}
+
+static void account_batch(int count)
+{
+    static uint64_t stats_ns, warn_ns;
+    static udp_rx_stats_t last;
+    static uint32_t drops_reported;
+
+    udp_rx_stats.syscalls++;
+
+    for (int i = 0; i < count; i++)
+    {
+        struct msghdr *hdr = &rx_msgs[i].msg_hdr;
+
+        udp_rx_stats.packets++;
+        udp_rx_stats.bytes += rx_msgs[i].msg_len;
+
+        if (hdr->msg_flags & MSG_TRUNC)
+            udp_rx_stats.truncated++;
+
+        for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(hdr); cmsg != NULL; cmsg = CMSG_NXTHDR(hdr, cmsg))
+        {
+            if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SO_RXQ_OVFL)
+                memcpy(&udp_rx_stats.kernel_drops, CMSG_DATA(cmsg), sizeof(uint32_t));
+        }
+    }
+
+    uint64_t now = monotonic_ns();
+
+    // Drops are always reported, but at most once a second
+    if ((udp_rx_stats.kernel_drops != drops_reported || udp_rx_stats.truncated != last.truncated) &&
+        now - warn_ns >= UDP_RX_WARN_INTERVAL_NS)
+    {
+        fprintf(stderr, "MAVLink datagrams lost: %u dropped by kernel (socket buffer full), %u truncated\n",
+                udp_rx_stats.kernel_drops - drops_reported, udp_rx_stats.truncated - last.truncated);
+        drops_reported = udp_rx_stats.kernel_drops;
+        last.truncated = udp_rx_stats.truncated;
+        warn_ns = now;
+    }
+
+    if (osd_debug && now - stats_ns >= UDP_RX_STATS_INTERVAL_NS)
+    {
+        uint64_t packets = udp_rx_stats.packets - last.packets;
+        uint64_t syscalls = udp_rx_stats.syscalls - last.syscalls;
+
+        if (stats_ns != 0)
+        {
+            fprintf(stderr, "MAVLink rx: %.0f pkt/s, %.0f B/s, %.3f syscalls/pkt, %u kernel drops total\n",
+                    packets * 1e9 / (now - stats_ns), (udp_rx_stats.bytes - last.bytes) * 1e9 / (now - stats_ns),
+                    packets ? (double)syscalls / packets : 0.0, udp_rx_stats.kernel_drops);
+        }
+        last.packets = udp_rx_stats.packets;
+        last.bytes = udp_rx_stats.bytes;
+        last.syscalls = udp_rx_stats.syscalls;
+        stats_ns = now;
+    }
+}
+
+/**
+ * udp_rx_receive: receive a batch of datagrams into the ring.
+ * On a nonblocking socket fewer than UDP_RX_BATCH datagrams means the
+ * queue is drained, so no extra call is needed to see EAGAIN.
+ *
+ * @param       fd      socket from udp_rx_open()
+ * @param       flags   recvmmsg() flags, MSG_WAITFORONE blocks until first datagram only
+ * @return      number of datagrams, read them with udp_rx_packet(); -1 on error (errno is set)
+ */
+int udp_rx_receive(int fd, int flags)
+{
+    for (int i = 0; i < UDP_RX_BATCH; i++)
+    {
+        // Kernel updates lengths and flags, so they are reset every call
+        rx_msgs[i].msg_hdr.msg_control = rx_control[i].buf;
+        rx_msgs[i].msg_hdr.msg_controllen = sizeof(rx_control[i].buf);
+        rx_msgs[i].msg_hdr.msg_flags = 0;
+    }
+
+    int count = recvmmsg(fd, rx_msgs, UDP_RX_BATCH, flags, NULL);
+    if (count < 0)
+        return -1;
+
+    account_batch(count);
+    return count;
+}
+
+/**
+ * udp_rx_packet: datagram of the last received batch.
+ * Data stays valid until the next udp_rx_receive() call.
+ *
+ * @param       idx     index in the batch
+ * @param       size    datagram size, cut to UDP_RX_SLOT_SIZE
+ * @return      datagram data
+ */
+uint8_t *udp_rx_packet(int idx, size_t *size)
+{
+    *size = rx_msgs[idx].msg_len < UDP_RX_SLOT_SIZE ? rx_msgs[idx].msg_len : UDP_RX_SLOT_SIZE;
+    return rx_slots[idx];
+}
@@ -0,0 +1,25 @@
+#ifndef __UDPRX_H
+#define __UDPRX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define UDP_RX_BATCH            32      // datagrams per recvmmsg() call
+#define UDP_RX_SLOT_SIZE        8192    // larger datagrams are truncated and counted
+
+typedef struct {
+    uint64_t packets;
+    uint64_t bytes;
+    uint64_t syscalls;
+    uint32_t kernel_drops;              // SO_RXQ_OVFL: dropped by the kernel, socket buffer was full
+    uint32_t truncated;
+} udp_rx_stats_t;
+
+extern int udp_rx_rcvbuf;               // SO_RCVBUF in bytes, 0 = system default
+extern udp_rx_stats_t udp_rx_stats;
+
+int udp_rx_open(int port);
+int udp_rx_receive(int fd, int flags);
+uint8_t *udp_rx_packet(int idx, size_t *size);
+
+#endif //__UDPRX_H
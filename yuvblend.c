@@ -0,0 +1,447 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/*
+ * Sparse blending of the OSD into NV12 / I420 video frames.
+ * Most of the OSD is transparent, so the frame is split into tiles and
+ * only tiles covered by non-transparent OSD pixels are touched. The OSD is
+ * scaled and converted to YUV once per OSD change, every video frame then
+ * costs one alpha blend of the occupied tiles.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "yuvblend.h"
+
+#define LIMIT(x, lo, hi) ((x) < (lo) ? (lo) : ((x) > (hi) ? (hi) : (x)))
+
+// (d * (255 - a) + v * a) / 255 rounded, exact for all inputs
+static inline uint8_t blend_pixel(uint8_t d, uint8_t v, uint8_t a)
+{
+    unsigned int t = d * (255 - a) + v * a + 128;
+    return (t + (t >> 8)) >> 8;
+}
+
+#if defined(__AVX2__)
+static inline __m256i blend_epi16(__m256i d, __m256i v, __m256i a)
+{
+    __m256i t = _mm256_add_epi16(_mm256_mullo_epi16(d, _mm256_sub_epi16(_mm256_set1_epi16(255), a)),
+                                 _mm256_mullo_epi16(v, a));
+    t = _mm256_add_epi16(t, _mm256_set1_epi16(128));
+    return _mm256_srli_epi16(_mm256_add_epi16(t, _mm256_srli_epi16(t, 8)), 8);
+}
+#elif defined(__SSE2__)
+static inline __m128i blend_epi16(__m128i d, __m128i v, __m128i a)
+{
+    __m128i t = _mm_add_epi16(_mm_mullo_epi16(d, _mm_sub_epi16(_mm_set1_epi16(255), a)),
+                              _mm_mullo_epi16(v, a));
+    t = _mm_add_epi16(t, _mm_set1_epi16(128));
+    return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+}
+#endif
+
+/**
+ * blend_row: alpha blend a run of overlay samples into the frame.
+ * Vectors which are fully transparent or fully opaque skip the arithmetic.
+ *
+ * @param       dst     frame samples
+ * @param       val     overlay samples
+ * @param       alpha   overlay alpha per sample
+ * @param       count   number of samples
+ */
+static void blend_row(uint8_t *dst, const uint8_t *val, const uint8_t *alpha, int count)
+{
+#if defined(__AVX2__)
+    const __m256i zero = _mm256_setzero_si256(), ones = _mm256_set1_epi8(-1);
+
+    for (; count >= 32; count -= 32, dst += 32, val += 32, alpha += 32)
+    {
+        __m256i a = _mm256_loadu_si256((const __m256i*)alpha);
+
+        if (_mm256_movemask_epi8(_mm256_cmpeq_epi8(a, zero)) == -1) continue;
+
+        __m256i v = _mm256_loadu_si256((const __m256i*)val);
+
+        if (_mm256_movemask_epi8(_mm256_cmpeq_epi8(a, ones)) == -1)
+        {
+            _mm256_storeu_si256((__m256i*)dst, v);
+            continue;
+        }
+
+        // unpack and pack work within 128-bit lanes, so the byte order is kept
+        __m256i d = _mm256_loadu_si256((const __m256i*)dst);
+        __m256i lo = blend_epi16(_mm256_unpacklo_epi8(d, zero), _mm256_unpacklo_epi8(v, zero), _mm256_unpacklo_epi8(a, zero));
+        __m256i hi = blend_epi16(_mm256_unpackhi_epi8(d, zero), _mm256_unpackhi_epi8(v, zero), _mm256_unpackhi_epi8(a, zero));
+        _mm256_storeu_si256((__m256i*)dst, _mm256_packus_epi16(lo, hi));
+    }
+#elif defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128(), ones = _mm_set1_epi8(-1);
+
+    for (; count >= 16; count -= 16, dst += 16, val += 16, alpha += 16)
+    {
+        __m128i a = _mm_loadu_si128((const __m128i*)alpha);
+
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(a, zero)) == 0xffff) continue;
+
+        __m128i v = _mm_loadu_si128((const __m128i*)val);
+
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(a, ones)) == 0xffff)
+        {
+            _mm_storeu_si128((__m128i*)dst, v);
+            continue;
+        }
+
+        __m128i d = _mm_loadu_si128((const __m128i*)dst);
+        __m128i lo = blend_epi16(_mm_unpacklo_epi8(d, zero), _mm_unpacklo_epi8(v, zero), _mm_unpacklo_epi8(a, zero));
+        __m128i hi = blend_epi16(_mm_unpackhi_epi8(d, zero), _mm_unpackhi_epi8(v, zero), _mm_unpackhi_epi8(a, zero));
+        _mm_storeu_si128((__m128i*)dst, _mm_packus_epi16(lo, hi));
+    }
+#elif defined(__ARM_NEON)
+    for (; count >= 16; count -= 16, dst += 16, val += 16, alpha += 16)
+    {
+        uint8x16_t a = vld1q_u8(alpha);
+        uint64x2_t any = vreinterpretq_u64_u8(a);
+
+        if ((vgetq_lane_u64(any, 0) | vgetq_lane_u64(any, 1)) == 0) continue;
+
+        uint8x16_t d = vld1q_u8(dst), v = vld1q_u8(val), ia = vmvnq_u8(a);
+        uint16x8_t lo = vmlal_u8(vmull_u8(vget_low_u8(d), vget_low_u8(ia)), vget_low_u8(v), vget_low_u8(a));
+        uint16x8_t hi = vmlal_u8(vmull_u8(vget_high_u8(d), vget_high_u8(ia)), vget_high_u8(v), vget_high_u8(a));
+
+        // (t + ((t + 128) >> 8) + 128) >> 8, same rounding as blend_pixel()
+        vst1q_u8(dst, vcombine_u8(vraddhn_u16(lo, vrshrq_n_u16(lo, 8)),
+                                  vraddhn_u16(hi, vrshrq_n_u16(hi, 8))));
+    }
+#endif
+    for (; count > 0; count--, dst++, val++, alpha++)
+    {
+        if (*alpha) *dst = blend_pixel(*dst, *val, *alpha);
+    }
+}
+
+/**
+ * yuvblend_init: allocate overlay planes for a video format.
+ *
+ * @param       b           blender to setup
+ * @param       format      video format
+ * @param       width       video width
+ * @param       height      video height
+ * @param       bt709       use BT.709 matrix instead of BT.601
+ * @param       full_range  0..255 samples instead of 16..235 / 16..240
+ * @return      0 on success, -1 if out of memory
+ */
+int yuvblend_init(yuvblend_t *b, yuvblend_format_t format, int width, int height, int bt709, int full_range)
+{
+    int cw = (width + 1) / 2, ch = (height + 1) / 2;
+
+    memset(b, 0, sizeof(*b));
+    b->format = format;
+    b->width = width;
+    b->height = height;
+
+    b->plane[0] = (yuvblend_plane_t) { .width = width, .height = height,
+                                       .tile_width = YUVBLEND_TILE, .tile_height = YUVBLEND_TILE };
+    if (format == YUVBLEND_NV12)
+    {
+        b->planes = 2;
+        b->plane[1] = (yuvblend_plane_t) { .width = cw * 2, .height = ch,
+                                           .tile_width = YUVBLEND_TILE, .tile_height = YUVBLEND_TILE / 2 };
+    } else {
+        b->planes = 3;
+        for (int i = 1; i < 3; i++)
+        {
+            b->plane[i] = (yuvblend_plane_t) { .width = cw, .height = ch,
+                                               .tile_width = YUVBLEND_TILE / 2, .tile_height = YUVBLEND_TILE / 2 };
+        }
+    }
+
+    for (int i = 0; i < b->planes; i++)
+    {
+        size_t size = (size_t)b->plane[i].width * b->plane[i].height;
+
+        // Only samples of occupied tiles are written and blended
+        b->plane[i].value = calloc(size, 1);
+        b->plane[i].alpha = calloc(size, 1);
+        if (b->plane[i].value == NULL || b->plane[i].alpha == NULL) goto fail;
+    }
+
+    b->tiles_x = (width + YUVBLEND_TILE - 1) / YUVBLEND_TILE;
+    b->tiles_y = (height + YUVBLEND_TILE - 1) / YUVBLEND_TILE;
+    b->tiles = calloc(b->tiles_x * b->tiles_y, 1);
+    b->x_map = malloc(width * sizeof(int));
+    b->y_map = malloc(height * sizeof(int));
+    if (b->tiles == NULL || b->x_map == NULL || b->y_map == NULL) goto fail;
+
+    // Y' = Kr R + Kg G + Kb B, Cb = (B - Y') / (2 - 2 Kb), Cr = (R - Y') / (2 - 2 Kr)
+    double kr = bt709 ? 0.2126 : 0.299, kb = bt709 ? 0.0722 : 0.114, kg = 1.0 - kr - kb;
+    double ys = full_range ? 1.0 : 219.0 / 255.0, cs = full_range ? 1.0 : 224.0 / 255.0;
+    double m[3][3] = {
+        { kr * ys, kg * ys, kb * ys },
+        { -kr / (2 - 2 * kb) * cs, -kg / (2 - 2 * kb) * cs, 0.5 * cs },
+        { 0.5 * cs, -kg / (2 - 2 * kr) * cs, -kb / (2 - 2 * kr) * cs },
+    };
+
+    for (int i = 0; i < 3; i++)
+    {
+        for (int j = 0; j < 3; j++)
+        {
+            b->coef[i][j] = (int32_t)(m[i][j] * 65536.0 + (m[i][j] < 0 ? -0.5 : 0.5));
+        }
+    }
+    b->y_offset = full_range ? 0 : 16;
+
+    return 0;
+
+fail:
+    yuvblend_free(b);
+    return -1;
+}
+
+/**
+ * yuvblend_free: release overlay planes.
+ */
+void yuvblend_free(yuvblend_t *b)
+{
+    for (int i = 0; i < 3; i++)
+    {
+        free(b->plane[i].value);
+        free(b->plane[i].alpha);
+    }
+    free(b->tiles);
+    free(b->x_map);
+    free(b->y_map);
+    free(b->chunks);
+    memset(b, 0, sizeof(*b));
+}
+
+static inline void rgb_to_yuv(const yuvblend_t *b, const uint8_t *p, int *y, int *u, int *v)
+{
+    int r = p[0], g = p[1], bl = p[2];
+
+    *y = b->y_offset + ((b->coef[0][0] * r + b->coef[0][1] * g + b->coef[0][2] * bl + 32768) >> 16);
+    *u = (b->coef[1][0] * r + b->coef[1][1] * g + b->coef[1][2] * bl + (128 << 16) + 32768) >> 16;
+    *v = (b->coef[2][0] * r + b->coef[2][1] * g + b->coef[2][2] * bl + (128 << 16) + 32768) >> 16;
+    *y = LIMIT(*y, 0, 255);
+    *u = LIMIT(*u, 0, 255);
+    *v = LIMIT(*v, 0, 255);
+}
+
+// Any OSD chunk under the tile holds a visible pixel
+static int tile_occupied(const yuvblend_t *b, int tx, int ty)
+{
+    int x0 = tx * YUVBLEND_TILE, x1 = LIMIT(x0 + YUVBLEND_TILE, 0, b->width) - 1;
+    int y0 = ty * YUVBLEND_TILE, y1 = LIMIT(y0 + YUVBLEND_TILE, 0, b->height) - 1;
+    int cw = (b->osd_width + YUVBLEND_TILE - 1) / YUVBLEND_TILE;
+    int c0 = b->x_map[x0] / YUVBLEND_TILE, c1 = b->x_map[x1] / YUVBLEND_TILE;
+
+    for (int sy = b->y_map[y0]; sy <= b->y_map[y1]; sy++)
+    {
+        for (int c = c0; c <= c1; c++)
+        {
+            if (b->chunks[sy * cw + c]) return 1;
+        }
+    }
+    return 0;
+}
+
+// Scale and convert OSD pixels under one tile
+static void convert_tile(yuvblend_t *b, const uint8_t *osd, int osd_stride, int tx, int ty)
+{
+    int x0 = tx * YUVBLEND_TILE, x1 = LIMIT(x0 + YUVBLEND_TILE, 0, b->width);
+    int y0 = ty * YUVBLEND_TILE, y1 = LIMIT(y0 + YUVBLEND_TILE, 0, b->height);
+    yuvblend_plane_t *py = &b->plane[0];
+
+    for (int y = y0; y < y1; y++)
+    {
+        const uint8_t *src = osd + (size_t)b->y_map[y] * osd_stride;
+
+        for (int x = x0; x < x1; x++)
+        {
+            const uint8_t *p = src + b->x_map[x] * 4;
+            int yy, u, v;
+
+            // Value under transparent pixels doesn't matter
+            py->alpha[y * py->width + x] = p[3];
+            if (p[3] == 0) continue;
+
+            rgb_to_yuv(b, p, &yy, &u, &v);
+            py->value[y * py->width + x] = yy;
+        }
+    }
+
+    // Chroma sample is the alpha weighted average of its 2x2 luma block
+    for (int cy = y0 / 2; cy < (y1 + 1) / 2; cy++)
+    {
+        for (int cx = x0 / 2; cx < (x1 + 1) / 2; cx++)
+        {
+            int n = 0, sa = 0, su = 0, sv = 0;
+
+            for (int y = cy * 2; y < cy * 2 + 2 && y < b->height; y++)
+            {
+                for (int x = cx * 2; x < cx * 2 + 2 && x < b->width; x++)
+                {
+                    const uint8_t *p = osd + (size_t)b->y_map[y] * osd_stride + b->x_map[x] * 4;
+                    int yy, u, v;
+
+                    n++;
+                    if (p[3] == 0) continue;
+
+                    rgb_to_yuv(b, p, &yy, &u, &v);
+                    sa += p[3];
+                    su += u * p[3];
+                    sv += v * p[3];
+                }
+            }
+
+            int a = (sa + n / 2) / n;
+            int u = sa ? (su + sa / 2) / sa : 128;
+            int v = sa ? (sv + sa / 2) / sa : 128;
+
+            if (b->format == YUVBLEND_NV12)
+            {
+                yuvblend_plane_t *puv = &b->plane[1];
+                int i = cy * puv->width + cx * 2;
+
+                puv->value[i] = u;
+                puv->value[i + 1] = v;
+                puv->alpha[i] = puv->alpha[i + 1] = a;
+            } else {
+                int i = cy * b->plane[1].width + cx;
+
+                b->plane[1].value[i] = u;
+                b->plane[2].value[i] = v;
+                b->plane[1].alpha[i] = b->plane[2].alpha[i] = a;
+            }
+        }
+    }
+}
+
+/**
+ * yuvblend_update: convert new OSD frame, only tiles it covers are converted.
+ * The OSD is stretched over the whole video frame (nearest neighbour).
+ *
+ * @param       b           blender
+ * @param       osd         RGBA pixels
+ * @param       osd_width   OSD width
+ * @param       osd_height  OSD height
+ * @param       osd_stride  bytes per OSD row
+ * @return      number of occupied tiles, -1 if out of memory
+ */
+int yuvblend_update(yuvblend_t *b, const uint8_t *osd, int osd_width, int osd_height, int osd_stride)
+{
+    int cw = (osd_width + YUVBLEND_TILE - 1) / YUVBLEND_TILE;
+
+    if (b->osd_width != osd_width || b->osd_height != osd_height)
+    {
+        uint8_t *chunks = realloc(b->chunks, (size_t)cw * osd_height);
+
+        if (chunks == NULL) return -1;
+
+        b->chunks = chunks;
+        b->osd_width = osd_width;
+        b->osd_height = osd_height;
+
+        for (int x = 0; x < b->width; x++) b->x_map[x] = (int)((int64_t)x * osd_width / b->width);
+        for (int y = 0; y < b->height; y++) b->y_map[y] = (int)((int64_t)y * osd_height / b->height);
+    }
+
+    for (int y = 0; y < osd_height; y++)
+    {
+        const uint8_t *row = osd + (size_t)y * osd_stride;
+
+        for (int c = 0; c < cw; c++)
+        {
+            int end = LIMIT((c + 1) * YUVBLEND_TILE, 0, osd_width);
+            uint8_t any = 0;
+
+            for (int x = c * YUVBLEND_TILE; x < end; x++) any |= row[x * 4 + 3];
+            b->chunks[y * cw + c] = any != 0;
+        }
+    }
+
+    b->occupied = 0;
+    for (int ty = 0; ty < b->tiles_y; ty++)
+    {
+        for (int tx = 0; tx < b->tiles_x; tx++)
+        {
+            int occupied = tile_occupied(b, tx, ty);
+
+            b->tiles[ty * b->tiles_x + tx] = occupied;
+            if (occupied)
+            {
+                convert_tile(b, osd, osd_stride, tx, ty);
+                b->occupied++;
+            }
+        }
+    }
+
+    return b->occupied;
+}
+
+/**
+ * yuvblend_apply: blend occupied tiles into a video frame.
+ * Adjacent occupied tiles are blended as one run per row.
+ *
+ * @param       b       blender
+ * @param       data    video planes: Y, UV for NV12 or Y, U, V for I420
+ * @param       stride  bytes per row of every plane
+ */
+void yuvblend_apply(const yuvblend_t *b, uint8_t *const data[], const int stride[])
+{
+    for (int ty = 0; ty < b->tiles_y; ty++)
+    {
+        const uint8_t *tiles = b->tiles + ty * b->tiles_x;
+        int t0 = 0;
+
+        while (t0 < b->tiles_x)
+        {
+            if (!tiles[t0])
+            {
+                t0++;
+                continue;
+            }
+
+            int t1 = t0 + 1;
+
+            while (t1 < b->tiles_x && tiles[t1]) t1++;
+
+            for (int i = 0; i < b->planes; i++)
+            {
+                const yuvblend_plane_t *p = &b->plane[i];
+                int x0 = t0 * p->tile_width, x1 = LIMIT(t1 * p->tile_width, 0, p->width);
+                int y0 = ty * p->tile_height, y1 = LIMIT(y0 + p->tile_height, 0, p->height);
+
+                for (int y = y0; y < y1; y++)
+                {
+                    size_t o = (size_t)y * p->width + x0;
+
+                    blend_row(data[i] + (size_t)y * stride[i] + x0, p->value + o, p->alpha + o, x1 - x0);
+                }
+            }
+            t0 = t1;
+        }
+    }
+}
@@ -0,0 +1,46 @@
+#ifndef __YUVBLEND_H
+#define __YUVBLEND_H
+
+#include <stdint.h>
+
+#define YUVBLEND_TILE   16              // luma pixels per tile side
+
+typedef enum {
+    YUVBLEND_NV12 = 0,
+    YUVBLEND_I420,
+} yuvblend_format_t;
+
+// OSD converted to one video plane, samples are laid out like in the plane itself
+typedef struct {
+    uint8_t *value;
+    uint8_t *alpha;                     // 0 = video shows through
+    int width;                          // bytes per row
+    int height;
+    int tile_width;                     // bytes of a row covered by one tile
+    int tile_height;
+} yuvblend_plane_t;
+
+typedef struct {
+    yuvblend_format_t format;
+    int width, height;                  // video frame
+    int planes;
+    yuvblend_plane_t plane[3];
+
+    int tiles_x, tiles_y;
+    uint8_t *tiles;                     // occupancy map: tile has non-transparent OSD pixels
+    int occupied;
+
+    int32_t coef[3][3];                 // RGB -> Y, U, V, 16.16 fixed point
+    int y_offset;
+
+    int osd_width, osd_height;          // source size the maps below were built for
+    int *x_map, *y_map;                 // video pixel -> nearest OSD pixel
+    uint8_t *chunks;                    // per OSD row, YUVBLEND_TILE pixel chunks with non-transparent pixels
+} yuvblend_t;
+
+int yuvblend_init(yuvblend_t *b, yuvblend_format_t format, int width, int height, int bt709, int full_range);
+void yuvblend_free(yuvblend_t *b);
+int yuvblend_update(yuvblend_t *b, const uint8_t *osd, int osd_width, int osd_height, int osd_stride);
+void yuvblend_apply(const yuvblend_t *b, uint8_t *const data[], const int stride[]);
+
+#endif //__YUVBLEND_H